@@ -0,0 +1,326 @@
+/*
+ * Checks the ImOutbox journal and measures what it costs:
+ *
+ *  - reload: messages that were not acked come back after a restart in
+ *    their original order, with their msgid and content, and are counted as
+ *    resent; new messages continue after the largest msgid in the journal;
+ *  - truncated tail: cutting the journal anywhere inside its last record
+ *    loses only that message, and the journal is rewritten so that later
+ *    appends and reloads see a clean file;
+ *  - compaction: every 1024 acks the journal shrinks to the pending
+ *    messages, and msgids are still not reused after a reload;
+ *  - without a journal, two outboxes start at different msgids.
+ *
+ * Then times Add() with and without the journal and reloading -n pending
+ * messages.
+ *
+ * usage: im_outbox_bench [-n messages] [-s size] [-d dir]
+ * Exits with 1 on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "examples/voip/im_outbox.h"
+
+namespace {
+
+struct Options {
+  int messages = 10000;
+  int size = 256;
+  std::string dir = "/tmp";
+};
+
+double Now() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool Fail(const char* what) {
+  fprintf(stderr, "%s\n", what);
+  return false;
+}
+
+long FileSize(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return -1;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+std::string Content(int i) {
+  return "message " + std::to_string(i);
+}
+
+// Adds |count| messages with contents Content(first)...; returns the msgids.
+std::vector<int> AddMessages(ImOutbox* outbox, int first, int count) {
+  std::vector<int> ids;
+  for (int i = first; i < first + count; i++) {
+    IMMessage m;
+    m.sender = 1;
+    m.receiver = 2;
+    m.timestamp = 1000 + i;
+    m.content = Content(i);
+    ids.push_back(outbox->Add(m));
+  }
+  return ids;
+}
+
+// Sends everything the window allows, with frame seqs from |*seq|.
+void SendWindow(ImOutbox* outbox, int* seq) {
+  while (outbox->NextToSend()) {
+    outbox->OnSent(++*seq);
+  }
+}
+
+// The outbox holds exactly |ids| with contents Content(first + i), in order.
+bool CheckPending(ImOutbox* outbox, const std::vector<int>& ids, int first) {
+  if (outbox->pending() != ids.size()) {
+    fprintf(stderr, "pending %zu, expected %zu\n", outbox->pending(),
+            ids.size());
+    return false;
+  }
+  size_t window = outbox->window();
+  outbox->set_window(ids.size() + 1);
+  int seq = 0;
+  bool ok = true;
+  for (size_t i = 0; i < ids.size(); i++) {
+    const IMMessage* m = outbox->NextToSend();
+    if (!m || m->msgid != ids[i] || m->content != Content(first + (int)i) ||
+        m->timestamp != 1000 + first + (int)i || m->sender != 1 ||
+        m->receiver != 2) {
+      ok = false;
+      break;
+    }
+    outbox->OnSent(++seq);
+  }
+  outbox->Rewind();
+  outbox->set_window(window);
+  return ok || Fail("reloaded messages differ");
+}
+
+bool CheckReload(const std::string& path) {
+  remove(path.c_str());
+  std::vector<int> ids;
+  {
+    ImOutbox outbox(4);
+    if (!outbox.Open(path)) {
+      return Fail("can't open journal");
+    }
+    ids = AddMessages(&outbox, 0, 10);
+    for (size_t i = 1; i < ids.size(); i++) {
+      if (ids[i] != ids[i - 1] + 1) {
+        return Fail("msgids not consecutive");
+      }
+    }
+    int seq = 100;
+    SendWindow(&outbox, &seq);
+    if (outbox.in_flight() != 4) {
+      return Fail("window not filled");
+    }
+    //一个ack确认之前的所有消息
+    if (outbox.OnAck(102) != 2) {
+      return Fail("batched ack");
+    }
+    outbox.Rewind();
+  }
+
+  ImOutbox outbox(4);
+  if (!outbox.Open(path)) {
+    return Fail("can't reopen journal");
+  }
+  std::vector<int> pending(ids.begin() + 2, ids.end());
+  if (!CheckPending(&outbox, pending, 2)) {
+    return false;
+  }
+  //CheckPending()发送了每一条
+  if (outbox.stats().resent != (int64_t)pending.size() ||
+      outbox.stats().sent != 0) {
+    return Fail("reloaded messages not counted as resent");
+  }
+  if (AddMessages(&outbox, 10, 1)[0] != ids.back() + 1) {
+    return Fail("msgid does not continue after the journal");
+  }
+  return true;
+}
+
+bool CheckTruncatedTail(const std::string& path) {
+  remove(path.c_str());
+  std::vector<int> ids;
+  long size_before_last = 0;
+  {
+    ImOutbox outbox(4);
+    if (!outbox.Open(path)) {
+      return Fail("can't open journal");
+    }
+    ids = AddMessages(&outbox, 0, 5);
+    size_before_last = FileSize(path);
+    ids.push_back(AddMessages(&outbox, 5, 1)[0]);
+  }
+  std::string journal;
+  {
+    FILE* file = fopen(path.c_str(), "rb");
+    journal.resize(FileSize(path));
+    if (!file || fread(&journal[0], 1, journal.size(), file) !=
+                     journal.size()) {
+      return Fail("can't read journal");
+    }
+    fclose(file);
+  }
+
+  //在最后一条记录的每个位置截断
+  std::vector<int> kept(ids.begin(), ids.end() - 1);
+  for (long cut = size_before_last + 1; cut < (long)journal.size(); cut++) {
+    FILE* file = fopen(path.c_str(), "wb");
+    fwrite(journal.data(), 1, cut, file);
+    fclose(file);
+
+    std::vector<int> expected = kept;
+    {
+      ImOutbox outbox(4);
+      if (!outbox.Open(path) || !CheckPending(&outbox, expected, 0)) {
+        return Fail("truncated journal not recovered");
+      }
+      int id = AddMessages(&outbox, 5, 1)[0];
+      if (id <= kept.back()) {
+        return Fail("msgid reused after truncation");
+      }
+      expected.push_back(id);
+    }
+    ImOutbox outbox(4);
+    if (!outbox.Open(path) || !CheckPending(&outbox, expected, 0)) {
+      return Fail("append after truncation not reloaded");
+    }
+  }
+  return true;
+}
+
+bool CheckCompaction(const std::string& path) {
+  remove(path.c_str());
+  int last = 0;
+  long peak = 0;
+  {
+    ImOutbox outbox(8);
+    if (!outbox.Open(path)) {
+      return Fail("can't open journal");
+    }
+    int seq = 0;
+    for (int i = 0; i < 2048; i++) {
+      last = AddMessages(&outbox, i, 1)[0];
+      SendWindow(&outbox, &seq);
+      outbox.OnAck(seq);
+      peak = std::max(peak, FileSize(path));
+    }
+    //第2048个ack之后刚压缩过, 再留下两条未确认的
+    AddMessages(&outbox, 2048, 2);
+  }
+  long size = FileSize(path);
+  if (size >= peak / 4) {
+    fprintf(stderr, "journal %ld bytes, peak %ld\n", size, peak);
+    return Fail("journal not compacted");
+  }
+
+  ImOutbox outbox(8);
+  if (!outbox.Open(path) ||
+      !CheckPending(&outbox, {last + 1, last + 2}, 2048)) {
+    return Fail("compacted journal not reloaded");
+  }
+  if (AddMessages(&outbox, 2050, 1)[0] != last + 3) {
+    return Fail("msgid reused after compaction");
+  }
+  printf("compaction: peak %ld bytes, %ld after 2048 acks\n", peak, size);
+  return true;
+}
+
+bool CheckUnjournaled() {
+  ImOutbox a(1);
+  ImOutbox b(1);
+  int first_a = AddMessages(&a, 0, 1)[0];
+  int first_b = AddMessages(&b, 0, 1)[0];
+  //随机的起始值, 相等的概率是2^-30
+  if (first_a == first_b || first_a <= 0 || first_b <= 0) {
+    return Fail("unjournaled msgids do not start at a random value");
+  }
+  return true;
+}
+
+void Measure(const Options& options, const std::string& path) {
+  std::string content(options.size, 'm');
+  double memory_us = 0;
+  double journal_us = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    remove(path.c_str());
+    ImOutbox outbox(64);
+    if (pass == 1 && !outbox.Open(path)) {
+      return;
+    }
+    double t0 = Now();
+    for (int i = 0; i < options.messages; i++) {
+      IMMessage m;
+      m.sender = 1;
+      m.receiver = 2;
+      m.content = content;
+      outbox.Add(m);
+    }
+    (pass == 0 ? memory_us : journal_us) = Now() - t0;
+  }
+
+  double t0 = Now();
+  ImOutbox outbox(64);
+  outbox.Open(path);
+  double load_us = Now() - t0;
+  printf("Add() %.2f us in memory, %.2f us journaled; reload of %zu "
+         "messages %.1f ms (%ld bytes)\n",
+         memory_us / options.messages, journal_us / options.messages,
+         outbox.pending(), load_us / 1000, FileSize(path));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:d:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        options.messages = atoi(optarg);
+        break;
+      case 's':
+        options.size = atoi(optarg);
+        break;
+      case 'd':
+        options.dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n messages] [-s size] [-d dir]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  std::string path =
+      options.dir + "/im_outbox_bench." + std::to_string(getpid());
+  bool ok = CheckReload(path) && CheckTruncatedTail(path) &&
+            CheckCompaction(path) && CheckUnjournaled();
+  if (ok) {
+    Measure(options, path);
+  }
+  remove(path.c_str());
+  remove((path + ".tmp").c_str());
+  if (!ok) {
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * Measures MSG_IM throughput through a relay (e.g. voip_relay) for a range
+ * of sliding window sizes. One connection sends through ImOutbox, the same
+ * window the client uses, and another one receives and acks every batch it
+ * reads. A pass ends when every message was received and acked by the
+ * relay, so window 1 is the old stop-and-wait behaviour and larger windows
+ * show what pipelining and batched acks buy.
+ *
+ * With -j every message also goes through the outbox journal.
+ *
+ * usage: im_window_bench [-a ip] [-p port] [-n messages] [-b base uid]
+ *                        [-w window,...] [-s size,...] [-j journal]
+ *
+ * Tokens are the decimal uid, which voip_relay accepts without -t.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "examples/voip/im_outbox.h"
+#include "examples/voip/message.h"
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/send_queue.h"
+
+namespace {
+
+const int kMaxIov = 64;
+const size_t kRecvBufferSize = 64*1024;
+const size_t kMaxRecvBufferSize = HEADER_SIZE + MAX_BODY_SIZE;
+//没有任何进展超过这个时间则认为失败
+const int64_t kStallTimeout = 5*1000*1000;
+
+struct Options {
+  std::string ip = "127.0.0.1";
+  int port = 23000;
+  int messages = 20000;
+  int64_t base_uid = 900000;
+  std::vector<int> windows = {1, 8, 64, 512};
+  std::vector<int> sizes = {64, 1024};
+  std::string journal;
+};
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::vector<int> ParseList(const char* s) {
+  std::vector<int> v;
+  while (*s) {
+    int n = atoi(s);
+    if (n > 0) {
+      v.push_back(n);
+    }
+    const char* comma = strchr(s, ',');
+    if (!comma) {
+      break;
+    }
+    s = comma + 1;
+  }
+  return v;
+}
+
+class Conn {
+ public:
+  Conn()
+      : fd_(-1), seq_(0), recv_buffer_(kRecvBufferSize, kMaxRecvBufferSize) {}
+  ~Conn() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  int fd() const { return fd_; }
+  bool want_write() const { return !send_queue_.empty(); }
+
+  // Connects and signs in, blocking.
+  bool SignIn(const Options& options, int64_t uid) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    if (fd_ < 0 ||
+        inet_pton(AF_INET, options.ip.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd_, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+      perror("connect");
+      return false;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Message m;
+    m.cmd = MSG_AUTH_TOKEN;
+    m.token = std::to_string(uid);
+    m.device_id = "im_window_bench";
+    m.platform_id = PLATFORM_LINUX;
+    Send(m);
+    while (want_write()) {
+      if (!Flush()) {
+        return false;
+      }
+    }
+
+    MessageView v;
+    while (!Read(&v, MSG_AUTH_STATUS)) {
+      if (closed_) {
+        return false;
+      }
+    }
+    if (v.status != 0) {
+      fprintf(stderr, "uid %lld: auth failed\n", (long long)uid);
+      return false;
+    }
+    return true;
+  }
+
+  bool Send(Message& m) {
+    m.seq = ++seq_;
+    return send_queue_.Push(m);
+  }
+
+  bool Flush() {
+    while (!send_queue_.empty()) {
+      SendQueue::Segment segs[kMaxIov];
+      int count = send_queue_.Gather(segs, kMaxIov);
+      iovec iov[kMaxIov];
+      for (int i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<char*>(segs[i].data);
+        iov[i].iov_len = segs[i].size;
+      }
+      ssize_t n = writev(fd_, iov, count);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      send_queue_.Consume(n);
+    }
+    return true;
+  }
+
+  // Reads once and hands every complete frame to |handler|. Returns false
+  // when the connection is gone or the stream is corrupt.
+  template <typename Handler>
+  bool OnReadable(Handler handler) {
+    size_t len = 0;
+    char* p = recv_buffer_.WritePtr(&len);
+    ssize_t bytes = recv(fd_, p, len, 0);
+    if (bytes == 0) {
+      return false;
+    }
+    if (bytes < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    recv_buffer_.Commit(bytes);
+    while (true) {
+      MessageView m;
+      int n = recv_buffer_.PeekMessage(&m);
+      if (n < 0) {
+        return false;
+      }
+      if (n == 0) {
+        return true;
+      }
+      handler(m);
+      recv_buffer_.Consume(n);
+    }
+  }
+
+  void SetNonBlocking() {
+    int flags = fcntl(fd_, F_GETFL, 0);
+    fcntl(fd_, F_SETFL, flags | O_NONBLOCK);
+  }
+
+ private:
+  // Blocking read of the next frame with |cmd|.
+  bool Read(MessageView* v, int cmd) {
+    bool found = false;
+    if (!OnReadable([&](const MessageView& m) {
+          if (m.cmd == cmd) {
+            *v = m;
+            found = true;
+          }
+        })) {
+      closed_ = true;
+    }
+    return found;
+  }
+
+  int fd_;
+  int seq_;
+  bool closed_ = false;
+  RecvBuffer recv_buffer_;
+  SendQueue send_queue_;
+};
+
+struct PassResult {
+  double seconds = 0;
+  int64_t received = 0;
+  int64_t acks = 0;
+  int64_t receiver_acks = 0;
+  bool ok = false;
+};
+
+PassResult RunPass(const Options& options, int64_t uid, int window,
+                   int size) {
+  PassResult result;
+  Conn sender;
+  Conn receiver;
+  if (!sender.SignIn(options, uid) || !receiver.SignIn(options, uid + 1)) {
+    return result;
+  }
+  sender.SetNonBlocking();
+  receiver.SetNonBlocking();
+
+  ImOutbox outbox(window);
+  if (!options.journal.empty()) {
+    remove(options.journal.c_str());
+    if (!outbox.Open(options.journal)) {
+      fprintf(stderr, "can't open journal %s\n", options.journal.c_str());
+      return result;
+    }
+  }
+
+  int64_t start = NowUs();
+  std::string content(size, 'm');
+  //msgid不从1开始
+  int next_msgid = 0;
+  for (int i = 0; i < options.messages; i++) {
+    IMMessage im;
+    im.sender = uid;
+    im.receiver = uid + 1;
+    im.timestamp = (int)time(NULL);
+    im.content = content;
+    int msgid = outbox.Add(im);
+    if (i == 0) {
+      next_msgid = msgid;
+    }
+  }
+
+  bool in_order = true;
+  int64_t last_progress = start;
+  while (outbox.pending() > 0 || result.received < options.messages) {
+    while (const IMMessage* im = outbox.NextToSend()) {
+      Message m;
+      m.cmd = MSG_IM;
+      m.sender = im->sender;
+      m.receiver = im->receiver;
+      m.timestamp = im->timestamp;
+      m.msgid = im->msgid;
+      m.content = im->content;
+      if (!sender.Send(m)) {
+        break;
+      }
+      outbox.OnSent(m.seq);
+    }
+    if (!sender.Flush() || !receiver.Flush()) {
+      return result;
+    }
+
+    pollfd fds[2];
+    fds[0].fd = sender.fd();
+    fds[0].events = POLLIN | (sender.want_write() ? POLLOUT : 0);
+    fds[1].fd = receiver.fd();
+    fds[1].events = POLLIN | (receiver.want_write() ? POLLOUT : 0);
+    int n = poll(fds, 2, 100);
+    if (n < 0 && errno != EINTR) {
+      perror("poll");
+      return result;
+    }
+
+    int64_t now = NowUs();
+    bool progress = false;
+    if (fds[0].revents & POLLIN) {
+      bool ok = sender.OnReadable([&](const MessageView& m) {
+        if (m.cmd == MSG_ACK && m.sender == 0 && m.receiver == 0) {
+          progress |= outbox.OnAck(m.ack_seq) > 0;
+        }
+      });
+      if (!ok) {
+        fprintf(stderr, "sender connection lost\n");
+        return result;
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      int last_seq = 0;
+      bool ok = receiver.OnReadable([&](const MessageView& m) {
+        if (m.cmd != MSG_IM) {
+          return;
+        }
+        in_order &= m.msgid == next_msgid;
+        next_msgid = m.msgid + 1;
+        last_seq = m.seq;
+        result.received++;
+      });
+      if (!ok) {
+        fprintf(stderr, "receiver connection lost\n");
+        return result;
+      }
+      if (last_seq != 0) {
+        //一次读取的消息只确认一次
+        Message ack;
+        ack.cmd = MSG_ACK;
+        ack.ack_seq = last_seq;
+        receiver.Send(ack);
+        result.receiver_acks++;
+        progress = true;
+      }
+    }
+
+    if (progress) {
+      last_progress = now;
+    } else if (now - last_progress > kStallTimeout) {
+      fprintf(stderr, "stalled: received %lld/%d pending %zu\n",
+              (long long)result.received, options.messages, outbox.pending());
+      return result;
+    }
+  }
+
+  result.seconds = (NowUs() - start) / 1e6;
+  result.acks = outbox.stats().acks;
+  result.ok = in_order;
+  if (!in_order) {
+    fprintf(stderr, "messages arrived out of order\n");
+  }
+  if (!options.journal.empty()) {
+    outbox.Close();
+    remove(options.journal.c_str());
+  }
+  return result;
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-a ip] [-p port] [-n messages] [-b base uid]\n"
+          "          [-w window,...] [-s size,...] [-j journal]\n",
+          name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "a:p:n:b:w:s:j:h")) != -1) {
+    switch (opt) {
+      case 'a': options.ip = optarg; break;
+      case 'p': options.port = atoi(optarg); break;
+      case 'n': options.messages = std::max(1, atoi(optarg)); break;
+      case 'b': options.base_uid = atoll(optarg); break;
+      case 'w': options.windows = ParseList(optarg); break;
+      case 's': options.sizes = ParseList(optarg); break;
+      case 'j': options.journal = optarg; break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if (options.base_uid <= 0 || options.windows.empty() ||
+      options.sizes.empty()) {
+    Usage(argv[0]);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("%8s %8s %12s %10s %12s %12s\n", "window", "size", "msg/s", "MB/s",
+         "msgs/ack", "msgs/rx-ack");
+  int64_t uid = options.base_uid;
+  for (int size : options.sizes) {
+    for (int window : options.windows) {
+      PassResult r = RunPass(options, uid, window, size);
+      uid += 2;
+      if (!r.ok) {
+        return 1;
+      }
+      double rate = options.messages / r.seconds;
+      printf("%8d %8d %12.0f %10.1f %12.1f %12.1f\n", window, size, rate,
+             rate * (IM_HEADER_SIZE + size) / (1024 * 1024),
+             r.acks > 0 ? (double)options.messages / r.acks : 0,
+             r.receiver_acks > 0 ? (double)r.received / r.receiver_acks : 0);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Measures the throughput of the signaling frame codec (WriteMessage,
+ * ReadMessage and the zero-copy DecodeMessage) across MSG_RT payload sizes,
+ * and the cost of the JSON and TLV encodings of the MSG_RT body.
+ *
+ * The last pass decodes randomly corrupted and truncated frames from
+ * exactly-sized heap buffers; build with -fsanitize=address to have it catch
+ * reads past the end of a frame.
+ *
+ * usage: message_codec_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "examples/voip/message.h"
+#include "examples/voip/signaling_payload.h"
+
+namespace {
+
+const int kPayloadSizes[] = {16, 256, 4 * 1024, 64 * 1024};
+
+const char kSampleCandidate[] =
+    "candidate:1510613869 1 udp 2122260223 192.168.1.101 52718 typ host "
+    "generation 0 ufrag Zq2G network-id 1 network-cost 10";
+
+// Keeps the compiler from dropping the measured loops.
+volatile size_t g_sink;
+
+double Now() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Report(const char* name, int size, int iterations, double us,
+            size_t bytes) {
+  double seconds = us / 1e6;
+  printf("%-22s %7d bytes  %10.0f msg/s  %9.1f MB/s\n", name, size,
+         iterations / seconds, bytes / seconds / (1024 * 1024));
+}
+
+bool BenchFrames(int payload_size, int iterations) {
+  Message msg;
+  msg.cmd = MSG_RT;
+  msg.seq = 1;
+  msg.sender = 1000;
+  msg.receiver = 2000;
+  msg.content.assign(payload_size, 'x');
+
+  int frame_size = GetMessageSize(msg);
+  std::vector<char> buf(frame_size);
+
+  double t0 = Now();
+  size_t sink = 0;
+  for (int i = 0; i < iterations; i++) {
+    msg.seq = i;
+    sink += WriteMessage(buf.data(), frame_size, msg);
+  }
+  double t1 = Now();
+
+  Message m;
+  for (int i = 0; i < iterations; i++) {
+    if (!ReadMessage(buf.data(), frame_size, m)) {
+      fprintf(stderr, "ReadMessage failed for %d bytes\n", payload_size);
+      return false;
+    }
+    sink += m.content.size();
+  }
+  double t2 = Now();
+
+  MessageView v;
+  for (int i = 0; i < iterations; i++) {
+    sink += DecodeMessage(buf.data(), frame_size, &v);
+  }
+  double t3 = Now();
+
+  if (m.sender != msg.sender || m.receiver != msg.receiver ||
+      m.content != msg.content) {
+    fprintf(stderr, "round trip failed for %d bytes\n", payload_size);
+    return false;
+  }
+
+  size_t total = (size_t)frame_size * iterations;
+  Report("WriteMessage", payload_size, iterations, t1 - t0, total);
+  Report("ReadMessage", payload_size, iterations, t2 - t1, total);
+  Report("DecodeMessage", payload_size, iterations, t3 - t2, total);
+  g_sink += sink;
+  return true;
+}
+
+bool BenchPayload(const char* name, const P2PSignal& signal, int version,
+                  int iterations) {
+  std::string encoded = EncodeP2PSignal(signal, version, PAYLOAD_CAPS);
+  RTPayload payload;
+  if (!DecodeRTPayload(version, encoded, &payload) ||
+      payload.kind != RTPayload::P2P || payload.p2p.type != signal.type) {
+    fprintf(stderr, "%s: round trip failed\n", name);
+    return false;
+  }
+
+  double t0 = Now();
+  size_t sink = 0;
+  for (int i = 0; i < iterations; i++) {
+    sink += EncodeP2PSignal(signal, version, PAYLOAD_CAPS).size();
+  }
+  double t1 = Now();
+  for (int i = 0; i < iterations; i++) {
+    RTPayload p;
+    DecodeRTPayload(version, encoded, &p);
+    sink += p.p2p.candidate.size();
+  }
+  double t2 = Now();
+
+  printf("%-22s %7zu bytes  encode %7.2f us  decode %7.2f us  (%zu)\n", name,
+         encoded.size(), (t1 - t0) / iterations, (t2 - t1) / iterations,
+         sink % 10);
+  return true;
+}
+
+// Decodes mutated copies of valid frames. Every result must be -1, 0 or a
+// frame size that fits in the buffer.
+bool BenchCorrupt(int iterations) {
+  std::mt19937 rng(0x5eed);
+  std::vector<std::vector<char>> frames;
+  for (int size : kPayloadSizes) {
+    Message msg;
+    msg.cmd = MSG_RT;
+    msg.sender = 1;
+    msg.receiver = 2;
+    msg.content.assign(size, 'y');
+    std::vector<char> frame(GetMessageSize(msg));
+    WriteMessage(frame.data(), (int)frame.size(), msg);
+    frames.push_back(frame);
+  }
+
+  int complete = 0, incomplete = 0, rejected = 0;
+  double t0 = Now();
+  for (int i = 0; i < iterations; i++) {
+    const std::vector<char>& frame = frames[rng() % frames.size()];
+    int size = (int)(rng() % (frame.size() + 1));
+    std::unique_ptr<char[]> buf(new char[size > 0 ? size : 1]);
+    memcpy(buf.get(), frame.data(), size);
+    for (int j = rng() % 4; j > 0 && size > 0; j--) {
+      //优先破坏header中的length和cmd
+      int pos = (rng() % 2) ? (int)(rng() % std::min(size, HEADER_SIZE))
+                            : (int)(rng() % size);
+      buf[pos] = (char)rng();
+    }
+
+    MessageView v;
+    int n = DecodeMessage(buf.get(), size, &v);
+    if (n > size) {
+      fprintf(stderr, "frame size %d exceeds buffer %d\n", n, size);
+      return false;
+    }
+    if (n > 0) {
+      complete++;
+    } else if (n == 0) {
+      incomplete++;
+    } else {
+      rejected++;
+    }
+  }
+  double t1 = Now();
+
+  printf("corrupt frames %d: complete %d incomplete %d rejected %d  "
+         "%.0f msg/s\n",
+         iterations, complete, incomplete, rejected,
+         iterations / ((t1 - t0) / 1e6));
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+  if (iterations <= 0) {
+    iterations = 100000;
+  }
+
+  bool ok = true;
+  for (int size : kPayloadSizes) {
+    //大消息减少迭代次数
+    int n = std::max(1, iterations / std::max(1, size / 1024));
+    ok = BenchFrames(size, n) && ok;
+  }
+
+  P2PSignal candidate;
+  candidate.type = "candidate";
+  candidate.sdp_mid = "0";
+  candidate.sdp_mline_index = 0;
+  candidate.candidate = kSampleCandidate;
+  ok = BenchPayload("candidate json", candidate, PAYLOAD_VERSION_JSON,
+                    std::max(1, iterations / 10)) && ok;
+  ok = BenchPayload("candidate tlv", candidate, PAYLOAD_VERSION_TLV,
+                    std::max(1, iterations / 10)) && ok;
+
+  ok = BenchCorrupt(iterations) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+/*
+ * Runs -n MuxSessions of one SignalingMux against a relay (e.g. voip_relay)
+ * and prints SignalingMux::stats() every -i seconds: sessions signed in,
+ * memory and handler time per session, pending receive buffers and timers
+ * on the wheel. Sessions are paired (base + 2k, base + 2k + 1); every -m ms
+ * each signed-in session sends a MSG_RT of -s bytes to its partner.
+ *
+ * After -d seconds sending stops, in-flight messages are given a second to
+ * arrive, and a summary with the largest per-session memory and handler
+ * time is printed.
+ *
+ * usage: mux_bench [-a ip] [-p port] [-n sessions] [-d seconds]
+ *                  [-b base uid] [-s bytes] [-m interval ms] [-i seconds]
+ *
+ * Tokens are the decimal uid, which voip_relay accepts without -t. Exits
+ * with 1 if a session never signed in or a sent MSG_RT did not arrive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "examples/voip/signaling_mux.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+struct Options {
+  std::string ip = "127.0.0.1";
+  int port = 23000;
+  int sessions = 1000;
+  int duration = 10;
+  int64_t base_uid = 300000;
+  int size = 256;
+  int interval_ms = 1000;
+  int stats_interval = 2;
+};
+
+// Time for in-flight messages to arrive after sending stopped.
+const int kDrainDelay = 1000;
+
+enum {
+  MSG_SEND = 0,
+  MSG_REPORT,
+  MSG_STOP,
+  MSG_QUIT,
+};
+
+class MuxBench : public SignalingMuxObserver, public rtc::MessageHandler {
+ public:
+  MuxBench(SignalingMux* mux, const Options& options)
+      : mux_(mux),
+        options_(options),
+        start_ms_(0),
+        sending_(true),
+        signed_in_events_(0),
+        disconnects_(0),
+        sent_(0),
+        send_failures_(0),
+        received_(0),
+        corrupt_(0),
+        latency_sum_us_(0),
+        latency_max_us_(0) {
+    mux_->RegisterObserver(this);
+  }
+
+  void Start() {
+    start_ms_ = rtc::TimeMillis();
+    for (int i = 0; i < options_.sessions; i++) {
+      int64_t uid = options_.base_uid + i;
+      mux_->AddSession(uid, std::to_string(uid));
+    }
+    rtc::Thread* thread = rtc::Thread::Current();
+    thread->PostDelayed(RTC_FROM_HERE, options_.interval_ms, this, MSG_SEND);
+    thread->PostDelayed(RTC_FROM_HERE, options_.stats_interval * 1000, this,
+                        MSG_REPORT);
+    thread->PostDelayed(RTC_FROM_HERE, options_.duration * 1000, this,
+                        MSG_STOP);
+  }
+
+  bool Finish() {
+    Report("final");
+
+    const auto& sessions = mux_->sessions();
+    size_t max_bytes = 0;
+    int64_t max_cpu_us = 0;
+    int64_t frames_in = 0;
+    int64_t frames_out = 0;
+    int reconnects = 0;
+    int64_t srtt_sum_us = 0;
+    int rtt_sessions = 0;
+    size_t not_signed_in = 0;
+    for (const auto& session : sessions) {
+      MuxSession::Stats stats = session->stats();
+      max_bytes = std::max(max_bytes, stats.memory_bytes);
+      max_cpu_us = std::max(max_cpu_us, stats.cpu_us);
+      frames_in += stats.frames_in;
+      frames_out += stats.frames_out;
+      //第一次连接也计入了reconnects
+      reconnects += std::max(0, stats.reconnects - 1);
+      if (session->rtt_stats().samples > 0) {
+        srtt_sum_us += session->rtt_stats().srtt_us;
+        rtt_sessions++;
+      }
+      if (!session->is_connected()) {
+        not_signed_in++;
+      }
+    }
+
+    printf("=== %d sessions, %.1fs ===\n", options_.sessions,
+           (rtc::TimeMillis() - start_ms_) / 1000.0);
+    printf("per session max  memory:%zuB cpu:%.2fms\n", max_bytes,
+           max_cpu_us / 1000.0);
+    printf("frames in:%lld out:%lld sign_ins:%d reconnects:%d "
+           "disconnects:%d srtt avg:%.2fms\n",
+           (long long)frames_in, (long long)frames_out, signed_in_events_,
+           reconnects, disconnects_,
+           rtt_sessions > 0 ? srtt_sum_us / 1000.0 / rtt_sessions : 0.0);
+    printf("MSG_RT sent:%lld received:%lld send_failures:%lld corrupt:%lld "
+           "latency avg:%.2fms max:%.2fms\n",
+           (long long)sent_, (long long)received_, (long long)send_failures_,
+           (long long)corrupt_,
+           received_ > 0 ? latency_sum_us_ / 1000.0 / received_ : 0.0,
+           latency_max_us_ / 1000.0);
+
+    bool ok = true;
+    if (not_signed_in > 0) {
+      fprintf(stderr, "%zu sessions not signed in\n", not_signed_in);
+      ok = false;
+    }
+    if (received_ != sent_ || corrupt_ > 0) {
+      fprintf(stderr, "%lld of %lld MSG_RT lost or corrupt\n",
+              (long long)(sent_ - received_ + corrupt_), (long long)sent_);
+      ok = false;
+    }
+    return ok;
+  }
+
+  // SignalingMuxObserver implementation.
+  void OnSignedIn(MuxSession* session) override { signed_in_events_++; }
+
+  void OnDisconnected(MuxSession* session) override { disconnects_++; }
+
+  void HandleRTMessage(MuxSession* session,
+                       int64_t sender,
+                       int64_t receiver,
+                       int version,
+                       absl::string_view content) override {
+    int64_t sent_us = 0;
+    if (receiver != session->uid() || sender != Partner(receiver) ||
+        content.size() != (size_t)options_.size ||
+        content.size() < sizeof(sent_us)) {
+      corrupt_++;
+      return;
+    }
+    memcpy(&sent_us, content.data(), sizeof(sent_us));
+    int64_t latency = rtc::TimeMicros() - sent_us;
+    latency_sum_us_ += latency;
+    latency_max_us_ = std::max(latency_max_us_, latency);
+    received_++;
+  }
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override {
+    rtc::Thread* thread = rtc::Thread::Current();
+    switch (msg->message_id) {
+      case MSG_SEND:
+        if (sending_) {
+          SendAll();
+          thread->PostDelayed(RTC_FROM_HERE, options_.interval_ms, this,
+                              MSG_SEND);
+        }
+        break;
+      case MSG_REPORT:
+        Report("stats");
+        thread->PostDelayed(RTC_FROM_HERE, options_.stats_interval * 1000,
+                            this, MSG_REPORT);
+        break;
+      case MSG_STOP:
+        sending_ = false;
+        thread->PostDelayed(RTC_FROM_HERE, kDrainDelay, this, MSG_QUIT);
+        break;
+      case MSG_QUIT:
+        thread->Clear(this);
+        thread->Quit();
+        break;
+    }
+  }
+
+ private:
+  int64_t Partner(int64_t uid) const {
+    return options_.base_uid + ((uid - options_.base_uid) ^ 1);
+  }
+
+  void SendAll() {
+    const auto& sessions = mux_->sessions();
+    std::string content(std::max<size_t>(options_.size, sizeof(int64_t)),
+                        'm');
+    for (const auto& session : sessions) {
+      int64_t partner = Partner(session->uid());
+      size_t index = (size_t)(partner - options_.base_uid);
+      //对端不在线时中转服务器会丢弃
+      if (!session->is_connected() || index >= sessions.size() ||
+          !sessions[index]->is_connected()) {
+        continue;
+      }
+      int64_t now = rtc::TimeMicros();
+      memcpy(&content[0], &now, sizeof(now));
+      if (session->SendRTMessage(partner, content)) {
+        sent_++;
+      } else {
+        send_failures_++;
+      }
+    }
+  }
+
+  void Report(const char* label) {
+    SignalingMux::Stats stats = mux_->stats();
+    printf("%s t=%.1fs sessions:%zu signed_in:%zu bytes/session:%zu "
+           "(sessions:%zu shared:%zu) cpu/session:%lldus pending_recv:%zu "
+           "timers:%zu\n",
+           label, (rtc::TimeMillis() - start_ms_) / 1000.0, stats.sessions,
+           stats.signed_in, stats.bytes_per_session(), stats.session_bytes,
+           stats.shared_bytes, (long long)stats.cpu_us_per_session(),
+           stats.pending_recv_buffers, stats.timers);
+    fflush(stdout);
+  }
+
+  SignalingMux* mux_;
+  Options options_;
+  int64_t start_ms_;
+  bool sending_;
+  int signed_in_events_;
+  int disconnects_;
+  int64_t sent_;
+  int64_t send_failures_;
+  int64_t received_;
+  int64_t corrupt_;
+  int64_t latency_sum_us_;
+  int64_t latency_max_us_;
+};
+
+// Thousands of sessions need more than the default 1024 fds.
+void RaiseFdLimit(int sessions) {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return;
+  }
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if ((int64_t)limit.rlim_cur < sessions + 16) {
+    fprintf(stderr, "warning: open file limit %llu < %d sessions\n",
+            (unsigned long long)limit.rlim_cur, sessions);
+  }
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-a ip] [-p port] [-n sessions] [-d seconds] "
+          "[-b base uid] [-s bytes] [-m interval ms] [-i seconds]\n",
+          name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "a:p:n:d:b:s:m:i:h")) != -1) {
+    switch (opt) {
+      case 'a':
+        options.ip = optarg;
+        break;
+      case 'p':
+        options.port = atoi(optarg);
+        break;
+      case 'n':
+        options.sessions = atoi(optarg);
+        break;
+      case 'd':
+        options.duration = atoi(optarg);
+        break;
+      case 'b':
+        options.base_uid = atoll(optarg);
+        break;
+      case 's':
+        options.size = atoi(optarg);
+        break;
+      case 'm':
+        options.interval_ms = atoi(optarg);
+        break;
+      case 'i':
+        options.stats_interval = atoi(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if (options.sessions <= 0 || options.duration <= 0 ||
+      options.interval_ms <= 0 || options.stats_interval <= 0 ||
+      options.size < (int)sizeof(int64_t)) {
+    Usage(argv[0]);
+    return 1;
+  }
+  RaiseFdLimit(options.sessions);
+
+  rtc::PhysicalSocketServer socket_server;
+  rtc::AutoSocketServerThread thread(&socket_server);
+  SignalingMux mux(rtc::SocketAddress(options.ip, options.port));
+  MuxBench bench(&mux, options);
+  bench.Start();
+  thread.Run();
+  return bench.Finish() ? 0 : 1;
+}
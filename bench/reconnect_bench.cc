@@ -0,0 +1,373 @@
+/*
+ * Measures reconnect-to-signed-in latency against a relay (e.g. voip_relay):
+ * the time from starting a new connection to receiving MSG_AUTH_STATUS, the
+ * window in which a reconnecting client can't signal. Each mode connects,
+ * signs in and disconnects -n times, the way PeerConnectionClient does it:
+ *
+ *   tcp           plain TCP
+ *   tcp+tfo       TCP Fast Open, the auth frame travels in the SYN
+ *   tls           full TLS handshake on every connection
+ *   tls+resume    TLS resuming the previous connection's session ticket
+ *   tls+tfo       and the same two with the ClientHello in the SYN
+ *   tls+resume+tfo
+ *
+ * With -t the relay is expected to serve TLS (voip_relay -c cert -k key) and
+ * the tls modes run, otherwise the tcp ones. Loopback has next to no RTT, so
+ * add delay (e.g. tc qdisc add dev lo root netem delay 10ms) to see the round
+ * trips that fast open and resumption save. -2 caps TLS at 1.2, where
+ * resumption also saves a round trip; with 1.3 it saves the certificate and
+ * its signature.
+ *
+ * The kernel only puts data in the SYN once it holds a TFO cookie for the
+ * relay, so the first fast open connection is a normal handshake; the relay
+ * needs net.ipv4.tcp_fastopen & 2 to accept the data.
+ *
+ * With -c the bench checks what it measures and exits with 1 unless every
+ * connection after the first of a mode resumed its TLS session or carried
+ * data in the SYN, as the mode says, and none of the other modes did.
+ *
+ * usage: reconnect_bench [-a ip] [-p port] [-n count] [-u uid] [-t] [-2] [-c]
+ *
+ * Tokens are the decimal uid, which voip_relay accepts without -t.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include "examples/voip/message.h"
+#include "examples/voip/recv_buffer.h"
+
+namespace {
+
+const size_t kRecvBufferSize = 4*1024;
+const size_t kMaxRecvBufferSize = HEADER_SIZE + MAX_BODY_SIZE;
+
+struct Options {
+  std::string ip = "127.0.0.1";
+  int port = 23000;
+  int count = 200;
+  int64_t uid = 800000;
+  bool tls = false;
+  bool tls12 = false;
+  bool check = false;
+};
+
+struct Mode {
+  const char* name;
+  bool tls;
+  bool resume;
+  bool fast_open;
+};
+
+struct Sample {
+  int64_t us = 0;
+  bool resumed = false;
+  //SYN中的数据被服务器接受
+  bool syn_data = false;
+};
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+class Session {
+ public:
+  explicit Session(SSL_CTX* ctx)
+      : ctx_(ctx),
+        fd_(-1),
+        ssl_(NULL),
+        recv_buffer_(kRecvBufferSize, kMaxRecvBufferSize) {}
+  ~Session() {
+    if (ssl_ != NULL) {
+      //OpenSSL会让没有shutdown的session不可恢复, 而断线重连正是要恢复它
+      SSL_set_quiet_shutdown(ssl_, 1);
+      SSL_shutdown(ssl_);
+      SSL_free(ssl_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  // Connects and signs in, blocking. With |session| the TLS handshake
+  // offers it for resumption.
+  bool SignIn(const Options& options, bool fast_open, SSL_SESSION* session,
+              Sample* sample) {
+    int64_t start = NowUs();
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+      perror("socket");
+      return false;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (fast_open &&
+        setsockopt(fd_, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one,
+                   sizeof(one)) != 0) {
+      perror("TCP_FASTOPEN_CONNECT");
+      return false;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.ip.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd_, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+      perror("connect");
+      return false;
+    }
+
+    if (ctx_ != NULL) {
+      ssl_ = SSL_new(ctx_);
+      SSL_set_fd(ssl_, fd_);
+      if (session != NULL) {
+        SSL_set_session(ssl_, session);
+      }
+      //TFO时ClientHello在SYN中发出
+      if (SSL_connect(ssl_) != 1) {
+        fprintf(stderr, "tls handshake failed\n");
+        return false;
+      }
+    }
+
+    Message m;
+    m.cmd = MSG_AUTH_TOKEN;
+    m.seq = 1;
+    m.token = std::to_string(options.uid);
+    m.device_id = "reconnect_bench";
+    m.platform_id = PLATFORM_LINUX;
+    char buf[HEADER_SIZE + 256];
+    int size = WriteMessage(buf, sizeof(buf), m);
+    if (size <= 0 || !Write(buf, size)) {
+      fprintf(stderr, "can't send auth\n");
+      return false;
+    }
+
+    MessageView v;
+    if (!ReadStatus(&v) || v.status != 0) {
+      fprintf(stderr, "uid %lld: auth failed\n", (long long)options.uid);
+      return false;
+    }
+    sample->us = NowUs() - start;
+    sample->resumed = ssl_ != NULL && SSL_session_reused(ssl_);
+
+    tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd_, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+      sample->syn_data = (info.tcpi_options & TCPI_OPT_SYN_DATA) != 0;
+    }
+    return true;
+  }
+
+  // Session to resume next time. TLS 1.3 tickets arrive after the
+  // handshake, so ask only once the auth status was read.
+  SSL_SESSION* TakeSession() {
+    return ssl_ != NULL ? SSL_get1_session(ssl_) : NULL;
+  }
+
+ private:
+  bool Write(const char* p, int size) {
+    if (ssl_ != NULL) {
+      return SSL_write(ssl_, p, size) == size;
+    }
+    while (size > 0) {
+      ssize_t n = send(fd_, p, size, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      p += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  bool ReadStatus(MessageView* v) {
+    while (true) {
+      int n = recv_buffer_.PeekMessage(v);
+      if (n < 0) {
+        return false;
+      }
+      if (n > 0) {
+        if (v->cmd == MSG_AUTH_STATUS) {
+          return true;
+        }
+        recv_buffer_.Consume(n);
+        continue;
+      }
+
+      size_t len = 0;
+      char* p = recv_buffer_.WritePtr(&len);
+      int bytes;
+      if (ssl_ != NULL) {
+        bytes = SSL_read(ssl_, p, (int)len);
+      } else {
+        do {
+          bytes = (int)recv(fd_, p, len, 0);
+        } while (bytes < 0 && errno == EINTR);
+      }
+      if (bytes <= 0) {
+        return false;
+      }
+      recv_buffer_.Commit(bytes);
+    }
+  }
+
+  SSL_CTX* ctx_;
+  int fd_;
+  SSL* ssl_;
+  RecvBuffer recv_buffer_;
+};
+
+bool RunMode(const Options& options, SSL_CTX* ctx, const Mode& mode) {
+  std::vector<Sample> samples;
+  SSL_SESSION* session = NULL;
+  for (int i = 0; i < options.count; i++) {
+    Sample sample;
+    Session s(mode.tls ? ctx : NULL);
+    if (!s.SignIn(options, mode.fast_open, mode.resume ? session : NULL,
+                  &sample)) {
+      if (session != NULL) {
+        SSL_SESSION_free(session);
+      }
+      return false;
+    }
+    samples.push_back(sample);
+    if (mode.resume) {
+      if (session != NULL) {
+        SSL_SESSION_free(session);
+      }
+      session = s.TakeSession();
+    }
+  }
+  if (session != NULL) {
+    SSL_SESSION_free(session);
+  }
+
+  std::vector<int64_t> us;
+  int64_t total = 0;
+  int resumed = 0;
+  int syn_data = 0;
+  for (const Sample& sample : samples) {
+    us.push_back(sample.us);
+    total += sample.us;
+    resumed += sample.resumed;
+    syn_data += sample.syn_data;
+  }
+  std::sort(us.begin(), us.end());
+  size_t n = us.size();
+  printf("%-16s %6zu %9.2f %9.2f %9.2f %9.2f %8d %8d\n", mode.name, n,
+         us[0] / 1000.0, us[n / 2] / 1000.0,
+         us[std::min(n - 1, n * 99 / 100)] / 1000.0,
+         total / 1000.0 / n, resumed, syn_data);
+
+  if (!options.check) {
+    return true;
+  }
+  //第一次连接没有可恢复的session, 也没有TFO cookie
+  int expected = (int)n - 1;
+  bool ok = true;
+  if (mode.resume ? resumed < expected : resumed > 0) {
+    fprintf(stderr, "%s: %d of %zu connections resumed, expected %d\n",
+            mode.name, resumed, n, mode.resume ? expected : 0);
+    ok = false;
+  }
+  if (mode.fast_open ? syn_data < expected : syn_data > 0) {
+    fprintf(stderr, "%s: %d of %zu SYNs carried data, expected %d\n",
+            mode.name, syn_data, n, mode.fast_open ? expected : 0);
+    ok = false;
+  }
+  return ok;
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-a ip] [-p port] [-n count] [-u uid] [-t] [-2] "
+          "[-c]\n",
+          name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "a:p:n:u:t2ch")) != -1) {
+    switch (opt) {
+      case 'a': options.ip = optarg; break;
+      case 'p': options.port = atoi(optarg); break;
+      case 'n': options.count = std::max(1, atoi(optarg)); break;
+      case 'u': options.uid = atoll(optarg); break;
+      case 't': options.tls = true; break;
+      case '2': options.tls12 = true; break;
+      case 'c': options.check = true; break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if (options.uid <= 0) {
+    Usage(argv[0]);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  SSL_CTX* ctx = NULL;
+  if (options.tls) {
+    ctx = SSL_CTX_new(TLS_client_method());
+    //voip_relay使用自签名证书
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    if (options.tls12) {
+      SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+  }
+
+  const Mode kModes[] = {
+      {"tcp", false, false, false},
+      {"tcp+tfo", false, false, true},
+      {"tls", true, false, false},
+      {"tls+resume", true, true, false},
+      {"tls+tfo", true, false, true},
+      {"tls+resume+tfo", true, true, true},
+  };
+
+  printf("%-16s %6s %9s %9s %9s %9s %8s %8s\n", "mode", "n", "min(ms)",
+         "p50(ms)", "p99(ms)", "avg(ms)", "resumed", "syn-data");
+  int ret = 0;
+  for (const Mode& mode : kModes) {
+    if (mode.tls != options.tls) {
+      continue;
+    }
+    if (!RunMode(options, ctx, mode)) {
+      ret = 1;
+      //-c时继续检查其它模式
+      if (!options.check) {
+        break;
+      }
+    }
+  }
+  if (ctx != NULL) {
+    SSL_CTX_free(ctx);
+  }
+  return ret;
+}
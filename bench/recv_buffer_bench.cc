@@ -0,0 +1,211 @@
+/*
+ * Streams back-to-back MSG_RT frames through RecvBuffer the way
+ * PeerConnectionClient reads a socket: WritePtr()/Commit() with reads split
+ * at random points, then PeekMessage()/Consume() for every complete frame.
+ * Bodies range from empty to a few hundred KB, so frames straddle the end
+ * of the ring and grow the storage. Every decoded frame is checked against
+ * what was written; the decode throughput is printed.
+ *
+ * A last pass feeds a header whose length exceeds the buffer's
+ * max_capacity(), which must be reported as malformed.
+ *
+ * usage: recv_buffer_bench [megabytes] [seed]
+ * Exits with 1 on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "examples/voip/message.h"
+#include "examples/voip/recv_buffer.h"
+
+namespace {
+
+const size_t kInitialCapacity = 4*1024;
+const size_t kMaxCapacity = HEADER_SIZE + MAX_BODY_SIZE;
+
+struct Expected {
+  int seq;
+  int rt_seq;
+  int64_t sender;
+  size_t offset;  // Body position in the stream.
+  size_t size;
+};
+
+double Now() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+size_t BodySize(std::mt19937* rng) {
+  //大多数是candidate大小的消息, 少量offer, 偶尔超过初始容量很多
+  int r = (*rng)() % 100;
+  if (r < 70) {
+    return (*rng)() % 512;
+  } else if (r < 97) {
+    return 2*1024 + (*rng)() % (8*1024);
+  }
+  return 64*1024 + (*rng)() % (256*1024);
+}
+
+// Appends frames to |stream| until it holds |bytes|.
+void BuildStream(size_t bytes, std::mt19937* rng, std::string* stream,
+                 std::vector<Expected>* expected) {
+  std::vector<char> frame;
+  int seq = 0;
+  while (stream->size() < bytes) {
+    Message m;
+    m.cmd = MSG_RT;
+    m.seq = ++seq;
+    m.rt_seq = seq & 0xffff;
+    m.version = seq & 1;
+    m.sender = 1000 + seq;
+    m.receiver = 7;
+    m.content.resize(BodySize(rng));
+    for (size_t i = 0; i < m.content.size(); i++) {
+      m.content[i] = (char)(seq * 31 + i);
+    }
+    frame.resize(GetMessageSize(m));
+    int n = WriteMessage(frame.data(), (int)frame.size(), m);
+
+    Expected e;
+    e.seq = m.seq;
+    e.rt_seq = m.rt_seq;
+    e.sender = m.sender;
+    e.size = m.content.size();
+    //body在帧的末尾
+    e.offset = stream->size() + n - e.size;
+    expected->push_back(e);
+    stream->append(frame.data(), n);
+  }
+}
+
+bool Check(const MessageView& v, const Expected& e, const std::string& stream) {
+  return v.cmd == MSG_RT && v.seq == e.seq && v.rt_seq == e.rt_seq &&
+         v.sender == e.sender && v.receiver == 7 &&
+         v.content.size() == e.size &&
+         memcmp(v.content.data(), stream.data() + e.offset, e.size) == 0;
+}
+
+// Feeds |stream| in random pieces; returns the number of frames decoded, or
+// -1 on a mismatch.
+int64_t Run(const std::string& stream, const std::vector<Expected>& expected,
+            std::mt19937* rng, double* decode_us) {
+  RecvBuffer buffer(kInitialCapacity, kMaxCapacity);
+  size_t pos = 0;
+  size_t next = 0;
+  *decode_us = 0;
+  while (pos < stream.size()) {
+    size_t len = 0;
+    char* p = buffer.WritePtr(&len);
+    if (len == 0) {
+      //缓冲区满而且没有完整的消息, PeekMessage()应该已经扩容
+      fprintf(stderr, "buffer full at frame %zu\n", next);
+      return -1;
+    }
+    //模拟recv返回任意长度, 常常只有几个字节
+    size_t want = (*rng)() % 4 == 0 ? 1 + (*rng)() % 16
+                                    : 1 + (*rng)() % (64*1024);
+    size_t n = std::min(std::min(want, len), stream.size() - pos);
+    memcpy(p, stream.data() + pos, n);
+    buffer.Commit(n);
+    pos += n;
+
+    double t0 = Now();
+    while (true) {
+      MessageView v;
+      int size = buffer.PeekMessage(&v);
+      if (size < 0) {
+        fprintf(stderr, "frame %zu reported malformed\n", next);
+        return -1;
+      }
+      if (size == 0) {
+        break;
+      }
+      if (next >= expected.size() || !Check(v, expected[next], stream)) {
+        fprintf(stderr, "frame %zu mismatch\n", next);
+        return -1;
+      }
+      buffer.Consume(size);
+      next++;
+    }
+    *decode_us += Now() - t0;
+  }
+
+  if (next != expected.size() || buffer.size() != 0) {
+    fprintf(stderr, "decoded %zu of %zu frames, %zu bytes left\n", next,
+            expected.size(), buffer.size());
+    return -1;
+  }
+  return (int64_t)next;
+}
+
+bool CheckOversized() {
+  RecvBuffer buffer(kInitialCapacity, kMaxCapacity);
+  Message m;
+  m.cmd = MSG_RT;
+  m.sender = 1;
+  m.receiver = 2;
+  char header[HEADER_SIZE + 16];
+  int n = WriteMessage(header, sizeof(header), m);
+  if (n <= 0) {
+    return false;
+  }
+  //把length改成超过上限
+  uint32_t length = MAX_BODY_SIZE + 1;
+  header[0] = (char)(length >> 24);
+  header[1] = (char)(length >> 16);
+  header[2] = (char)(length >> 8);
+  header[3] = (char)length;
+
+  size_t len = 0;
+  char* p = buffer.WritePtr(&len);
+  memcpy(p, header, n);
+  buffer.Commit(n);
+  MessageView v;
+  if (buffer.PeekMessage(&v) != -1) {
+    fprintf(stderr, "oversized frame not rejected\n");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int megabytes = argc > 1 ? atoi(argv[1]) : 64;
+  unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 0x5eed;
+  if (megabytes <= 0) {
+    megabytes = 64;
+  }
+
+  std::mt19937 rng(seed);
+  std::string stream;
+  std::vector<Expected> expected;
+  BuildStream((size_t)megabytes * 1024 * 1024, &rng, &stream, &expected);
+
+  double decode_us = 0;
+  double t0 = Now();
+  int64_t frames = Run(stream, expected, &rng, &decode_us);
+  double elapsed = Now() - t0;
+  if (frames < 0) {
+    return 1;
+  }
+  printf("%lld frames, %.1f MB: %.1f MB/s overall, decode %.3f us/frame\n",
+         (long long)frames, stream.size() / 1048576.0,
+         stream.size() / elapsed, decode_us / frames);
+
+  if (!CheckOversized()) {
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Measures the compression ratio and the encode/decode time per SDP of the
+ * built-in SDP dictionary codec.
+ *
+ * usage: sdp_codec_bench [iterations] [sdp file...]
+ * Without files it runs on a sample offer from this client.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "examples/voip/sdp_codec.h"
+
+namespace {
+
+const char kSampleOffer[] =
+    "v=0\r\n"
+    "o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+    "s=-\r\n"
+    "t=0 0\r\n"
+    "a=group:BUNDLE 0 1\r\n"
+    "a=msid-semantic: WMS stream_label\r\n"
+    "m=audio 9 UDP/TLS/RTP/SAVPF 111 103 104 9 102 0 8 106 105 13 110 112 113 126\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=rtcp:9 IN IP4 0.0.0.0\r\n"
+    "a=ice-ufrag:Zq2G\r\n"
+    "a=ice-pwd:3Bv1YcHB2Xd5hq8Mvwm5Fj7O\r\n"
+    "a=ice-options:trickle\r\n"
+    "a=fingerprint:sha-256 5A:7C:3B:10:9E:33:D0:71:AF:0E:55:83:4C:2D:1B:67:"
+    "E2:9F:40:8A:C6:11:DB:35:70:0C:94:AE:28:5F:B3:19\r\n"
+    "a=setup:actpass\r\n"
+    "a=mid:0\r\n"
+    "a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+    "a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+    "a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+    "a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:mid\r\n"
+    "a=extmap:5 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id\r\n"
+    "a=extmap:6 urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id\r\n"
+    "a=sendrecv\r\n"
+    "a=msid:stream_label audio_label\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtpmap:111 opus/48000/2\r\n"
+    "a=rtcp-fb:111 transport-cc\r\n"
+    "a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+    "a=rtpmap:103 ISAC/16000\r\n"
+    "a=rtpmap:104 ISAC/32000\r\n"
+    "a=rtpmap:9 G722/8000\r\n"
+    "a=rtpmap:102 ILBC/8000\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:106 CN/32000\r\n"
+    "a=rtpmap:105 CN/16000\r\n"
+    "a=rtpmap:13 CN/8000\r\n"
+    "a=rtpmap:110 telephone-event/48000\r\n"
+    "a=rtpmap:112 telephone-event/32000\r\n"
+    "a=rtpmap:113 telephone-event/16000\r\n"
+    "a=rtpmap:126 telephone-event/8000\r\n"
+    "a=ssrc:1912315716 cname:pX3n4Y9ZqCvJtM1s\r\n"
+    "a=ssrc:1912315716 msid:stream_label audio_label\r\n"
+    "a=ssrc:1912315716 mslabel:stream_label\r\n"
+    "a=ssrc:1912315716 label:audio_label\r\n"
+    "m=video 9 UDP/TLS/RTP/SAVPF 96 97 98 99 100 101 127 124 125\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=rtcp:9 IN IP4 0.0.0.0\r\n"
+    "a=ice-ufrag:Zq2G\r\n"
+    "a=ice-pwd:3Bv1YcHB2Xd5hq8Mvwm5Fj7O\r\n"
+    "a=ice-options:trickle\r\n"
+    "a=fingerprint:sha-256 5A:7C:3B:10:9E:33:D0:71:AF:0E:55:83:4C:2D:1B:67:"
+    "E2:9F:40:8A:C6:11:DB:35:70:0C:94:AE:28:5F:B3:19\r\n"
+    "a=setup:actpass\r\n"
+    "a=mid:1\r\n"
+    "a=extmap:14 urn:ietf:params:rtp-hdrext:toffset\r\n"
+    "a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+    "a=extmap:13 urn:3gpp:video-orientation\r\n"
+    "a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+    "a=extmap:12 http://www.webrtc.org/experiments/rtp-hdrext/playout-delay\r\n"
+    "a=extmap:11 http://www.webrtc.org/experiments/rtp-hdrext/video-content-type\r\n"
+    "a=extmap:7 http://www.webrtc.org/experiments/rtp-hdrext/video-timing\r\n"
+    "a=extmap:8 http://www.webrtc.org/experiments/rtp-hdrext/color-space\r\n"
+    "a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:mid\r\n"
+    "a=extmap:5 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id\r\n"
+    "a=extmap:6 urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id\r\n"
+    "a=sendrecv\r\n"
+    "a=msid:stream_label video_label\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtcp-rsize\r\n"
+    "a=rtpmap:96 VP8/90000\r\n"
+    "a=rtcp-fb:96 goog-remb\r\n"
+    "a=rtcp-fb:96 transport-cc\r\n"
+    "a=rtcp-fb:96 ccm fir\r\n"
+    "a=rtcp-fb:96 nack\r\n"
+    "a=rtcp-fb:96 nack pli\r\n"
+    "a=rtpmap:97 rtx/90000\r\n"
+    "a=fmtp:97 apt=96\r\n"
+    "a=rtpmap:98 VP9/90000\r\n"
+    "a=rtcp-fb:98 goog-remb\r\n"
+    "a=rtcp-fb:98 transport-cc\r\n"
+    "a=rtcp-fb:98 ccm fir\r\n"
+    "a=rtcp-fb:98 nack\r\n"
+    "a=rtcp-fb:98 nack pli\r\n"
+    "a=fmtp:98 profile-id=0\r\n"
+    "a=rtpmap:99 rtx/90000\r\n"
+    "a=fmtp:99 apt=98\r\n"
+    "a=rtpmap:100 VP9/90000\r\n"
+    "a=rtcp-fb:100 goog-remb\r\n"
+    "a=rtcp-fb:100 transport-cc\r\n"
+    "a=rtcp-fb:100 ccm fir\r\n"
+    "a=rtcp-fb:100 nack\r\n"
+    "a=rtcp-fb:100 nack pli\r\n"
+    "a=fmtp:100 profile-id=2\r\n"
+    "a=rtpmap:101 rtx/90000\r\n"
+    "a=fmtp:101 apt=100\r\n"
+    "a=rtpmap:127 red/90000\r\n"
+    "a=rtpmap:124 rtx/90000\r\n"
+    "a=fmtp:124 apt=127\r\n"
+    "a=rtpmap:125 ulpfec/90000\r\n"
+    "a=ssrc-group:FID 3308415162 2215793003\r\n"
+    "a=ssrc:3308415162 cname:pX3n4Y9ZqCvJtM1s\r\n"
+    "a=ssrc:3308415162 msid:stream_label video_label\r\n"
+    "a=ssrc:3308415162 mslabel:stream_label\r\n"
+    "a=ssrc:3308415162 label:video_label\r\n"
+    "a=ssrc:2215793003 cname:pX3n4Y9ZqCvJtM1s\r\n"
+    "a=ssrc:2215793003 msid:stream_label video_label\r\n"
+    "a=ssrc:2215793003 mslabel:stream_label\r\n"
+    "a=ssrc:2215793003 label:video_label\r\n";
+
+double Now() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool Bench(const std::string& name, const std::string& sdp, int iterations) {
+  std::string compressed = CompressSdp(sdp);
+  std::string decompressed;
+  if (!DecompressSdp(compressed, &decompressed) || decompressed != sdp) {
+    fprintf(stderr, "%s: round trip failed\n", name.c_str());
+    return false;
+  }
+
+  double t0 = Now();
+  size_t sink = 0;
+  for (int i = 0; i < iterations; i++) {
+    sink += CompressSdp(sdp).size();
+  }
+  double t1 = Now();
+  for (int i = 0; i < iterations; i++) {
+    DecompressSdp(compressed, &decompressed);
+    sink += decompressed.size();
+  }
+  double t2 = Now();
+
+  printf("%-24s %6zu -> %5zu bytes  ratio %.2f  encode %7.2f us  "
+         "decode %7.2f us  (%zu)\n",
+         name.c_str(), sdp.size(), compressed.size(),
+         (double)sdp.size() / compressed.size(), (t1 - t0) / iterations,
+         (t2 - t1) / iterations, sink % 10);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+  if (iterations <= 0) {
+    iterations = 10000;
+  }
+
+  bool ok = true;
+  if (argc <= 2) {
+    ok = Bench("sample offer", kSampleOffer, iterations);
+  }
+  for (int i = 2; i < argc; i++) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+      fprintf(stderr, "can't open %s\n", argv[i]);
+      ok = false;
+      continue;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    ok = Bench(argv[i], ss.str(), iterations) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,396 @@
+/*
+ * Checks the priority lanes of SendQueue:
+ *
+ *  - order: frames pushed to random lanes and written out with random
+ *    partial writes arrive whole, never interleaved, FIFO within every lane,
+ *    with the bytes they were pushed with; now and then the connection is
+ *    "lost" (Rewind() and a fresh receive buffer) and no frame is lost or
+ *    duplicated;
+ *  - priority: the head frame comes from the highest non-empty lane, but a
+ *    frame that has started going out is finished first;
+ *  - starvation: a waiting bulk frame goes out after starvation_bytes()
+ *    of call frames;
+ *  - rewind: the partially sent head frame goes out whole again, after the
+ *    control lane and with what lower lanes were owed forgotten.
+ *
+ * Then prints the queueing delay of each lane while bulk frames flood the
+ * queue.
+ *
+ * usage: send_queue_bench [rounds] [seed]
+ * Exits with 1 on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "examples/voip/message.h"
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/send_queue.h"
+
+namespace {
+
+const int kLanes = SendQueue::LANE_COUNT;
+
+bool Fail(const char* what) {
+  fprintf(stderr, "%s\n", what);
+  return false;
+}
+
+// Frame |index| of |lane|: seq carries the lane, sender the index, and the
+// body a pattern derived from both.
+Message MakeFrame(int lane, int64_t index, size_t size) {
+  Message m;
+  m.cmd = MSG_RT;
+  m.seq = lane;
+  m.sender = index;
+  m.receiver = 1;
+  m.content.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    m.content[i] = (char)(lane * 71 + index * 13 + i);
+  }
+  return m;
+}
+
+size_t FrameSize(int lane, size_t size) {
+  Message m = MakeFrame(lane, 0, size);
+  return GetMessageSize(m);
+}
+
+// Peer side of the connection: decodes what was written and checks that
+// every lane arrives in order.
+class Receiver {
+ public:
+  Receiver() { Reconnect(); }
+
+  // A new connection: bytes of a frame cut off by the old one are dropped.
+  void Reconnect() {
+    buffer_.reset(new RecvBuffer(4*1024, HEADER_SIZE + MAX_BODY_SIZE));
+  }
+
+  bool Receive(const char* data, size_t size) {
+    while (size > 0) {
+      size_t len = 0;
+      char* p = buffer_->WritePtr(&len);
+      size_t n = std::min(len, size);
+      memcpy(p, data, n);
+      buffer_->Commit(n);
+      data += n;
+      size -= n;
+      while (true) {
+        MessageView v;
+        int r = buffer_->PeekMessage(&v);
+        if (r < 0) {
+          //两条消息交错会破坏帧边界
+          return Fail("malformed stream, frames interleaved");
+        }
+        if (r == 0) {
+          break;
+        }
+        if (!Check(v)) {
+          return false;
+        }
+        buffer_->Consume(r);
+      }
+    }
+    return true;
+  }
+
+  int64_t received(int lane) const { return received_[lane]; }
+  const std::vector<int>& lanes() const { return lanes_; }
+
+ private:
+  bool Check(const MessageView& v) {
+    if (v.cmd != MSG_RT || v.seq < 0 || v.seq >= kLanes) {
+      return Fail("unexpected frame");
+    }
+    if (v.sender != received_[v.seq]) {
+      fprintf(stderr, "lane %d: frame %lld, expected %lld\n", v.seq,
+              (long long)v.sender, (long long)received_[v.seq]);
+      return false;
+    }
+    Message m = MakeFrame(v.seq, v.sender, v.content.size());
+    if (memcmp(v.content.data(), m.content.data(), m.content.size()) != 0) {
+      return Fail("frame body corrupted");
+    }
+    received_[v.seq]++;
+    lanes_.push_back(v.seq);
+    return true;
+  }
+
+  std::unique_ptr<RecvBuffer> buffer_;
+  int64_t received_[kLanes] = {0, 0, 0};
+  std::vector<int> lanes_;
+};
+
+// Writes up to |budget| bytes of the queue to |receiver|, like one
+// writev() that may stop anywhere. Returns the bytes written, or -1.
+int64_t Write(SendQueue* queue, Receiver* receiver, size_t budget) {
+  SendQueue::Segment segs[16];
+  int n = queue->Gather(segs, 16);
+  size_t used = 0;
+  for (int i = 0; i < n && used < budget; i++) {
+    size_t take = std::min(segs[i].size, budget - used);
+    if (!receiver->Receive(segs[i].data, take)) {
+      return -1;
+    }
+    used += take;
+  }
+  queue->Consume(used);
+  return (int64_t)used;
+}
+
+// Empties the queue in writes of up to |step| bytes. The head lane is picked
+// once per Gather(), so what a lane is owed only shows with small writes.
+bool Drain(SendQueue* queue, Receiver* receiver, size_t step = (size_t)-1) {
+  while (!queue->empty()) {
+    if (Write(queue, receiver, step) <= 0) {
+      return Fail("queue not drained");
+    }
+  }
+  return true;
+}
+
+bool RunRandom(int rounds, std::mt19937* rng) {
+  SendQueue queue;
+  queue.set_max_bytes(64*1024*1024);
+  queue.set_starvation_bytes(8*1024);
+  Receiver receiver;
+  int64_t pushed[kLanes] = {0, 0, 0};
+  int reconnects = 0;
+  for (int round = 0; round < rounds; round++) {
+    int count = (*rng)() % 5;
+    for (int i = 0; i < count; i++) {
+      int lane = (*rng)() % kLanes;
+      //bulk偶尔会有超过一个chunk的大消息
+      size_t size = lane == SendQueue::LANE_BULK ? (*rng)() % 40000
+                                                  : (*rng)() % 600;
+      Message m = MakeFrame(lane, pushed[lane], size);
+      if (!queue.Push(m, (SendQueue::Lane)lane)) {
+        return Fail("push failed");
+      }
+      pushed[lane]++;
+    }
+    //多数是部分写入, 常常只有几个字节
+    size_t budget = (*rng)() % 4 == 0 ? (*rng)() % 16 : (*rng)() % 60000;
+    if (Write(&queue, &receiver, budget) < 0) {
+      return false;
+    }
+    if ((*rng)() % 200 == 0) {
+      queue.Rewind();
+      receiver.Reconnect();
+      reconnects++;
+    }
+  }
+  if (!Drain(&queue, &receiver)) {
+    return false;
+  }
+  size_t total = 0;
+  for (int lane = 0; lane < kLanes; lane++) {
+    if (receiver.received(lane) != pushed[lane] ||
+        queue.lane_stats((SendQueue::Lane)lane).frames != pushed[lane]) {
+      fprintf(stderr, "lane %d: %lld of %lld frames received\n", lane,
+              (long long)receiver.received(lane), (long long)pushed[lane]);
+      return false;
+    }
+    total += pushed[lane];
+  }
+  if (queue.frames() != 0 || queue.bytes() != 0) {
+    return Fail("queue not empty after drain");
+  }
+  printf("random: %zu frames, %d reconnects\n", total, reconnects);
+  return true;
+}
+
+bool CheckPriority() {
+  SendQueue queue;
+  Receiver receiver;
+  Message bulk = MakeFrame(SendQueue::LANE_BULK, 0, 20000);
+  Message call = MakeFrame(SendQueue::LANE_CALL, 0, 100);
+  Message control = MakeFrame(SendQueue::LANE_CONTROL, 0, 10);
+  queue.Push(bulk, SendQueue::LANE_BULK);
+  queue.Push(call, SendQueue::LANE_CALL);
+  queue.Push(control, SendQueue::LANE_CONTROL);
+  if (!Drain(&queue, &receiver) ||
+      receiver.lanes() != std::vector<int>{0, 1, 2}) {
+    return Fail("highest lane not sent first");
+  }
+
+  //已经开始发送的bulk消息先发完
+  Receiver partial;
+  Message bulk2 = MakeFrame(SendQueue::LANE_BULK, 0, 20000);
+  queue.Push(bulk2, SendQueue::LANE_BULK);
+  if (Write(&queue, &partial, 1000) != 1000) {
+    return Fail("partial write");
+  }
+  Message control2 = MakeFrame(SendQueue::LANE_CONTROL, 0, 10);
+  queue.Push(control2, SendQueue::LANE_CONTROL);
+  if (!Drain(&queue, &partial) || partial.lanes() != std::vector<int>{2, 0}) {
+    return Fail("partially sent frame not finished first");
+  }
+  return true;
+}
+
+bool CheckStarvation() {
+  const size_t kStarvation = 1000;
+  const int kCalls = 30;
+  SendQueue queue;
+  queue.set_starvation_bytes(kStarvation);
+  Receiver receiver;
+  Message bulk = MakeFrame(SendQueue::LANE_BULK, 0, 100);
+  queue.Push(bulk, SendQueue::LANE_BULK);
+  for (int i = 0; i < kCalls; i++) {
+    Message call = MakeFrame(SendQueue::LANE_CALL, i, 100);
+    queue.Push(call, SendQueue::LANE_CALL);
+  }
+  size_t call_size = FrameSize(SendQueue::LANE_CALL, 100);
+  if (!Drain(&queue, &receiver, call_size)) {
+    return false;
+  }
+  //每发送starvation_bytes的call消息, bulk可以插队一条
+  size_t expected = (kStarvation + call_size - 1) / call_size;
+  const std::vector<int>& lanes = receiver.lanes();
+  size_t position =
+      std::find(lanes.begin(), lanes.end(), (int)SendQueue::LANE_BULK) -
+      lanes.begin();
+  if (position != expected) {
+    fprintf(stderr, "bulk frame sent after %zu call frames, expected %zu\n",
+            position, expected);
+    return false;
+  }
+
+  //关闭后bulk要等所有call消息
+  SendQueue fifo;
+  fifo.set_starvation_bytes(0);
+  Receiver strict;
+  fifo.Push(bulk, SendQueue::LANE_BULK);
+  for (int i = 0; i < kCalls; i++) {
+    Message call = MakeFrame(SendQueue::LANE_CALL, i, 100);
+    fifo.Push(call, SendQueue::LANE_CALL);
+  }
+  if (!Drain(&fifo, &strict, call_size) ||
+      strict.lanes().back() != SendQueue::LANE_BULK) {
+    return Fail("bulk frame overtook with starvation_bytes 0");
+  }
+  return true;
+}
+
+bool CheckRewind() {
+  const size_t kStarvation = 1000;
+  SendQueue queue;
+  queue.set_starvation_bytes(kStarvation);
+  Receiver receiver;
+  Message bulk = MakeFrame(SendQueue::LANE_BULK, 0, 100);
+  queue.Push(bulk, SendQueue::LANE_BULK);
+  for (int i = 0; i < 20; i++) {
+    Message call = MakeFrame(SendQueue::LANE_CALL, i, 100);
+    queue.Push(call, SendQueue::LANE_CALL);
+  }
+  //发送5条call消息, bulk积累了欠账, 然后在第6条的中间断开
+  size_t call_size = FrameSize(SendQueue::LANE_CALL, 100);
+  if (Write(&queue, &receiver, call_size * 5 + call_size / 2) < 0 ||
+      receiver.received(SendQueue::LANE_CALL) != 5) {
+    return Fail("partial write");
+  }
+  queue.Rewind();
+  receiver.Reconnect();
+
+  //新连接上auth先发, 然后是完整的第6条call消息
+  Message auth = MakeFrame(SendQueue::LANE_CONTROL, 0, 40);
+  queue.Push(auth, SendQueue::LANE_CONTROL);
+  if (!Drain(&queue, &receiver, call_size)) {
+    return false;
+  }
+  //欠账已清零, 从auth开始重新累计
+  size_t auth_size = FrameSize(SendQueue::LANE_CONTROL, 40);
+  size_t calls_before_bulk =
+      (kStarvation - auth_size + call_size - 1) / call_size;
+  std::vector<int> expected(5, SendQueue::LANE_CALL);
+  expected.push_back(SendQueue::LANE_CONTROL);
+  expected.insert(expected.end(), calls_before_bulk, SendQueue::LANE_CALL);
+  expected.push_back(SendQueue::LANE_BULK);
+  expected.insert(expected.end(), 15 - calls_before_bulk,
+                  SendQueue::LANE_CALL);
+  if (receiver.lanes() != expected) {
+    fprintf(stderr, "order after rewind:");
+    for (int lane : receiver.lanes()) {
+      fprintf(stderr, " %d", lane);
+    }
+    fprintf(stderr, "\n");
+    return Fail("rewind did not restart with the control lane");
+  }
+  return true;
+}
+
+// Bulk frames keep the queue full while call and control frames trickle
+// in; the link takes |budget| bytes per round. With |lanes| false every
+// frame goes to the bulk lane, as before the lanes.
+void Measure(bool lanes, int rounds, std::mt19937* rng) {
+  SendQueue queue;
+  queue.set_max_bytes(64*1024*1024);
+  Receiver receiver;
+  int64_t pushed[kLanes] = {0, 0, 0};
+  const size_t budget = 16*1024;
+  for (int round = 0; round < rounds; round++) {
+    int lane = SendQueue::LANE_BULK;
+    size_t size = 4*1024;
+    if (round % 8 == 0) {
+      lane = SendQueue::LANE_CALL;
+      size = 200 + (*rng)() % 800;
+    } else if (round % 32 == 1) {
+      lane = SendQueue::LANE_CONTROL;
+      size = 8;
+    }
+    Message m = MakeFrame(lane, pushed[lane], size);
+    pushed[lane]++;
+    queue.Push(m, lanes ? (SendQueue::Lane)lane : SendQueue::LANE_BULK);
+    //积压时只发出一部分
+    while (queue.bytes() > 256*1024) {
+      Write(&queue, &receiver, budget);
+    }
+    if (round % 2 == 0) {
+      Write(&queue, &receiver, budget);
+    }
+  }
+  Drain(&queue, &receiver);
+
+  printf("%s:", lanes ? "lanes" : "single FIFO");
+  static const char* kNames[] = {"control", "call", "bulk"};
+  for (int i = 0; i < kLanes; i++) {
+    const SendQueue::LaneStats& stats =
+        queue.lane_stats((SendQueue::Lane)i);
+    if (stats.frames == 0) {
+      continue;
+    }
+    printf(" %s %lld frames avg %lldus max %lldus;", kNames[i],
+           (long long)stats.frames, (long long)stats.average_delay_us(),
+           (long long)stats.max_queue_delay_us);
+  }
+  printf("\n");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+  unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 0x5eed;
+  if (rounds <= 0) {
+    rounds = 100000;
+  }
+
+  std::mt19937 rng(seed);
+  if (!RunRandom(rounds, &rng) || !CheckPriority() || !CheckStarvation() ||
+      !CheckRewind()) {
+    return 1;
+  }
+  Measure(false, rounds, &rng);
+  Measure(true, rounds, &rng);
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Checks TimerWheel against the deadlines it was given and measures the cost
+ * of its operations with the mux's geometry (512 slots of 100 ms):
+ *
+ *  - timers with random deadlines up to several revolutions, some cancelled,
+ *    some rescheduled, some destroyed while pending, expire exactly in the
+ *    tick of their deadline when the wheel is advanced tick by tick;
+ *  - advanced in random steps, including jumps over more than a revolution,
+ *    every timer expires in the first Advance() past its deadline and never
+ *    before it;
+ *  - deadlines in the past expire on the next Advance().
+ *
+ * usage: timer_wheel_bench [timers] [seed]
+ * Exits with 1 on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "examples/voip/timer_wheel.h"
+
+namespace {
+
+const int kTick = 100;
+const size_t kSlots = 512;
+// Deadlines span about three revolutions.
+const int64_t kMaxDeadline = 3 * kTick * (int64_t)kSlots;
+
+struct TestTimer : public TimerWheel::Timer {
+  int64_t expected_ms = -1;  // -1: cancelled, must not expire.
+  int64_t expired_ms = -1;
+};
+
+double Now() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool Fail(const char* what, size_t index) {
+  fprintf(stderr, "%s, timer %zu\n", what, index);
+  return false;
+}
+
+// Schedules |count| timers, then cancels, reschedules and destroys some of
+// them. Returns the timers; destroyed ones are NULL.
+std::vector<std::unique_ptr<TestTimer>> Setup(TimerWheel* wheel, size_t count,
+                                              int64_t start_ms,
+                                              std::mt19937* rng) {
+  std::vector<std::unique_ptr<TestTimer>> timers;
+  for (size_t i = 0; i < count; i++) {
+    timers.emplace_back(new TestTimer());
+    TestTimer* t = timers.back().get();
+    t->expected_ms = start_ms + (int64_t)((*rng)() % kMaxDeadline);
+    wheel->Schedule(t, t->expected_ms);
+  }
+  for (size_t i = 0; i < count; i++) {
+    TestTimer* t = timers[i].get();
+    switch ((*rng)() % 10) {
+      case 0:
+        TimerWheel::Cancel(t);
+        t->expected_ms = -1;
+        break;
+      case 1:
+        //重新调度会先从原来的槽中摘下
+        t->expected_ms = start_ms + (int64_t)((*rng)() % kMaxDeadline);
+        wheel->Schedule(t, t->expected_ms);
+        break;
+      case 2:
+        //析构时自动取消
+        timers[i].reset();
+        break;
+    }
+  }
+  return timers;
+}
+
+size_t Pending(const std::vector<std::unique_ptr<TestTimer>>& timers) {
+  size_t n = 0;
+  for (const auto& t : timers) {
+    if (t && t->expected_ms >= 0) {
+      n++;
+    }
+  }
+  return n;
+}
+
+// Every timer must have expired exactly once, in the first Advance() that
+// reached its deadline's tick. |steps| lists the times Advance() was called
+// on a wheel created at |start_ms|; a deadline in the start tick is due in
+// the tick after it.
+bool Verify(const std::vector<std::unique_ptr<TestTimer>>& timers,
+            int64_t start_ms, const std::vector<int64_t>& steps) {
+  for (size_t i = 0; i < timers.size(); i++) {
+    const TestTimer* t = timers[i].get();
+    if (!t) {
+      continue;
+    }
+    if (t->scheduled()) {
+      return Fail("still scheduled", i);
+    }
+    if (t->expected_ms < 0) {
+      if (t->expired_ms >= 0) {
+        return Fail("cancelled timer expired", i);
+      }
+      continue;
+    }
+    if (t->expired_ms < 0) {
+      return Fail("timer never expired", i);
+    }
+    if (t->expired_ms / kTick < t->expected_ms / kTick) {
+      return Fail("timer expired early", i);
+    }
+    //第一个到达截止tick的Advance()
+    int64_t due_tick = std::max(t->expected_ms / kTick, start_ms / kTick + 1);
+    int64_t due = -1;
+    for (int64_t step : steps) {
+      if (step / kTick >= due_tick) {
+        due = step;
+        break;
+      }
+    }
+    if (t->expired_ms != due) {
+      return Fail("timer expired late", i);
+    }
+  }
+  return true;
+}
+
+bool Drain(TimerWheel* wheel, int64_t now_ms,
+           std::vector<TimerWheel::Timer*>* expired) {
+  expired->clear();
+  wheel->Advance(now_ms, expired);
+  for (TimerWheel::Timer* timer : *expired) {
+    TestTimer* t = static_cast<TestTimer*>(timer);
+    if (t->expired_ms >= 0) {
+      fprintf(stderr, "timer expired twice\n");
+      return false;
+    }
+    t->expired_ms = now_ms;
+  }
+  return true;
+}
+
+bool RunTickByTick(size_t count, std::mt19937* rng) {
+  const int64_t start = 1000000;
+  TimerWheel wheel(kTick, kSlots, start);
+  std::vector<std::unique_ptr<TestTimer>> timers =
+      Setup(&wheel, count, start, rng);
+  if (wheel.size() != Pending(timers)) {
+    fprintf(stderr, "size %zu, expected %zu\n", wheel.size(), Pending(timers));
+    return false;
+  }
+
+  std::vector<int64_t> steps;
+  std::vector<TimerWheel::Timer*> expired;
+  double t0 = Now();
+  size_t fired = 0;
+  for (int64_t now = start; now <= start + kMaxDeadline + kTick;
+       now += kTick) {
+    if (!Drain(&wheel, now, &expired)) {
+      return false;
+    }
+    fired += expired.size();
+    steps.push_back(now);
+  }
+  double elapsed = Now() - t0;
+  if (wheel.size() != 0) {
+    fprintf(stderr, "%zu timers left on the wheel\n", wheel.size());
+    return false;
+  }
+  if (!Verify(timers, start, steps)) {
+    return false;
+  }
+  printf("tick by tick: %zu timers, %zu expired, %zu ticks, %.3f us/tick\n",
+         count, fired, steps.size(), elapsed / steps.size());
+  return true;
+}
+
+bool RunRandomSteps(size_t count, std::mt19937* rng) {
+  const int64_t start = 7;
+  TimerWheel wheel(kTick, kSlots, start);
+  std::vector<std::unique_ptr<TestTimer>> timers =
+      Setup(&wheel, count, start, rng);
+
+  std::vector<int64_t> steps;
+  std::vector<TimerWheel::Timer*> expired;
+  int64_t now = start;
+  while (wheel.size() > 0) {
+    //多数是几个tick, 偶尔跳过一圈以上
+    int64_t step = (*rng)() % 50 == 0
+                       ? kTick * (int64_t)kSlots + (*rng)() % (2 * kTick * kSlots)
+                       : (*rng)() % (5 * kTick);
+    now += step;
+    if (!Drain(&wheel, now, &expired)) {
+      return false;
+    }
+    steps.push_back(now);
+  }
+  if (!Verify(timers, start, steps)) {
+    return false;
+  }
+  printf("random steps: %zu timers, %zu advances\n", count, steps.size());
+  return true;
+}
+
+bool RunPastDeadlines() {
+  TimerWheel wheel(kTick, kSlots, 50000);
+  TestTimer past;
+  TestTimer now;
+  wheel.Schedule(&past, 100);
+  wheel.Schedule(&now, 50000);
+  std::vector<TimerWheel::Timer*> expired;
+  //同一个tick内不会到期
+  wheel.Advance(50099, &expired);
+  if (!expired.empty()) {
+    fprintf(stderr, "timer expired before the next tick\n");
+    return false;
+  }
+  wheel.Advance(50100, &expired);
+  if (expired.size() != 2 || wheel.size() != 0) {
+    fprintf(stderr, "past deadlines did not expire on the next tick\n");
+    return false;
+  }
+  return true;
+}
+
+void MeasureOps(size_t count, std::mt19937* rng) {
+  TimerWheel wheel(kTick, kSlots, 0);
+  std::vector<TimerWheel::Timer> timers(count);
+  std::vector<int64_t> deadlines(count);
+  for (size_t i = 0; i < count; i++) {
+    deadlines[i] = (*rng)() % kMaxDeadline;
+  }
+
+  double t0 = Now();
+  for (size_t i = 0; i < count; i++) {
+    wheel.Schedule(&timers[i], deadlines[i]);
+  }
+  double t1 = Now();
+  //心跳的典型用法: 每次收到pong都重新调度
+  for (size_t i = 0; i < count; i++) {
+    wheel.Schedule(&timers[i], deadlines[count - 1 - i]);
+  }
+  double t2 = Now();
+  for (size_t i = 0; i < count; i++) {
+    TimerWheel::Cancel(&timers[i]);
+  }
+  double t3 = Now();
+  printf("schedule %.1f ns, reschedule %.1f ns, cancel %.1f ns\n",
+         (t1 - t0) * 1000 / count, (t2 - t1) * 1000 / count,
+         (t3 - t2) * 1000 / count);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 0x5eed;
+  if (count <= 0) {
+    count = 100000;
+  }
+
+  std::mt19937 rng(seed);
+  if (!RunTickByTick(count, &rng) || !RunRandomSteps(count, &rng) ||
+      !RunPastDeadlines()) {
+    return 1;
+  }
+  MeasureOps(count, &rng);
+  printf("ok\n");
+  return 0;
+}
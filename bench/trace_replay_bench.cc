@@ -0,0 +1,277 @@
+/*
+ * Checks that TraceReplayer hands the observer what the live client would:
+ *
+ *  - retransmitted MSG_RT frames, i.e. a frame received again with the same
+ *    sender and rt_seq, are dropped and counted as duplicates, also when
+ *    other frames arrived in between;
+ *  - the same rt_seq from another sender, and frames with rt_seq 0, which
+ *    the sender does not want acked, are delivered every time;
+ *  - frames come in recorded order, and a second Start() replays the trace
+ *    again from the first frame instead of dropping it all as duplicates;
+ *  - the first sent DIAL gives the peer and channel, sent frames are not
+ *    replayed.
+ *
+ * Then replays a call with -n retransmitted candidates per original and
+ * prints the replay stats.
+ *
+ * usage: trace_replay_bench [-n duplicates] [-d dir]
+ * Exits with 1 on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "examples/voip/message.h"
+#include "examples/voip/signaling_payload.h"
+#include "examples/voip/signaling_trace.h"
+#include "examples/voip/trace_replayer.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/thread.h"
+
+namespace {
+
+const int64_t kMyId = 1001;
+const int64_t kPeerId = 7;
+const int64_t kOtherId = 8;
+const char kChannel[] = "ch-42";
+
+struct Options {
+  int duplicates = 3;
+  std::string dir = "/tmp";
+};
+
+bool Fail(const char* what) {
+  fprintf(stderr, "%s\n", what);
+  return false;
+}
+
+// Records the MSG_RT frames it is handed as "sender:label", the label being
+// the VOIP command or the P2P type and candidate.
+class Recorder : public PeerConnectionClientObserver,
+                 public sigslot::has_slots<> {
+ public:
+  std::vector<std::string> frames;
+  int signed_in = 0;
+
+  void OnSignedIn() override { signed_in++; }
+  void OnDisconnected() override {}
+  void OnServerConnectionFailure() override {}
+  void HandleRTMessage(int64_t sender, int64_t receiver, int version,
+                       absl::string_view content) override {
+    RTPayload payload;
+    if (!DecodeRTPayload(version, content, &payload)) {
+      frames.push_back("invalid");
+      return;
+    }
+    std::string label = payload.kind == RTPayload::VOIP
+                            ? std::to_string(payload.voip.command)
+                            : payload.p2p.type + payload.p2p.candidate;
+    frames.push_back(std::to_string(sender) + ":" + label);
+  }
+
+  void OnDone(TraceReplayer* replayer) { rtc::Thread::Current()->Quit(); }
+};
+
+RTPayload Voip(int command) {
+  RTPayload payload;
+  payload.kind = RTPayload::VOIP;
+  payload.voip.command = command;
+  payload.voip.channel_id = kChannel;
+  return payload;
+}
+
+RTPayload Candidate(int i) {
+  RTPayload payload;
+  payload.kind = RTPayload::P2P;
+  payload.p2p.type = "candidate";
+  payload.p2p.candidate =
+      "candidate:" + std::to_string(i) + " 1 udp 1 10.0.0.1 5000 typ host";
+  return payload;
+}
+
+class TraceBuilder {
+ public:
+  bool Open(const std::string& path) { return writer_.Open(path, 1); }
+  void Close() { writer_.Close(); }
+
+  void SignedIn() {
+    Message m;
+    m.cmd = MSG_AUTH_STATUS;
+    Record(TRACE_RECEIVED, m);
+  }
+
+  void Rt(TraceDirection direction, int64_t peer_id, int rt_seq,
+          const RTPayload& payload) {
+    Message m;
+    m.cmd = MSG_RT;
+    m.version = PAYLOAD_VERSION_TLV;
+    m.sender = direction == TRACE_SENT ? kMyId : peer_id;
+    m.receiver = direction == TRACE_SENT ? peer_id : kMyId;
+    m.rt_seq = rt_seq;
+    m.content = EncodeRTPayload(payload, m.version);
+    Record(direction, m);
+  }
+
+ private:
+  void Record(TraceDirection direction, Message& m) {
+    char buf[8192];
+    int n = WriteMessage(buf, sizeof(buf), m);
+    time_us_ += 1000;
+    writer_.Record(direction, time_us_, buf, n);
+  }
+
+  SignalingTraceWriter writer_;
+  int64_t time_us_ = 0;
+};
+
+// Replays |path| at |speed| into |recorder|, twice on the same replayer.
+bool Replay(const std::string& path, double speed, Recorder* recorder,
+            TraceReplayer::Stats* stats) {
+  rtc::PhysicalSocketServer socket_server;
+  rtc::AutoSocketServerThread thread(&socket_server);
+  TraceReplayer replayer(recorder);
+  replayer.SignalDone.connect(recorder, &Recorder::OnDone);
+  if (!replayer.Open(path)) {
+    return Fail("can't open trace");
+  }
+  if (replayer.dial_peer_id() != kPeerId ||
+      replayer.dial_channel_id() != kChannel) {
+    return Fail("dial not found in trace");
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    replayer.Start(speed);
+    if (!replayer.done()) {
+      //OnDone()调用了Quit()
+      thread.Restart();
+      thread.Run();
+    }
+    *stats = replayer.stats();
+  }
+  return true;
+}
+
+bool CheckDuplicates(const std::string& path) {
+  TraceBuilder trace;
+  if (!trace.Open(path)) {
+    return Fail("can't write trace");
+  }
+  trace.SignedIn();
+  trace.Rt(TRACE_SENT, kPeerId, 500, Voip(VOIP_COMMAND_DIAL_VIDEO));
+  trace.Rt(TRACE_RECEIVED, kPeerId, 100, Voip(VOIP_COMMAND_ACCEPT));
+  trace.Rt(TRACE_RECEIVED, kPeerId, 101, Candidate(1));
+  //ack丢失, 对方重传了accept
+  trace.Rt(TRACE_RECEIVED, kPeerId, 100, Voip(VOIP_COMMAND_ACCEPT));
+  trace.Rt(TRACE_RECEIVED, kPeerId, 102, Candidate(2));
+  trace.Rt(TRACE_RECEIVED, kPeerId, 101, Candidate(1));
+  //另一个发送者的序号空间是独立的
+  trace.Rt(TRACE_RECEIVED, kOtherId, 101, Voip(VOIP_COMMAND_DIAL));
+  //rt_seq 0不去重
+  trace.Rt(TRACE_RECEIVED, kPeerId, 0, Voip(VOIP_COMMAND_PING));
+  trace.Rt(TRACE_RECEIVED, kPeerId, 0, Voip(VOIP_COMMAND_PING));
+  //发送的消息不回放
+  trace.Rt(TRACE_SENT, kPeerId, 501, Voip(VOIP_COMMAND_CONNECTED));
+  trace.Close();
+
+  const std::string peer = std::to_string(kPeerId) + ":";
+  const std::string other = std::to_string(kOtherId) + ":";
+  std::vector<std::string> once = {
+      peer + std::to_string(VOIP_COMMAND_ACCEPT),
+      peer + Candidate(1).p2p.type + Candidate(1).p2p.candidate,
+      peer + Candidate(2).p2p.type + Candidate(2).p2p.candidate,
+      other + std::to_string(VOIP_COMMAND_DIAL),
+      peer + std::to_string(VOIP_COMMAND_PING),
+      peer + std::to_string(VOIP_COMMAND_PING),
+  };
+  std::vector<std::string> expected = once;
+  expected.insert(expected.end(), once.begin(), once.end());
+
+  for (double speed : {0.0, 4.0}) {
+    Recorder recorder;
+    TraceReplayer::Stats stats;
+    if (!Replay(path, speed, &recorder, &stats)) {
+      return false;
+    }
+    if (recorder.frames != expected) {
+      for (const std::string& frame : recorder.frames) {
+        fprintf(stderr, "  %s\n", frame.c_str());
+      }
+      return Fail("replayed frames differ");
+    }
+    if (stats.duplicates != 2 || stats.delivered != 7 ||
+        recorder.signed_in != 2) {
+      fprintf(stderr, "delivered %lld duplicates %lld signed in %d\n",
+              (long long)stats.delivered, (long long)stats.duplicates,
+              recorder.signed_in);
+      return Fail("replay stats differ");
+    }
+  }
+  return true;
+}
+
+bool Measure(const Options& options, const std::string& path) {
+  TraceBuilder trace;
+  if (!trace.Open(path)) {
+    return Fail("can't write trace");
+  }
+  trace.SignedIn();
+  trace.Rt(TRACE_SENT, kPeerId, 500, Voip(VOIP_COMMAND_DIAL_VIDEO));
+  trace.Rt(TRACE_RECEIVED, kPeerId, 100, Voip(VOIP_COMMAND_ACCEPT));
+  const int kCandidates = 20;
+  for (int i = 0; i < kCandidates; i++) {
+    for (int j = 0; j <= options.duplicates; j++) {
+      trace.Rt(TRACE_RECEIVED, kPeerId, 101 + i, Candidate(i));
+    }
+  }
+  trace.Close();
+
+  Recorder recorder;
+  TraceReplayer::Stats stats;
+  if (!Replay(path, 0, &recorder, &stats)) {
+    return false;
+  }
+  if (stats.duplicates != (int64_t)kCandidates * options.duplicates) {
+    return Fail("retransmitted candidates not dropped");
+  }
+  printf("replay: %lld frames delivered, %lld duplicates dropped, handler "
+         "%lld us, max lag %lld us\n",
+         (long long)stats.delivered, (long long)stats.duplicates,
+         (long long)stats.handler_us, (long long)stats.max_lag_us);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        options.duplicates = atoi(optarg);
+        break;
+      case 'd':
+        options.dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n duplicates] [-d dir]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (options.duplicates < 0) {
+    options.duplicates = 3;
+  }
+
+  std::string path =
+      options.dir + "/trace_replay_bench." + std::to_string(getpid());
+  bool ok = CheckDuplicates(path) && Measure(options, path);
+  remove(path.c_str());
+  if (!ok) {
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
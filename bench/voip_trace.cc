@@ -0,0 +1,149 @@
+/*
+ * Reads a signaling trace recorded with PeerConnectionClient::StartTrace()
+ * (VOIP_TRACE=path with the linux client) and prints, per direction and
+ * command, the number of frames and bytes, plus the trace duration.
+ *
+ *   -d         also print every record: time, direction, command, sizes
+ *   -b count   replay the received MSG_RT bodies through DecodeRTPayload()
+ *              |count| times and print the decode time per frame, without
+ *              a UI; replay into VOIPWnd itself with VOIP_REPLAY=path
+ *
+ * usage: voip_trace [-d] [-b count] trace
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "examples/voip/message.h"
+#include "examples/voip/signaling_payload.h"
+#include "examples/voip/signaling_trace.h"
+
+namespace {
+
+struct Counter {
+  int64_t frames = 0;
+  int64_t bytes = 0;
+};
+
+// Keeps the compiler from dropping the measured loop.
+volatile size_t g_sink;
+
+double Now() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+const char* DirectionName(TraceDirection direction) {
+  return direction == TRACE_RECEIVED ? "recv" : "send";
+}
+
+void Usage(const char* name) {
+  fprintf(stderr, "usage: %s [-d] [-b count] trace\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool dump = false;
+  int iterations = 0;
+  const char* path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-d") == 0) {
+      dump = true;
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (path == NULL) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  SignalingTraceReader reader;
+  if (!reader.Open(path)) {
+    fprintf(stderr, "can't open trace %s\n", path);
+    return 1;
+  }
+
+  //(方向, cmd) -> 计数
+  std::map<std::pair<int, int>, Counter> counters;
+  //收到的MSG_RT, 用于-b
+  std::vector<std::pair<int, std::string>> rt_bodies;
+  int64_t records = 0;
+  int64_t invalid = 0;
+  int64_t last_us = 0;
+  SignalingTraceReader::Record record;
+  while (reader.Next(&record)) {
+    records++;
+    last_us = record.time_us;
+    MessageView m;
+    int n = DecodeMessage(record.frame.data(), (int)record.frame.size(), &m);
+    if (n <= 0) {
+      invalid++;
+      if (dump) {
+        printf("%10.3f %s invalid frame, %zu bytes\n",
+               record.time_us / 1000.0, DirectionName(record.direction),
+               record.frame.size());
+      }
+      continue;
+    }
+    Counter& counter = counters[std::make_pair((int)record.direction,
+                                               (int)m.cmd)];
+    counter.frames++;
+    counter.bytes += record.frame.size();
+    if (record.direction == TRACE_RECEIVED && m.cmd == MSG_RT) {
+      rt_bodies.push_back(
+          std::make_pair((int)m.version,
+                         std::string(m.content.data(), m.content.size())));
+    }
+    if (dump) {
+      printf("%10.3f %s cmd:%d seq:%d version:%d frame:%zu body:%zu\n",
+             record.time_us / 1000.0, DirectionName(record.direction),
+             (int)m.cmd, (int)m.seq, (int)m.version, record.frame.size(),
+             m.content.size());
+    }
+  }
+
+  printf("records:%lld invalid:%lld duration:%.3fms wall start:%lldus\n",
+         (long long)records, (long long)invalid, last_us / 1000.0,
+         (long long)reader.wall_time_us());
+  printf("%-6s %5s %10s %12s\n", "dir", "cmd", "frames", "bytes");
+  for (const auto& it : counters) {
+    printf("%-6s %5d %10lld %12lld\n",
+           DirectionName((TraceDirection)it.first.first), it.first.second,
+           (long long)it.second.frames, (long long)it.second.bytes);
+  }
+
+  if (iterations > 0 && !rt_bodies.empty()) {
+    int64_t failed = 0;
+    double start = Now();
+    for (int i = 0; i < iterations; i++) {
+      for (const auto& body : rt_bodies) {
+        RTPayload payload;
+        if (!DecodeRTPayload(body.first, body.second, &payload)) {
+          failed++;
+        }
+        g_sink += payload.kind;
+      }
+    }
+    double elapsed = Now() - start;
+    int64_t decoded = (int64_t)iterations * rt_bodies.size();
+    printf("decode MSG_RT: %lld frames, %.3fus/frame, failed:%lld\n",
+           (long long)decoded, elapsed / decoded,
+           (long long)(failed / iterations));
+  }
+  return 0;
+}
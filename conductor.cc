@@ -14,15 +14,9 @@
 #include <utility>
 #include <vector>
 
-#include "api/audio_codecs/builtin_audio_decoder_factory.h"
-#include "api/audio_codecs/builtin_audio_encoder_factory.h"
-#include "api/video_codecs/builtin_video_decoder_factory.h"
-#include "api/video_codecs/builtin_video_encoder_factory.h"
-#include "api/create_peerconnection_factory.h"
-
 #include "rtc_base/checks.h"
-#include "rtc_base/strings/json.h"
 #include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
 #include "pc/video_track_source.h"
 #include "modules/audio_device/include/audio_device.h"
 #include "modules/audio_processing/include/audio_processing.h"
@@ -32,15 +26,6 @@
 #include "defaults.h"
 
 
-// Names used for a IceCandidate JSON object.
-const char kCandidateSdpMidName[] = "id";//"sdpMid";
-const char kCandidateSdpMlineIndexName[] = "label";//"sdpMLineIndex";
-const char kCandidateSdpName[] = "candidate";
-
-// Names used for a SessionDescription JSON object.
-const char kSessionDescriptionTypeName[] = "type";
-const char kSessionDescriptionSdpName[] = "sdp";
-
 #define DTLS_ON  true
 #define DTLS_OFF false
 
@@ -128,31 +113,24 @@ class CapturerTrackSource : public webrtc::VideoTrackSource {
 };
 
 
-Conductor::Conductor(PeerConnectionClient* client,
+Conductor::Conductor(SignalingTransport* client,
+                     MediaEngine* engine,
                      rtc::Thread* main_thread,
                      int64_t uid,
                      std::string& token)
   : peer_id_(-1),
     loopback_(false),
     client_(client),
+    engine_(engine),
+    pool_(NULL),
+    peer_caps_(0),
+    candidate_batch_window_(0),
+    candidate_batch_(0),
     main_thread_(main_thread),
+    setup_us_(0),
     uid_(uid),
     token_(token) {
-    
-    _networkThread = rtc::Thread::CreateWithSocketServer();
-    bool result = _networkThread->Start();
-    if (!result) {
-        RTC_LOG(INFO) <<"start thread error";
-    }
-    
-    _workerThread = rtc::Thread::Create();
-    result = _workerThread->Start();
-
-
-    _signalingThread = rtc::Thread::Create();
-    result = _signalingThread->Start();
-
-
+    client_->SignalReadyToSend.connect(this, &Conductor::OnReadyToSend);
 }
 
 Conductor::~Conductor() {
@@ -171,35 +149,13 @@ bool Conductor::InitializePeerConnection() {
   RTC_DCHECK(peer_connection_factory_.get() == NULL);
   RTC_DCHECK(peer_connection_.get() == NULL);
 
-//    peer_connection_factory_ = webrtc::CreatePeerConnectionFactory(
-//      nullptr /* network_thread */, nullptr /* worker_thread */,
-//      nullptr /* signaling_thread */, nullptr /* default_adm */,
-//      webrtc::CreateBuiltinAudioEncoderFactory(),
-//      webrtc::CreateBuiltinAudioDecoderFactory(),
-//      webrtc::CreateBuiltinVideoEncoderFactory(),
-//      webrtc::CreateBuiltinVideoDecoderFactory(), nullptr /* audio_mixer */,
-//      nullptr /* audio_processing */);
-
-
-  peer_connection_factory_ = webrtc::CreatePeerConnectionFactory(
-      _networkThread.get(),
-      _workerThread.get(),
-      _signalingThread.get(),
-      nullptr,
-      webrtc::CreateBuiltinAudioEncoderFactory(),
-      webrtc::CreateBuiltinAudioDecoderFactory(),
-      webrtc::CreateBuiltinVideoEncoderFactory(),
-      webrtc::CreateBuiltinVideoDecoderFactory(),
-      nullptr, nullptr);
-
-  
-  //peer_connection_factory_  = webrtc::CreatePeerConnectionFactory();
-
-  if (!peer_connection_factory_.get()) {
-    RTC_LOG(WARNING) << "Failed to initialize PeerConnectionFactory";
+  int64_t start = rtc::TimeMicros();
+  //线程, ADM和factory由所有通话共享, 通常在启动时已经创建
+  if (!engine_->Initialize()) {
     DeletePeerConnection();
     return false;
   }
+  peer_connection_factory_ = engine_->factory();
 
   RTC_LOG(INFO) << "CreatePeerConnection...";  
   if (!CreatePeerConnection(DTLS_ON)) {
@@ -208,6 +164,8 @@ bool Conductor::InitializePeerConnection() {
     return false;
   }
   AddTracks();
+  setup_us_ = rtc::TimeMicros() - start;
+  RTC_LOG(INFO) << "peer connection setup:" << setup_us_ << "us";
   return peer_connection_.get() != NULL;
 }
 
@@ -216,19 +174,16 @@ bool Conductor::CreatePeerConnection(bool dtls) {
   RTC_DCHECK(peer_connection_factory_.get() != NULL);
   RTC_DCHECK(peer_connection_.get() == NULL);
 
-  webrtc::PeerConnectionInterface::RTCConfiguration config;
-  webrtc::PeerConnectionInterface::IceServer server;
-  server.uri = "stun:stun.counterpath.net:3478";
-  config.servers.push_back(server);
-  webrtc::PeerConnectionInterface::IceServer server2;
-  server2.uri = "turn:turn.gobelieve.io:3478?transport=udp";
-  char s[64] = {0};
-  snprintf(s, 64, "7_%ld", uid_);
-  server2.username = s;
-  server2.password = token_;
-  config.servers.push_back(server2);
-  
-  config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;  
+  //池中的连接都开启了DTLS
+  if (pool_ && dtls) {
+    peer_connection_ = pool_->Take(this, &pooled_observer_);
+    if (peer_connection_) {
+      return true;
+    }
+  }
+
+  webrtc::PeerConnectionInterface::RTCConfiguration config =
+      CreateRTCConfiguration(uid_, token_);
   config.enable_dtls_srtp = dtls;
 
 
@@ -238,7 +193,14 @@ bool Conductor::CreatePeerConnection(bool dtls) {
 }
 
 void Conductor::DeletePeerConnection() {
+  if (pooled_observer_) {
+    //Close()之后PeerConnection不再回调pooled_observer_
+    peer_connection_->Close();
+    pooled_observer_.reset();
+  }
   peer_connection_ = NULL;
+  pending_candidates_.clear();
+  candidate_batch_++;
   StopLocalRenderer();
   StopRemoteRenderer();  
   peer_connection_factory_ = NULL;
@@ -326,18 +288,56 @@ void Conductor::OnIceCandidate(const webrtc::IceCandidateInterface* candidate) {
     return;
   }
 
-  Json::StyledWriter writer;
-  Json::Value jmessage;
-  jmessage["type"] = "candidate";
-  jmessage[kCandidateSdpMidName] = candidate->sdp_mid();
-  jmessage[kCandidateSdpMlineIndexName] = candidate->sdp_mline_index();
-  std::string sdp;
-  if (!candidate->ToString(&sdp)) {
+  P2PCandidate* c = new P2PCandidate();
+  c->sdp_mid = candidate->sdp_mid();
+  c->sdp_mline_index = candidate->sdp_mline_index();
+  if (!candidate->ToString(&c->candidate)) {
     RTC_LOG(LS_ERROR) << "Failed to serialize candidate";
+    delete c;
+    return;
+  }
+
+  this->AddRef();
+  main_thread_->Post(RTC_FROM_HERE, this, CANDIDATE_GATHERED, new MessageData(c));
+}
+
+void Conductor::OnIceGatheringChange(
+    webrtc::PeerConnectionInterface::IceGatheringState new_state) {
+  if (new_state != webrtc::PeerConnectionInterface::kIceGatheringComplete) {
+    return;
+  }
+  RTC_LOG(INFO) << "ice gathering complete";
+  this->AddRef();
+  main_thread_->Post(RTC_FROM_HERE, this, FLUSH_CANDIDATES);
+}
+
+void Conductor::SendCandidates() {
+  if (pending_candidates_.empty()) {
     return;
   }
-  jmessage[kCandidateSdpName] = sdp;
-  SendMessage(writer.write(jmessage));
+
+  int n = pending_candidates_.size();
+  P2PSignal* signal = new P2PSignal();
+  if (n == 1) {
+    const P2PCandidate& c = pending_candidates_[0];
+    signal->type = "candidate";
+    signal->sdp_mid = c.sdp_mid;
+    signal->sdp_mline_index = c.sdp_mline_index;
+    signal->candidate = c.candidate;
+  } else {
+    signal->type = "candidates";
+    signal->candidates.swap(pending_candidates_);
+  }
+
+  candidate_stats_.candidates += n;
+  candidate_stats_.messages++;
+  RTC_LOG(INFO) << "send candidates:" << n << " average per message:"
+                << candidate_stats_.candidates_per_message();
+
+  pending_candidates_.clear();
+  candidate_batch_++;
+  pending_messages_.push_back(signal);
+  SendPendingMessages();
 }
 
 
@@ -364,9 +364,8 @@ void Conductor::OnPeerDisconnected(int id) {
   }
 }
 
-void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
+void Conductor::OnMessageFromPeer(int peer_id, const P2PSignal& signal) {
   RTC_DCHECK(peer_id_ == peer_id || peer_id_ == -1);
-  RTC_DCHECK(!message.empty());
 
   if (!peer_connection_.get()) {
     RTC_DCHECK(peer_id_ == -1);
@@ -383,32 +382,21 @@ void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
     return;
   }
 
-  Json::Reader reader;
-  Json::Value jmessage;
-  if (!reader.parse(message, jmessage)) {
-    RTC_LOG(WARNING) << "Received unknown message. " << message;
-    return;
-  }
-  std::string type;
-  std::string json_object;
-
-  rtc::GetStringFromJsonObject(jmessage, kSessionDescriptionTypeName, &type);
+  const std::string& type = signal.type;
   if (type == "offer" || type == "answer" || type == "offer-loopback") {
-    std::string sdp;
-    if (!rtc::GetStringFromJsonObject(jmessage, kSessionDescriptionSdpName,
-                                      &sdp)) {
+    if (signal.sdp.empty()) {
       RTC_LOG(WARNING) << "Can't parse received session description message.";
       return;
     }
     webrtc::SdpParseError error;
     webrtc::SessionDescriptionInterface* session_description(
-        webrtc::CreateSessionDescription(type, sdp, &error));
+        webrtc::CreateSessionDescription(type, signal.sdp, &error));
     if (!session_description) {
       RTC_LOG(WARNING) << "Can't parse received session description message. "
           << "SdpParseError was: " << error.description;
       return;
     }
-    RTC_LOG(INFO) << " Received session description :" << message;
+    RTC_LOG(INFO) << " Received session description :" << signal.sdp;
     peer_connection_->SetRemoteDescription(
         DummySetSessionDescriptionObserver::Create(), session_description);
     if (session_description->type() ==
@@ -417,30 +405,18 @@ void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
     }
     return;
   } else if (type == "candidate") {
-    std::string sdp_mid;
-    int sdp_mlineindex = 0;
-    std::string sdp;
-    if (!rtc::GetStringFromJsonObject(jmessage, kCandidateSdpMidName,
-                                      &sdp_mid) ||
-        !rtc::GetIntFromJsonObject(jmessage, kCandidateSdpMlineIndexName,
-                                   &sdp_mlineindex) ||
-        !rtc::GetStringFromJsonObject(jmessage, kCandidateSdpName, &sdp)) {
+    if (signal.candidate.empty()) {
       RTC_LOG(WARNING) << "Can't parse received message.";
       return;
     }
-    webrtc::SdpParseError error;
-    std::unique_ptr<webrtc::IceCandidateInterface> candidate(
-        webrtc::CreateIceCandidate(sdp_mid, sdp_mlineindex, sdp, &error));
-    if (!candidate.get()) {
-      RTC_LOG(WARNING) << "Can't parse received candidate message. "
-          << "SdpParseError was: " << error.description;
-      return;
-    }
-    if (!peer_connection_->AddIceCandidate(candidate.get())) {
-      RTC_LOG(WARNING) << "Failed to apply the received candidate";
-      return;
+    AddRemoteCandidate(signal.sdp_mid, signal.sdp_mline_index,
+                       signal.candidate);
+    return;
+  } else if (type == "candidates") {
+    RTC_LOG(INFO) << " Received candidates:" << signal.candidates.size();
+    for (const P2PCandidate& c : signal.candidates) {
+      AddRemoteCandidate(c.sdp_mid, c.sdp_mline_index, c.candidate);
     }
-    RTC_LOG(INFO) << " Received candidate :" << message;
     return;
   } else {
     RTC_LOG(WARNING) << "unknown type:" << type;
@@ -448,6 +424,26 @@ void Conductor::OnMessageFromPeer(int peer_id, const std::string& message) {
 }
 
 
+bool Conductor::AddRemoteCandidate(const std::string& sdp_mid,
+                                   int sdp_mline_index,
+                                   const std::string& sdp) {
+  webrtc::SdpParseError error;
+  std::unique_ptr<webrtc::IceCandidateInterface> candidate(
+      webrtc::CreateIceCandidate(sdp_mid, sdp_mline_index, sdp, &error));
+  if (!candidate.get()) {
+    RTC_LOG(WARNING) << "Can't parse received candidate message. "
+        << "SdpParseError was: " << error.description;
+    return false;
+  }
+  if (!peer_connection_->AddIceCandidate(candidate.get())) {
+    RTC_LOG(WARNING) << "Failed to apply the received candidate";
+    return false;
+  }
+  RTC_LOG(INFO) << " Received candidate :" << sdp;
+  return true;
+}
+
+
 void Conductor::OnServerConnectionFailure() {
     RTC_LOG(INFO) << "Failed to connect to server";
 }
@@ -518,7 +514,7 @@ void Conductor::OnMessage(rtc::Message* msg) {
     switch (msg->message_id) {
       case SEND_MESSAGE_TO_PEER: {
           RTC_LOG(INFO) << "SEND_MESSAGE_TO_PEER";
-          std::string* msg = reinterpret_cast<std::string*>(data);
+          P2PSignal* msg = reinterpret_cast<P2PSignal*>(data);
           if (msg) {
               // For convenience, we always run the message through the queue.
               // This way we can be sure that messages are sent to the server
@@ -526,18 +522,42 @@ void Conductor::OnMessage(rtc::Message* msg) {
               pending_messages_.push_back(msg);
           }
        
-          if (!pending_messages_.empty()) {
-              msg = pending_messages_.front();
-              pending_messages_.pop_front();
-              
-              if (!this->SendToPeer(*msg)) {
-                  RTC_LOG(LS_ERROR) << "SendToPeer failed";
+          SendPendingMessages();
+          break;
+      }
+       
+      case CANDIDATE_GATHERED: {
+          P2PCandidate* c = reinterpret_cast<P2PCandidate*>(data);
+          if (peer_id_ != -1) {
+              pending_candidates_.push_back(*c);
+              bool batch = candidate_batch_window_ > 0 &&
+                  (peer_caps_ & PAYLOAD_CAP_CANDIDATE_BATCH);
+              if (!batch) {
+                  SendCandidates();
+              } else if (pending_candidates_.size() == 1) {
+                  //收集完成时会提前发送这一批, 定时器带上批号以便忽略
+                  this->AddRef();
+                  main_thread_->PostDelayed(RTC_FROM_HERE,
+                                            candidate_batch_window_,
+                                            this, FLUSH_CANDIDATES,
+                                            new MessageData(
+                                                new int(candidate_batch_)));
               }
-              delete msg;
           }
+          delete c;
           break;
       }
-       
+
+      case FLUSH_CANDIDATES: {
+          //没有批号的来自OnIceGatheringChange(), 总是发送
+          int* batch = reinterpret_cast<int*>(data);
+          if (peer_id_ != -1 && (!batch || *batch == candidate_batch_)) {
+              SendCandidates();
+          }
+          delete batch;
+          break;
+      }
+
       case NEW_STREAM_ADDED: {
           webrtc::MediaStreamInterface* stream =
               reinterpret_cast<webrtc::MediaStreamInterface*>(
@@ -570,38 +590,41 @@ void Conductor::OnMessage(rtc::Message* msg) {
     this->Release();
 }
 
-bool Conductor::SendToPeer(const std::string& message) {
-    Json::Reader reader;
-    Json::Value value;
+void Conductor::SendPendingMessages() {
+    while (!pending_messages_.empty() && client_->writable()) {
+        P2PSignal* msg = pending_messages_.front();
+        pending_messages_.pop_front();
 
-    if (!reader.parse(message, value)) {
-        return false;
+        if (!this->SendToPeer(*msg)) {
+            RTC_LOG(LS_ERROR) << "SendToPeer failed";
+        }
+        delete msg;
     }
+}
 
-    Json::Value json;
-    json["p2p"] = value;
-    std::string s = rtc::JsonValueToString(json);
-    //todo fix json bug
-    client_->SendRTMessage(peer_id_, s);
-    return true;
+void Conductor::OnReadyToSend(SignalingTransport* client) {
+    RTC_LOG(INFO) << "send queue drained, pending:" << pending_messages_.size();
+    SendPendingMessages();
+}
+
+bool Conductor::SendToPeer(const P2PSignal& signal) {
+    RTPayload payload;
+    payload.kind = RTPayload::P2P;
+    payload.p2p = signal;
+    return client_->SendRTPayload(peer_id_, payload, peer_caps_);
 }
 
 void Conductor::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
   peer_connection_->SetLocalDescription(
       DummySetSessionDescriptionObserver::Create(), desc);
 
-  std::string sdp;
-  desc->ToString(&sdp);
-
-  Json::StyledWriter writer;
-  Json::Value jmessage;
-
-  jmessage[kSessionDescriptionTypeName] = desc->type();
-  jmessage[kSessionDescriptionSdpName] = sdp;
+  P2PSignal signal;
+  signal.type = desc->type();
+  desc->ToString(&signal.sdp);
 
-  RTC_LOG(INFO) << "sdp type:" << jmessage[kSessionDescriptionTypeName];
-  RTC_LOG(INFO) << "sdp" << sdp;
-  SendMessage(writer.write(jmessage));
+  RTC_LOG(INFO) << "sdp type:" << signal.type;
+  RTC_LOG(INFO) << "sdp" << signal.sdp;
+  SendMessage(signal);
 }
 
 
@@ -609,8 +632,8 @@ void Conductor::OnFailure(webrtc::RTCError error) {
   RTC_LOG(LERROR) << ToString(error.type()) << ": " << error.message();
 }
 
-void Conductor::SendMessage(const std::string& json_object) {
-  std::string* msg = new std::string(json_object);
+void Conductor::SendMessage(const P2PSignal& signal) {
+  P2PSignal* msg = new P2PSignal(signal);
   this->AddRef();
   main_thread_->Post(RTC_FROM_HERE, this, SEND_MESSAGE_TO_PEER, new MessageData(msg));
 }
@@ -16,10 +16,14 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "api/media_stream_interface.h"
 #include "api/peer_connection_interface.h"
-#include "examples/voip/peer_connection_client.h"
+#include "examples/voip/media_engine.h"
+#include "examples/voip/peer_connection_pool.h"
+#include "examples/voip/signaling_payload.h"
+#include "examples/voip/signaling_transport.h"
 //#include "examples/voip/video_renderer.h"
 //#include "base/win32.h"
 
@@ -35,15 +39,29 @@ class VideoRenderer;
 class Conductor
     : public webrtc::PeerConnectionObserver,
     public webrtc::CreateSessionDescriptionObserver,
-    public rtc::MessageHandler {
+    public rtc::MessageHandler,
+    public sigslot::has_slots<> {
  public:
   enum CallbackID {
     SEND_MESSAGE_TO_PEER = 1,
     NEW_STREAM_ADDED,
     STREAM_REMOVED,
+    CANDIDATE_GATHERED,
+    FLUSH_CANDIDATES,
   };
 
-  Conductor(PeerConnectionClient* client,
+  struct CandidateStats {
+    int candidates = 0;  // Local candidates sent to the peer.
+    int messages = 0;    // Messages they were sent in.
+
+    double candidates_per_message() const {
+      return messages > 0 ? (double)candidates / messages : 0;
+    }
+  };
+
+  // |engine| is shared by all calls and must outlive the Conductor.
+  Conductor(SignalingTransport* client,
+            MediaEngine* engine,
             rtc::Thread* main_thread,
             int64_t uid,
             std::string& token);
@@ -55,7 +73,7 @@ class Conductor
   void ConnectToPeer(int peer_id);
   void OnPeerConnected(int id, const std::string& name);
   void OnPeerDisconnected(int id);
-  void OnMessageFromPeer(int peer_id, const std::string& message);
+  void OnMessageFromPeer(int peer_id, const P2PSignal& signal);
   void OnServerConnectionFailure();
 
 
@@ -74,6 +92,35 @@ class Conductor
   void SetRemoteRenderer(rtc::VideoSinkInterface<webrtc::VideoFrame>* render) {
       remote_renderer_ = render;
   }
+
+  // Capabilities the peer advertised, PAYLOAD_CAP_*. They select the
+  // encoding of outgoing p2p messages.
+  void set_peer_caps(int caps) {
+      peer_caps_ = caps;
+  }
+
+  // Local candidates gathered within |window_ms| of the first one are sent
+  // to the peer as a single "candidates" message; the batch also goes out
+  // as soon as gathering completes. Only used for peers that advertise
+  // PAYLOAD_CAP_CANDIDATE_BATCH. 0 sends every candidate on its own.
+  void set_candidate_batch_window(int window_ms) {
+      candidate_batch_window_ = window_ms;
+  }
+
+  const CandidateStats& candidate_stats() const {
+      return candidate_stats_;
+  }
+
+  // Calls take a warm PeerConnection from |pool| when it has one, with
+  // candidates gathered and TURN allocated, and create their own otherwise.
+  void set_peer_connection_pool(PeerConnectionPool* pool) {
+      pool_ = pool;
+  }
+
+  // Time InitializePeerConnection() took for this call, 0 before.
+  int64_t setup_us() const {
+      return setup_us_;
+  }
   
  protected:
   ~Conductor();
@@ -112,7 +159,7 @@ class Conductor
   void OnIceConnectionChange(
       webrtc::PeerConnectionInterface::IceConnectionState new_state) override{}
   void OnIceGatheringChange(
-      webrtc::PeerConnectionInterface::IceGatheringState new_state) override{}
+      webrtc::PeerConnectionInterface::IceGatheringState new_state) override;
   void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
   void OnIceConnectionReceivingChange(bool receiving) override {}
 
@@ -126,24 +173,40 @@ class Conductor
 
  protected:
   // Send a message to the remote peer.
-  void SendMessage(const std::string& json_object);
-  bool SendToPeer(const std::string& message);
+  void SendMessage(const P2PSignal& signal);
+  bool SendToPeer(const P2PSignal& signal);
+  // Sends queued messages while the client's send queue is below its high
+  // watermark; the rest wait for SignalReadyToSend.
+  void SendPendingMessages();
+  void OnReadyToSend(SignalingTransport* client);
+  void SendCandidates();
+  bool AddRemoteCandidate(const std::string& sdp_mid, int sdp_mline_index,
+                          const std::string& sdp);
     
   int peer_id_;
   bool loopback_;
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
   rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
       peer_connection_factory_;
-  PeerConnectionClient* client_;
+  SignalingTransport* client_;
+  MediaEngine* engine_;
+  PeerConnectionPool* pool_;
+  //peer_connection_取自pool_时, 它创建时使用的observer, 转发给this
+  std::unique_ptr<PooledPeerConnectionObserver> pooled_observer_;
  
-  std::deque<std::string*> pending_messages_;
+  std::deque<P2PSignal*> pending_messages_;
+  int peer_caps_;
+
+  int candidate_batch_window_;
+  //等待合并发送的本地candidate
+  std::vector<P2PCandidate> pending_candidates_;
+  //每发出或丢弃一批加1, 窗口定时器只发送它开始的那一批
+  int candidate_batch_;
+  CandidateStats candidate_stats_;
   std::string server_;
 
   rtc::Thread *main_thread_;
-  
-  std::unique_ptr<rtc::Thread> _networkThread;
-  std::unique_ptr<rtc::Thread> _workerThread;
-  std::unique_ptr<rtc::Thread> _signalingThread;
+  int64_t setup_us_;
 
   int64_t uid_;
   std::string token_;
@@ -0,0 +1,79 @@
+/*
+ * libFuzzer target for the signaling frame decoder. The input is treated as
+ * a TCP stream from the server: frames are decoded back to back with
+ * DecodeMessage() and ReadMessage() until the data runs out or a frame is
+ * malformed. Decoded MSG_RT and MSG_IM frames are encoded again and must
+ * decode to the same content.
+ *
+ * Built by the message_fuzzer target when use_fuzzing_engine is set, or
+ * standalone:
+ *   clang++ -std=c++14 -fsanitize=fuzzer,address -I<webrtc src> \
+ *       fuzz/message_fuzzer.cc message.cc
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "examples/voip/message.h"
+
+namespace {
+
+void Check(bool condition) {
+  if (!condition) {
+    abort();
+  }
+}
+
+bool InFrame(absl::string_view s, const char* p, int size) {
+  return s.empty() || (s.data() >= p && s.data() + s.size() <= p + size);
+}
+
+void RoundTrip(const Message& decoded) {
+  Message m = decoded;
+  std::vector<char> buf(GetMessageSize(m));
+  int n = WriteMessage(buf.data(), (int)buf.size(), m);
+  Check(n == (int)buf.size());
+  Message again;
+  Check(ReadMessage(buf.data(), n, again));
+  Check(again.cmd == m.cmd && again.seq == m.seq &&
+        again.sender == m.sender && again.receiver == m.receiver &&
+        again.content == m.content);
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  const char* p = (const char*)data;
+  int left = (int)size;
+  while (left > 0) {
+    MessageView v;
+    int n = DecodeMessage(p, left, &v);
+    if (n <= 0) {
+      Check(n == 0 || n == -1);
+      Message m;
+      Check(!ReadMessage(p, left, m));
+      break;
+    }
+    Check(n == HEADER_SIZE + v.length && n <= left);
+    Check(InFrame(v.content, p, n));
+    if (v.cmd == MSG_AUTH_TOKEN) {
+      Check(InFrame(v.token, p, n) && InFrame(v.device_id, p, n));
+    }
+
+    //ReadMessage只看第一帧, 后面的数据不影响结果
+    Message m;
+    Check(ReadMessage(p, left, m));
+    Check(m.cmd == v.cmd && m.seq == v.seq && m.length == v.length);
+    if (m.cmd == MSG_RT || m.cmd == MSG_IM) {
+      Check(m.content.size() == v.content.size());
+      RoundTrip(m);
+    }
+
+    p += n;
+    left -= n;
+  }
+  return 0;
+}
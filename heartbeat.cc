@@ -0,0 +1,119 @@
+#include "examples/voip/heartbeat.h"
+
+#include <algorithm>
+
+namespace {
+
+const int64_t kMinTimeout = 3*1000;
+const int64_t kMaxTimeout = 8*1000;
+//从连接断开到发现的目标时间
+const int64_t kDetectTime = 15*1000;
+const int64_t kMinInterval = 5*1000;
+const int64_t kMaxInterval = 25*1000;
+
+//未收到pong的ping最多保留的数量
+const size_t kMaxOutstanding = 16;
+
+int BucketOf(int64_t rtt_us) {
+  int64_t ms = rtt_us / 1000;
+  int bucket = 0;
+  while (ms > 0 && bucket < RttStats::kBuckets - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+}  // namespace
+
+int64_t RttStats::Percentile(double p) const {
+  if (samples == 0) {
+    return 0;
+  }
+  int64_t rank = (int64_t)(samples * std::min(100.0, std::max(0.0, p)) / 100);
+  int64_t count = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    count += buckets[i];
+    if (count > rank || i == kBuckets - 1) {
+      return std::min<int64_t>(max_us, (int64_t)1000 << i);
+    }
+  }
+  return max_us;
+}
+
+Heartbeat::Heartbeat() {
+}
+
+void Heartbeat::OnPingSent(int seq, int64_t now_us) {
+  if (pings_.size() == kMaxOutstanding) {
+    pings_.pop_front();
+    stats_.lost++;
+  }
+  Ping ping;
+  ping.seq = seq;
+  ping.ts = now_us;
+  pings_.push_back(ping);
+}
+
+bool Heartbeat::OnPong(int seq, int64_t now_us) {
+  if (pings_.empty()) {
+    return false;
+  }
+
+  auto it = std::find_if(pings_.begin(), pings_.end(),
+                         [seq](const Ping& p) { return p.seq == seq; });
+  if (it == pings_.end()) {
+    it = pings_.begin();
+  }
+
+  AddSample(std::max<int64_t>(0, now_us - it->ts));
+  //之前的ping已经不会再有pong
+  stats_.lost += it - pings_.begin();
+  pings_.erase(pings_.begin(), it + 1);
+  return true;
+}
+
+bool Heartbeat::IsTimedOut(int64_t now_us) const {
+  return !pings_.empty() &&
+         now_us - pings_.front().ts > (int64_t)timeout_ms() * 1000;
+}
+
+int Heartbeat::timeout_ms() const {
+  if (stats_.samples == 0) {
+    return (int)kMaxTimeout;
+  }
+  int64_t rto = 3 * (stats_.srtt_us + 4 * stats_.rttvar_us) / 1000;
+  return (int)std::min(kMaxTimeout, std::max(kMinTimeout, rto));
+}
+
+int Heartbeat::interval_ms() const {
+  int64_t interval = kDetectTime - timeout_ms();
+  return (int)std::min(kMaxInterval, std::max(kMinInterval, interval));
+}
+
+void Heartbeat::Reset() {
+  pings_.clear();
+}
+
+void Heartbeat::ResetStats() {
+  stats_ = RttStats();
+}
+
+void Heartbeat::AddSample(int64_t rtt_us) {
+  if (stats_.samples == 0) {
+    stats_.srtt_us = rtt_us;
+    stats_.rttvar_us = rtt_us / 2;
+    stats_.min_us = rtt_us;
+    stats_.max_us = rtt_us;
+  } else {
+    int64_t delta = rtt_us > stats_.srtt_us ? rtt_us - stats_.srtt_us
+                                            : stats_.srtt_us - rtt_us;
+    stats_.rttvar_us = (3 * stats_.rttvar_us + delta) / 4;
+    stats_.srtt_us = (7 * stats_.srtt_us + rtt_us) / 8;
+    stats_.min_us = std::min(stats_.min_us, rtt_us);
+    stats_.max_us = std::max(stats_.max_us, rtt_us);
+  }
+  stats_.last_us = rtt_us;
+  stats_.samples++;
+  stats_.buckets[BucketOf(rtt_us)]++;
+}
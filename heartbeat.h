@@ -0,0 +1,72 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stdint.h>
+
+#include <deque>
+
+// Round-trip statistics of the MSG_PING/MSG_PONG exchange. Times are in
+// microseconds. srtt/rttvar follow the TCP estimator (RFC 6298); the
+// histogram has log2 buckets: bucket 0 counts RTTs below 1 ms, bucket i
+// counts [2^(i-1), 2^i) ms and the last bucket everything above.
+struct RttStats {
+  static const int kBuckets = 16;
+
+  int64_t samples = 0;
+  int64_t lost = 0;  // Pings that never got a pong.
+  int64_t last_us = 0;
+  int64_t min_us = 0;
+  int64_t max_us = 0;
+  int64_t srtt_us = 0;
+  int64_t rttvar_us = 0;
+  int64_t buckets[kBuckets] = {};
+
+  // Upper bound of the bucket holding the |p|-th percentile (0-100), in
+  // microseconds. 0 without samples.
+  int64_t Percentile(double p) const;
+};
+
+// Heartbeat state of one signaling connection. Each MSG_PONG is matched to
+// the MSG_PING with the same seq; a pong with an unknown seq (servers that do
+// not echo it) answers the oldest outstanding ping, which is equivalent on an
+// ordered stream.
+//
+// The pong timeout is 3 * (srtt + 4 * rttvar) clamped to [3 s, 8 s], 8 s until
+// the first sample. The ping interval is chosen so that a dead connection is
+// detected about 15 s after it went silent (interval + timeout), bounded to
+// [5 s, 25 s] to stay below common NAT idle timeouts.
+class Heartbeat {
+ public:
+  Heartbeat();
+
+  void OnPingSent(int seq, int64_t now_us);
+  // Returns false if the pong matches no outstanding ping.
+  bool OnPong(int seq, int64_t now_us);
+
+  // True when the oldest outstanding ping is older than timeout_ms().
+  bool IsTimedOut(int64_t now_us) const;
+  int outstanding() const { return (int)pings_.size(); }
+
+  int timeout_ms() const;
+  int interval_ms() const;
+
+  // Forgets outstanding pings, e.g. when the connection is replaced. The RTT
+  // statistics are kept.
+  void Reset();
+  void ResetStats();
+
+  const RttStats& stats() const { return stats_; }
+
+ private:
+  struct Ping {
+    int seq;
+    int64_t ts;
+  };
+
+  void AddSample(int64_t rtt_us);
+
+  std::deque<Ping> pings_;
+  RttStats stats_;
+};
+
+#endif
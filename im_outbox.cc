@@ -0,0 +1,290 @@
+#include "examples/voip/im_outbox.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace {
+
+//日志记录: 1字节类型 + 4字节msgid, 消息记录之后是
+//8字节sender + 8字节receiver + 4字节timestamp + 4字节长度 + 内容
+const char kRecordMessage = 'M';
+const char kRecordAck = 'A';
+
+//日志中已确认的记录超过这个数量且多于未确认的消息时重写日志
+const size_t kCompactThreshold = 1024;
+const uint32_t kMaxContentSize = 1024*1024;
+
+void Put32(std::string* s, uint32_t v) {
+  char b[4] = {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+  s->append(b, 4);
+}
+
+void Put64(std::string* s, uint64_t v) {
+  Put32(s, (uint32_t)(v >> 32));
+  Put32(s, (uint32_t)v);
+}
+
+bool Get32(FILE* file, uint32_t* v) {
+  unsigned char b[4];
+  if (fread(b, 1, 4, file) != 4) {
+    return false;
+  }
+  *v = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+       ((uint32_t)b[2] << 8) | b[3];
+  return true;
+}
+
+bool Get64(FILE* file, uint64_t* v) {
+  uint32_t high, low;
+  if (!Get32(file, &high) || !Get32(file, &low)) {
+    return false;
+  }
+  *v = ((uint64_t)high << 32) | low;
+  return true;
+}
+
+void EncodeMessage(const IMMessage& m, std::string* s) {
+  s->push_back(kRecordMessage);
+  Put32(s, (uint32_t)m.msgid);
+  Put64(s, (uint64_t)m.sender);
+  Put64(s, (uint64_t)m.receiver);
+  Put32(s, (uint32_t)m.timestamp);
+  Put32(s, (uint32_t)m.content.size());
+  s->append(m.content);
+}
+
+//没有日志时msgid从随机值开始, 重启后几乎不会落入上次用过的范围.
+//不超过2^30, 之后的2^30条消息不会回绕
+int RandomMsgid() {
+  std::random_device rd;
+  return (int)(rd() % 0x40000000) + 1;
+}
+
+}  // namespace
+
+ImOutbox::ImOutbox(size_t window)
+    : window_(std::max<size_t>(1, window)),
+      in_flight_(0),
+      next_msgid_(RandomMsgid()),
+      journal_(NULL),
+      journal_acked_(0) {
+}
+
+ImOutbox::~ImOutbox() {
+  Close();
+}
+
+bool ImOutbox::Open(const std::string& path) {
+  Close();
+  path_ = path;
+  FILE* file = fopen(path.c_str(), "rb");
+  bool complete = true;
+  if (file) {
+    complete = Load(file);
+    fclose(file);
+  }
+  journal_ = fopen(path.c_str(), "ab");
+  if (!journal_) {
+    return false;
+  }
+  if (!complete) {
+    //截断的记录之后不能再追加
+    Compact();
+  } else {
+    MaybeCompact();
+  }
+  return true;
+}
+
+void ImOutbox::Close() {
+  if (journal_) {
+    fclose(journal_);
+    journal_ = NULL;
+  }
+}
+
+bool ImOutbox::Load(FILE* file) {
+  std::map<int, IMMessage> messages;
+  size_t acked = 0;
+  bool complete = false;
+  //有日志时msgid接着日志中最大的msgid, 不用随机的初始值
+  int last_msgid = 0;
+  while (true) {
+    int type = fgetc(file);
+    if (type == EOF) {
+      complete = true;
+      break;
+    }
+    uint32_t msgid;
+    if (!Get32(file, &msgid)) {
+      break;
+    }
+    last_msgid = std::max(last_msgid, (int)msgid);
+    if (type == kRecordAck) {
+      messages.erase((int)msgid);
+      acked++;
+      continue;
+    }
+    if (type != kRecordMessage) {
+      break;
+    }
+
+    IMMessage m;
+    uint64_t sender, receiver;
+    uint32_t timestamp, size;
+    if (!Get64(file, &sender) || !Get64(file, &receiver) ||
+        !Get32(file, &timestamp) || !Get32(file, &size) ||
+        size > kMaxContentSize) {
+      break;
+    }
+    m.content.resize(size);
+    if (size > 0 && fread(&m.content[0], 1, size, file) != size) {
+      //最后一条记录没有写完
+      break;
+    }
+    m.msgid = (int)msgid;
+    m.sender = (int64_t)sender;
+    m.receiver = (int64_t)receiver;
+    m.timestamp = (int)timestamp;
+    messages[m.msgid] = std::move(m);
+  }
+
+  if (last_msgid > 0) {
+    next_msgid_ = last_msgid < INT_MAX ? last_msgid + 1 : 1;
+  }
+
+  for (auto& it : messages) {
+    Entry e;
+    e.msg = std::move(it.second);
+    e.seq = 0;
+    e.resend = true;
+    entries_.push_back(std::move(e));
+  }
+  journal_acked_ = acked;
+  return complete;
+}
+
+void ImOutbox::set_window(size_t window) {
+  window_ = std::max<size_t>(1, window);
+}
+
+int ImOutbox::Add(IMMessage m) {
+  m.msgid = next_msgid_++;
+  if (next_msgid_ <= 0) {
+    next_msgid_ = 1;
+  }
+  AppendMessage(m);
+
+  Entry e;
+  e.msg = std::move(m);
+  e.seq = 0;
+  e.resend = false;
+  entries_.push_back(std::move(e));
+  return entries_.back().msg.msgid;
+}
+
+const IMMessage* ImOutbox::NextToSend() const {
+  if (in_flight_ >= window_ || in_flight_ >= entries_.size()) {
+    return NULL;
+  }
+  return &entries_[in_flight_].msg;
+}
+
+void ImOutbox::OnSent(int seq) {
+  if (in_flight_ >= entries_.size()) {
+    return;
+  }
+  Entry& e = entries_[in_flight_++];
+  e.seq = seq;
+  if (e.resend) {
+    stats_.resent++;
+  } else {
+    stats_.sent++;
+  }
+}
+
+int ImOutbox::OnAck(int seq) {
+  stats_.acks++;
+  int count = 0;
+  //seq会回绕, 比较差值
+  while (in_flight_ > 0 && (int32_t)((uint32_t)entries_.front().seq -
+                                     (uint32_t)seq) <= 0) {
+    AppendAck(entries_.front().msg.msgid);
+    entries_.pop_front();
+    in_flight_--;
+    count++;
+  }
+  stats_.acked += count;
+  if (count > 0 && journal_) {
+    fflush(journal_);
+    MaybeCompact();
+  }
+  return count;
+}
+
+void ImOutbox::Rewind() {
+  for (size_t i = 0; i < in_flight_; i++) {
+    entries_[i].resend = true;
+  }
+  in_flight_ = 0;
+}
+
+void ImOutbox::AppendMessage(const IMMessage& m) {
+  if (!journal_) {
+    return;
+  }
+  std::string record;
+  EncodeMessage(m, &record);
+  fwrite(record.data(), 1, record.size(), journal_);
+  //消息在发出之前写入日志
+  fflush(journal_);
+}
+
+void ImOutbox::AppendAck(int msgid) {
+  if (!journal_) {
+    return;
+  }
+  std::string record;
+  record.push_back(kRecordAck);
+  Put32(&record, (uint32_t)msgid);
+  fwrite(record.data(), 1, record.size(), journal_);
+  journal_acked_++;
+}
+
+void ImOutbox::MaybeCompact() {
+  if (journal_acked_ < kCompactThreshold || journal_acked_ < entries_.size()) {
+    return;
+  }
+  Compact();
+}
+
+void ImOutbox::Compact() {
+  if (!journal_) {
+    return;
+  }
+  std::string tmp = path_ + ".tmp";
+  FILE* file = fopen(tmp.c_str(), "wb");
+  if (!file) {
+    return;
+  }
+  //保留最后一个msgid, 重启后的msgid不会重复
+  std::string data;
+  data.push_back(kRecordAck);
+  Put32(&data, (uint32_t)(next_msgid_ - 1));
+  for (const Entry& e : entries_) {
+    EncodeMessage(e.msg, &data);
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path_.c_str()) != 0) {
+    remove(tmp.c_str());
+    return;
+  }
+  fclose(journal_);
+  journal_ = fopen(path_.c_str(), "ab");
+  journal_acked_ = 0;
+}
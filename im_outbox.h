@@ -0,0 +1,102 @@
+#ifndef IM_OUTBOX_H
+#define IM_OUTBOX_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <deque>
+#include <string>
+
+struct IMMessage {
+  int64_t sender = 0;
+  int64_t receiver = 0;
+  int timestamp = 0;
+  // Assigned by the outbox. With a journal it continues after the last id
+  // in it; without one it starts at a random value below 2^30, so a
+  // restarted client is very unlikely to reuse a recent (sender, msgid).
+  int msgid = 0;
+  std::string content;
+};
+
+// Outgoing MSG_IM queue with a sliding window. Up to window() messages are
+// on the wire at once; the server acks them with MSG_ACK carrying the frame
+// seq, and since frames travel in order on one connection an ack also covers
+// every earlier frame, so the server may ack a whole batch with one frame.
+//
+// With Open(), every message is appended to a journal file before it is
+// sent and an ack record is appended when it is acked, so messages that were
+// not acked survive a restart. The journal is rewritten with only the
+// pending messages once acked records dominate it.
+//
+// Delivery is at least once: after a reconnect the unacked window is sent
+// again, so receivers should drop repeated (sender, msgid) pairs.
+class ImOutbox {
+ public:
+  struct Stats {
+    int64_t sent = 0;
+    int64_t resent = 0;
+    int64_t acked = 0;
+    // MSG_ACK frames received; acked / acks is the batching factor.
+    int64_t acks = 0;
+  };
+
+  explicit ImOutbox(size_t window);
+  ~ImOutbox();
+
+  // Loads the messages left in the journal at |path| and appends to it from
+  // now on. Returns false if the file can't be opened; the outbox then keeps
+  // working in memory only.
+  bool Open(const std::string& path);
+  void Close();
+
+  size_t window() const { return window_; }
+  void set_window(size_t window);
+
+  // Queues |m|, assigning its msgid, and returns the msgid.
+  int Add(IMMessage m);
+
+  // The next message to send, or NULL when the window is full or nothing is
+  // waiting. Call OnSent() with the seq of the frame it was sent in.
+  const IMMessage* NextToSend() const;
+  void OnSent(int seq);
+
+  // Handles a server ack for the frame |seq| and everything sent before it.
+  // Returns the number of messages acked.
+  int OnAck(int seq);
+
+  // The connection was lost; the in-flight messages are sent again.
+  void Rewind();
+
+  size_t pending() const { return entries_.size(); }
+  size_t in_flight() const { return in_flight_; }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    IMMessage msg;
+    int seq;
+    bool resend;
+  };
+
+  // Returns false if the journal ends in a truncated record.
+  bool Load(FILE* file);
+  void AppendMessage(const IMMessage& m);
+  void AppendAck(int msgid);
+  void MaybeCompact();
+  void Compact();
+
+  size_t window_;
+  //未确认的消息, 前in_flight_条已发出
+  std::deque<Entry> entries_;
+  size_t in_flight_;
+  int next_msgid_;
+
+  std::string path_;
+  FILE* journal_;
+  //日志中已确认的消息数量
+  size_t journal_acked_;
+
+  Stats stats_;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "examples/voip/in_process_transport.h"
+
+#include <utility>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace {
+
+enum {
+  MSG_DRAIN = 1,
+  MSG_SIGNED_IN,
+  MSG_DISCONNECTED,
+};
+
+}  // namespace
+
+InProcessTransport::InProcessTransport(int64_t id, rtc::Thread* thread)
+    : id_(id),
+      thread_(thread),
+      peer_(NULL),
+      observer_(NULL),
+      drain_posted_(false),
+      delivered_(0) {
+}
+
+InProcessTransport::~InProcessTransport() {
+  Disconnect();
+  thread_->Clear(this);
+}
+
+void InProcessTransport::Connect(InProcessTransport* a,
+                                 InProcessTransport* b) {
+  RTC_DCHECK(a->thread_ == b->thread_);
+  RTC_DCHECK(a->thread_->IsCurrent());
+  a->Disconnect();
+  b->Disconnect();
+  a->peer_ = b;
+  b->peer_ = a;
+  a->Post(MSG_SIGNED_IN);
+  b->Post(MSG_SIGNED_IN);
+}
+
+void InProcessTransport::Disconnect() {
+  RTC_DCHECK(thread_->IsCurrent());
+  if (peer_ == NULL) {
+    return;
+  }
+  InProcessTransport* peer = peer_;
+  peer_ = NULL;
+  peer->peer_ = NULL;
+  //与连接断开时一样, 丢弃还没有送达的消息
+  inbound_.clear();
+  peer->inbound_.clear();
+  Post(MSG_DISCONNECTED);
+  peer->Post(MSG_DISCONNECTED);
+}
+
+void InProcessTransport::RegisterObserver(
+    PeerConnectionClientObserver* observer) {
+  RTC_DCHECK(thread_->IsCurrent());
+  observer_ = observer;
+}
+
+bool InProcessTransport::SendRTPayload(int64_t peer_id,
+                                       const RTPayload& payload,
+                                       int peer_caps) {
+  RTC_DCHECK(thread_->IsCurrent());
+  if (peer_ == NULL || peer_id != peer_->id_) {
+    RTC_LOG(WARNING) << "no in-process peer:" << peer_id;
+    return false;
+  }
+
+  Delivery delivery;
+  delivery.sender = id_;
+  delivery.payload = payload;
+  peer_->inbound_.push_back(std::move(delivery));
+  if (!peer_->drain_posted_) {
+    peer_->drain_posted_ = true;
+    peer_->Post(MSG_DRAIN);
+  }
+  return true;
+}
+
+void InProcessTransport::Post(int id) {
+  thread_->Post(RTC_FROM_HERE, this, id);
+}
+
+void InProcessTransport::OnMessage(rtc::Message* msg) {
+  switch (msg->message_id) {
+    case MSG_DRAIN: {
+      drain_posted_ = false;
+      //observer可能在回调中发送或断开, 先取出本批消息
+      std::deque<Delivery> batch;
+      batch.swap(inbound_);
+      for (const Delivery& delivery : batch) {
+        //回调中断开后, 本批余下的消息也不再送达
+        if (observer_ == NULL || peer_ == NULL) {
+          break;
+        }
+        delivered_++;
+        observer_->HandleRTPayload(delivery.sender, id_, delivery.payload);
+      }
+      break;
+    }
+    case MSG_SIGNED_IN:
+      if (observer_ != NULL) {
+        observer_->OnSignedIn();
+      }
+      break;
+    case MSG_DISCONNECTED:
+      if (observer_ != NULL) {
+        observer_->OnDisconnected();
+      }
+      break;
+  }
+}
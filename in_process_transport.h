@@ -0,0 +1,69 @@
+#ifndef IN_PROCESS_TRANSPORT_H
+#define IN_PROCESS_TRANSPORT_H
+
+#include <stdint.h>
+
+#include <deque>
+
+#include "examples/voip/signaling_transport.h"
+#include "rtc_base/thread.h"
+
+// Signaling between two endpoints in the same process, e.g. two Conductors,
+// with no relay, socket or encoding in the path: SendRTPayload() copies the
+// RTPayload into the peer's queue and the peer's observer gets it through
+// HandleRTPayload().
+//
+// Delivery is posted to |thread| rather than made from inside
+// SendRTPayload(), so the observer is never re-entered and sees the same
+// ordering as over the relay. Both ends must live on |thread|, which is
+// also where the observers are called.
+class InProcessTransport : public SignalingTransport,
+                           public rtc::MessageHandler {
+ public:
+  InProcessTransport(int64_t id, rtc::Thread* thread);
+  ~InProcessTransport();
+
+  // Links |a| and |b| to each other and posts OnSignedIn() to both
+  // observers.
+  static void Connect(InProcessTransport* a, InProcessTransport* b);
+  // Unlinks from the peer, dropping what it has not delivered yet, and
+  // posts OnDisconnected() to both observers.
+  void Disconnect();
+
+  int64_t id() const { return id_; }
+  bool is_connected() const { return peer_ != NULL; }
+  // Payloads handed to this end's observer.
+  int64_t delivered() const { return delivered_; }
+
+  // SignalingTransport implementation.
+  void RegisterObserver(PeerConnectionClientObserver* observer) override;
+  // Fails unless |peer_id| is the linked peer's id.
+  bool SendRTPayload(int64_t peer_id, const RTPayload& payload,
+                     int peer_caps) override;
+  // Nothing is buffered on the way, so it is always writable.
+  bool writable() const override { return true; }
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  struct Delivery {
+    int64_t sender = 0;
+    RTPayload payload;
+  };
+
+  void Post(int id);
+
+  int64_t id_;
+  rtc::Thread* thread_;
+  InProcessTransport* peer_;
+  PeerConnectionClientObserver* observer_;
+
+  //对端发来, 等待交给observer_的消息
+  std::deque<Delivery> inbound_;
+  //inbound_从空变为非空时投递一次
+  bool drain_posted_;
+  int64_t delivered_;
+};
+
+#endif
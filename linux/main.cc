@@ -9,11 +9,21 @@
  */
 
 #include <gtk/gtk.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
 
 #include "examples/voip/conductor.h"
+#include "examples/voip/defaults.h"
 #include "examples/voip/linux/main_wnd.h"
-#include "examples/voip/peer_connection_client.h"
+#include "examples/voip/media_engine.h"
+#include "examples/voip/signaling_thread.h"
+#include "examples/voip/trace_replayer.h"
 
+#include "rtc_base/logging.h"
 #include "rtc_base/ssl_adapter.h"
 #include "rtc_base/thread.h"
 
@@ -22,11 +32,20 @@
 #define ID 10
 
 
+// Runs the GLib main context from inside the socket server's Wait(), so the
+// main thread blocks in a single poll() on GLib's fds (X11 connection, idle
+// and timeout sources) until there is a GTK event, a posted message or the
+// next delayed message is due. Posts from other threads interrupt the poll
+// through |wakeup_fd_|.
 class CustomSocketServer : public rtc::PhysicalSocketServer {
  public:
   CustomSocketServer()
-      : wnd_(NULL), client_(NULL) {}
-  virtual ~CustomSocketServer() {}
+      : message_queue_(NULL), wnd_(NULL), client_(NULL), poll_fds_(16) {
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  }
+  virtual ~CustomSocketServer() {
+    close(wakeup_fd_);
+  }
 
   void SetMessageQueue(rtc::Thread* queue) override { message_queue_ = queue; }    
 
@@ -34,31 +53,75 @@ class CustomSocketServer : public rtc::PhysicalSocketServer {
   void set_wnd(GtkMainWnd *wnd) {
         wnd_ = wnd;
   }
-  void set_client(PeerConnectionClient* client) { client_ = client; }
+  void set_client(SignalingThread* client) { client_ = client; }
+
+  // Called from any thread by Thread::Post()/Quit().
+  void WakeUp() override {
+    uint64_t one = 1;
+    ssize_t r = write(wakeup_fd_, &one, sizeof(one));
+    (void)r;
+    rtc::PhysicalSocketServer::WakeUp();
+  }
 
   // Override so that we can also pump the GTK message loop.
   bool Wait(int cms, bool process_io) override {
-    // Pump GTK events.
-    // TODO(henrike): We really should move either the socket server or UI to a
-    // different thread.  Alternatively we could look at merging the two loops
-    // by implementing a dispatcher for the socket server and/or use
-    // g_main_context_set_poll_func.
-    while (gtk_events_pending())
-      gtk_main_iteration();
+    GMainContext* context = g_main_context_default();
+    if (!g_main_context_acquire(context)) {
+      //其他线程拥有GLib上下文, 退回到原来的轮询方式
+      while (gtk_events_pending())
+        gtk_main_iteration();
+      return rtc::PhysicalSocketServer::Wait(cms == -1 ? 10 : std::min(cms, 10),
+                                             process_io);
+    }
+
+    gint priority = 0;
+    g_main_context_prepare(context, &priority);
+
+    gint timeout = -1;
+    gint n = g_main_context_query(context, priority, &timeout,
+                                  poll_fds_.data(), poll_fds_.size());
+    if (n + 1 > static_cast<gint>(poll_fds_.size())) {
+      poll_fds_.resize(n + 1);
+      n = g_main_context_query(context, priority, &timeout,
+                               poll_fds_.data(), n);
+    }
+
+    //取GLib超时和下一个消息到期时间中较早的
+    if (cms != -1 && (timeout < 0 || cms < timeout)) {
+      timeout = cms;
+    }
+
+    GPollFD& wakeup = poll_fds_[n];
+    wakeup.fd = wakeup_fd_;
+    wakeup.events = G_IO_IN;
+    wakeup.revents = 0;
+    g_poll(poll_fds_.data(), n + 1, timeout);
+
+    if (wakeup.revents & G_IO_IN) {
+      uint64_t count;
+      ssize_t r = read(wakeup_fd_, &count, sizeof(count));
+      (void)r;
+    }
+    if (g_main_context_check(context, priority, poll_fds_.data(), n)) {
+      g_main_context_dispatch(context);
+    }
+    g_main_context_release(context);
 
     if (!wnd_->IsWindow() &&
         client_ != NULL &&
         !client_->is_connected()) {
       message_queue_->Quit();
     }
-    return rtc::PhysicalSocketServer::Wait(0 /*cms == -1 ? 1 : cms*/,
-                                           process_io);
+    //主线程不持有socket, 这里只处理已就绪的事件, 不阻塞
+    return rtc::PhysicalSocketServer::Wait(0, process_io);
   }
 
  protected:
   rtc::Thread* message_queue_;    
   GtkMainWnd* wnd_;
-  PeerConnectionClient* client_;
+  SignalingThread* client_;
+  int wakeup_fd_;
+  std::vector<GPollFD> poll_fds_;
 };
 
 int main(int argc, char* argv[]) {
@@ -76,23 +139,51 @@ int main(int argc, char* argv[]) {
 
   rtc::InitializeSSL();
   
-  PeerConnectionClient client;
+  CustomSocketServer socket_server;
+  rtc::AutoSocketServerThread thread(&socket_server);
+
+  //信令在独立的I/O线程上收发
+  SignalingThread client(rtc::Thread::Current());
   std::string token = TOKEN;
   client.setToken(token);
   client.setID(ID);//当前uid
 
-  
-  CustomSocketServer socket_server;
-  rtc::AutoSocketServerThread thread(&socket_server);
+  //媒体线程, ADM和PeerConnectionFactory在进程内只创建一次, 所有通话共享
+  MediaEngine engine;
+  if (!engine.Initialize()) {
+    RTC_LOG(LS_ERROR) << "media engine initialize failed";
+  }
+
   std::string t = std::string(token);
-  GtkMainWnd wnd(&client, rtc::Thread::Current(), ID, t);
+  GtkMainWnd wnd(&client, &engine, rtc::Thread::Current(), ID, t);
   wnd.Create();
   
   socket_server.set_wnd(&wnd);
   socket_server.set_client(&client);
 
-
-  client.Connect();
+  //VOIP_TRACE: 记录信令到trace文件
+  //VOIP_REPLAY: 不连接服务器, 回放trace中收到的信令, VOIP_REPLAY_SPEED倍速
+  std::string trace = GetEnvVarOrDefault("VOIP_TRACE", "");
+  std::string replay = GetEnvVarOrDefault("VOIP_REPLAY", "");
+  TraceReplayer replayer(&wnd);
+  if (!replay.empty()) {
+    if (!replayer.Open(replay)) {
+      RTC_LOG(LS_ERROR) << "can't open trace:" << replay;
+      return 1;
+    }
+    //对方的回复只有在拨号状态下才会处理
+    if (replayer.dial_peer_id() != 0) {
+      wnd.ReplayDial(replayer.dial_peer_id(), replayer.dial_channel_id());
+    } else {
+      RTC_LOG(WARNING) << "no dial in trace, peer messages will be dropped";
+    }
+    replayer.Start(atof(GetEnvVarOrDefault("VOIP_REPLAY_SPEED", "1").c_str()));
+  } else {
+    if (!trace.empty()) {
+      client.StartTrace(trace);
+    }
+    client.Connect();
+  }
   
   thread.Run();
 
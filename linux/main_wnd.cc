@@ -89,9 +89,10 @@ gboolean Draw(GtkWidget* widget, cairo_t* cr, gpointer data) {
 // GtkMainWnd implementation.
 //
 
-GtkMainWnd::GtkMainWnd(PeerConnectionClient *client, rtc::Thread* main_thread,
-                       int64_t uid, std::string& token)
-    : VOIPWnd(client, main_thread, uid, token),
+GtkMainWnd::GtkMainWnd(SignalingTransport* client, MediaEngine* engine,
+                       rtc::Thread* main_thread, int64_t uid,
+                       std::string& token)
+    : VOIPWnd(client, engine, main_thread, uid, token),
       window_(NULL),
       draw_area_(NULL),
       vbox_(NULL),
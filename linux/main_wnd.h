@@ -15,7 +15,7 @@
 #include <string>
 
 #include "examples/voip/voip_wnd.h"
-#include "examples/voip/peer_connection_client.h"
+#include "examples/voip/signaling_transport.h"
 
 // Forward declarations.
 typedef struct _GtkWidget GtkWidget;
@@ -31,8 +31,8 @@ typedef struct _cairo cairo_t;
 // implementation.
 class GtkMainWnd : public VOIPWnd {
  public:
-  GtkMainWnd(PeerConnectionClient *client, rtc::Thread* main_thread,
-             int64_t uid, std::string& token);
+  GtkMainWnd(SignalingTransport* client, MediaEngine* engine,
+             rtc::Thread* main_thread, int64_t uid, std::string& token);
   ~GtkMainWnd();
 
   virtual bool IsWindow();
@@ -0,0 +1,868 @@
+/*
+ * Signaling load generator. Opens N authenticated connections to a relay
+ * (e.g. voip_relay) and drives scripted call traffic between pairs of them:
+ *
+ *   caller                         callee
+ *   DIAL                  ->
+ *                         <-       ACCEPT
+ *   offer + candidates    ->
+ *                         <-       answer + candidates
+ *   ... hold ...
+ *   HANG_UP               ->
+ *   ... think, repeat ...
+ *
+ * while every connection also pings on the Heartbeat schedule. Frames are
+ * built with the client's codec (message.cc, signaling_payload.cc) and read
+ * back through RecvBuffer/SendQueue, so codec regressions show up here too.
+ *
+ * Delivery latency is measured from the moment a MSG_RT is queued by the
+ * sender to the moment the receiver has decoded it. Both ends live in this
+ * process and the relay preserves order per connection, so every receiver
+ * matches frames against its partner's FIFO of send times.
+ *
+ * usage: voip_loadgen [-a ip] [-p port] [-n clients] [-r connects/s]
+ *                     [-d seconds] [-b base uid] [-s sdp bytes]
+ *                     [-c candidates] [-H hold ms] [-T think ms] [-j]
+ *                     [-i stats seconds]
+ *
+ * Tokens are the decimal uid, which voip_relay accepts without -t.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "examples/voip/heartbeat.h"
+#include "examples/voip/message.h"
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/send_queue.h"
+#include "examples/voip/signaling_payload.h"
+
+namespace {
+
+const int kMaxEvents = 256;
+const int kMaxIov = 64;
+const size_t kRecvBufferSize = 16*1024;
+const size_t kMaxRecvBufferSize = HEADER_SIZE + MAX_BODY_SIZE;
+
+const char kCandidate[] =
+    "candidate:1510613869 1 udp 2122260223 192.168.1.101 52718 typ host "
+    "generation 0 ufrag Zq2G network-id 1 network-cost 10";
+
+struct Options {
+  std::string ip = "127.0.0.1";
+  int port = 23000;
+  int clients = 1000;
+  int connect_rate = 2000;
+  int duration = 30;
+  int64_t base_uid = 100000;
+  int sdp_size = 4*1024;
+  int candidates = 8;
+  int hold_ms = 2000;
+  int think_ms = 1000;
+  int version = PAYLOAD_VERSION_TLV;
+  int stats_interval = 5;
+};
+
+volatile sig_atomic_t g_stop = 0;
+
+void OnSignal(int) {
+  g_stop = 1;
+}
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Exact percentiles over a set of samples, in microseconds.
+class LatencyRecorder {
+ public:
+  void Add(int64_t us) { samples_.push_back(us); }
+  size_t count() const { return samples_.size(); }
+  void Clear() { samples_.clear(); }
+
+  void Merge(const LatencyRecorder& other) {
+    samples_.insert(samples_.end(), other.samples_.begin(),
+                    other.samples_.end());
+  }
+
+  // Sorts in place; call once per report.
+  void Summary(int64_t* p50, int64_t* p99, int64_t* p999, int64_t* max) {
+    *p50 = *p99 = *p999 = *max = 0;
+    if (samples_.empty()) {
+      return;
+    }
+    std::sort(samples_.begin(), samples_.end());
+    *p50 = At(0.5);
+    *p99 = At(0.99);
+    *p999 = At(0.999);
+    *max = samples_.back();
+  }
+
+ private:
+  int64_t At(double p) const {
+    size_t i = (size_t)(p * (samples_.size() - 1));
+    return samples_[i];
+  }
+
+  std::vector<int64_t> samples_;
+};
+
+struct Counters {
+  uint64_t connected = 0;
+  uint64_t signed_in = 0;
+  uint64_t disconnected = 0;
+  uint64_t auth_failures = 0;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t bytes_out = 0;
+  uint64_t bytes_in = 0;
+  uint64_t pings = 0;
+  uint64_t pongs = 0;
+  uint64_t calls = 0;
+  //接收到的消息无法与发送记录对应
+  uint64_t unmatched = 0;
+  uint64_t decode_errors = 0;
+};
+
+enum CallState {
+  CALL_IDLE,
+  CALL_DIALING,
+  CALL_ACCEPTED,
+  CALL_OFFERED,
+  CALL_TALKING,
+};
+
+class LoadGen;
+
+class LoadClient {
+ public:
+  LoadClient(LoadGen* gen, int index, int64_t uid, int64_t peer_uid,
+             bool caller, ChunkPool* pool)
+      : gen_(gen),
+        index_(index),
+        uid_(uid),
+        peer_uid_(peer_uid),
+        caller_(caller),
+        fd_(-1),
+        connecting_(false),
+        signed_in_(false),
+        want_write_(false),
+        dirty_(false),
+        seq_(0),
+        recv_buffer_(kRecvBufferSize, kMaxRecvBufferSize),
+        send_queue_(pool),
+        state_(CALL_IDLE),
+        next_ping_us_(0),
+        next_action_us_(0),
+        dial_us_(0),
+        call_count_(0) {}
+
+  int64_t uid() const { return uid_; }
+  int fd() const { return fd_; }
+  bool signed_in() const { return signed_in_; }
+  bool dirty() const { return dirty_; }
+  void set_dirty(bool dirty) { dirty_ = dirty; }
+  const Heartbeat& heartbeat() const { return heartbeat_; }
+
+  // Send times of MSG_RT frames to the partner that it has not decoded yet.
+  std::deque<int64_t>& in_flight() { return in_flight_; }
+
+  bool Connect(const sockaddr_in& addr, int epoll_fd);
+  void OnEvent(uint32_t events);
+  void OnTimer(int64_t now_us);
+  void Flush();
+  void Close();
+
+ private:
+  void OnConnected();
+  void OnReadable();
+  void HandleMessage(const MessageView& m);
+  void HandleRT(const MessageView& m);
+  void SendAuth();
+  void SendPing(int64_t now_us);
+  void SendVOIP(int command);
+  void SendSignal(const char* type, const std::string& sdp);
+  void SendRT(const std::string& content);
+  bool Push(Message& m);
+  void UpdateEvents();
+
+  LoadGen* gen_;
+  int index_;
+  int64_t uid_;
+  int64_t peer_uid_;
+  bool caller_;
+  int fd_;
+  int epoll_fd_;
+  bool connecting_;
+  bool signed_in_;
+  bool want_write_;
+  bool dirty_;
+  int seq_;
+
+  RecvBuffer recv_buffer_;
+  SendQueue send_queue_;
+  Heartbeat heartbeat_;
+  std::deque<int64_t> in_flight_;
+
+  CallState state_;
+  int64_t next_ping_us_;
+  int64_t next_action_us_;
+  int64_t dial_us_;
+  int call_count_;
+};
+
+class LoadGen {
+ public:
+  explicit LoadGen(const Options& options);
+  ~LoadGen();
+
+  const Options& options() const { return options_; }
+  Counters& counters() { return counters_; }
+  LatencyRecorder& delivery() { return delivery_; }
+  LatencyRecorder& call_setup() { return call_setup_; }
+  const std::string& sdp() const { return sdp_; }
+
+  LoadClient* Peer(int64_t uid) {
+    int64_t i = uid - options_.base_uid;
+    if (i < 0 || i >= (int64_t)clients_.size()) {
+      return NULL;
+    }
+    return clients_[i].get();
+  }
+
+  void MarkDirty(LoadClient* client) {
+    if (!client->dirty()) {
+      client->set_dirty(true);
+      dirty_.push_back(client);
+    }
+  }
+
+  bool Run();
+
+ private:
+  void ConnectMore(int64_t now_us);
+  void Report(double seconds, bool final);
+
+  Options options_;
+  int epoll_fd_;
+  sockaddr_in addr_;
+  ChunkPool pool_;
+  std::vector<std::unique_ptr<LoadClient>> clients_;
+  std::vector<LoadClient*> dirty_;
+  int next_connect_;
+  int64_t start_us_;
+
+  std::string sdp_;
+  Counters counters_;
+  Counters last_counters_;
+  //本统计周期的样本, 报告后并入total
+  LatencyRecorder delivery_;
+  LatencyRecorder delivery_total_;
+  LatencyRecorder call_setup_;
+};
+
+bool LoadClient::Connect(const sockaddr_in& addr, int epoll_fd) {
+  epoll_fd_ = epoll_fd;
+  fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    perror("socket");
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd_, (const sockaddr*)&addr, sizeof(addr)) != 0 &&
+      errno != EINPROGRESS) {
+    perror("connect");
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  connecting_ = true;
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLOUT;
+  ev.data.u32 = index_;
+  want_write_ = true;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &ev);
+  return true;
+}
+
+void LoadClient::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd_, NULL);
+  close(fd_);
+  fd_ = -1;
+  if (signed_in_) {
+    gen_->counters().disconnected++;
+  }
+  signed_in_ = false;
+  send_queue_.Clear();
+  recv_buffer_.Clear();
+}
+
+void LoadClient::OnEvent(uint32_t events) {
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    Close();
+    return;
+  }
+  if (connecting_ && (events & EPOLLOUT)) {
+    OnConnected();
+  }
+  if (events & EPOLLIN) {
+    OnReadable();
+  }
+  if (fd_ >= 0 && (events & EPOLLOUT)) {
+    Flush();
+  }
+}
+
+void LoadClient::OnConnected() {
+  connecting_ = false;
+  gen_->counters().connected++;
+  SendAuth();
+}
+
+void LoadClient::OnReadable() {
+  while (fd_ >= 0) {
+    size_t len = 0;
+    char* p = recv_buffer_.WritePtr(&len);
+    if (len == 0) {
+      Close();
+      return;
+    }
+    ssize_t bytes = recv(fd_, p, len, 0);
+    if (bytes == 0) {
+      Close();
+      return;
+    }
+    if (bytes < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        Close();
+      }
+      return;
+    }
+    recv_buffer_.Commit(bytes);
+    gen_->counters().bytes_in += bytes;
+
+    while (fd_ >= 0) {
+      MessageView m;
+      int n = recv_buffer_.PeekMessage(&m);
+      if (n < 0) {
+        gen_->counters().decode_errors++;
+        Close();
+        return;
+      }
+      if (n == 0) {
+        break;
+      }
+      HandleMessage(m);
+      recv_buffer_.Consume(n);
+    }
+
+    if ((size_t)bytes < len) {
+      return;
+    }
+  }
+}
+
+void LoadClient::HandleMessage(const MessageView& m) {
+  int64_t now = NowUs();
+  if (m.cmd == MSG_AUTH_STATUS) {
+    if (m.status != 0) {
+      gen_->counters().auth_failures++;
+      Close();
+      return;
+    }
+    signed_in_ = true;
+    gen_->counters().signed_in++;
+    //登录后立即ping一次, 之后按Heartbeat的间隔
+    next_ping_us_ = now;
+    //错开各呼叫的开始时间
+    next_action_us_ = now + (index_ % 1000) * 1000LL;
+  } else if (m.cmd == MSG_PONG) {
+    if (heartbeat_.OnPong(m.seq, now)) {
+      gen_->counters().pongs++;
+    }
+  } else if (m.cmd == MSG_RT) {
+    HandleRT(m);
+  }
+}
+
+void LoadClient::HandleRT(const MessageView& m) {
+  int64_t now = NowUs();
+  gen_->counters().received++;
+
+  LoadClient* sender = gen_->Peer(m.sender);
+  if (sender != NULL && !sender->in_flight().empty()) {
+    gen_->delivery().Add(now - sender->in_flight().front());
+    sender->in_flight().pop_front();
+  } else {
+    gen_->counters().unmatched++;
+  }
+
+  RTPayload payload;
+  if (!DecodeRTPayload(m.version, m.content, &payload)) {
+    gen_->counters().decode_errors++;
+    return;
+  }
+
+  if (payload.kind == RTPayload::VOIP) {
+    switch (payload.voip.command) {
+      case VOIP_COMMAND_DIAL:
+        if (!caller_) {
+          SendVOIP(VOIP_COMMAND_ACCEPT);
+          state_ = CALL_ACCEPTED;
+        }
+        break;
+      case VOIP_COMMAND_ACCEPT:
+        if (caller_ && state_ == CALL_DIALING) {
+          SendSignal("offer", gen_->sdp());
+          state_ = CALL_OFFERED;
+        }
+        break;
+      case VOIP_COMMAND_HANG_UP:
+        state_ = CALL_IDLE;
+        break;
+      default:
+        break;
+    }
+  } else if (payload.kind == RTPayload::P2P) {
+    if (payload.p2p.type == "offer" && !caller_) {
+      SendSignal("answer", gen_->sdp());
+      state_ = CALL_TALKING;
+    } else if (payload.p2p.type == "answer" && caller_ &&
+               state_ == CALL_OFFERED) {
+      SendVOIP(VOIP_COMMAND_CONNECTED);
+      gen_->call_setup().Add(now - dial_us_);
+      gen_->counters().calls++;
+      state_ = CALL_TALKING;
+      next_action_us_ = now + gen_->options().hold_ms * 1000LL;
+    }
+  }
+}
+
+void LoadClient::OnTimer(int64_t now_us) {
+  if (!signed_in_) {
+    return;
+  }
+
+  if (now_us >= next_ping_us_) {
+    SendPing(now_us);
+    next_ping_us_ = now_us + heartbeat_.interval_ms() * 1000LL;
+  }
+
+  if (!caller_ || now_us < next_action_us_) {
+    return;
+  }
+  LoadClient* peer = gen_->Peer(peer_uid_);
+  if (state_ == CALL_IDLE) {
+    if (peer != NULL && peer->signed_in()) {
+      call_count_++;
+      dial_us_ = now_us;
+      SendVOIP(VOIP_COMMAND_DIAL);
+      state_ = CALL_DIALING;
+    }
+    //应答超时后重拨
+    next_action_us_ = now_us + 10*1000*1000LL;
+  } else if (state_ == CALL_TALKING) {
+    SendVOIP(VOIP_COMMAND_HANG_UP);
+    state_ = CALL_IDLE;
+    next_action_us_ = now_us + gen_->options().think_ms * 1000LL;
+  } else {
+    //对方没有回应, 重新开始
+    state_ = CALL_IDLE;
+  }
+}
+
+void LoadClient::SendAuth() {
+  Message m;
+  m.cmd = MSG_AUTH_TOKEN;
+  m.seq = ++seq_;
+  m.platform_id = PLATFORM_LINUX;
+  m.token = std::to_string(uid_);
+  m.device_id = "loadgen";
+  Push(m);
+}
+
+void LoadClient::SendPing(int64_t now_us) {
+  Message m;
+  m.cmd = MSG_PING;
+  m.seq = ++seq_;
+  if (Push(m)) {
+    heartbeat_.OnPingSent(m.seq, now_us);
+    gen_->counters().pings++;
+  }
+}
+
+void LoadClient::SendVOIP(int command) {
+  VOIPCommand voip;
+  voip.command = command;
+  voip.channel_id = "loadgen-" + std::to_string(uid_) + "-" +
+                    std::to_string(call_count_);
+  voip.caps = PAYLOAD_CAPS;
+  SendRT(EncodeVOIPCommand(voip, gen_->options().version));
+}
+
+void LoadClient::SendSignal(const char* type, const std::string& sdp) {
+  P2PSignal signal;
+  signal.type = type;
+  signal.sdp = sdp;
+  SendRT(EncodeP2PSignal(signal, gen_->options().version, PAYLOAD_CAPS));
+
+  //每个候选单独发送, 模拟trickle ICE的突发
+  for (int i = 0; i < gen_->options().candidates; i++) {
+    P2PSignal candidate;
+    candidate.type = "candidate";
+    candidate.sdp_mid = "0";
+    candidate.sdp_mline_index = 0;
+    candidate.candidate = kCandidate;
+    SendRT(EncodeP2PSignal(candidate, gen_->options().version, PAYLOAD_CAPS));
+  }
+}
+
+void LoadClient::SendRT(const std::string& content) {
+  Message m;
+  m.cmd = MSG_RT;
+  m.seq = ++seq_;
+  m.version = gen_->options().version;
+  m.sender = uid_;
+  m.receiver = peer_uid_;
+  m.content = content;
+  if (Push(m)) {
+    in_flight_.push_back(NowUs());
+    gen_->counters().sent++;
+  }
+}
+
+bool LoadClient::Push(Message& m) {
+  if (fd_ < 0 || !send_queue_.Push(m)) {
+    return false;
+  }
+  gen_->MarkDirty(this);
+  return true;
+}
+
+void LoadClient::Flush() {
+  if (connecting_) {
+    return;
+  }
+  while (fd_ >= 0 && !send_queue_.empty()) {
+    SendQueue::Segment segs[kMaxIov];
+    int count = send_queue_.Gather(segs, kMaxIov);
+    iovec iov[kMaxIov];
+    for (int i = 0; i < count; i++) {
+      iov[i].iov_base = const_cast<char*>(segs[i].data);
+      iov[i].iov_len = segs[i].size;
+    }
+    ssize_t n = writev(fd_, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        Close();
+        return;
+      }
+      break;
+    }
+    send_queue_.Consume(n);
+    gen_->counters().bytes_out += n;
+  }
+  UpdateEvents();
+}
+
+void LoadClient::UpdateEvents() {
+  if (fd_ < 0) {
+    return;
+  }
+  bool want_write = !send_queue_.empty();
+  if (want_write == want_write_) {
+    return;
+  }
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  ev.data.u32 = index_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd_, &ev);
+  want_write_ = want_write;
+}
+
+// An offer-sized SDP; the exact text does not matter to the relay.
+std::string MakeSdp(int size) {
+  std::string sdp =
+      "v=0\r\n"
+      "o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+      "s=-\r\n"
+      "t=0 0\r\n"
+      "a=group:BUNDLE 0 1\r\n"
+      "m=audio 9 UDP/TLS/RTP/SAVPF 111 103 104 9 0 8 106 105 13 110\r\n"
+      "c=IN IP4 0.0.0.0\r\n"
+      "a=rtcp-mux\r\n"
+      "a=rtpmap:111 opus/48000/2\r\n"
+      "a=fmtp:111 minptime=10;useinbandfec=1\r\n";
+  int line = 0;
+  while ((int)sdp.size() < size) {
+    sdp += "a=ssrc:" + std::to_string(3735928559u - line) +
+           " cname:loadgen" + std::to_string(line) + "\r\n";
+    line++;
+  }
+  return sdp;
+}
+
+LoadGen::LoadGen(const Options& options)
+    : options_(options),
+      epoll_fd_(-1),
+      pool_(16*1024, 4096),
+      next_connect_(0),
+      start_us_(0) {
+  sdp_ = MakeSdp(options_.sdp_size);
+  for (int i = 0; i < options_.clients; i++) {
+    int64_t uid = options_.base_uid + i;
+    //相邻的两个客户端互为通话对象, 偶数为主叫
+    int64_t peer = options_.base_uid + (i ^ 1);
+    if (peer - options_.base_uid >= options_.clients) {
+      peer = uid;
+    }
+    bool caller = (i & 1) == 0 && peer != uid;
+    clients_.emplace_back(new LoadClient(this, i, uid, peer, caller, &pool_));
+  }
+}
+
+LoadGen::~LoadGen() {
+  for (auto& client : clients_) {
+    client->Close();
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+void LoadGen::ConnectMore(int64_t now_us) {
+  int64_t due = (now_us - start_us_) * options_.connect_rate / 1000000 + 1;
+  while (next_connect_ < (int)clients_.size() && next_connect_ < due) {
+    if (!clients_[next_connect_]->Connect(addr_, epoll_fd_)) {
+      //fd不足等, 停止继续建立连接
+      next_connect_ = clients_.size();
+      return;
+    }
+    next_connect_++;
+  }
+}
+
+bool LoadGen::Run() {
+  memset(&addr_, 0, sizeof(addr_));
+  addr_.sin_family = AF_INET;
+  addr_.sin_port = htons(options_.port);
+  if (inet_pton(AF_INET, options_.ip.c_str(), &addr_.sin_addr) != 1) {
+    fprintf(stderr, "invalid address:%s\n", options_.ip.c_str());
+    return false;
+  }
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    perror("epoll_create1");
+    return false;
+  }
+
+  start_us_ = NowUs();
+  int64_t end_us = start_us_ + options_.duration * 1000000LL;
+  int64_t last_report = start_us_;
+  int64_t next_timer = start_us_;
+  epoll_event events[kMaxEvents];
+
+  while (!g_stop) {
+    int64_t now = NowUs();
+    if (now >= end_us) {
+      break;
+    }
+    ConnectMore(now);
+
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, 1);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      clients_[events[i].data.u32]->OnEvent(events[i].events);
+    }
+
+    now = NowUs();
+    if (now >= next_timer) {
+      for (auto& client : clients_) {
+        client->OnTimer(now);
+      }
+      next_timer = now + 1000;
+    }
+
+    for (size_t i = 0; i < dirty_.size(); i++) {
+      dirty_[i]->set_dirty(false);
+      dirty_[i]->Flush();
+    }
+    dirty_.clear();
+
+    if (options_.stats_interval > 0 &&
+        now - last_report >= options_.stats_interval * 1000000LL) {
+      Report((now - last_report) / 1e6, false);
+      last_report = now;
+    }
+  }
+
+  Report((NowUs() - start_us_) / 1e6, true);
+  return true;
+}
+
+void LoadGen::Report(double seconds, bool final) {
+  if (seconds <= 0) {
+    return;
+  }
+
+  int64_t p50, p99, p999, max;
+  if (!final) {
+    const Counters& c = counters_;
+    const Counters& l = last_counters_;
+    delivery_.Summary(&p50, &p99, &p999, &max);
+    printf("signed_in:%llu sent:%.0f/s recv:%.0f/s out:%.1fMB/s "
+           "in:%.1fMB/s calls:%.1f/s delivery p50:%.2fms p99:%.2fms "
+           "p999:%.2fms max:%.2fms\n",
+           (unsigned long long)(c.signed_in - c.disconnected),
+           (c.sent - l.sent) / seconds, (c.received - l.received) / seconds,
+           (c.bytes_out - l.bytes_out) / seconds / (1024 * 1024),
+           (c.bytes_in - l.bytes_in) / seconds / (1024 * 1024),
+           (c.calls - l.calls) / seconds, p50 / 1000.0, p99 / 1000.0,
+           p999 / 1000.0, max / 1000.0);
+    fflush(stdout);
+    delivery_total_.Merge(delivery_);
+    delivery_.Clear();
+    last_counters_ = counters_;
+    return;
+  }
+
+  delivery_total_.Merge(delivery_);
+  delivery_.Clear();
+  const Counters& c = counters_;
+  printf("\n=== %d clients, %.1fs ===\n", options_.clients, seconds);
+  printf("connected:%llu signed_in:%llu disconnected:%llu "
+         "auth_failures:%llu\n",
+         (unsigned long long)c.connected, (unsigned long long)c.signed_in,
+         (unsigned long long)c.disconnected,
+         (unsigned long long)c.auth_failures);
+  printf("MSG_RT sent:%llu (%.0f/s) received:%llu (%.0f/s) "
+         "unmatched:%llu decode_errors:%llu\n",
+         (unsigned long long)c.sent, c.sent / seconds,
+         (unsigned long long)c.received, c.received / seconds,
+         (unsigned long long)c.unmatched,
+         (unsigned long long)c.decode_errors);
+  printf("bytes out:%.1fMB/s in:%.1fMB/s\n",
+         c.bytes_out / seconds / (1024 * 1024),
+         c.bytes_in / seconds / (1024 * 1024));
+
+  delivery_total_.Summary(&p50, &p99, &p999, &max);
+  printf("delivery latency  p50:%.2fms p99:%.2fms p999:%.2fms max:%.2fms "
+         "(%zu samples)\n",
+         p50 / 1000.0, p99 / 1000.0, p999 / 1000.0, max / 1000.0,
+         delivery_total_.count());
+  call_setup_.Summary(&p50, &p99, &p999, &max);
+  printf("call setup        p50:%.2fms p99:%.2fms p999:%.2fms max:%.2fms "
+         "(%llu calls)\n",
+         p50 / 1000.0, p99 / 1000.0, p999 / 1000.0, max / 1000.0,
+         (unsigned long long)c.calls);
+
+  LatencyRecorder rtt;
+  uint64_t lost = 0;
+  for (auto& client : clients_) {
+    const RttStats& stats = client->heartbeat().stats();
+    if (stats.samples > 0) {
+      rtt.Add(stats.srtt_us);
+    }
+    lost += stats.lost;
+  }
+  rtt.Summary(&p50, &p99, &p999, &max);
+  printf("ping srtt         p50:%.2fms p99:%.2fms max:%.2fms "
+         "(pings:%llu pongs:%llu lost:%llu)\n",
+         p50 / 1000.0, p99 / 1000.0, max / 1000.0,
+         (unsigned long long)c.pings, (unsigned long long)c.pongs,
+         (unsigned long long)lost);
+}
+
+void RaiseFdLimit(int clients) {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return;
+  }
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if ((int64_t)limit.rlim_cur < clients + 16) {
+    fprintf(stderr, "warning: open file limit %llu < %d clients\n",
+            (unsigned long long)limit.rlim_cur, clients);
+  }
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-a ip] [-p port] [-n clients] [-r connects/s] "
+          "[-d seconds] [-b base uid] [-s sdp bytes] [-c candidates] "
+          "[-H hold ms] [-T think ms] [-j] [-i stats seconds]\n",
+          name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "a:p:n:r:d:b:s:c:H:T:ji:h")) != -1) {
+    switch (opt) {
+      case 'a': options.ip = optarg; break;
+      case 'p': options.port = atoi(optarg); break;
+      case 'n': options.clients = std::max(1, atoi(optarg)); break;
+      case 'r': options.connect_rate = std::max(1, atoi(optarg)); break;
+      case 'd': options.duration = atoi(optarg); break;
+      case 'b': options.base_uid = atoll(optarg); break;
+      case 's': options.sdp_size = atoi(optarg); break;
+      case 'c': options.candidates = atoi(optarg); break;
+      case 'H': options.hold_ms = atoi(optarg); break;
+      case 'T': options.think_ms = atoi(optarg); break;
+      case 'j': options.version = PAYLOAD_VERSION_JSON; break;
+      case 'i': options.stats_interval = atoi(optarg); break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if (options.base_uid <= 0) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  RaiseFdLimit(options.clients);
+
+  LoadGen gen(options);
+  return gen.Run() ? 0 : 1;
+}
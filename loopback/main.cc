@@ -0,0 +1,495 @@
+/*
+ * Makes -n calls between two Conductors in one process. Their signaling
+ * goes through a pair of InProcessTransports joined with
+ * InProcessTransport::Connect(), not the relay, and media uses one shared
+ * MediaEngine. The caller sends an offer with ConnectToPeer(). The callee's
+ * Conductor answers from OnMessageFromPeer(), and candidates go both ways
+ * until ICE connects on loopback. Both ends then hang up, and the next
+ * call starts -w ms later.
+ *
+ * For every call it prints:
+ *  - connect: from ConnectToPeer() until both ends reported ICE connected;
+ *  - setup: Conductor::setup_us() of caller and callee, the time each
+ *    spent creating its PeerConnection and tracks;
+ *  - the payloads each transport delivered.
+ * A summary with averages follows.
+ *
+ * With -f every Conductor gets a MediaEngine of its own that is created for
+ * the call, which is what each call paid before the engine was shared:
+ * starting the network, worker and signaling threads, creating the ADM and
+ * the PeerConnectionFactory, then the PeerConnection. setup_us() includes
+ * all of it, because InitializePeerConnection() initializes the engine.
+ * Comparing setup with and without -f gives the saving of the shared
+ * engine. The engines of a call are destroyed before the next call starts.
+ *
+ * With -p each endpoint keeps a PeerConnectionPool of that size, started
+ * once signed in as VOIPWnd does, and the Conductors take their
+ * PeerConnection from it. Every call then shows which ends got a warm
+ * connection; the summary splits setup and connect times by that and
+ * prints the pools' hits, misses, created and expired connections. -w
+ * should leave the pool time to refill and gather between calls.
+ *
+ * usage: voip_loopback [-n calls] [-w ms between calls] [-t timeout s] [-f]
+ *                      [-p pool size]
+ *
+ * The ICE servers are the ones every call uses, see
+ * CreateRTCConfiguration(); without network access only host candidates
+ * are gathered, which is enough on loopback. Exits with 1 if a call did
+ * not connect within the timeout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "examples/voip/conductor.h"
+#include "examples/voip/in_process_transport.h"
+#include "examples/voip/media_engine.h"
+#include "examples/voip/peer_connection_pool.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/ref_counted_object.h"
+#include "rtc_base/ssl_adapter.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+const int64_t kCallerId = 1;
+const int64_t kCalleeId = 2;
+const int kCandidateBatchWindow = 50;
+
+struct Options {
+  int calls = 10;
+  int wait_ms = 1000;
+  int timeout = 10;
+  bool engine_per_call = false;
+  int pool_size = 0;
+};
+
+enum {
+  MSG_START_CALL = 0,
+  MSG_TIMEOUT,
+  MSG_QUIT,
+  //MSG_CONNECTED + 2*call + side
+  MSG_CONNECTED,
+};
+
+// Conductor that posts MSG_CONNECTED for its |call| and |side| to
+// |handler| on the main thread once ICE connected.
+class LoopbackConductor : public Conductor {
+ public:
+  LoopbackConductor(SignalingTransport* client,
+                    MediaEngine* engine,
+                    rtc::Thread* main_thread,
+                    int64_t uid,
+                    std::string& token,
+                    rtc::MessageHandler* handler,
+                    int call,
+                    int side)
+      : Conductor(client, engine, main_thread, uid, token),
+        handler_(handler),
+        call_(call),
+        side_(side) {}
+
+  //在媒体信令线程上回调
+  void OnIceConnectionChange(
+      webrtc::PeerConnectionInterface::IceConnectionState new_state) override {
+    if (new_state ==
+            webrtc::PeerConnectionInterface::kIceConnectionConnected ||
+        new_state ==
+            webrtc::PeerConnectionInterface::kIceConnectionCompleted) {
+      main_thread_->Post(RTC_FROM_HERE, handler_,
+                         MSG_CONNECTED + 2 * call_ + side_);
+    }
+  }
+
+ private:
+  rtc::MessageHandler* handler_;
+  int call_;
+  int side_;
+};
+
+// One end of the call: hands the peer's p2p messages to the Conductor of
+// the current call, as VOIPWnd does.
+class Endpoint : public PeerConnectionClientObserver {
+ public:
+  Endpoint(int64_t id, rtc::Thread* thread)
+      : transport_(id, thread), conductor_(NULL), signed_in_(false) {
+    transport_.RegisterObserver(this);
+  }
+
+  ~Endpoint() { transport_.RegisterObserver(NULL); }
+
+  // Keeps |size| warm PeerConnections from |engine| once signed in.
+  void EnablePool(MediaEngine* engine, rtc::Thread* thread, int size,
+                  const std::string& token) {
+    pool_.reset(new PeerConnectionPool(engine, thread));
+    pool_->set_configuration(CreateRTCConfiguration(transport_.id(), token));
+    pool_->set_size(size);
+  }
+
+  InProcessTransport* transport() { return &transport_; }
+  PeerConnectionPool* pool() { return pool_.get(); }
+  bool signed_in() const { return signed_in_; }
+  Conductor* conductor() { return conductor_; }
+
+  void set_conductor(Conductor* conductor) { conductor_ = conductor; }
+
+  // PeerConnectionClientObserver implementation.
+  void OnSignedIn() override {
+    signed_in_ = true;
+    if (pool_) {
+      pool_->Start();
+    }
+  }
+  void OnDisconnected() override { signed_in_ = false; }
+  void OnServerConnectionFailure() override {}
+  //InProcessTransport不编码, 只会回调HandleRTPayload
+  void HandleRTMessage(int64_t sender,
+                       int64_t receiver,
+                       int version,
+                       absl::string_view content) override {}
+  void HandleRTPayload(int64_t sender,
+                       int64_t receiver,
+                       const RTPayload& payload) override {
+    if (conductor_ != NULL && payload.kind == RTPayload::P2P) {
+      conductor_->OnMessageFromPeer(sender, payload.p2p);
+    }
+  }
+
+ private:
+  InProcessTransport transport_;
+  //在共享的MediaEngine之前释放
+  std::unique_ptr<PeerConnectionPool> pool_;
+  Conductor* conductor_;
+  bool signed_in_;
+};
+
+struct CallResult {
+  bool connected = false;
+  int64_t connect_us = 0;
+  int64_t caller_setup_us = 0;
+  int64_t callee_setup_us = 0;
+  // The end took a warm PeerConnection from its pool.
+  bool caller_pooled = false;
+  bool callee_pooled = false;
+};
+
+// Setup and connect times of the calls in one group, e.g. those where both
+// ends took a pooled connection.
+struct Summary {
+  int calls = 0;
+  int setups = 0;
+  int64_t connect_sum = 0;
+  int64_t connect_max = 0;
+  int64_t setup_sum = 0;
+
+  void AddSetup(int64_t us) {
+    setups++;
+    setup_sum += us;
+  }
+
+  void AddCall(const CallResult& result) {
+    calls++;
+    connect_sum += result.connect_us;
+    connect_max = std::max(connect_max, result.connect_us);
+  }
+
+  void Print(const char* label) const {
+    if (setups > 0) {
+      printf("%s setup avg:%.2fms over %d\n", label,
+             setup_sum / 1000.0 / setups, setups);
+    }
+    if (calls > 0) {
+      printf("%s connect avg:%.2fms max:%.2fms over %d calls\n", label,
+             connect_sum / 1000.0 / calls, connect_max / 1000.0, calls);
+    }
+  }
+};
+
+class Loopback : public rtc::MessageHandler {
+ public:
+  Loopback(MediaEngine* engine, rtc::Thread* thread, const Options& options)
+      : engine_(engine),
+        thread_(thread),
+        options_(options),
+        caller_(kCallerId, thread),
+        callee_(kCalleeId, thread),
+        token_("loopback"),
+        call_(-1),
+        start_us_(0),
+        connected_{false, false},
+        pool_hits_{0, 0} {
+    if (options_.pool_size > 0) {
+      caller_.EnablePool(engine_, thread_, options_.pool_size, token_);
+      callee_.EnablePool(engine_, thread_, options_.pool_size, token_);
+    }
+  }
+
+  void Start() {
+    InProcessTransport::Connect(caller_.transport(), callee_.transport());
+    //OnSignedIn()已经先投递
+    thread_->Post(RTC_FROM_HERE, this, MSG_START_CALL);
+  }
+
+  bool Finish() {
+    Summary all;
+    Summary pooled;
+    Summary created;
+    Summary both_pooled;
+    for (const CallResult& result : results_) {
+      if (!result.connected) {
+        continue;
+      }
+      all.AddCall(result);
+      all.AddSetup(result.caller_setup_us);
+      all.AddSetup(result.callee_setup_us);
+      (result.caller_pooled ? pooled : created).AddSetup(
+          result.caller_setup_us);
+      (result.callee_pooled ? pooled : created).AddSetup(
+          result.callee_setup_us);
+      (result.caller_pooled && result.callee_pooled ? both_pooled : created)
+          .AddCall(result);
+    }
+    printf("=== %d of %zu calls connected, %s ===\n", all.calls,
+           results_.size(),
+           options_.engine_per_call ? "media engine per call"
+                                    : "shared media engine");
+    all.Print("all");
+    if (options_.pool_size > 0) {
+      pooled.Print("pooled");
+      created.Print("created");
+      both_pooled.Print("both pooled");
+      Endpoint* endpoints[] = {&caller_, &callee_};
+      const char* names[] = {"caller", "callee"};
+      for (int side = 0; side < 2; side++) {
+        const PeerConnectionPool::Stats& stats =
+            endpoints[side]->pool()->stats();
+        printf("%s pool hits:%lld misses:%lld created:%lld expired:%lld "
+               "warm:%d\n",
+               names[side], (long long)stats.hits, (long long)stats.misses,
+               (long long)stats.created, (long long)stats.expired,
+               endpoints[side]->pool()->warm());
+      }
+    }
+    if (options_.engine_per_call) {
+      int engines = 0;
+      int64_t initialize_sum = 0;
+      for (int64_t us : engine_initialize_us_) {
+        if (us > 0) {
+          engines++;
+          initialize_sum += us;
+        }
+      }
+      printf("media engine initialize avg:%.2fms over %d engines\n",
+             engines > 0 ? initialize_sum / 1000.0 / engines : 0.0, engines);
+    } else {
+      printf("media engine initialize:%.2fms once\n",
+             engine_->initialize_us() / 1000.0);
+    }
+    return all.calls == (int)results_.size() &&
+           (int)results_.size() == options_.calls;
+  }
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override {
+    switch (msg->message_id) {
+      case MSG_START_CALL:
+        StartCall();
+        break;
+      case MSG_TIMEOUT:
+        RTC_LOG(WARNING) << "call " << call_ << " did not connect";
+        EndCall();
+        break;
+      case MSG_QUIT:
+        thread_->Clear(this);
+        thread_->Quit();
+        break;
+      default: {
+        int id = (int)msg->message_id - MSG_CONNECTED;
+        //上一个通话迟到的通知
+        if (id / 2 != call_ || conductors_.empty()) {
+          break;
+        }
+        connected_[id % 2] = true;
+        if (connected_[0] && connected_[1]) {
+          CallResult& result = results_.back();
+          result.connected = true;
+          result.connect_us = rtc::TimeMicros() - start_us_;
+          EndCall();
+        }
+        break;
+      }
+    }
+  }
+
+ private:
+  void StartCall() {
+    if (!caller_.signed_in() || !callee_.signed_in()) {
+      fprintf(stderr, "in-process transports not signed in\n");
+      thread_->Post(RTC_FROM_HERE, this, MSG_QUIT);
+      return;
+    }
+    call_++;
+    connected_[0] = false;
+    connected_[1] = false;
+    results_.push_back(CallResult());
+    //上一个通话的PeerConnection已经释放
+    call_engines_.clear();
+
+    Endpoint* endpoints[] = {&caller_, &callee_};
+    for (int side = 0; side < 2; side++) {
+      MediaEngine* engine = engine_;
+      if (options_.engine_per_call) {
+        //在InitializePeerConnection()中初始化, 计入setup_us()
+        call_engines_.emplace_back(new MediaEngine());
+        engine = call_engines_.back().get();
+      }
+      LoopbackConductor* conductor =
+          new rtc::RefCountedObject<LoopbackConductor>(
+              endpoints[side]->transport(), engine, thread_,
+              endpoints[side]->transport()->id(), token_, this, call_, side);
+      conductor->AddRef();
+      conductor->SetLocalRenderer(NULL);
+      conductor->SetRemoteRenderer(NULL);
+      conductor->set_peer_caps(PAYLOAD_CAPS);
+      conductor->set_candidate_batch_window(kCandidateBatchWindow);
+      if (endpoints[side]->pool()) {
+        conductor->set_peer_connection_pool(endpoints[side]->pool());
+        pool_hits_[side] = endpoints[side]->pool()->stats().hits;
+      }
+      endpoints[side]->set_conductor(conductor);
+      conductors_.push_back(conductor);
+    }
+
+    start_us_ = rtc::TimeMicros();
+    //被叫方在收到offer时创建PeerConnection
+    caller_.conductor()->ConnectToPeer(kCalleeId);
+    thread_->PostDelayed(RTC_FROM_HERE, options_.timeout * 1000, this,
+                         MSG_TIMEOUT);
+  }
+
+  void EndCall() {
+    thread_->Clear(this, MSG_TIMEOUT);
+    CallResult& result = results_.back();
+    result.caller_setup_us = conductors_[0]->setup_us();
+    result.callee_setup_us = conductors_[1]->setup_us();
+    if (options_.pool_size > 0) {
+      result.caller_pooled = caller_.pool()->stats().hits > pool_hits_[0];
+      result.callee_pooled = callee_.pool()->stats().hits > pool_hits_[1];
+    }
+    printf("call %d: %s connect:%.2fms setup caller:%.2fms%s "
+           "callee:%.2fms%s delivered caller:%lld callee:%lld\n",
+           call_, result.connected ? "connected" : "FAILED",
+           result.connect_us / 1000.0, result.caller_setup_us / 1000.0,
+           result.caller_pooled ? " (pooled)" : "",
+           result.callee_setup_us / 1000.0,
+           result.callee_pooled ? " (pooled)" : "",
+           (long long)caller_.transport()->delivered(),
+           (long long)callee_.transport()->delivered());
+    fflush(stdout);
+
+    caller_.set_conductor(NULL);
+    callee_.set_conductor(NULL);
+    for (Conductor* conductor : conductors_) {
+      conductor->Close();
+      conductor->Release();
+    }
+    conductors_.clear();
+    for (const auto& engine : call_engines_) {
+      engine_initialize_us_.push_back(engine->initialize_us());
+    }
+
+    if ((int)results_.size() < options_.calls) {
+      thread_->PostDelayed(RTC_FROM_HERE, options_.wait_ms, this,
+                           MSG_START_CALL);
+    } else {
+      thread_->Post(RTC_FROM_HERE, this, MSG_QUIT);
+    }
+  }
+
+  MediaEngine* engine_;
+  rtc::Thread* thread_;
+  Options options_;
+  Endpoint caller_;
+  Endpoint callee_;
+  std::string token_;
+  int call_;
+  int64_t start_us_;
+  bool connected_[2];
+  //通话开始时各端池的hits
+  int64_t pool_hits_[2];
+  std::vector<Conductor*> conductors_;
+  // -f: the engines of the current call and the Initialize() time of all.
+  std::vector<std::unique_ptr<MediaEngine>> call_engines_;
+  std::vector<int64_t> engine_initialize_us_;
+  std::vector<CallResult> results_;
+};
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-n calls] [-w ms between calls] [-t timeout s] [-f] "
+          "[-p pool size]\n",
+          name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:w:t:fp:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        options.calls = atoi(optarg);
+        break;
+      case 'w':
+        options.wait_ms = atoi(optarg);
+        break;
+      case 't':
+        options.timeout = atoi(optarg);
+        break;
+      case 'f':
+        options.engine_per_call = true;
+        break;
+      case 'p':
+        options.pool_size = atoi(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  //池中的连接来自共享的engine
+  if (options.calls <= 0 || options.wait_ms < 0 || options.timeout <= 0 ||
+      options.pool_size < 0 ||
+      (options.pool_size > 0 && options.engine_per_call)) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  rtc::InitializeSSL();
+  rtc::PhysicalSocketServer socket_server;
+  rtc::AutoSocketServerThread thread(&socket_server);
+
+  bool ok = false;
+  {
+    MediaEngine engine;
+    if (!options.engine_per_call && !engine.Initialize()) {
+      fprintf(stderr, "media engine initialize failed\n");
+      return 1;
+    }
+    Loopback loopback(&engine, &thread, options);
+    loopback.Start();
+    thread.Run();
+    ok = loopback.Finish();
+  }
+  rtc::CleanupSSL();
+  return ok ? 0 : 1;
+}
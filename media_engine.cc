@@ -0,0 +1,79 @@
+#include "examples/voip/media_engine.h"
+
+#include "api/audio_codecs/builtin_audio_decoder_factory.h"
+#include "api/audio_codecs/builtin_audio_encoder_factory.h"
+#include "api/create_peerconnection_factory.h"
+#include "api/task_queue/default_task_queue_factory.h"
+#include "api/video_codecs/builtin_video_decoder_factory.h"
+#include "api/video_codecs/builtin_video_encoder_factory.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+MediaEngine::MediaEngine() : initialize_us_(0) {
+}
+
+MediaEngine::~MediaEngine() {
+  //先释放factory, 再在工作线程上释放adm, 最后停止线程
+  factory_ = NULL;
+  if (adm_) {
+    worker_thread_->Invoke<void>(RTC_FROM_HERE, [this] { adm_ = NULL; });
+  }
+}
+
+bool MediaEngine::Initialize() {
+  if (factory_) {
+    return true;
+  }
+  int64_t start = rtc::TimeMicros();
+
+  if (!network_thread_) {
+    network_thread_ = rtc::Thread::CreateWithSocketServer();
+    network_thread_->SetName("media_network", nullptr);
+    worker_thread_ = rtc::Thread::Create();
+    worker_thread_->SetName("media_worker", nullptr);
+    signaling_thread_ = rtc::Thread::Create();
+    signaling_thread_->SetName("media_signaling", nullptr);
+    if (!network_thread_->Start() || !worker_thread_->Start() ||
+        !signaling_thread_->Start()) {
+      RTC_LOG(LS_ERROR) << "start media threads error";
+      network_thread_.reset();
+      worker_thread_.reset();
+      signaling_thread_.reset();
+      return false;
+    }
+    task_queue_factory_ = webrtc::CreateDefaultTaskQueueFactory();
+  }
+
+  if (!adm_) {
+    //ADM只能在工作线程上创建
+    adm_ = worker_thread_->Invoke<rtc::scoped_refptr<webrtc::AudioDeviceModule>>(
+        RTC_FROM_HERE, [this] {
+          return webrtc::AudioDeviceModule::Create(
+              webrtc::AudioDeviceModule::kPlatformDefaultAudio,
+              task_queue_factory_.get());
+        });
+    if (!adm_) {
+      RTC_LOG(WARNING) << "create audio device module error";
+      return false;
+    }
+  }
+
+  factory_ = webrtc::CreatePeerConnectionFactory(
+      network_thread_.get(),
+      worker_thread_.get(),
+      signaling_thread_.get(),
+      adm_,
+      webrtc::CreateBuiltinAudioEncoderFactory(),
+      webrtc::CreateBuiltinAudioDecoderFactory(),
+      webrtc::CreateBuiltinVideoEncoderFactory(),
+      webrtc::CreateBuiltinVideoDecoderFactory(),
+      nullptr, nullptr);
+  if (!factory_) {
+    RTC_LOG(WARNING) << "Failed to initialize PeerConnectionFactory";
+    return false;
+  }
+
+  initialize_us_ = rtc::TimeMicros() - start;
+  RTC_LOG(INFO) << "media engine initialized in " << initialize_us_ << "us";
+  return true;
+}
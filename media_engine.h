@@ -0,0 +1,53 @@
+#ifndef MEDIA_ENGINE_H
+#define MEDIA_ENGINE_H
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "api/peer_connection_interface.h"
+#include "api/scoped_refptr.h"
+#include "api/task_queue/task_queue_factory.h"
+#include "modules/audio_device/include/audio_device.h"
+#include "rtc_base/thread.h"
+
+// The media stack every call shares, kept for the life of the process: the
+// network, worker and signaling threads, the audio device module and the
+// PeerConnectionFactory with its codec factories. Creating them costs
+// thread startup and opening the audio devices, which a Conductor used to
+// pay on every call; now it only creates a PeerConnection on the factory.
+//
+// Create one before the first call and destroy it after the last
+// PeerConnection is gone.
+class MediaEngine {
+ public:
+  MediaEngine();
+  ~MediaEngine();
+
+  // Starts the threads and creates the ADM and the factory. Does nothing
+  // once it succeeded.
+  bool Initialize();
+  bool initialized() const { return factory_ != NULL; }
+
+  // NULL until Initialize() succeeded.
+  webrtc::PeerConnectionFactoryInterface* factory() { return factory_.get(); }
+  rtc::Thread* network_thread() { return network_thread_.get(); }
+  rtc::Thread* worker_thread() { return worker_thread_.get(); }
+  rtc::Thread* signaling_thread() { return signaling_thread_.get(); }
+
+  // Time Initialize() took, i.e. what each call paid before the engine was
+  // shared.
+  int64_t initialize_us() const { return initialize_us_; }
+
+ private:
+  std::unique_ptr<rtc::Thread> network_thread_;
+  std::unique_ptr<rtc::Thread> worker_thread_;
+  std::unique_ptr<rtc::Thread> signaling_thread_;
+  //adm_在工作线程上创建和释放, 使用期间必须存在
+  std::unique_ptr<webrtc::TaskQueueFactory> task_queue_factory_;
+  rtc::scoped_refptr<webrtc::AudioDeviceModule> adm_;
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory_;
+  int64_t initialize_us_;
+};
+
+#endif
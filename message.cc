@@ -1,6 +1,5 @@
 #include "examples/voip/message.h"
 #include <string.h>
-#include <assert.h>
 #ifdef WIN32
 #include <Winsock2.h>
 #else
@@ -41,20 +40,31 @@ static void WriteInt64(char *p, int64_t t) {
     memcpy(p, &t, 8);
 }
 
-static int32_t ReadInt32(char *p) {
+static void WriteInt16(char *p, int16_t t) {
+    t = htons(t);
+    memcpy(p, &t, 2);
+}
+
+static int32_t ReadInt32(const char *p) {
     int32_t t;
     memcpy(&t, p, 4);
     return ntohl(t);
 }
 
-static int64_t ReadInt64(char *p) {
+static uint16_t ReadInt16(const char *p) {
+    uint16_t t;
+    memcpy(&t, p, 2);
+    return ntohs(t);
+}
+
+static int64_t ReadInt64(const char *p) {
     int64_t t;
     memcpy(&t, p, 8);
     return ntoh64(t);
 }
 
 
-void ReadHeader(char *p, Message *m) {
+void ReadHeader(const char *p, Message *m) {
     int32_t t;
     memcpy(&t, p, 4);
     m->length = ntohl(t);
@@ -66,44 +76,172 @@ void ReadHeader(char *p, Message *m) {
 
     uint8_t c = *p++;
     m->cmd = c;
-    m->version = *p++;
+    m->version = (uint8_t)*p++;
 }
 
-    
-    
-bool ReadMessage(char *p, int size, Message& m) {
+int DecodeMessage(const char *p, int size, MessageView *m) {
     if (size < HEADER_SIZE) {
-        return false;
+        return 0;
     }
 
-    ReadHeader(p, &m);
-    if (m.length > (size - HEADER_SIZE)) {
-        return false;
+    m->length = ReadInt32(p);
+    m->seq = ReadInt32(p + 4);
+    m->cmd = (uint8_t)p[8];
+    m->version = (uint8_t)p[9];
+    m->rt_seq = ReadInt16(p + 10);
+    if (m->length < 0 || m->length > MAX_BODY_SIZE) {
+        return -1;
     }
+    if (m->length > size - HEADER_SIZE) {
+        return 0;
+    }
+
+    const char *body = p + HEADER_SIZE;
+    if (m->cmd == MSG_AUTH_STATUS) {
+        if (m->length < 4) {
+            return -1;
+        }
+        m->status = ReadInt32(body);
+    } else if (m->cmd == MSG_AUTH_TOKEN) {
+        //1字节platform + 1字节长度 + token + 1字节长度 + device_id
+        const char *end = body + m->length;
+        const char *q = body;
+        if (end - q < 2) {
+            return -1;
+        }
+        m->platform_id = (uint8_t)*q++;
+        int token_len = (uint8_t)*q++;
+        if (end - q < token_len + 1) {
+            return -1;
+        }
+        m->token = absl::string_view(q, token_len);
+        q += token_len;
+        int device_len = (uint8_t)*q++;
+        if (end - q < device_len) {
+            return -1;
+        }
+        m->device_id = absl::string_view(q, device_len);
+        q += device_len;
+        m->last_seq = 0;
+        if (m->version == AUTH_VERSION_RESUME) {
+            if (end - q < 4) {
+                return -1;
+            }
+            m->last_seq = ReadInt32(q);
+        }
+    } else if (m->cmd == MSG_RT) {
+        if (m->length < 16) {
+            return -1;
+        }
+        m->sender = ReadInt64(body);
+        m->receiver = ReadInt64(body + 8);
+        m->content = absl::string_view(body + 16, m->length - 16);
+    } else if (m->cmd == MSG_IM) {
+        if (m->length < IM_HEADER_SIZE) {
+            return -1;
+        }
+        m->sender = ReadInt64(body);
+        m->receiver = ReadInt64(body + 8);
+        m->timestamp = ReadInt32(body + 16);
+        m->msgid = ReadInt32(body + 20);
+        m->content = absl::string_view(body + IM_HEADER_SIZE,
+                                       m->length - IM_HEADER_SIZE);
+    } else if (m->cmd == MSG_ACK) {
+        //按body长度区分对端的确认和服务器的确认
+        m->sender = 0;
+        m->receiver = 0;
+        m->ack_seq = 0;
+        if (m->length >= PEER_ACK_BODY_SIZE) {
+            m->sender = ReadInt64(body);
+            m->receiver = ReadInt64(body + 8);
+        } else if (m->length >= SERVER_ACK_BODY_SIZE) {
+            m->ack_seq = ReadInt32(body);
+        } else {
+            return -1;
+        }
+    } else if (m->cmd == MSG_REGISTER_CAMERA) {
+        m->content = absl::string_view(body, m->length);
+    }
+    return HEADER_SIZE + m->length;
+}
     
-    p = p + HEADER_SIZE;
+bool ReadMessage(const char *p, int size, Message& m) {
+    MessageView v;
+    if (DecodeMessage(p, size, &v) <= 0) {
+        return false;
+    }
+
+    m.length = v.length;
+    m.seq = v.seq;
+    m.cmd = v.cmd;
+    m.version = v.version;
+    m.rt_seq = v.rt_seq;
     if (m.cmd == MSG_AUTH_STATUS) {
-        //assert m.length == 4
-        assert(m.length >= 4);
-        m.status = ReadInt32(p);
+        m.status = v.status;
+    } else if (m.cmd == MSG_AUTH_TOKEN) {
+        m.platform_id = v.platform_id;
+        m.token.assign(v.token.data(), v.token.size());
+        m.device_id.assign(v.device_id.data(), v.device_id.size());
+        m.last_seq = v.last_seq;
     } else if (m.cmd == MSG_RT) {
-        assert(m.length >= 16);
-        m.sender = ReadInt64(p);
-        p += 8;
-        m.receiver = ReadInt64(p);
-        p += 8;
-        m.content.assign(p, m.length - 16);
+        m.sender = v.sender;
+        m.receiver = v.receiver;
+        m.content.assign(v.content.data(), v.content.size());
+    } else if (m.cmd == MSG_IM) {
+        m.sender = v.sender;
+        m.receiver = v.receiver;
+        m.timestamp = v.timestamp;
+        m.msgid = v.msgid;
+        m.content.assign(v.content.data(), v.content.size());
+    } else if (m.cmd == MSG_ACK) {
+        m.sender = v.sender;
+        m.receiver = v.receiver;
+        m.ack_seq = v.ack_seq;
     } else if (m.cmd == MSG_REGISTER_CAMERA) {
-        m.camera_id.assign(p, m.length);
+        m.camera_id.assign(v.content.data(), v.content.size());
     }
     return true;
 }
 
-//todo 校验缓冲区是否越界
+static int GetBodySize(const Message& msg) {
+    if (msg.cmd == MSG_AUTH_TOKEN) {
+        int size = (int)(1 + 1 + msg.token.length() + 1 + msg.device_id.length());
+        if (msg.version == AUTH_VERSION_RESUME) {
+            size += 4;
+        }
+        return size;
+    } else if (msg.cmd == MSG_AUTH_STATUS) {
+        return 4;
+    } else if (msg.cmd == MSG_RT) {
+        return (int)(8 + 8 + msg.content.length());
+    } else if (msg.cmd == MSG_IM) {
+        return (int)(IM_HEADER_SIZE + msg.content.length());
+    } else if (msg.cmd == MSG_ACK) {
+        if (msg.sender == 0 && msg.receiver == 0) {
+            return SERVER_ACK_BODY_SIZE;
+        }
+        return PEER_ACK_BODY_SIZE;
+    } else if (msg.cmd == MSG_REGISTER_CAMERA) {
+        return (int)msg.camera_id.length();
+    }
+    return 0;
+}
+
+int GetMessageSize(const Message& msg) {
+    return HEADER_SIZE + GetBodySize(msg);
+}
+
 int WriteMessage(char *buf, int size, Message& msg) {
-    char *p = buf;
+    int body_len = GetBodySize(msg);
+    if (body_len > MAX_BODY_SIZE || HEADER_SIZE + body_len > size) {
+        return -1;
+    }
+    if (msg.cmd == MSG_AUTH_TOKEN &&
+        (msg.token.length() > 255 || msg.device_id.length() > 255)) {
+        return -1;
+    }
 
-    int body_len = 0;
+    char *p = buf;
     WriteInt32(p, body_len);
     p += 4;
     WriteInt32(p, msg.seq);
@@ -111,8 +249,8 @@ int WriteMessage(char *buf, int size, Message& msg) {
 
     *p++ = msg.cmd;
     *p++ = msg.version;
-    *p++ = 0;
-    *p++ = 0;
+    WriteInt16(p, (int16_t)msg.rt_seq);
+    p += 2;
 
     if (msg.cmd == MSG_AUTH_TOKEN) {
         *p++ = msg.platform_id;
@@ -125,7 +263,13 @@ int WriteMessage(char *buf, int size, Message& msg) {
         memcpy(p, msg.device_id.c_str(), msg.device_id.length());
         p += msg.device_id.length();
 
-        body_len = (int)(1 + 1 + msg.token.length() + 1 + msg.device_id.length());
+        if (msg.version == AUTH_VERSION_RESUME) {
+            WriteInt32(p, msg.last_seq);
+            p += 4;
+        }
+    } else if (msg.cmd == MSG_AUTH_STATUS) {
+        WriteInt32(p, msg.status);
+        p += 4;
     } else if (msg.cmd == MSG_RT) {
         WriteInt64(p, msg.sender);
         p += 8;
@@ -133,17 +277,30 @@ int WriteMessage(char *buf, int size, Message& msg) {
         p += 8;
         memcpy(p, msg.content.c_str(), msg.content.length());
         p += msg.content.length();
-
-        body_len = (int)(8 + 8 + msg.content.length());
+    } else if (msg.cmd == MSG_IM) {
+        WriteInt64(p, msg.sender);
+        p += 8;
+        WriteInt64(p, msg.receiver);
+        p += 8;
+        WriteInt32(p, msg.timestamp);
+        p += 4;
+        WriteInt32(p, msg.msgid);
+        p += 4;
+        memcpy(p, msg.content.c_str(), msg.content.length());
+        p += msg.content.length();
+    } else if (msg.cmd == MSG_ACK) {
+        if (msg.sender == 0 && msg.receiver == 0) {
+            WriteInt32(p, msg.ack_seq);
+            p += 4;
+        } else {
+            WriteInt64(p, msg.sender);
+            p += 8;
+            WriteInt64(p, msg.receiver);
+            p += 8;
+        }
     } else if (msg.cmd == MSG_REGISTER_CAMERA) {
         memcpy(p, msg.camera_id.c_str(), msg.camera_id.length());
-        
-        body_len = (int)msg.camera_id.length();
     }
     
-    //重写消息体长度
-    WriteInt32(buf, body_len);
-
-    //assert(body_len <= size);
     return body_len + HEADER_SIZE;
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <stdint.h>
 
+#include "absl/strings/string_view.h"
+
 
 #define MSG_AUTH_STATUS 3
 #define MSG_IM 4
@@ -25,19 +27,38 @@
 #define PLATFORM_WEB 3
 #define PLATFORM_LINUX 4
 
+//MSG_AUTH_TOKEN的version, 1: body末尾附带4字节的last_seq, 用于恢复会话
+#define AUTH_VERSION_RESUME 1
+
 #define HEADER_SIZE 12
 
+//MSG_ACK的body: 8字节sender + 8字节receiver, 为对端确认收到的MSG_RT
+#define PEER_ACK_BODY_SIZE 16
+//MSG_ACK的body: 4字节seq, 与服务器之间确认收到的MSG_IM
+#define SERVER_ACK_BODY_SIZE 4
+
+//MSG_IM的body: 8字节sender + 8字节receiver + 4字节timestamp + 4字节msgid
+#define IM_HEADER_SIZE 24
+
+//body长度上限,超过则认为数据流已损坏
+#define MAX_BODY_SIZE (1024*1024)
+
 
 class Message {
 public:
-  Message() {}
+  Message()
+      : length(0), seq(0), cmd(0), version(0), rt_seq(0), status(0),
+        platform_id(0), last_seq(0), sender(0), receiver(0), timestamp(0),
+        msgid(0), ack_seq(0) {}
   ~Message() {}
   //header
-  //4字节length + 4字节seq + 1字节cmd + 1字节version + 2字节0
+  //4字节length + 4字节seq + 1字节cmd + 1字节version + 2字节rt_seq
   int length;//body的长度
   int seq;
   int cmd;
   int version;
+  //MSG_RT/MSG_ACK: 端到端的序号, 0表示不需要确认
+  int rt_seq;
 
 
 
@@ -49,20 +70,73 @@ public:
   std::string device_id;
   std::string token;
   int platform_id;
-
+  //AUTH_VERSION_RESUME: 上一个连接收到的最后一条消息的seq
+  int last_seq;
 
   
-  //MSG_RT
+  //MSG_RT, MSG_IM, MSG_ACK
   int64_t sender;
   int64_t receiver;
   std::string content;
 
+  //MSG_IM
+  int timestamp;
+  //发送端生成的消息id
+  int msgid;
+
+  //MSG_ACK: sender和receiver为0时是服务器确认, 确认到ack_seq为止的MSG_IM
+  int ack_seq;
+
   //MSG_REGISTER_CAMERA
   std::string camera_id;
 };
 
-void ReadHeader(char *p, Message *m);
-bool ReadMessage(char *p, int size, Message& m);
+// A decoded frame whose variable-length fields point into the buffer it was
+// decoded from, so the body can be consumed in place. It is only valid until
+// that buffer is modified.
+struct MessageView {
+  int length;
+  int seq;
+  int cmd;
+  int version;
+  int rt_seq;
+
+  //MSG_AUTH_STATUS
+  int status;
+
+  //MSG_AUTH_TOKEN
+  int platform_id;
+  absl::string_view token;
+  absl::string_view device_id;
+  int last_seq;
+
+  //MSG_RT, MSG_IM, MSG_ACK
+  int64_t sender;
+  int64_t receiver;
+  //MSG_RT/MSG_IM: 消息内容, MSG_REGISTER_CAMERA: camera id
+  absl::string_view content;
+
+  //MSG_IM
+  int timestamp;
+  int msgid;
+
+  //MSG_ACK: body为SERVER_ACK_BODY_SIZE时有效, 否则为0
+  int ack_seq;
+};
+
+void ReadHeader(const char *p, Message *m);
+
+// Decodes one frame from the start of |p|. Returns the size of the whole frame
+// (header + body) on success, 0 if |size| does not hold a complete frame yet,
+// and -1 if the frame is malformed and the stream cannot be resynchronized.
+int DecodeMessage(const char *p, int size, MessageView *m);
+
+bool ReadMessage(const char *p, int size, Message& m);
+
+// Size of the encoded frame (header + body) for |m|.
+int GetMessageSize(const Message& m);
+// Encodes |m| into |p|. Returns the frame size, or -1 if it does not fit in
+// |size| bytes or exceeds the protocol limits.
 int WriteMessage(char *p, int size, Message& m);
 
 #endif
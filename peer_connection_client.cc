@@ -9,9 +9,15 @@
  */
 
 #include "examples/voip/peer_connection_client.h"
+
+#include <string.h>
+
+#include <algorithm>
+
 #include "examples/voip/message.h"
 #include "examples/voip/defaults.h"
 #include "rtc_base/checks.h"
+#include "rtc_base/helpers.h"
 #include "rtc_base/logging.h"
 #include "rtc_base/net_helpers.h"
 #include "rtc_base/string_utils.h"
@@ -20,6 +26,10 @@
 
 #ifdef WIN32
 #include "rtc_base/win32socketserver.h"
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 
@@ -31,25 +41,36 @@
 namespace {
 
 
-// Delay between server connection retries, in milliseconds
-const int kReconnectDelay = 2000;
-// heartbeat 
+// Backoff between server connection retries, in milliseconds
+const int kReconnectBaseDelay = 500;
+const int kReconnectMaxDelay = 30*1000;
+// A session is only resumed within this many milliseconds of losing the
+// connection; after that queued frames are dropped and we sign in afresh.
+const int kResumeTimeout = 60*1000;
+// Ping interval until the first RTT sample is taken
 const int kHeartbeatDelay = 10*1000;
+// A TLS handshake that has not finished after this long is abandoned; it is
+// checked on the heartbeat timer.
+const int kHandshakeTimeout = 10*1000;
 
+// Initial and default maximum size of the receive buffer.
+const size_t kRecvBufferSize = 16*1024;
+const size_t kMaxRecvBufferSize = HEADER_SIZE + MAX_BODY_SIZE;
 
-rtc::AsyncSocket* CreateClientSocket(int family) {
-#ifdef WIN32
-  rtc::Win32Socket* sock = new rtc::Win32Socket();
-  sock->CreateT(family, SOCK_STREAM);
-  return sock;
-#elif defined(WEBRTC_POSIX)
-  rtc::Thread* thread = rtc::Thread::Current();
-  RTC_DCHECK(thread != NULL);
-  return thread->socketserver()->CreateAsyncSocket(family, SOCK_STREAM);
-#else
-#error Platform not supported.
-#endif
+// Maximum number of chunks handed to a single sendmsg().
+const int kMaxSendSegments = 16;
+
+// Instant messages sent ahead of the server's acks.
+const size_t kIMWindow = 32;
+
+
+#if defined(WEBRTC_POSIX)
+// Sockets created by PhysicalSocketServer are SocketDispatchers, which is
+// what lets us write to the descriptor directly with sendmsg().
+int GetSocketDescriptor(rtc::AsyncSocket* socket) {
+  return static_cast<rtc::SocketDispatcher*>(socket)->GetDescriptor();
 }
+#endif
 
 }  // namespace
 
@@ -57,16 +78,39 @@ rtc::AsyncSocket* CreateClientSocket(int family) {
 
 PeerConnectionClient::PeerConnectionClient()
     : callback_(NULL),
-    resolver_(NULL),
+    server_index_(0),
     state_(NOT_CONNECTED),
     my_id_(-1),
-    ping_ts_(0) {
-    
-    data_size_ = 0;
-    offset_ = 0;
-    size_ = 0;
+    tls_ignore_bad_cert_(false),
+    fast_open_(false),
+    tls_socket_(NULL),
+    connect_start_ms_(0),
+    recv_buffer_(kRecvBufferSize, kMaxRecvBufferSize),
+    socket_fd_(-1),
+    coalesce_delay_us_(0),
+    coalesce_bytes_(0),
+    coalesce_frames_(0),
+    coalesce_first_ts_(0),
+    coalesce_ts_sum_(0),
+    reconnect_base_delay_(kReconnectBaseDelay),
+    reconnect_max_delay_(kReconnectMaxDelay),
+    reconnect_attempts_(0),
+    reconnect_pending_(false),
+    signed_in_(false),
+    resuming_(false),
+    disconnect_ts_(0),
+    last_recv_seq_(0),
+    retransmit_deadline_(-1),
+    im_outbox_(kIMWindow),
+    im_ack_seq_(0),
+    im_ack_pending_(false) {
+
 
     seq_ = 0;
+    connector_.SignalConnected.connect(this,
+        &PeerConnectionClient::OnServerConnected);
+    connector_.SignalFailed.connect(this,
+        &PeerConnectionClient::OnServerConnectFailed);
 }
 
 PeerConnectionClient::~PeerConnectionClient() {
@@ -79,10 +123,11 @@ void PeerConnectionClient::InitSocketSignals() {
       &PeerConnectionClient::OnWrite);
   control_socket_->SignalCloseEvent.connect(this,
       &PeerConnectionClient::OnClose);
-  control_socket_->SignalConnectEvent.connect(this,
-      &PeerConnectionClient::OnConnect);
   control_socket_->SignalReadEvent.connect(this,
       &PeerConnectionClient::OnRead);
+  //TLS握手完成
+  control_socket_->SignalConnectEvent.connect(this,
+      &PeerConnectionClient::OnConnect);
 }
 
 void PeerConnectionClient::setID(int64_t id) {
@@ -93,6 +138,50 @@ void PeerConnectionClient::setToken(std::string& token) {
     token_ = token;
 }
 
+void PeerConnectionClient::set_reconnect_backoff(int base_ms, int max_ms) {
+    reconnect_base_delay_ = std::max(1, base_ms);
+    reconnect_max_delay_ = std::max(reconnect_base_delay_, max_ms);
+}
+
+void PeerConnectionClient::set_tls(bool enabled, bool ignore_bad_cert) {
+    RTC_DCHECK(state_ == NOT_CONNECTED);
+    tls_ignore_bad_cert_ = ignore_bad_cert;
+    if (!enabled) {
+        tls_factory_.reset();
+    } else if (!tls_factory_) {
+        tls_factory_ = std::unique_ptr<rtc::SSLAdapterFactory>(
+            rtc::SSLAdapterFactory::Create());
+    }
+    relay_pool_.set_ping(!enabled);
+}
+
+void PeerConnectionClient::set_fast_open(bool enabled) {
+    fast_open_ = enabled;
+    connector_.set_fast_open(enabled);
+}
+
+const PeerConnectionClient::SignInStats&
+PeerConnectionClient::sign_in_stats() const {
+    return sign_in_stats_;
+}
+
+void PeerConnectionClient::set_max_recv_buffer_size(size_t size) {
+    recv_buffer_.set_max_capacity(size);
+}
+
+bool PeerConnectionClient::StartTrace(const std::string& path) {
+    if (!trace_.Open(path, rtc::TimeUTCMicros())) {
+        RTC_LOG(LS_ERROR) << "can't open trace:" << path;
+        return false;
+    }
+    RTC_LOG(INFO) << "trace signaling to " << path;
+    return true;
+}
+
+void PeerConnectionClient::StopTrace() {
+    trace_.Close();
+}
+
 int64_t PeerConnectionClient::id() const {
   return my_id_;
 }
@@ -117,9 +206,16 @@ void PeerConnectionClient::Connect() {
   }
 
 
-  RTC_LOG(INFO) << "connect...:" << HOST << ":" << PORT;
-  server_address_.SetIP(HOST);
-  server_address_.SetPort(PORT);
+  if (servers_.empty()) {
+    servers_.push_back(rtc::SocketAddress(HOST, PORT));
+  }
+  server_index_ = 0;
+  server_address_ = servers_[0];
+  RTC_LOG(INFO) << "connect...:" << server_address_.ToString()
+                << " relays:" << servers_.size();
+  //其它服务器在后台探测延迟, 并作为热备连接
+  relay_pool_.SetEndpoints(servers_);
+  relay_pool_.SetActive(server_address_);
 
   rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kHeartbeatDelay, this,
                                       1);
@@ -128,40 +224,117 @@ void PeerConnectionClient::Connect() {
 }
 
 void PeerConnectionClient::DoResolveOrConnect() {
-  //todo 刷新dns
-  if (server_address_.IsUnresolvedIP()) {
-    state_ = RESOLVING;
-    resolver_ = new rtc::AsyncResolver();
-    resolver_->SignalDone.connect(this, &PeerConnectionClient::OnResolveResult);
-    resolver_->Start(server_address_);
-  } else {
-    DoConnect();
-  } 
+  rtc::SocketAddress server = server_address_;
+  if (!relay_pool_.SelectBest(&server) && reconnect_attempts_ > 1 &&
+      servers_.size() > 1) {
+    //没有可用的探测结果, 轮流尝试下一个服务器
+    server_index_ = (server_index_ + 1) % servers_.size();
+    server = servers_[server_index_];
+  }
+  if (server != server_address_) {
+    //rtt统计属于之前的服务器
+    heartbeat_.ResetStats();
+    server_address_ = server;
+  }
+  relay_pool_.SetActive(server_address_);
+
+  //dns缓存及多地址竞速连接由connector_完成
+  state_ = RESOLVING;
+  connect_start_ms_ = rtc::TimeMillis();
+  connector_.Connect(server_address_);
 }
 
-void PeerConnectionClient::OnResolveResult(
-    rtc::AsyncResolverInterface* resolver) {
-  if (resolver_->GetError() != 0) {
-    callback_->OnServerConnectionFailure();
-    resolver_->Destroy(false);
-    resolver_ = NULL;
-    state_ = NOT_CONNECTED;
-  } else {
-    server_address_ = resolver_->address();
-    DoConnect();
+bool PeerConnectionClient::Failover() {
+  rtc::SocketAddress backup;
+  rtc::AsyncSocket* socket = relay_pool_.TakeBackup(&backup);
+  if (socket == NULL) {
+    return false;
   }
+  RTC_LOG(INFO) << "fail over from " << server_address_.ToString()
+                << " to " << backup.ToString();
+  server_address_ = backup;
+  heartbeat_.ResetStats();
+  relay_pool_.SetActive(server_address_);
+  connect_start_ms_ = rtc::TimeMillis();
+  DoConnect(socket);
+  return true;
 }
 
-void PeerConnectionClient::DoConnect() {
-  control_socket_.reset(CreateClientSocket(server_address_.ipaddr().family()));
-  InitSocketSignals();
+void PeerConnectionClient::set_servers(
+    const std::vector<rtc::SocketAddress>& servers) {
+  servers_ = servers;
+}
 
-  RTC_LOG(INFO) << "connect control socket....";
-  bool ret = ConnectControlSocket();
-  if (ret)
-    state_ = SIGNING_IN;
-  if (!ret) {
-    callback_->OnServerConnectionFailure();
+std::vector<RelayPool::EndpointStats> PeerConnectionClient::relay_stats()
+    const {
+  std::vector<RelayPool::EndpointStats> stats = relay_pool_.stats();
+  for (RelayPool::EndpointStats& s : stats) {
+    if (s.active) {
+      s.healthy = state_ == CONNECTED;
+      s.latency_us = heartbeat_.stats().srtt_us;
+    }
+  }
+  return stats;
+}
+
+void PeerConnectionClient::OnServerConnected(ServerConnector* connector,
+                                             rtc::AsyncSocket* socket) {
+  DoConnect(socket);
+}
+
+void PeerConnectionClient::OnServerConnectFailed(ServerConnector* connector) {
+  state_ = NOT_CONNECTED;
+  callback_->OnServerConnectionFailure();
+  ScheduleReconnect();
+}
+
+const std::vector<ServerConnector::AttemptResult>&
+PeerConnectionClient::connect_results() const {
+  return connector_.results();
+}
+
+void PeerConnectionClient::DoConnect(rtc::AsyncSocket* socket) {
+  recv_buffer_.Clear();
+  if (resuming_ && rtc::TimeMillis() - disconnect_ts_ > kResumeTimeout) {
+    RTC_LOG(INFO) << "session expired, drop " << send_queue_.frames()
+                  << " queued frames";
+    resuming_ = false;
+  }
+  if (resuming_) {
+    //未发送完的消息在新连接上完整重发
+    send_queue_.Rewind();
+  } else {
+    send_queue_.Clear();
+    last_recv_seq_ = 0;
+  }
+  coalesce_frames_ = 0;
+  coalesce_ts_sum_ = 0;
+  if (!tls_factory_) {
+    tls_socket_ = NULL;
+    control_socket_.reset(socket);
+#if defined(WEBRTC_POSIX)
+    socket_fd_ = GetSocketDescriptor(control_socket_.get());
+#endif
+    InitSocketSignals();
+    OnConnect(control_socket_.get());
+    return;
+  }
+
+  //sendmsg会绕过TLS, 只能通过adapter发送
+  socket_fd_ = -1;
+  tls_socket_ = tls_factory_->CreateAdapter(socket);
+  tls_socket_->SetIgnoreBadCert(tls_ignore_bad_cert_);
+  control_socket_.reset(tls_socket_);
+  InitSocketSignals();
+  state_ = SIGNING_IN;
+  //session按主机名缓存, 重连时恢复
+  std::string host = server_address_.hostname();
+  if (host.empty()) {
+    host = server_address_.ipaddr().ToString();
+  }
+  if (tls_socket_->StartSSL(host.c_str(), false) != 0) {
+    RTC_LOG(LS_ERROR) << "start tls failed, error:" << tls_socket_->GetError();
+    OnConnectionLost();
   }
 }
 
@@ -172,6 +345,14 @@ bool PeerConnectionClient::SignOut() {
   Close();
 
   rtc::Thread::Current()->Clear(this);
+  relay_pool_.Stop();
+  reconnect_pending_ = false;
+  signed_in_ = false;
+  resuming_ = false;
+  send_queue_.Clear();
+  im_outbox_.Rewind();
+  reliable_.Reset();
+  retransmit_deadline_ = -1;
       
   state_ = SIGNING_OUT;
 
@@ -179,170 +360,566 @@ bool PeerConnectionClient::SignOut() {
 }
 
 void PeerConnectionClient::Close() {
-  control_socket_->Close();
-  if (resolver_ != NULL) {
-    resolver_->Destroy(false);
-    resolver_ = NULL;
+  if (control_socket_) {
+    control_socket_->Close();
   }
+  connector_.Cancel();
   state_ = NOT_CONNECTED;
 }
 
-bool PeerConnectionClient::ConnectControlSocket() {
-    RTC_DCHECK(control_socket_->GetState() == rtc::Socket::CS_CLOSED);
-    int err = control_socket_->Connect(server_address_);
-    if (err == SOCKET_ERROR) {
-        Close();
-        return false;
-    }
-    return true;
-}
-
 void PeerConnectionClient::OnConnect(rtc::AsyncSocket* socket) {
     state_ = CONNECTED;
+    heartbeat_.Reset();
     RTC_LOG(INFO) << "on connected";
     SendAuth();
 }
 
 void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket) {
-    do {
-        int bytes = socket->Recv(data_ + data_size_, 128*1024 - data_size_, nullptr);
+    while (true) {
+        size_t len = 0;
+        char *p = recv_buffer_.WritePtr(&len);
+        if (len == 0) {
+            //缓冲区已满且无法容纳一条完整的消息
+            RTC_LOG(LS_ERROR) << "receive buffer overflow, size:"
+                              << recv_buffer_.size();
+            recv_buffer_.Clear();
+            OnClose(socket, 0);
+            return;
+        }
+        int bytes = socket->Recv(p, len, nullptr);
         if (bytes <= 0)
             break;
-        data_size_ += bytes;
-    } while (true);
+        recv_buffer_.Commit(bytes);
 
-    int offset = 0;
+        if (!ProcessMessages()) {
+            recv_buffer_.Clear();
+            OnClose(socket, 0);
+            return;
+        }
+    }
+}
+
+bool PeerConnectionClient::ProcessMessages() {
     while (true) {
-        Message m;
-        bool r = ReadMessage(data_+offset, data_size_ - offset, m);
-        if (!r) {
-            break;
+        MessageView m;
+        int n = recv_buffer_.PeekMessage(&m);
+        if (n < 0) {
+            RTC_LOG(LS_ERROR) << "invalid message, cmd:" << m.cmd
+                              << " length:" << m.length;
+            return false;
+        }
+        if (n == 0) {
+            if (im_ack_pending_) {
+                SendIMAck();
+            }
+            return true;
         }
 
         RTC_LOG(INFO) << "recv message:" << m.cmd;
-        offset += m.length + HEADER_SIZE;
+        last_recv_seq_ = m.seq;
+        if (trace_.is_open()) {
+            trace_.Record(TRACE_RECEIVED, rtc::TimeMicros(),
+                          recv_buffer_.Peek(n), n);
+        }
         //处理消息
         if (m.cmd == MSG_AUTH_STATUS) {
-            RTC_LOG(INFO) << "auth status:" << m.status;
+            RTC_LOG(INFO) << "auth status:" << m.status
+                          << " resumed:" << resuming_;
+            signed_in_ = true;
+            resuming_ = false;
+            reconnect_attempts_ = 0;
+            sign_in_stats_.sign_ins++;
+            sign_in_stats_.last_latency_ms =
+                rtc::TimeMillis() - connect_start_ms_;
+            sign_in_stats_.last_tls_resumed =
+                tls_socket_ != NULL && tls_socket_->IsResumedSession();
+            if (sign_in_stats_.last_tls_resumed) {
+                sign_in_stats_.tls_resumed++;
+            }
+            RTC_LOG(INFO) << "signed in after "
+                          << sign_in_stats_.last_latency_ms << "ms"
+                          << " tls resumed:"
+                          << sign_in_stats_.last_tls_resumed;
+            connector_.set_fast_open(fast_open_);
             callback_->OnSignedIn();
+            PumpIM();
         } else if (m.cmd == MSG_RT) {
-            callback_->HandleRTMessage(m.sender, m.receiver, m.content);
+            HandleRT(m);
+        } else if (m.cmd == MSG_ACK) {
+            HandleAck(m);
+        } else if (m.cmd == MSG_IM) {
+            HandleIM(m);
         } else if (m.cmd == MSG_PONG) {
             HandlePong(m);
         }
+        recv_buffer_.Consume(n);
     }
+}
 
-    if (offset > 0) {
-        data_size_ -= offset;
-        if (data_size_ > 0) {
-            //将不完整的消息copy到缓冲区的开头位置
-            memmove(data_, data_ + offset, data_size_);
+bool PeerConnectionClient::SendRTMessage(int64_t peer_id, std::string content,
+                                         int version) {
+    Message m;
+    m.cmd = MSG_RT;
+    m.version = version;
+    m.sender = my_id_;
+    m.receiver = peer_id;
+    m.content = content;
+    m.rt_seq = reliable_.OnSend(peer_id, m.content, version,
+                                rtc::TimeMillis());
+    RTC_LOG(INFO) << "send rt message, version:" << version
+                  << " size:" << content.size() << " rt seq:" << m.rt_seq;
+    bool r = SendMessage(m);
+    ScheduleRetransmit();
+    return r;
+}
+
+const ReliableChannel::Stats& PeerConnectionClient::reliable_stats() const {
+    return reliable_.stats();
+}
+
+void PeerConnectionClient::HandleRT(MessageView& msg) {
+    if (msg.rt_seq != 0) {
+        //重复的消息也要确认, 之前的ack可能丢失了
+        SendAck(msg.sender, msg.rt_seq);
+        if (!reliable_.OnReceive(msg.sender, msg.rt_seq)) {
+            RTC_LOG(INFO) << "duplicate rt message, sender:" << msg.sender
+                          << " rt seq:" << msg.rt_seq;
+            return;
         }
     }
+    callback_->HandleRTMessage(msg.sender, msg.receiver, msg.version,
+                               msg.content);
+}
+
+void PeerConnectionClient::HandleAck(MessageView& msg) {
+    if (msg.sender == 0 && msg.receiver == 0) {
+        //服务器确认MSG_IM, 一个ack确认seq之前的所有消息
+        int count = im_outbox_.OnAck(msg.ack_seq);
+        RTC_LOG(INFO) << "im ack, seq:" << msg.ack_seq << " acked:" << count
+                      << " pending:" << im_outbox_.pending();
+        PumpIM();
+        return;
+    }
+    if (msg.receiver != my_id_ || msg.rt_seq == 0) {
+        return;
+    }
+    if (!reliable_.OnAck(msg.sender, msg.rt_seq, rtc::TimeMillis())) {
+        RTC_LOG(INFO) << "unexpected ack, sender:" << msg.sender
+                      << " rt seq:" << msg.rt_seq;
+        return;
+    }
+    RTC_LOG(INFO) << "ack, sender:" << msg.sender << " rt seq:" << msg.rt_seq
+                  << " rto:" << reliable_.rto_ms(msg.sender) << "ms";
+}
+
+int PeerConnectionClient::SendIMMessage(int64_t peer_id, std::string content) {
+    IMMessage m;
+    m.sender = my_id_;
+    m.receiver = peer_id;
+    m.timestamp = (int)(rtc::TimeUTCMillis() / 1000);
+    m.content = std::move(content);
+    int msgid = im_outbox_.Add(std::move(m));
+    PumpIM();
+    return msgid;
 }
 
-void PeerConnectionClient::SendRTMessage(int64_t peer_id, std::string content) {
+bool PeerConnectionClient::OpenIMOutbox(const std::string& path) {
+    if (!im_outbox_.Open(path)) {
+        RTC_LOG(LS_ERROR) << "can't open im outbox:" << path;
+        return false;
+    }
+    RTC_LOG(INFO) << "im outbox:" << path
+                  << " pending:" << im_outbox_.pending();
+    PumpIM();
+    return true;
+}
+
+void PeerConnectionClient::set_im_window(size_t window) {
+    im_outbox_.set_window(window);
+    PumpIM();
+}
+
+const ImOutbox::Stats& PeerConnectionClient::im_stats() const {
+    return im_outbox_.stats();
+}
+
+void PeerConnectionClient::PumpIM() {
+    if (state_ != CONNECTED || !signed_in_) {
+        return;
+    }
+    while (const IMMessage* im = im_outbox_.NextToSend()) {
+        Message m;
+        m.cmd = MSG_IM;
+        m.sender = im->sender;
+        m.receiver = im->receiver;
+        m.timestamp = im->timestamp;
+        m.msgid = im->msgid;
+        m.content = im->content;
+        if (!SendMessage(m)) {
+            //发送队列已满, 剩余的消息等下一个ack
+            break;
+        }
+        im_outbox_.OnSent(m.seq);
+    }
+}
+
+void PeerConnectionClient::HandleIM(MessageView& msg) {
+    im_ack_seq_ = msg.seq;
+    im_ack_pending_ = true;
+    callback_->HandleIMMessage(msg.sender, msg.receiver, msg.msgid,
+                               msg.content);
+}
+
+void PeerConnectionClient::SendIMAck() {
+    im_ack_pending_ = false;
     Message m;
-    m.cmd = MSG_RT;
+    m.cmd = MSG_ACK;
+    m.ack_seq = im_ack_seq_;
+    SendMessage(m);
+}
+
+void PeerConnectionClient::SendAck(int64_t peer_id, int rt_seq) {
+    Message m;
+    m.cmd = MSG_ACK;
     m.sender = my_id_;
     m.receiver = peer_id;
-    m.content = content;
-    RTC_LOG(INFO) << "send rt message:" << content;
-    SendMessage(m);    
+    m.rt_seq = rt_seq;
+    SendMessage(m);
+}
+
+void PeerConnectionClient::Retransmit() {
+    std::vector<ReliableChannel::Retransmit> frames;
+    std::vector<ReliableChannel::Retransmit> gave_up;
+    reliable_.Poll(rtc::TimeMillis(), &frames, &gave_up);
+    for (ReliableChannel::Retransmit& r : frames) {
+        RTC_LOG(INFO) << "retransmit rt message, peer:" << r.peer_id
+                      << " rt seq:" << r.rt_seq
+                      << " rto:" << reliable_.rto_ms(r.peer_id) << "ms";
+        Message m;
+        m.cmd = MSG_RT;
+        m.version = r.version;
+        m.rt_seq = r.rt_seq;
+        m.sender = my_id_;
+        m.receiver = r.peer_id;
+        m.content = std::move(r.content);
+        SendMessage(m);
+    }
+    for (const ReliableChannel::Retransmit& r : gave_up) {
+        RTC_LOG(WARNING) << "gave up rt message, peer:" << r.peer_id
+                         << " rt seq:" << r.rt_seq;
+        callback_->OnRTMessageGaveUp(r.peer_id, r.version, r.content);
+    }
+}
+
+void PeerConnectionClient::ScheduleRetransmit() {
+    int64_t deadline = reliable_.NextDeadline();
+    if (deadline < 0 ||
+        (retransmit_deadline_ >= 0 && retransmit_deadline_ <= deadline)) {
+        return;
+    }
+    //已投递的定时器到期太晚, 重新投递
+    rtc::Thread::Current()->Clear(this, 4);
+    retransmit_deadline_ = deadline;
+    int delay = (int)std::max<int64_t>(0, deadline - rtc::TimeMillis());
+    rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this, 4);
 }
 
+bool PeerConnectionClient::writable() const {
+    return send_queue_.writable();
+}
+
+size_t PeerConnectionClient::send_queue_depth() const {
+    return send_queue_.frames();
+}
 
-void PeerConnectionClient::HandlePong(Message& msg) {
-    RTC_LOG(INFO) << "pong...";
-    ping_ts_ = 0;
+size_t PeerConnectionClient::send_queue_bytes() const {
+    return send_queue_.bytes();
+}
+
+void PeerConnectionClient::set_send_watermarks(size_t high, size_t low) {
+    send_queue_.set_watermarks(high, low);
+}
+
+void PeerConnectionClient::set_coalescing(int64_t max_delay_us,
+                                          size_t max_bytes) {
+    coalesce_delay_us_ = max_delay_us;
+    coalesce_bytes_ = max_bytes;
+    if (coalesce_delay_us_ <= 0 && coalesce_frames_ > 0 &&
+        state_ == CONNECTED) {
+        Flush();
+    }
+}
+
+const PeerConnectionClient::WriteStats&
+PeerConnectionClient::write_stats() const {
+    return write_stats_;
+}
+
+
+const SendQueue::LaneStats& PeerConnectionClient::lane_stats(
+    SendQueue::Lane lane) const {
+    return send_queue_.lane_stats(lane);
+}
+
+const RttStats& PeerConnectionClient::rtt_stats() const {
+    return heartbeat_.stats();
+}
+
+void PeerConnectionClient::HandlePong(MessageView& msg) {
+    if (!heartbeat_.OnPong(msg.seq, rtc::TimeMicros())) {
+        RTC_LOG(WARNING) << "unexpected pong, seq:" << msg.seq;
+        return;
+    }
+    const RttStats& stats = heartbeat_.stats();
+    RTC_LOG(INFO) << "pong... rtt:" << stats.last_us / 1000
+                  << "ms srtt:" << stats.srtt_us / 1000
+                  << "ms timeout:" << heartbeat_.timeout_ms() << "ms";
 }
 
 void PeerConnectionClient::OnWrite(rtc::AsyncSocket* socket) {
-    if (size_ > 0) {
-        size_t sent = control_socket_->Send(block_ + offset_, size_);
+    Flush();
+}
+
+void PeerConnectionClient::Flush() {
+    if (coalesce_frames_ > 0) {
+        int64_t now = rtc::TimeMicros();
+        write_stats_.queue_delay_us += coalesce_frames_ * now - coalesce_ts_sum_;
+        write_stats_.max_queue_delay_us =
+            std::max(write_stats_.max_queue_delay_us, now - coalesce_first_ts_);
+        coalesce_frames_ = 0;
+        coalesce_ts_sum_ = 0;
+        //提前写出时取消窗口定时器, 否则它会截短下一个窗口
+        rtc::Thread::Current()->Clear(this, 2);
+    }
+
+    bool writable = send_queue_.writable();
+    size_t frames = send_queue_.frames();
+    while (!send_queue_.empty()) {
+        SendQueue::Segment segs[kMaxSendSegments];
+        int count = send_queue_.Gather(segs, kMaxSendSegments);
+        size_t total = 0;
+        for (int i = 0; i < count; i++) {
+            total += segs[i].size;
+        }
+
+        int sent = -1;
+#if defined(WEBRTC_POSIX)
+        if (socket_fd_ >= 0) {
+            struct iovec iov[kMaxSendSegments];
+            for (int i = 0; i < count; i++) {
+                iov[i].iov_base = const_cast<char*>(segs[i].data);
+                iov[i].iov_len = segs[i].size;
+            }
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_iov = iov;
+            hdr.msg_iovlen = count;
+            int flags = 0;
+#ifdef MSG_NOSIGNAL
+            flags |= MSG_NOSIGNAL;
+#endif
+            do {
+                sent = (int)sendmsg(socket_fd_, &hdr, flags);
+            } while (sent < 0 && errno == EINTR);
+            write_stats_.writes++;
+        }
+#endif
         if (sent > 0) {
-            offset_ += (int)sent;
-            size_ -= (int)sent;
+            send_queue_.Consume(sent);
+            if ((size_t)sent == total) {
+                continue;
+            }
+        }
+
+        const char* data;
+        size_t size;
+        if (tls_socket_ != NULL) {
+            //合并成一次Send, 而不是每段一个TLS记录
+            tls_buffer_.clear();
+            for (int i = 0; i < count; i++) {
+                tls_buffer_.append(segs[i].data, segs[i].size);
+            }
+            data = tls_buffer_.data();
+            size = tls_buffer_.size();
+        } else {
+            //sendmsg绕过了socket server, 通过Send发送队首数据,
+            //socket阻塞时Send会重新注册可写事件
+            send_queue_.Gather(segs, 1);
+            data = segs[0].data;
+            size = segs[0].size;
+        }
+        sent = control_socket_->Send(data, size);
+        write_stats_.writes++;
+        if (sent <= 0) {
+            if (!rtc::IsBlockingError(control_socket_->GetError())) {
+                RTC_LOG(LS_ERROR) << "send error:" << control_socket_->GetError();
+            }
+            break;
+        }
+        send_queue_.Consume(sent);
+        if ((size_t)sent < size) {
+            break;
         }
     }
+
+    write_stats_.frames += frames - send_queue_.frames();
+
+    if (!writable && send_queue_.writable()) {
+        SignalReadyToSend(this);
+        PumpIM();
+    }
 }
 
 void PeerConnectionClient::OnClose(rtc::AsyncSocket* socket, int err) {
   RTC_LOG(INFO) << __FUNCTION__ << "error:" << err;
+  OnConnectionLost();
+}
+
+void PeerConnectionClient::OnConnectionLost() {
+  if (state_ == SIGNING_OUT) {
+    return;
+  }
   state_ = NOT_CONNECTED;
-  socket->Close();
-  
-  RTC_LOG(WARNING) << "Connection refused; retrying in 2 seconds";
-  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kReconnectDelay, this,
-                                      0);
+  control_socket_->Close();
+
+  //未确认的MSG_IM在重新登录后再次发送
+  im_outbox_.Rewind();
+  im_ack_pending_ = false;
+  if (fast_open_ && !signed_in_) {
+    //登录之前断开, TFO的地址可能已不可用, 下次正常竞速
+    connector_.set_fast_open(false);
+  }
+  if (signed_in_) {
+    //保留发送队列, 重连后恢复会话
+    signed_in_ = false;
+    resuming_ = true;
+    disconnect_ts_ = rtc::TimeMillis();
+  }
+  ScheduleReconnect();
+}
+
+int PeerConnectionClient::NextReconnectDelay() {
+  int attempt = reconnect_attempts_++;
+  if (attempt == 0) {
+    return 0;
+  }
+  //到达上限后不再加倍, 任意的base_ms都不会溢出
+  int64_t delay = reconnect_base_delay_;
+  for (int i = 1; i < attempt && delay < reconnect_max_delay_; i++) {
+    delay *= 2;
+  }
+  delay = std::min<int64_t>(delay, reconnect_max_delay_);
+  //随机化, 避免大量客户端同时重连
+  return (int)(delay / 2 + rtc::CreateRandomId() % (delay / 2 + 1));
+}
+
+void PeerConnectionClient::ScheduleReconnect() {
+  if (reconnect_pending_ || state_ == SIGNING_OUT) {
+    return;
+  }
+  int delay = NextReconnectDelay();
+  RTC_LOG(WARNING) << "Connection lost; retrying in " << delay << " ms"
+                   << " attempt:" << reconnect_attempts_;
+  reconnect_pending_ = true;
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this, 0);
 }
 
 void PeerConnectionClient::OnMessage(rtc::Message* msg) {
+    if (msg->message_id == 2) {
+        //合并写入的窗口到期
+        if (coalesce_frames_ > 0 && state_ == CONNECTED) {
+            Flush();
+        }
+        return;
+    }
+
     if (msg->message_id == 0) {
+        reconnect_pending_ = false;
         if (state_ == NOT_CONNECTED) {
-            DoResolveOrConnect();
+            //优先切换到已连接的备用服务器
+            if (!Failover()) {
+                DoResolveOrConnect();
+            }
         }
     } else if (msg->message_id == 1) {
+        int delay = kHeartbeatDelay;
+        //trace定期落盘, 进程崩溃时最多丢失一个心跳周期的记录
+        trace_.Flush();
         if (state_ == NOT_CONNECTED) {
-            DoResolveOrConnect();
-        } else {
-            int64_t now = rtc::TimeMicros();
-            if (ping_ts_ > 0 && now - ping_ts_ > 1000*8) {
-                //8s未收到服务器的pong,断开重连
-                RTC_LOG(INFO) << "ping timeout, close socket...";
-                state_ = NOT_CONNECTED;
-                control_socket_->Close();
-                control_socket_.reset(NULL);
-                DoResolveOrConnect();
+            //重连由ScheduleReconnect的定时器负责
+            ScheduleReconnect();
+        } else if (state_ == CONNECTED) {
+            if (heartbeat_.IsTimedOut(rtc::TimeMicros())) {
+                OnPingTimeout();
             } else {
                 SendPing();
-                ping_ts_ = now;
-            }
-            if (state_ != SIGNING_OUT) {
-                rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kHeartbeatDelay,
-                                                    this, 1);
+                delay = heartbeat_.interval_ms();
             }
+        } else if (state_ == SIGNING_IN &&
+                   rtc::TimeMillis() - connect_start_ms_ > kHandshakeTimeout) {
+            RTC_LOG(WARNING) << "tls handshake timeout";
+            OnConnectionLost();
         }
+        if (state_ != SIGNING_OUT) {
+            rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this, 1);
+        }
+    } else if (msg->message_id == 3) {
+        //检查ping是否超时
+        if (state_ == CONNECTED && heartbeat_.IsTimedOut(rtc::TimeMicros())) {
+            OnPingTimeout();
+        }
+    } else if (msg->message_id == 4) {
+        //MSG_RT的重传定时器
+        retransmit_deadline_ = -1;
+        Retransmit();
+        ScheduleRetransmit();
     }
 }
 
+void PeerConnectionClient::OnPingTimeout() {
+    RTC_LOG(INFO) << "ping timeout after " << heartbeat_.timeout_ms()
+                  << "ms, close socket...";
+    heartbeat_.Reset();
+    OnConnectionLost();
+}
+
 
 bool PeerConnectionClient::SendMessage(Message& msg) {
-    if (control_socket_ == NULL || state_ != CONNECTED) {
+    if (control_socket_ == NULL) {
+        return false;
+    }
+    //恢复会话期间, 实时消息先进入队列, 在auth之后发出
+    bool queue_only = resuming_ && msg.cmd == MSG_RT;
+    if (state_ != CONNECTED && !queue_only) {
         return false;
     }
 
     msg.seq = ++seq_;
-    
-    char buf[64*1024] = {0};
-    int len = WriteMessage(buf, 64*1024, msg);
-    
-    if (size_ > 0) {
-        //socket不可写
-        int left = 128*1024 - offset_ - size_;
-        if (left < len) {
-            memmove(block_, block_ + offset_, size_);
-            offset_ = 0;
-            left = 128*1024 - size_;
-        }
-        if (left < len) {
-            //error data overflow
-            return false;
-        }
-        memcpy(block_ + offset_, buf, len);
-        size_ += len;
-    } else {
-        int sent = control_socket_->Send(buf, len);
-        if ((int)sent < 0 && rtc::IsBlockingError(control_socket_->GetError())) {
-            memcpy(block_ + offset_, buf, len);
-            size_ += len;
-        } else if (sent > 0 && sent < len) {
-            memcpy(block_ + offset_, buf + sent, len - sent);
-            size_ += (len - sent);
-        } else {
-            return false;
-        }
+    if (!send_queue_.Push(msg, SendQueue::LaneOf(msg.cmd))) {
+        RTC_LOG(LS_ERROR) << "send queue overflow, cmd:" << msg.cmd
+                          << " queued bytes:" << send_queue_.bytes();
+        return false;
     }
+    TraceSent(msg);
+
+    if (state_ != CONNECTED) {
+        return true;
+    }
+
+    if (coalesce_delay_us_ <= 0 || send_queue_.bytes() >= coalesce_bytes_) {
+        Flush();
+        return true;
+    }
+
+    //等待更多的消息合并到一次写入
+    int64_t now = rtc::TimeMicros();
+    if (coalesce_frames_ == 0) {
+        coalesce_first_ts_ = now;
+        int delay = (int)((coalesce_delay_us_ + 999) / 1000);
+        rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this, 2);
+    }
+    coalesce_frames_++;
+    coalesce_ts_sum_ += now;
     return true;
 }
 
@@ -352,10 +929,40 @@ void PeerConnectionClient::SendAuth() {
     
     Message m;
     m.cmd = MSG_AUTH_TOKEN;
+    m.seq = ++seq_;
     m.token = token_;
     m.device_id = device_id;
     m.platform_id = PLATFORM_ID;
-    SendMessage(m);
+    if (resuming_) {
+        m.version = AUTH_VERSION_RESUME;
+        m.last_seq = last_recv_seq_;
+        RTC_LOG(INFO) << "resume session, last seq:" << last_recv_seq_
+                      << " queued frames:" << send_queue_.frames();
+    }
+
+    //auth必须是连接上的第一条消息, 丢弃上一次连接未发出的auth
+    if (send_queue_.front_cmd() == MSG_AUTH_TOKEN) {
+        send_queue_.PopFront();
+    }
+    if (!send_queue_.PushFront(m, SendQueue::LANE_CONTROL)) {
+        RTC_LOG(LS_ERROR) << "can't queue auth";
+        return;
+    }
+    //trace中不保存token
+    m.token.clear();
+    TraceSent(m);
+    Flush();
+}
+
+void PeerConnectionClient::TraceSent(Message& msg) {
+    if (!trace_.is_open()) {
+        return;
+    }
+    trace_frame_.resize(GetMessageSize(msg));
+    int n = WriteMessage(&trace_frame_[0], (int)trace_frame_.size(), msg);
+    if (n > 0) {
+        trace_.Record(TRACE_SENT, rtc::TimeMicros(), trace_frame_.data(), n);
+    }
 }
 
 
@@ -363,5 +970,11 @@ void PeerConnectionClient::SendPing() {
   Message m;
   m.cmd = MSG_PING;
   RTC_LOG(INFO) << "ping...";
-  SendMessage(m);
+  if (!SendMessage(m)) {
+    return;
+  }
+  heartbeat_.OnPingSent(m.seq, rtc::TimeMicros());
+  //pong的超时比下一次ping更早到期, 单独检查
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE,
+                                      heartbeat_.timeout_ms() + 1, this, 3);
 }
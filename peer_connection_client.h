@@ -14,44 +14,61 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "absl/strings/string_view.h"
+#include "examples/voip/heartbeat.h"
+#include "examples/voip/im_outbox.h"
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/relay_pool.h"
+#include "examples/voip/reliable_channel.h"
+#include "examples/voip/send_queue.h"
+#include "examples/voip/server_connector.h"
+#include "examples/voip/signaling_payload.h"
+#include "examples/voip/signaling_trace.h"
 #include "rtc_base/net_helpers.h"
 #include "rtc_base/physical_socket_server.h"
+#include "rtc_base/ssl_adapter.h"
 #include "rtc_base/third_party/sigslot/sigslot.h"
 
-enum EVOIPCommand {
-    //语音通话
-    VOIP_COMMAND_DIAL = 1,
-    VOIP_COMMAND_ACCEPT = 2,
-    VOIP_COMMAND_CONNECTED = 3,
-    VOIP_COMMAND_REFUSE = 4,
-    VOIP_COMMAND_REFUSED = 5,
-    VOIP_COMMAND_HANG_UP = 6,
-    VOIP_COMMAND_RESET = 7,
-
-    //通话中
-    VOIP_COMMAND_TALKING = 8,
-    
-    //视频通话
-    VOIP_COMMAND_DIAL_VIDEO = 9,
-    
-    VOIP_COMMAND_PING = 10,
-};
-
 struct PeerConnectionClientObserver {
   virtual void OnSignedIn() = 0;  // Called when we're logged on.
   virtual void OnDisconnected() = 0;
   virtual void OnServerConnectionFailure() = 0;
     
+  // |content| points into the client's receive buffer and is only valid
+  // for the duration of the call. |version| is the header version byte,
+  // which selects the payload encoding.
   virtual void HandleRTMessage(int64_t sender,
                                int64_t receiver,
-                               std::string& content) = 0;
+                               int version,
+                               absl::string_view content) = 0;
+
+  // A MSG_RT payload that arrives already decoded, from a transport that
+  // does not serialize it, see InProcessTransport.
+  virtual void HandleRTPayload(int64_t sender,
+                               int64_t receiver,
+                               const RTPayload& payload) {}
+
+  // MSG_IM from |sender|. |msgid| identifies the message per sender; a
+  // message may be delivered again after the sender reconnects.
+  virtual void HandleIMMessage(int64_t sender,
+                               int64_t receiver,
+                               int msgid,
+                               absl::string_view content) {}
+
+  // A MSG_RT to |peer_id| that was given up without an ack, see
+  // ReliableChannel. |version| and |content| are as it was sent.
+  virtual void OnRTMessageGaveUp(int64_t peer_id,
+                                 int version,
+                                 absl::string_view content) {}
     
  protected:
   virtual ~PeerConnectionClientObserver() {}
 };
 
 class Message;
+struct MessageView;
 class PeerConnectionClient : public sigslot::has_slots<>,
                              public rtc::MessageHandler {
  public:
@@ -73,61 +90,233 @@ class PeerConnectionClient : public sigslot::has_slots<>,
   bool is_connected() const;
   void RegisterObserver(PeerConnectionClientObserver *ob);
 
+  // Relays to sign in to. Defaults to the built-in server. With more than
+  // one, the others are probed in the background; reconnects go to the
+  // lowest-latency healthy relay, and when the current one dies the client
+  // fails over to an already connected backup.
+  void set_servers(const std::vector<rtc::SocketAddress>& servers);
+  std::vector<RelayPool::EndpointStats> relay_stats() const;
+
+  // Signs in over TLS. Every connection shares one SSL adapter factory, whose
+  // session cache lets a reconnect resume the previous session from its
+  // ticket instead of running a full handshake. |ignore_bad_cert| accepts a
+  // self-signed relay such as voip_relay with a test certificate. Relay
+  // probes stop pinging, since the TLS handshake belongs to whoever takes
+  // their socket over. Call before Connect().
+  void set_tls(bool enabled, bool ignore_bad_cert = false);
+  // TCP Fast Open towards the relay address that won last time, see
+  // ServerConnector. Once the kernel holds a cookie for the relay, the auth
+  // frame, or the ClientHello with TLS, travels in the SYN.
+  void set_fast_open(bool enabled);
+
+  struct SignInStats {
+    int64_t sign_ins = 0;
+    // From starting the connection, or taking over a backup, to
+    // MSG_AUTH_STATUS, for the last sign in.
+    int64_t last_latency_ms = -1;
+    bool last_tls_resumed = false;
+    int64_t tls_resumed = 0;
+  };
+  const SignInStats& sign_in_stats() const;
+
   void Connect();
   bool SignOut();
 
-  void SendRTMessage(int64_t peer_id, std::string content);
+  // Returns false if the frame could not be queued, i.e. when not signed in
+  // or when the send queue is past its hard limit. Either way the frame is
+  // retransmitted until |peer_id| acks it, see ReliableChannel.
+  bool SendRTMessage(int64_t peer_id, std::string content, int version = 0);
+  const ReliableChannel::Stats& reliable_stats() const;
+
+  // Queues an instant message for |peer_id| and returns its msgid. Up to
+  // the IM window of messages are sent without waiting for the server's
+  // acks; the rest wait in the outbox, also while disconnected.
+  int SendIMMessage(int64_t peer_id, std::string content);
+  // Keeps unacked instant messages in a journal at |path| so they are sent
+  // again after a restart.
+  bool OpenIMOutbox(const std::string& path);
+  void set_im_window(size_t window);
+  const ImOutbox::Stats& im_stats() const;
+
+  // Send queue backpressure. writable() turns false when the queued bytes
+  // reach the high watermark; SignalReadyToSend fires once they drain back
+  // to the low watermark.
+  bool writable() const;
+  size_t send_queue_depth() const;
+  size_t send_queue_bytes() const;
+  void set_send_watermarks(size_t high, size_t low);
+  sigslot::signal1<PeerConnectionClient*> SignalReadyToSend;
+
+  // Write coalescing. When |max_delay_us| is positive, frames are held for
+  // up to that long (rounded up to whole milliseconds) or until |max_bytes|
+  // are queued, and then written together. A delay of 0 writes every frame
+  // immediately, which is the default.
+  void set_coalescing(int64_t max_delay_us, size_t max_bytes);
+
+  struct WriteStats {
+    int64_t frames = 0;  // Frames fully written to the socket.
+    int64_t writes = 0;  // sendmsg()/Send() calls.
+    // Total and worst time frames waited in the coalescing window.
+    int64_t queue_delay_us = 0;
+    int64_t max_queue_delay_us = 0;
+
+    // Writes avoided compared to one write per frame.
+    int64_t syscalls_saved() const {
+      return frames > writes ? frames - writes : 0;
+    }
+  };
+  const WriteStats& write_stats() const;
+
+  // Frames are sent in priority lanes: auth, heartbeat and acks first, then
+  // MSG_RT (call control, SDP and ICE, in order), then MSG_IM. Queueing
+  // delay per lane, see SendQueue.
+  const SendQueue::LaneStats& lane_stats(SendQueue::Lane lane) const;
+
+  // Reconnect backoff. The first retry after losing the connection is
+  // immediate; the n-th one waits a random time between half and all of
+  // min(max_ms, base_ms * 2^(n-2)), so clients dropped together by a relay
+  // restart spread out instead of reconnecting in lockstep. The count resets
+  // once the server accepts our auth.
+  void set_reconnect_backoff(int base_ms, int max_ms);
+
+  // Round-trip times measured by the heartbeat. The ping interval and the
+  // dead-connection timeout are derived from them, see Heartbeat.
+  const RttStats& rtt_stats() const;
+
+  // Per-address outcome and connect latency of the last connection race.
+  const std::vector<ServerConnector::AttemptResult>& connect_results() const;
+  DnsCache* dns_cache() { return connector_.dns_cache(); }
+
+  // Upper bound the receive buffer may grow to for an oversized frame.
+  void set_max_recv_buffer_size(size_t size);
+
+  // Records every frame sent and received from now on into a trace at
+  // |path|, see SignalingTraceWriter; TraceReplayer plays it back. Sent
+  // frames are recorded when queued, with the auth token left out.
+  bool StartTrace(const std::string& path);
+  void StopTrace();
     
   // implements the MessageHandler interface
   void OnMessage(rtc::Message* msg);
   
  protected:
   void DoResolveOrConnect();
-  void DoConnect();
+  // Adopts a connected socket as the control socket and signs in, after the
+  // TLS handshake when TLS is on.
+  void DoConnect(rtc::AsyncSocket* socket);
   void Close();
   void InitSocketSignals();
-  bool ConnectControlSocket();
+  void OnServerConnected(ServerConnector* connector, rtc::AsyncSocket* socket);
+  void OnServerConnectFailed(ServerConnector* connector);
+  // Takes over the warm backup connection, if any.
+  bool Failover();
   void OnConnect(rtc::AsyncSocket* socket);
   void OnMessageFromPeer(int peer_id, const std::string& message);
 
 
   void OnWrite(rtc::AsyncSocket* socket);
+  // Writes as much of |send_queue_| as the socket accepts.
+  void Flush();
   void OnRead(rtc::AsyncSocket* socket);
+  // Dispatches every complete frame in |recv_buffer_|. Returns false if the
+  // stream is corrupt and the connection must be dropped.
+  bool ProcessMessages();
 
   void OnClose(rtc::AsyncSocket* socket, int err);
-
-  void OnResolveResult(rtc::AsyncResolverInterface* resolver);
+  // Drops the current connection and schedules a reconnect that resumes the
+  // session if we were signed in.
+  void OnConnectionLost();
+  void ScheduleReconnect();
+  int NextReconnectDelay();
 
 
-  void HandlePong(Message& msg);
+  void HandlePong(MessageView& msg);
+  void HandleRT(MessageView& msg);
+  void HandleAck(MessageView& msg);
+  void HandleIM(MessageView& msg);
+  // Sends as many outbox messages as the IM window allows.
+  void PumpIM();
+  void SendIMAck();
+  void SendAck(int64_t peer_id, int rt_seq);
+  void Retransmit();
+  void ScheduleRetransmit();
   void SendAuth();
 
   void SendPing();
+  void OnPingTimeout();
   bool SendMessage(Message& msg);
+  void TraceSent(Message& msg);
     
 
 
 
   PeerConnectionClientObserver* callback_;
+  std::vector<rtc::SocketAddress> servers_;
+  size_t server_index_;
+  RelayPool relay_pool_;
   rtc::SocketAddress server_address_;
-  rtc::AsyncResolver* resolver_;
+  ServerConnector connector_;
+  //TLS连接共用的factory及其session缓存, 必须比control_socket_后释放
+  std::unique_ptr<rtc::SSLAdapterFactory> tls_factory_;
+  bool tls_ignore_bad_cert_;
+  bool fast_open_;
   std::unique_ptr<rtc::AsyncSocket> control_socket_;
+  //control_socket_是TLS连接时指向它, 否则为NULL
+  rtc::SSLAdapter* tls_socket_;
+  //TLS连接上合并写入的数据
+  std::string tls_buffer_;
+  //开始连接的时间, 用于统计登录延迟
+  int64_t connect_start_ms_;
+  SignInStats sign_in_stats_;
   State state_;
   int64_t my_id_;
   
-  char data_[128*1024];
-  int data_size_;
+  RecvBuffer recv_buffer_;
   
   std::string token_;
   
   //待写入socket的缓存,
-  uint8_t block_[128*1024];
-  int offset_;
-  int size_;
+  SendQueue send_queue_;
+  //control_socket_的描述符, 用于sendmsg批量写入
+  int socket_fd_;
+
+  int64_t coalesce_delay_us_;
+  size_t coalesce_bytes_;
+  //等待合并写入的消息数量及其入队时间
+  int64_t coalesce_frames_;
+  int64_t coalesce_first_ts_;
+  int64_t coalesce_ts_sum_;
+  WriteStats write_stats_;
 
   int seq_;
 
-  int64_t ping_ts_;
+  int reconnect_base_delay_;
+  int reconnect_max_delay_;
+  int reconnect_attempts_;
+  bool reconnect_pending_;
+
+  //会话恢复: 断线期间保留发送队列, 重连后在auth中带上last_recv_seq_
+  bool signed_in_;
+  bool resuming_;
+  int64_t disconnect_ts_;
+  //最后一条收到的服务器消息的seq
+  int last_recv_seq_;
+
+  Heartbeat heartbeat_;
+
+  //MSG_RT的确认, 重传及去重
+  ReliableChannel reliable_;
+  //已投递的重传定时器的到期时间, -1表示没有
+  int64_t retransmit_deadline_;
+
+  ImOutbox im_outbox_;
+  //本批收到的最后一条MSG_IM的seq, 处理完一批消息后统一确认
+  int im_ack_seq_;
+  bool im_ack_pending_;
+
+  SignalingTraceWriter trace_;
+  //编码发送消息的缓存
+  std::string trace_frame_;
 };
 
 #endif  // WEBRTC_EXAMPLES_PEERCONNECTION_CLIENT_PEER_CONNECTION_CLIENT_H_
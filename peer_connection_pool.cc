@@ -0,0 +1,292 @@
+#include "examples/voip/peer_connection_pool.h"
+
+#include <stdio.h>
+
+#include <utility>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+const int kDefaultPoolSize = 1;
+//TURN分配默认10分钟过期, 提前替换
+const int kDefaultMaxIdle = 5*60*1000;
+//检查过期的间隔
+const int kExpireCheckDelay = 30*1000;
+
+enum {
+  MSG_FILL = 1,
+  MSG_EXPIRE,
+};
+
+}  // namespace
+
+webrtc::PeerConnectionInterface::RTCConfiguration CreateRTCConfiguration(
+    int64_t uid, const std::string& token) {
+  webrtc::PeerConnectionInterface::RTCConfiguration config;
+  webrtc::PeerConnectionInterface::IceServer server;
+  server.uri = "stun:stun.counterpath.net:3478";
+  config.servers.push_back(server);
+  webrtc::PeerConnectionInterface::IceServer server2;
+  server2.uri = "turn:turn.gobelieve.io:3478?transport=udp";
+  char s[64] = {0};
+  snprintf(s, 64, "7_%ld", (long)uid);
+  server2.username = s;
+  server2.password = token;
+  config.servers.push_back(server2);
+
+  config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+  return config;
+}
+
+void PooledPeerConnectionObserver::OnSignalingChange(
+    webrtc::PeerConnectionInterface::SignalingState new_state) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnSignalingChange(new_state);
+  }
+}
+
+void PooledPeerConnectionObserver::OnAddStream(
+    rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnAddStream(stream);
+  }
+}
+
+void PooledPeerConnectionObserver::OnRemoveStream(
+    rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnRemoveStream(stream);
+  }
+}
+
+void PooledPeerConnectionObserver::OnDataChannel(
+    rtc::scoped_refptr<webrtc::DataChannelInterface> channel) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnDataChannel(channel);
+  }
+}
+
+void PooledPeerConnectionObserver::OnRenegotiationNeeded() {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnRenegotiationNeeded();
+  }
+}
+
+void PooledPeerConnectionObserver::OnIceConnectionChange(
+    webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnIceConnectionChange(new_state);
+  }
+}
+
+void PooledPeerConnectionObserver::OnIceGatheringChange(
+    webrtc::PeerConnectionInterface::IceGatheringState new_state) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnIceGatheringChange(new_state);
+  }
+}
+
+void PooledPeerConnectionObserver::OnIceCandidate(
+    const webrtc::IceCandidateInterface* candidate) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnIceCandidate(candidate);
+  }
+}
+
+void PooledPeerConnectionObserver::OnIceConnectionReceivingChange(
+    bool receiving) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnIceConnectionReceivingChange(receiving);
+  }
+}
+
+void PooledPeerConnectionObserver::OnAddTrack(
+    rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver,
+    const std::vector<rtc::scoped_refptr<webrtc::MediaStreamInterface>>&
+        streams) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnAddTrack(receiver, streams);
+  }
+}
+
+void PooledPeerConnectionObserver::OnTrack(
+    rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) {
+  webrtc::PeerConnectionObserver* target = target_;
+  if (target) {
+    target->OnTrack(transceiver);
+  }
+}
+
+PeerConnectionPool::PeerConnectionPool(MediaEngine* engine,
+                                       rtc::Thread* thread)
+    : engine_(engine),
+      thread_(thread),
+      size_(kDefaultPoolSize),
+      max_idle_ms_(kDefaultMaxIdle),
+      running_(false),
+      fill_posted_(false) {
+}
+
+PeerConnectionPool::~PeerConnectionPool() {
+  Stop();
+}
+
+void PeerConnectionPool::set_configuration(
+    const webrtc::PeerConnectionInterface::RTCConfiguration& config) {
+  config_ = config;
+  if (config_.ice_candidate_pool_size <= 0) {
+    config_.ice_candidate_pool_size = 1;
+  }
+  config_.enable_dtls_srtp = true;
+  Clear();
+  if (running_) {
+    Fill();
+  }
+}
+
+void PeerConnectionPool::set_size(int size) {
+  size_ = size;
+}
+
+void PeerConnectionPool::set_max_idle(int max_idle_ms) {
+  max_idle_ms_ = max_idle_ms;
+}
+
+void PeerConnectionPool::Start() {
+  RTC_DCHECK(thread_->IsCurrent());
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  Fill();
+  thread_->PostDelayed(RTC_FROM_HERE, kExpireCheckDelay, this, MSG_EXPIRE);
+}
+
+void PeerConnectionPool::Stop() {
+  RTC_DCHECK(thread_->IsCurrent());
+  running_ = false;
+  fill_posted_ = false;
+  thread_->Clear(this);
+  Clear();
+}
+
+rtc::scoped_refptr<webrtc::PeerConnectionInterface> PeerConnectionPool::Take(
+    webrtc::PeerConnectionObserver* observer,
+    std::unique_ptr<PooledPeerConnectionObserver>* pooled_observer) {
+  RTC_DCHECK(thread_->IsCurrent());
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+  //取最新创建的, 候选地址和TURN分配最新
+  while (!entries_.empty() && !pc) {
+    Entry entry = std::move(entries_.back());
+    entries_.pop_back();
+    webrtc::PeerConnectionInterface::PeerConnectionState state =
+        entry.pc->peer_connection_state();
+    if (state == webrtc::PeerConnectionInterface::PeerConnectionState::kFailed ||
+        state == webrtc::PeerConnectionInterface::PeerConnectionState::kClosed) {
+      Close(&entry);
+      continue;
+    }
+    entry.observer->set_target(observer);
+    pc = entry.pc;
+    *pooled_observer = std::move(entry.observer);
+  }
+
+  if (pc) {
+    stats_.hits++;
+  } else {
+    stats_.misses++;
+  }
+  RTC_LOG(INFO) << "peer connection pool " << (pc ? "hit" : "miss")
+                << ", hits:" << stats_.hits << " misses:" << stats_.misses;
+
+  if (running_ && !fill_posted_) {
+    fill_posted_ = true;
+    thread_->Post(RTC_FROM_HERE, this, MSG_FILL);
+  }
+  return pc;
+}
+
+void PeerConnectionPool::OnMessage(rtc::Message* msg) {
+  if (msg->message_id == MSG_FILL) {
+    fill_posted_ = false;
+    if (running_) {
+      Fill();
+    }
+  } else if (msg->message_id == MSG_EXPIRE) {
+    if (running_) {
+      Expire();
+      thread_->PostDelayed(RTC_FROM_HERE, kExpireCheckDelay, this, MSG_EXPIRE);
+    }
+  }
+}
+
+void PeerConnectionPool::Fill() {
+  if (!engine_->Initialize()) {
+    return;
+  }
+  while ((int)entries_.size() < size_) {
+    Entry entry;
+    entry.observer.reset(new PooledPeerConnectionObserver());
+    webrtc::PeerConnectionDependencies dependencies(entry.observer.get());
+    entry.pc = engine_->factory()->CreatePeerConnection(
+        config_, std::move(dependencies));
+    if (!entry.pc) {
+      RTC_LOG(WARNING) << "create pooled peer connection failed";
+      return;
+    }
+    entry.created_ms = rtc::TimeMillis();
+    entries_.push_back(std::move(entry));
+    stats_.created++;
+  }
+}
+
+void PeerConnectionPool::Expire() {
+  int64_t now = rtc::TimeMillis();
+  //先创建替换的连接, 再关闭过期的
+  std::vector<Entry> expired;
+  for (size_t i = 0; i < entries_.size();) {
+    if (now - entries_[i].created_ms >= max_idle_ms_) {
+      expired.push_back(std::move(entries_[i]));
+      entries_.erase(entries_.begin() + i);
+    } else {
+      i++;
+    }
+  }
+  if (expired.empty()) {
+    return;
+  }
+  Fill();
+  for (Entry& entry : expired) {
+    Close(&entry);
+    stats_.expired++;
+  }
+  RTC_LOG(INFO) << "replaced expired pooled peer connections:"
+                << expired.size();
+}
+
+void PeerConnectionPool::Clear() {
+  for (Entry& entry : entries_) {
+    Close(&entry);
+  }
+  entries_.clear();
+}
+
+void PeerConnectionPool::Close(Entry* entry) {
+  //Close()返回后PeerConnection不再回调observer, 可以释放
+  entry->pc->Close();
+  entry->pc = NULL;
+  entry->observer.reset();
+}
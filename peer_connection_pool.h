@@ -0,0 +1,130 @@
+#ifndef PEER_CONNECTION_POOL_H
+#define PEER_CONNECTION_POOL_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api/peer_connection_interface.h"
+#include "api/scoped_refptr.h"
+#include "examples/voip/media_engine.h"
+#include "rtc_base/thread.h"
+
+// The configuration every call uses: the STUN server and our TURN server,
+// with |uid| and |token| as the TURN credentials.
+webrtc::PeerConnectionInterface::RTCConfiguration CreateRTCConfiguration(
+    int64_t uid, const std::string& token);
+
+// Observer a pooled PeerConnection is created with. A PeerConnection keeps
+// the observer it was created with, so this one forwards to whoever took
+// the connection from the pool and drops events until then.
+class PooledPeerConnectionObserver : public webrtc::PeerConnectionObserver {
+ public:
+  PooledPeerConnectionObserver() : target_(NULL) {}
+
+  void set_target(webrtc::PeerConnectionObserver* target) { target_ = target; }
+
+  void OnSignalingChange(
+      webrtc::PeerConnectionInterface::SignalingState new_state) override;
+  void OnAddStream(
+      rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) override;
+  void OnRemoveStream(
+      rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) override;
+  void OnDataChannel(
+      rtc::scoped_refptr<webrtc::DataChannelInterface> channel) override;
+  void OnRenegotiationNeeded() override;
+  void OnIceConnectionChange(
+      webrtc::PeerConnectionInterface::IceConnectionState new_state) override;
+  void OnIceGatheringChange(
+      webrtc::PeerConnectionInterface::IceGatheringState new_state) override;
+  void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
+  void OnIceConnectionReceivingChange(bool receiving) override;
+  void OnAddTrack(
+      rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver,
+      const std::vector<rtc::scoped_refptr<webrtc::MediaStreamInterface>>&
+          streams) override;
+  void OnTrack(rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver)
+      override;
+
+ private:
+  //PeerConnection在媒体信令线程上回调, target在主线程上设置
+  std::atomic<webrtc::PeerConnectionObserver*> target_;
+};
+
+// Keeps PeerConnections created ahead of the call, so that STUN binding
+// and TURN allocation run while the client is idle instead of after the
+// peer answered. Each one is created with a non-zero
+// ice_candidate_pool_size, which makes it start gathering right away and
+// hand the gathered candidates and allocations to the first transport.
+//
+// Warm connections are replaced after |max_idle_ms|, well before the TURN
+// allocation lifetime (10 minutes by default) and before host candidates
+// get stale. Take() refills the pool in a posted task, off the call setup
+// path. All methods must be called on |thread|.
+class PeerConnectionPool : public rtc::MessageHandler {
+ public:
+  struct Stats {
+    int64_t hits = 0;
+    // Take() found the pool empty and the call created its own.
+    int64_t misses = 0;
+    int64_t created = 0;
+    int64_t expired = 0;
+  };
+
+  PeerConnectionPool(MediaEngine* engine, rtc::Thread* thread);
+  ~PeerConnectionPool();
+
+  // Configuration of the pooled connections. An ice_candidate_pool_size of
+  // 0 is raised to 1 and DTLS is always on. Warm connections made with an
+  // older configuration are replaced.
+  void set_configuration(
+      const webrtc::PeerConnectionInterface::RTCConfiguration& config);
+  void set_size(int size);
+  void set_max_idle(int max_idle_ms);
+
+  // Fills the pool and starts replacing expired connections; Stop() closes
+  // all of them.
+  void Start();
+  void Stop();
+
+  // Hands out a warm PeerConnection, which reports to |observer| from now
+  // on. |*pooled_observer| must be kept until the connection is closed.
+  // Returns NULL when none is ready.
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface> Take(
+      webrtc::PeerConnectionObserver* observer,
+      std::unique_ptr<PooledPeerConnectionObserver>* pooled_observer);
+
+  int warm() const { return (int)entries_.size(); }
+  const Stats& stats() const { return stats_; }
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  struct Entry {
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+    std::unique_ptr<PooledPeerConnectionObserver> observer;
+    int64_t created_ms = 0;
+  };
+
+  void Fill();
+  void Expire();
+  void Clear();
+  static void Close(Entry* entry);
+
+  MediaEngine* engine_;
+  rtc::Thread* thread_;
+  webrtc::PeerConnectionInterface::RTCConfiguration config_;
+  int size_;
+  int max_idle_ms_;
+  bool running_;
+  //已经投递了MSG_FILL
+  bool fill_posted_;
+  std::vector<Entry> entries_;
+  Stats stats_;
+};
+
+#endif
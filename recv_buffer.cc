@@ -0,0 +1,115 @@
+#include "examples/voip/recv_buffer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "examples/voip/message.h"
+
+RecvBuffer::RecvBuffer(size_t capacity, size_t max_capacity)
+    : storage_(new char[capacity]),
+      capacity_(capacity),
+      max_capacity_(std::max(capacity, max_capacity)),
+      head_(0),
+      size_(0) {
+}
+
+RecvBuffer::~RecvBuffer() {
+}
+
+void RecvBuffer::set_max_capacity(size_t max_capacity) {
+    max_capacity_ = std::max(capacity_, max_capacity);
+}
+
+char* RecvBuffer::WritePtr(size_t* len) {
+    if (size_ == 0) {
+        //缓冲区为空时从头开始写,尽量保证消息连续
+        head_ = 0;
+    }
+    size_t tail = (head_ + size_) % capacity_;
+    if (size_ == capacity_) {
+        *len = 0;
+    } else if (tail >= head_) {
+        *len = capacity_ - tail;
+    } else {
+        *len = head_ - tail;
+    }
+    return storage_.get() + tail;
+}
+
+void RecvBuffer::Commit(size_t n) {
+    size_ += std::min(n, capacity_ - size_);
+}
+
+const char* RecvBuffer::Peek(size_t n) {
+    n = std::min(n, size_);
+    if (head_ + n <= capacity_) {
+        return storage_.get() + head_;
+    }
+
+    size_t first = capacity_ - head_;
+    scratch_.resize(n);
+    memcpy(scratch_.data(), storage_.get() + head_, first);
+    memcpy(scratch_.data() + first, storage_.get(), n - first);
+    return scratch_.data();
+}
+
+void RecvBuffer::Consume(size_t n) {
+    n = std::min(n, size_);
+    head_ = (head_ + n) % capacity_;
+    size_ -= n;
+}
+
+void RecvBuffer::Clear() {
+    head_ = 0;
+    size_ = 0;
+}
+
+bool RecvBuffer::Reserve(size_t n) {
+    if (n <= capacity_) {
+        return true;
+    }
+    if (n > max_capacity_) {
+        return false;
+    }
+
+    size_t capacity = capacity_;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+    capacity = std::min(capacity, max_capacity_);
+
+    std::unique_ptr<char[]> storage(new char[capacity]);
+    size_t first = std::min(size_, capacity_ - head_);
+    memcpy(storage.get(), storage_.get() + head_, first);
+    memcpy(storage.get() + first, storage_.get(), size_ - first);
+    storage_ = std::move(storage);
+    capacity_ = capacity;
+    head_ = 0;
+    return true;
+}
+
+int RecvBuffer::PeekMessage(MessageView* m) {
+    if (size_ < HEADER_SIZE) {
+        return 0;
+    }
+
+    const char* p = Peek(HEADER_SIZE);
+    int n = DecodeMessage(p, HEADER_SIZE, m);
+    if (n < 0) {
+        return -1;
+    }
+    if (n == 0) {
+        //消息不完整,确保缓冲区能容纳整条消息
+        size_t frame = HEADER_SIZE + (size_t)m->length;
+        if (!Reserve(frame)) {
+            return -1;
+        }
+        if (size_ < frame) {
+            return 0;
+        }
+        p = Peek(frame);
+        n = DecodeMessage(p, (int)frame, m);
+    }
+    return n;
+}
@@ -0,0 +1,58 @@
+#ifndef RECV_BUFFER_H
+#define RECV_BUFFER_H
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+struct MessageView;
+
+// Circular receive buffer for a signaling socket. Bytes are appended at the
+// tail and frames are decoded from the head; space freed by consumed frames
+// is reused by wrapping around, so the buffer never compacts. A frame that
+// straddles the end of the storage is linearized into a scratch buffer, and
+// the storage grows (up to |max_capacity|) when one frame does not fit.
+class RecvBuffer {
+ public:
+  RecvBuffer(size_t capacity, size_t max_capacity);
+  ~RecvBuffer();
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t max_capacity() const { return max_capacity_; }
+  void set_max_capacity(size_t max_capacity);
+
+  // Returns the contiguous free space at the tail. |*len| is 0 when the
+  // buffer is full.
+  char* WritePtr(size_t* len);
+  // Marks |n| bytes written through WritePtr() as received.
+  void Commit(size_t n);
+
+  // Returns the first |n| bytes (n <= size()) as one contiguous block.
+  const char* Peek(size_t n);
+  void Consume(size_t n);
+  void Clear();
+
+  // Grows the storage so that at least |n| bytes fit. Returns false if that
+  // would exceed max_capacity().
+  bool Reserve(size_t n);
+
+  // Decodes the frame at the head of the buffer without consuming it. Same
+  // return convention as DecodeMessage(); a frame larger than the current
+  // capacity grows the storage, and one larger than max_capacity() is
+  // reported as malformed. |m| stays valid until the next non-const call.
+  int PeekMessage(MessageView* m);
+
+ private:
+  std::unique_ptr<char[]> storage_;
+  size_t capacity_;
+  size_t max_capacity_;
+  size_t head_;
+  size_t size_;
+
+  //跨越缓冲区末尾的消息拷贝到这里
+  std::vector<char> scratch_;
+};
+
+#endif
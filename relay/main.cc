@@ -0,0 +1,129 @@
+/*
+ * Local stand-in for the signaling relay, so clients, benchmarks and the
+ * load generator can run without the live server.
+ *
+ * usage: voip_relay [-l ip] [-p port] [-t token:uid]... [-s seconds]
+ *                   [-c cert.pem -k key.pem]
+ *
+ *   -l  listen address, default 0.0.0.0
+ *   -p  listen port, default 23000
+ *   -t  accept |token| as |uid|; may be repeated. Without -t any token that
+ *       is a positive decimal number signs in as that uid.
+ *   -s  print counters every |seconds|, 0 disables, default 5
+ *   -c  serve TLS with this PEM certificate chain, together with -k
+ *   -k  PEM private key of the -c certificate
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "examples/voip/relay/relay_server.h"
+
+namespace {
+
+RelayServer* g_server = NULL;
+
+void OnSignal(int) {
+  if (g_server != NULL) {
+    g_server->Stop();
+  }
+}
+
+// Tens of thousands of connections need more than the default 1024 fds.
+void RaiseFdLimit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return;
+  }
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  fprintf(stderr, "max open files:%llu\n",
+          (unsigned long long)limit.rlim_cur);
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-l ip] [-p port] [-t token:uid]... [-s seconds]\n"
+          "          [-c cert.pem -k key.pem]\n",
+          name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string ip = "0.0.0.0";
+  int port = 23000;
+  int stats_interval = 5;
+  std::string cert_file;
+  std::string key_file;
+
+  RelayServer server;
+  int opt;
+  while ((opt = getopt(argc, argv, "l:p:t:s:c:k:h")) != -1) {
+    switch (opt) {
+      case 'l':
+        ip = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 't': {
+        const char* colon = strrchr(optarg, ':');
+        if (colon == NULL || atoll(colon + 1) <= 0) {
+          Usage(argv[0]);
+          return 1;
+        }
+        server.AddToken(std::string(optarg, colon - optarg),
+                        atoll(colon + 1));
+        break;
+      }
+      case 's':
+        stats_interval = atoi(optarg);
+        break;
+      case 'c':
+        cert_file = optarg;
+        break;
+      case 'k':
+        key_file = optarg;
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  //对端关闭后writev不应杀死进程
+  signal(SIGPIPE, SIG_IGN);
+  g_server = &server;
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+
+  if (cert_file.empty() != key_file.empty()) {
+    Usage(argv[0]);
+    return 1;
+  }
+  if (!cert_file.empty() && !server.EnableTls(cert_file, key_file)) {
+    return 1;
+  }
+
+  RaiseFdLimit();
+  if (!server.Listen(ip, port)) {
+    return 1;
+  }
+  server.Run(stats_interval * 1000);
+
+  const RelayServer::Stats& stats = server.stats();
+  fprintf(stderr, "accepted:%llu routed:%llu pings:%llu\n",
+          (unsigned long long)stats.accepted,
+          (unsigned long long)stats.routed,
+          (unsigned long long)stats.pings);
+  return 0;
+}
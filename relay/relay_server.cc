@@ -0,0 +1,660 @@
+#include "examples/voip/relay/relay_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "examples/voip/message.h"
+
+namespace {
+
+const int kMaxEvents = 256;
+const int kMaxIov = 64;
+
+const size_t kRecvBufferSize = 4*1024;
+const size_t kMaxRecvBufferSize = HEADER_SIZE + MAX_BODY_SIZE;
+
+//多数连接只收发少量信令, 用小块减少内存占用
+const size_t kChunkSize = 4*1024;
+const size_t kMaxFreeChunks = 4096;
+
+// Per-connection send limit; frames for a receiver that does not drain its
+// socket are dropped beyond this.
+const size_t kMaxSendBytes = 1024*1024;
+
+// Pending connections whose SYN carried data (TCP_FASTOPEN queue length).
+const int kFastOpenQueue = 1024;
+// Largest TLS record payload.
+const size_t kMaxTlsRecord = 16*1024;
+
+#define AUTH_STATUS_OK 0
+#define AUTH_STATUS_FAILED 1
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool ParseUid(const std::string& token, int64_t* uid) {
+  if (token.empty() || token.size() > 18) {
+    return false;
+  }
+  int64_t v = 0;
+  for (char c : token) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    v = v * 10 + (c - '0');
+  }
+  *uid = v;
+  return v > 0;
+}
+
+}  // namespace
+
+RelayServer::Connection::Connection(ChunkPool* pool)
+    : fd(-1),
+      uid(0),
+      seq(0),
+      im_ack_seq(0),
+      im_ack_pending(false),
+      recv_buffer(kRecvBufferSize, kMaxRecvBufferSize),
+      send_queue(pool),
+      ssl(NULL),
+      handshaking(false),
+      handshake_want_write(false),
+      want_write(false),
+      dirty(false),
+      closing(false),
+      closed(false) {
+  send_queue.set_max_bytes(kMaxSendBytes);
+}
+
+RelayServer::Connection::~Connection() {
+  if (ssl != NULL) {
+    //不发送close_notify, 但session仍留在缓存中可以恢复
+    SSL_set_quiet_shutdown(ssl, 1);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+  }
+}
+
+RelayServer::RelayServer()
+    : epoll_fd_(-1),
+      listen_fd_(-1),
+      running_(false),
+      tls_ctx_(NULL),
+      pool_(kChunkSize, kMaxFreeChunks) {
+}
+
+RelayServer::~RelayServer() {
+  for (auto& it : connections_) {
+    close(it.first);
+  }
+  connections_.clear();
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+  if (tls_ctx_ != NULL) {
+    SSL_CTX_free(tls_ctx_);
+  }
+}
+
+void RelayServer::AddToken(const std::string& token, int64_t uid) {
+  tokens_[token] = uid;
+}
+
+bool RelayServer::EnableTls(const std::string& cert_file,
+                            const std::string& key_file) {
+  SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+  if (ctx == NULL) {
+    return false;
+  }
+  if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(),
+                                  SSL_FILETYPE_PEM) != 1) {
+    fprintf(stderr, "can't load tls certificate %s or key %s\n",
+            cert_file.c_str(), key_file.c_str());
+    ERR_print_errors_fp(stderr);
+    SSL_CTX_free(ctx);
+    return false;
+  }
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  //session ticket默认开启, 密钥在进程生命期内有效
+  SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  if (tls_ctx_ != NULL) {
+    SSL_CTX_free(tls_ctx_);
+  }
+  tls_ctx_ = ctx;
+  return true;
+}
+
+bool RelayServer::Listen(const std::string& ip, int port) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    perror("epoll_create1");
+    return false;
+  }
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    perror("socket");
+    return false;
+  }
+  int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+    fprintf(stderr, "invalid listen address:%s\n", ip.c_str());
+    return false;
+  }
+  if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror("bind");
+    return false;
+  }
+  if (listen(listen_fd_, SOMAXCONN) != 0) {
+    perror("listen");
+    return false;
+  }
+#ifdef TCP_FASTOPEN
+  //内核未开启服务端TFO时退化为普通的三次握手
+  int qlen = kFastOpenQueue;
+  setsockopt(listen_fd_, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
+#endif
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = listen_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+  fprintf(stderr, "relay listen on %s:%d%s\n", ip.c_str(), port,
+          tls_ctx_ != NULL ? " tls" : "");
+  return true;
+}
+
+void RelayServer::Run(int stats_interval_ms) {
+  running_ = true;
+  epoll_event events[kMaxEvents];
+  int64_t last_stats = NowMs();
+
+  while (running_) {
+    int timeout = stats_interval_ms > 0 ? stats_interval_ms : 1000;
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == listen_fd_) {
+        Accept();
+        continue;
+      }
+      auto it = connections_.find(fd);
+      if (it == connections_.end() || it->second->closed) {
+        continue;
+      }
+      Connection* conn = it->second.get();
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        Close(conn);
+        continue;
+      }
+      if (events[i].events & EPOLLIN) {
+        OnReadable(conn);
+      }
+      if (!conn->closed && (events[i].events & EPOLLOUT)) {
+        Flush(conn);
+      }
+    }
+
+    //一轮事件结束后统一发送, 每个连接一次writev
+    for (size_t i = 0; i < dirty_.size(); i++) {
+      Connection* conn = dirty_[i];
+      conn->dirty = false;
+      if (conn->closed) {
+        continue;
+      }
+      if (conn->im_ack_pending) {
+        SendIMAck(conn);
+      }
+      Flush(conn);
+    }
+    dirty_.clear();
+    ReleaseClosed();
+
+    int64_t now = NowMs();
+    if (stats_interval_ms > 0 && now - last_stats >= stats_interval_ms) {
+      PrintStats((now - last_stats) / 1000.0);
+      last_stats = now;
+    }
+  }
+}
+
+void RelayServer::Accept() {
+  while (true) {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = accept4(listen_fd_, (sockaddr*)&addr, &len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        //EMFILE等, 等待下一次可读事件
+        perror("accept4");
+      }
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef TCPI_OPT_SYN_DATA
+    tcp_info info;
+    socklen_t info_len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0 &&
+        (info.tcpi_options & TCPI_OPT_SYN_DATA)) {
+      stats_.fast_open++;
+    }
+#endif
+
+    std::unique_ptr<Connection> conn(new Connection(&pool_));
+    conn->fd = fd;
+    if (tls_ctx_ != NULL) {
+      conn->ssl = SSL_new(tls_ctx_);
+      if (conn->ssl == NULL || SSL_set_fd(conn->ssl, fd) != 1) {
+        close(fd);
+        continue;
+      }
+      SSL_set_accept_state(conn->ssl);
+      conn->handshaking = true;
+    }
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      perror("epoll_ctl");
+      close(fd);
+      continue;
+    }
+    connections_[fd] = std::move(conn);
+    stats_.accepted++;
+    stats_.connections++;
+  }
+}
+
+void RelayServer::OnReadable(Connection* conn) {
+  if (conn->handshaking && !Handshake(conn)) {
+    return;
+  }
+  while (!conn->closed) {
+    size_t len = 0;
+    char* p = conn->recv_buffer.WritePtr(&len);
+    if (len == 0) {
+      //缓冲区已满且无法解析出完整消息
+      Close(conn);
+      return;
+    }
+    ssize_t bytes = Read(conn, p, len);
+    if (bytes == 0) {
+      Close(conn);
+      return;
+    }
+    if (bytes < 0) {
+      return;
+    }
+    conn->recv_buffer.Commit(bytes);
+    stats_.bytes_in += bytes;
+
+    while (!conn->closed) {
+      MessageView m;
+      int n = conn->recv_buffer.PeekMessage(&m);
+      if (n < 0) {
+        fprintf(stderr, "fd:%d malformed frame, close\n", conn->fd);
+        Close(conn);
+        return;
+      }
+      if (n == 0) {
+        break;
+      }
+      if (m.cmd == MSG_RT || m.cmd == MSG_IM ||
+          (m.cmd == MSG_ACK && m.length >= PEER_ACK_BODY_SIZE)) {
+        //PeekMessage已把整个消息放到连续内存中
+        Route(conn, m, conn->recv_buffer.Peek(n), n);
+      } else {
+        HandleMessage(conn, m);
+      }
+      conn->recv_buffer.Consume(n);
+    }
+
+    //SSL中可能还有已解密的数据, TLS连接读到WANT_READ为止
+    if ((size_t)bytes < len && conn->ssl == NULL) {
+      return;
+    }
+  }
+}
+
+ssize_t RelayServer::Read(Connection* conn, char* p, size_t len) {
+  if (conn->ssl != NULL) {
+    int n = SSL_read(conn->ssl, p, (int)std::min<size_t>(len, INT32_MAX));
+    if (n > 0) {
+      return n;
+    }
+    int err = SSL_get_error(conn->ssl, n);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+      return -1;
+    }
+    return 0;
+  }
+
+  while (true) {
+    ssize_t bytes = recv(conn->fd, p, len, 0);
+    if (bytes >= 0) {
+      return bytes;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK ? -1 : 0;
+  }
+}
+
+bool RelayServer::Handshake(Connection* conn) {
+  int r = SSL_do_handshake(conn->ssl);
+  if (r == 1) {
+    conn->handshaking = false;
+    conn->handshake_want_write = false;
+    stats_.tls_handshakes++;
+    if (SSL_session_reused(conn->ssl)) {
+      stats_.tls_resumed++;
+    }
+    UpdateEvents(conn);
+    return true;
+  }
+
+  int err = SSL_get_error(conn->ssl, r);
+  if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+    conn->handshake_want_write = err == SSL_ERROR_WANT_WRITE;
+    UpdateEvents(conn);
+    return false;
+  }
+  stats_.tls_failures++;
+  ERR_clear_error();
+  Close(conn);
+  return false;
+}
+
+void RelayServer::HandleMessage(Connection* conn, const MessageView& m) {
+  switch (m.cmd) {
+    case MSG_AUTH_TOKEN:
+      HandleAuth(conn, m);
+      break;
+    case MSG_PING:
+      stats_.pings++;
+      Reply(conn, MSG_PONG, m.seq, 0);
+      break;
+    default:
+      break;
+  }
+}
+
+void RelayServer::HandleAuth(Connection* conn, const MessageView& m) {
+  std::string token(m.token.data(), m.token.size());
+  int64_t uid = 0;
+  bool ok;
+  if (tokens_.empty()) {
+    ok = ParseUid(token, &uid);
+  } else {
+    auto it = tokens_.find(token);
+    ok = it != tokens_.end();
+    if (ok) {
+      uid = it->second;
+    }
+  }
+
+  if (!ok) {
+    stats_.auth_failures++;
+    Reply(conn, MSG_AUTH_STATUS, 0, AUTH_STATUS_FAILED);
+    conn->closing = true;
+    return;
+  }
+
+  if (conn->uid != 0 && conn->uid != uid) {
+    auto it = users_.find(conn->uid);
+    if (it != users_.end() && it->second == conn) {
+      users_.erase(it);
+    }
+  }
+  if (conn->uid == 0) {
+    stats_.signed_in++;
+  }
+  //同一uid重复登录时, 消息发往最新的连接
+  conn->uid = uid;
+  users_[uid] = conn;
+  Reply(conn, MSG_AUTH_STATUS, 0, AUTH_STATUS_OK);
+}
+
+void RelayServer::Route(Connection* conn, const MessageView& m,
+                        const char* frame, size_t size) {
+  if (conn->uid == 0 || m.sender != conn->uid) {
+    //未登录或伪造的sender
+    stats_.rejected++;
+    return;
+  }
+  if (m.cmd == MSG_IM) {
+    //接收者不在线时也确认, 这里不保存离线消息
+    conn->im_ack_seq = m.seq;
+    conn->im_ack_pending = true;
+    MarkDirty(conn);
+  }
+  auto it = users_.find(m.receiver);
+  if (it == users_.end() || it->second->closed) {
+    stats_.offline++;
+    return;
+  }
+  Connection* receiver = it->second;
+  if (!receiver->send_queue.PushFrame(frame, size,
+                                        SendQueue::LaneOf(m.cmd))) {
+    stats_.overflow++;
+    return;
+  }
+  stats_.routed++;
+  MarkDirty(receiver);
+}
+
+void RelayServer::Reply(Connection* conn, int cmd, int seq, int status) {
+  Message m;
+  m.cmd = cmd;
+  m.seq = seq != 0 ? seq : ++conn->seq;
+  m.status = status;
+  if (!conn->send_queue.Push(m, SendQueue::LANE_CONTROL)) {
+    stats_.overflow++;
+    return;
+  }
+  MarkDirty(conn);
+}
+
+void RelayServer::SendIMAck(Connection* conn) {
+  conn->im_ack_pending = false;
+  Message m;
+  m.cmd = MSG_ACK;
+  m.seq = ++conn->seq;
+  m.ack_seq = conn->im_ack_seq;
+  if (!conn->send_queue.Push(m, SendQueue::LANE_CONTROL)) {
+    stats_.overflow++;
+    return;
+  }
+  stats_.im_acks++;
+}
+
+void RelayServer::MarkDirty(Connection* conn) {
+  if (!conn->dirty) {
+    conn->dirty = true;
+    dirty_.push_back(conn);
+  }
+}
+
+void RelayServer::Flush(Connection* conn) {
+  if (conn->handshaking) {
+    //握手完成前不发送, auth之前也没有数据
+    Handshake(conn);
+    return;
+  }
+  if (conn->ssl != NULL) {
+    if (!FlushTls(conn)) {
+      return;
+    }
+  }
+  while (conn->ssl == NULL && !conn->send_queue.empty()) {
+    SendQueue::Segment segs[kMaxIov];
+    int count = conn->send_queue.Gather(segs, kMaxIov);
+    iovec iov[kMaxIov];
+    for (int i = 0; i < count; i++) {
+      iov[i].iov_base = const_cast<char*>(segs[i].data);
+      iov[i].iov_len = segs[i].size;
+    }
+    ssize_t n = writev(conn->fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        Close(conn);
+        return;
+      }
+      break;
+    }
+    conn->send_queue.Consume(n);
+    stats_.bytes_out += n;
+  }
+
+  if (conn->send_queue.empty() && conn->tls_out.empty() && conn->closing) {
+    Close(conn);
+    return;
+  }
+  UpdateEvents(conn);
+}
+
+bool RelayServer::FlushTls(Connection* conn) {
+  while (!conn->tls_out.empty() || !conn->send_queue.empty()) {
+    if (conn->tls_out.empty()) {
+      //排队的消息合并成一个记录, SSL_write重试时数据不能变化
+      SendQueue::Segment segs[kMaxIov];
+      int count = conn->send_queue.Gather(segs, kMaxIov);
+      for (int i = 0; i < count && conn->tls_out.size() < kMaxTlsRecord;
+           i++) {
+        size_t take =
+            std::min(segs[i].size, kMaxTlsRecord - conn->tls_out.size());
+        conn->tls_out.append(segs[i].data, take);
+      }
+      conn->send_queue.Consume(conn->tls_out.size());
+    }
+
+    int n = SSL_write(conn->ssl, conn->tls_out.data(),
+                      (int)conn->tls_out.size());
+    if (n <= 0) {
+      int err = SSL_get_error(conn->ssl, n);
+      if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+        return true;
+      }
+      ERR_clear_error();
+      Close(conn);
+      return false;
+    }
+    conn->tls_out.erase(0, n);
+    stats_.bytes_out += n;
+  }
+  return true;
+}
+
+void RelayServer::UpdateEvents(Connection* conn) {
+  bool want_write = !conn->send_queue.empty() || !conn->tls_out.empty() ||
+                    conn->handshake_want_write;
+  if (want_write == conn->want_write) {
+    return;
+  }
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  ev.data.fd = conn->fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &ev);
+  conn->want_write = want_write;
+}
+
+void RelayServer::Close(Connection* conn) {
+  if (conn->closed) {
+    return;
+  }
+  conn->closed = true;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->fd, NULL);
+  if (conn->uid != 0) {
+    auto it = users_.find(conn->uid);
+    if (it != users_.end() && it->second == conn) {
+      users_.erase(it);
+    }
+  }
+  conn->send_queue.Clear();
+  conn->tls_out.clear();
+  stats_.connections--;
+  //可能还在dirty_或本轮事件中, 延迟释放
+  closed_.push_back(conn->fd);
+}
+
+void RelayServer::ReleaseClosed() {
+  for (int fd : closed_) {
+    connections_.erase(fd);
+    close(fd);
+  }
+  closed_.clear();
+}
+
+void RelayServer::PrintStats(double seconds) {
+  if (seconds <= 0) {
+    return;
+  }
+  fprintf(stderr,
+          "connections:%llu signed_in:%llu routed:%.0f/s im_acks:%.0f/s "
+          "pings:%.0f/s "
+          "in:%.1fMB/s out:%.1fMB/s offline:%llu overflow:%llu "
+          "rejected:%llu auth_failures:%llu fast_open:%llu",
+          (unsigned long long)stats_.connections,
+          (unsigned long long)users_.size(),
+          (stats_.routed - last_stats_.routed) / seconds,
+          (stats_.im_acks - last_stats_.im_acks) / seconds,
+          (stats_.pings - last_stats_.pings) / seconds,
+          (stats_.bytes_in - last_stats_.bytes_in) / seconds / (1024 * 1024),
+          (stats_.bytes_out - last_stats_.bytes_out) / seconds / (1024 * 1024),
+          (unsigned long long)stats_.offline,
+          (unsigned long long)stats_.overflow,
+          (unsigned long long)stats_.rejected,
+          (unsigned long long)stats_.auth_failures,
+          (unsigned long long)stats_.fast_open);
+  if (tls_ctx_ != NULL) {
+    fprintf(stderr, " tls:%llu resumed:%llu tls_failures:%llu",
+            (unsigned long long)stats_.tls_handshakes,
+            (unsigned long long)stats_.tls_resumed,
+            (unsigned long long)stats_.tls_failures);
+  }
+  fprintf(stderr, "\n");
+  last_stats_ = stats_;
+}
@@ -0,0 +1,154 @@
+#ifndef RELAY_SERVER_H
+#define RELAY_SERVER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/send_queue.h"
+
+struct MessageView;
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+
+// Minimal stand-in for the signaling relay: accepts MSG_AUTH_TOKEN, answers
+// MSG_PING with MSG_PONG and forwards MSG_RT, and the peer MSG_ACK that
+// answers it, to the connection signed in as its receiver. Frames are
+// forwarded verbatim, so anything a client puts in the header (version,
+// rt_seq) reaches the peer untouched. MSG_IM is forwarded the same way and
+// acked to its sender with one cumulative MSG_ACK per batch of events.
+//
+// Single-threaded, level-triggered epoll. Each connection has its own
+// RecvBuffer and a SendQueue drawing from one shared ChunkPool; frames routed
+// while handling one batch of events are flushed with one writev() per
+// receiver at the end of the batch. Session resume is accepted but nothing
+// is replayed.
+//
+// With EnableTls() every connection is TLS. Session tickets are on, so a
+// reconnecting client resumes with an abbreviated handshake; queued frames
+// are then packed into records of up to 16 KB, one SSL_write() each. The
+// listen socket accepts TCP Fast Open when the kernel allows it
+// (net.ipv4.tcp_fastopen & 2), so an auth frame or ClientHello carried in
+// the SYN is readable as soon as the connection is accepted.
+class RelayServer {
+ public:
+  struct Stats {
+    uint64_t accepted = 0;
+    uint64_t connections = 0;
+    uint64_t signed_in = 0;
+    uint64_t auth_failures = 0;
+    uint64_t pings = 0;
+    uint64_t routed = 0;
+    //发给MSG_IM发送者的ack, 一个ack确认一批消息
+    uint64_t im_acks = 0;
+    //未登录或sender与登录的uid不符
+    uint64_t rejected = 0;
+    //接收者不在线
+    uint64_t offline = 0;
+    //接收者的发送队列已满
+    uint64_t overflow = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    //SYN中携带了数据的连接
+    uint64_t fast_open = 0;
+    uint64_t tls_handshakes = 0;
+    uint64_t tls_resumed = 0;
+    uint64_t tls_failures = 0;
+  };
+
+  RelayServer();
+  ~RelayServer();
+
+  // Maps |token| to |uid|. Without any mapping every token that is a
+  // positive decimal number signs in as that uid.
+  void AddToken(const std::string& token, int64_t uid);
+
+  // Serves TLS with the PEM certificate chain and private key. Must be
+  // called before Listen().
+  bool EnableTls(const std::string& cert_file, const std::string& key_file);
+
+  bool Listen(const std::string& ip, int port);
+  // Runs the event loop until Stop(). |stats_interval_ms| > 0 prints the
+  // counters at that interval.
+  void Run(int stats_interval_ms);
+  // May be called from a signal handler.
+  void Stop() { running_ = false; }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Connection {
+    explicit Connection(ChunkPool* pool);
+    ~Connection();
+
+    int fd;
+    int64_t uid;
+    int seq;
+    //本轮事件中收到的最后一条MSG_IM的seq, 待确认
+    int im_ack_seq;
+    bool im_ack_pending;
+    RecvBuffer recv_buffer;
+    SendQueue send_queue;
+    //TLS连接, 否则为NULL
+    SSL* ssl;
+    bool handshaking;
+    //握手需要等待socket可写
+    bool handshake_want_write;
+    //已从send_queue取出, 等待SSL_write完成的数据
+    std::string tls_out;
+    //已注册EPOLLOUT
+    bool want_write;
+    //在dirty_列表中
+    bool dirty;
+    //发送完后关闭
+    bool closing;
+    bool closed;
+  };
+
+  void Accept();
+  void OnReadable(Connection* conn);
+  // Returns the number of bytes read, 0 when the connection is gone and -1
+  // when it would block.
+  ssize_t Read(Connection* conn, char* p, size_t len);
+  // Returns true once the TLS handshake is done.
+  bool Handshake(Connection* conn);
+  void HandleMessage(Connection* conn, const MessageView& m);
+  void HandleAuth(Connection* conn, const MessageView& m);
+  void Route(Connection* conn, const MessageView& m, const char* frame,
+             size_t size);
+  void Reply(Connection* conn, int cmd, int seq, int status);
+  void SendIMAck(Connection* conn);
+  void MarkDirty(Connection* conn);
+  void Flush(Connection* conn);
+  // Returns false if the connection was closed.
+  bool FlushTls(Connection* conn);
+  void UpdateEvents(Connection* conn);
+  void Close(Connection* conn);
+  void ReleaseClosed();
+  void PrintStats(double seconds);
+
+  int epoll_fd_;
+  int listen_fd_;
+  std::atomic<bool> running_;
+  SSL_CTX* tls_ctx_;
+
+  std::map<std::string, int64_t> tokens_;
+  ChunkPool pool_;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+  std::unordered_map<int64_t, Connection*> users_;
+  //本轮事件中有新数据待发送的连接
+  std::vector<Connection*> dirty_;
+  std::vector<int> closed_;
+
+  Stats stats_;
+  Stats last_stats_;
+};
+
+#endif
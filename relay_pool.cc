@@ -0,0 +1,309 @@
+#include "examples/voip/relay_pool.h"
+
+#include <algorithm>
+
+#include "examples/voip/message.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+// Ping interval of a probe connection.
+const int kProbeInterval = 5*1000;
+// Retry delay after a failed probe connection, doubled per failure.
+const int kProbeRetryDelay = 2*1000;
+const int kProbeMaxRetryDelay = 60*1000;
+
+const size_t kProbeBufferSize = 1024;
+const size_t kMaxProbeBufferSize = 64*1024;
+
+}  // namespace
+
+RelayProbe::RelayProbe(const rtc::SocketAddress& address)
+    : address_(address),
+      recv_buffer_(kProbeBufferSize, kMaxProbeBufferSize),
+      seq_(0),
+      running_(false),
+      ping_enabled_(true),
+      pong_received_(false),
+      connect_latency_us_(0),
+      failures_(0) {
+  connector_.SignalConnected.connect(this, &RelayProbe::OnConnected);
+  connector_.SignalFailed.connect(this, &RelayProbe::OnConnectFailed);
+}
+
+RelayProbe::~RelayProbe() {
+  Stop();
+  //释放所有待释放的socket
+  rtc::Thread::Current()->Clear(this);
+}
+
+void RelayProbe::Start() {
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  ScheduleTick(0);
+}
+
+void RelayProbe::Stop() {
+  running_ = false;
+  rtc::Thread::Current()->Clear(this, 0);
+  connector_.Cancel();
+  Disconnect();
+}
+
+bool RelayProbe::healthy() const {
+  if (!socket_) {
+    return false;
+  }
+  return !pong_received_ || !heartbeat_.IsTimedOut(rtc::TimeMicros());
+}
+
+int64_t RelayProbe::latency_us() const {
+  if (heartbeat_.stats().samples > 0) {
+    return heartbeat_.stats().srtt_us;
+  }
+  return connect_latency_us_;
+}
+
+rtc::AsyncSocket* RelayProbe::TakeSocket() {
+  if (!socket_) {
+    return NULL;
+  }
+  socket_->SignalReadEvent.disconnect(this);
+  socket_->SignalCloseEvent.disconnect(this);
+  recv_buffer_.Clear();
+  heartbeat_.Reset();
+  return socket_.release();
+}
+
+void RelayProbe::Connect() {
+  RTC_LOG(INFO) << "probe relay:" << address_.ToString();
+  connector_.Connect(address_);
+}
+
+void RelayProbe::OnConnected(ServerConnector* connector,
+                             rtc::AsyncSocket* socket) {
+  socket_.reset(socket);
+  socket_->SignalReadEvent.connect(this, &RelayProbe::OnRead);
+  socket_->SignalCloseEvent.connect(this, &RelayProbe::OnClose);
+  recv_buffer_.Clear();
+  heartbeat_.Reset();
+  failures_ = 0;
+
+  for (const ServerConnector::AttemptResult& r : connector->results()) {
+    if (r.connected) {
+      connect_latency_us_ = r.latency_ms * 1000;
+    }
+  }
+  if (ping_enabled_) {
+    SendPing();
+  }
+}
+
+void RelayProbe::OnConnectFailed(ServerConnector* connector) {
+  failures_++;
+  RTC_LOG(WARNING) << "probe relay " << address_.ToString()
+                   << " failed, failures:" << failures_;
+}
+
+void RelayProbe::OnRead(rtc::AsyncSocket* socket) {
+  while (true) {
+    size_t len = 0;
+    char* p = recv_buffer_.WritePtr(&len);
+    if (len == 0) {
+      OnClose(socket, 0);
+      return;
+    }
+    int bytes = socket->Recv(p, len, nullptr);
+    if (bytes <= 0) {
+      break;
+    }
+    recv_buffer_.Commit(bytes);
+
+    while (true) {
+      MessageView m;
+      int n = recv_buffer_.PeekMessage(&m);
+      if (n < 0) {
+        OnClose(socket, 0);
+        return;
+      }
+      if (n == 0) {
+        break;
+      }
+      if (m.cmd == MSG_PONG && heartbeat_.OnPong(m.seq, rtc::TimeMicros())) {
+        pong_received_ = true;
+      }
+      recv_buffer_.Consume(n);
+    }
+  }
+}
+
+void RelayProbe::OnClose(rtc::AsyncSocket* socket, int err) {
+  RTC_LOG(WARNING) << "probe relay " << address_.ToString()
+                   << " closed, error:" << err;
+  failures_++;
+  Disconnect();
+}
+
+void RelayProbe::Disconnect() {
+  if (socket_) {
+    socket_->SignalReadEvent.disconnect(this);
+    socket_->SignalCloseEvent.disconnect(this);
+    socket_->Close();
+    //可能在socket的回调中, 延迟释放
+    rtc::Thread::Current()->Post(
+        RTC_FROM_HERE, this, 1,
+        new rtc::ScopedMessageData<rtc::AsyncSocket>(std::move(socket_)));
+  }
+  recv_buffer_.Clear();
+  heartbeat_.Reset();
+}
+
+void RelayProbe::SendPing() {
+  if (!socket_) {
+    return;
+  }
+
+  Message m;
+  m.cmd = MSG_PING;
+  m.seq = ++seq_;
+  char buf[HEADER_SIZE];
+  int size = WriteMessage(buf, sizeof(buf), m);
+  int sent = socket_->Send(buf, size);
+  if (sent == size) {
+    heartbeat_.OnPingSent(m.seq, rtc::TimeMicros());
+  } else if (sent > 0) {
+    //半个消息, 数据流已无法使用
+    Disconnect();
+  }
+}
+
+void RelayProbe::ScheduleTick(int delay_ms) {
+  rtc::Thread::Current()->Clear(this, 0);
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay_ms, this, 0);
+}
+
+void RelayProbe::OnMessage(rtc::Message* msg) {
+  if (msg->message_id == 1) {
+    //释放已关闭的socket
+    delete msg->pdata;
+    return;
+  }
+
+  if (!running_) {
+    return;
+  }
+
+  int delay = kProbeInterval;
+  if (socket_) {
+    if (heartbeat_.IsTimedOut(rtc::TimeMicros())) {
+      if (pong_received_) {
+        RTC_LOG(WARNING) << "probe relay " << address_.ToString()
+                         << " ping timeout";
+        failures_++;
+        Disconnect();
+      } else {
+        //不支持auth之前的ping, 只用连接延迟评估
+        heartbeat_.Reset();
+      }
+    } else if (ping_enabled_ &&
+               (pong_received_ || heartbeat_.outstanding() == 0)) {
+      SendPing();
+      delay = std::min(kProbeInterval, heartbeat_.timeout_ms() + 1);
+    }
+  }
+
+  if (!socket_ && !connector_.connecting()) {
+    if (failures_ > 0) {
+      delay = std::min(kProbeMaxRetryDelay,
+                       kProbeRetryDelay << std::min(failures_ - 1, 5));
+    }
+    Connect();
+  }
+  ScheduleTick(delay);
+}
+
+RelayPool::RelayPool() : ping_(true) {
+}
+
+RelayPool::~RelayPool() {
+}
+
+void RelayPool::SetEndpoints(const std::vector<rtc::SocketAddress>& endpoints) {
+  endpoints_ = endpoints;
+  probes_.clear();
+  for (const rtc::SocketAddress& address : endpoints_) {
+    probes_.emplace_back(new RelayProbe(address));
+    probes_.back()->set_ping(ping_);
+  }
+}
+
+void RelayPool::set_ping(bool enabled) {
+  ping_ = enabled;
+  for (auto& probe : probes_) {
+    probe->set_ping(enabled);
+  }
+}
+
+void RelayPool::SetActive(const rtc::SocketAddress& active) {
+  active_ = active;
+  for (auto& probe : probes_) {
+    if (!active_.IsNil() && probe->address() == active_) {
+      probe->Stop();
+    } else {
+      probe->Start();
+    }
+  }
+}
+
+void RelayPool::Stop() {
+  for (auto& probe : probes_) {
+    probe->Stop();
+  }
+}
+
+RelayProbe* RelayPool::BestProbe() const {
+  RelayProbe* best = NULL;
+  for (auto& probe : probes_) {
+    if (!probe->running() || !probe->healthy()) {
+      continue;
+    }
+    if (best == NULL || probe->latency_us() < best->latency_us()) {
+      best = probe.get();
+    }
+  }
+  return best;
+}
+
+bool RelayPool::SelectBest(rtc::SocketAddress* endpoint) const {
+  RelayProbe* best = BestProbe();
+  if (best == NULL) {
+    return false;
+  }
+  *endpoint = best->address();
+  return true;
+}
+
+rtc::AsyncSocket* RelayPool::TakeBackup(rtc::SocketAddress* endpoint) {
+  RelayProbe* best = BestProbe();
+  if (best == NULL) {
+    return NULL;
+  }
+  *endpoint = best->address();
+  return best->TakeSocket();
+}
+
+std::vector<RelayPool::EndpointStats> RelayPool::stats() const {
+  std::vector<EndpointStats> result;
+  for (auto& probe : probes_) {
+    EndpointStats s;
+    s.address = probe->address();
+    s.active = !active_.IsNil() && probe->address() == active_;
+    s.healthy = probe->healthy();
+    s.latency_us = probe->latency_us();
+    result.push_back(s);
+  }
+  return result;
+}
@@ -0,0 +1,120 @@
+#ifndef RELAY_POOL_H
+#define RELAY_POOL_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "examples/voip/heartbeat.h"
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/server_connector.h"
+#include "rtc_base/async_socket.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/third_party/sigslot/sigslot.h"
+#include "rtc_base/thread.h"
+
+// Background connection to one relay that measures its latency with
+// MSG_PING/MSG_PONG. The connection is never authenticated; it doubles as a
+// warm standby that PeerConnectionClient can take over on failover.
+//
+// Relays that do not answer pings before auth are still usable: the probe
+// then stops pinging and ranks the relay by its TCP connect latency.
+class RelayProbe : public sigslot::has_slots<>,
+                   public rtc::MessageHandler {
+ public:
+  explicit RelayProbe(const rtc::SocketAddress& address);
+  ~RelayProbe();
+
+  const rtc::SocketAddress& address() const { return address_; }
+
+  void Start();
+  void Stop();
+  bool running() const { return running_; }
+
+  // Without pings the probe only measures the TCP connect latency and sends
+  // nothing, e.g. for a TLS relay where the handshake belongs to whoever
+  // takes the socket over.
+  void set_ping(bool enabled) { ping_enabled_ = enabled; }
+
+  // Connected, and answering pings if it ever did.
+  bool healthy() const;
+  // Smoothed ping RTT, or the connect latency when no pong was received.
+  int64_t latency_us() const;
+  const RttStats& rtt_stats() const { return heartbeat_.stats(); }
+
+  // Hands the connected socket over to the caller, who must connect its own
+  // signals. The probe reconnects on its next tick.
+  rtc::AsyncSocket* TakeSocket();
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  void Connect();
+  void OnConnected(ServerConnector* connector, rtc::AsyncSocket* socket);
+  void OnConnectFailed(ServerConnector* connector);
+  void OnRead(rtc::AsyncSocket* socket);
+  void OnClose(rtc::AsyncSocket* socket, int err);
+  void Disconnect();
+  void SendPing();
+  void ScheduleTick(int delay_ms);
+
+  rtc::SocketAddress address_;
+  ServerConnector connector_;
+  std::unique_ptr<rtc::AsyncSocket> socket_;
+  RecvBuffer recv_buffer_;
+  Heartbeat heartbeat_;
+  int seq_;
+  bool running_;
+  bool ping_enabled_;
+  //服务器在auth之前是否回复pong
+  bool pong_received_;
+  int64_t connect_latency_us_;
+  int failures_;
+};
+
+// The set of relays a client may sign in to. Every relay except the active
+// one is probed in the background, so the pool can name the lowest-latency
+// healthy relay and hand over an already connected socket to it.
+class RelayPool {
+ public:
+  struct EndpointStats {
+    rtc::SocketAddress address;
+    bool active = false;
+    bool healthy = false;
+    int64_t latency_us = 0;
+  };
+
+  RelayPool();
+  ~RelayPool();
+
+  void SetEndpoints(const std::vector<rtc::SocketAddress>& endpoints);
+  // See RelayProbe::set_ping().
+  void set_ping(bool enabled);
+  const std::vector<rtc::SocketAddress>& endpoints() const {
+    return endpoints_;
+  }
+
+  // Stops probing |active| (the client holds its own connection to it) and
+  // probes the others. A nil address probes every endpoint.
+  void SetActive(const rtc::SocketAddress& active);
+  void Stop();
+
+  // Healthy, non-active relay with the lowest latency.
+  bool SelectBest(rtc::SocketAddress* endpoint) const;
+  // Connected socket to the relay SelectBest() would pick, or NULL.
+  rtc::AsyncSocket* TakeBackup(rtc::SocketAddress* endpoint);
+
+  std::vector<EndpointStats> stats() const;
+
+ private:
+  RelayProbe* BestProbe() const;
+
+  std::vector<rtc::SocketAddress> endpoints_;
+  rtc::SocketAddress active_;
+  bool ping_;
+  std::vector<std::unique_ptr<RelayProbe>> probes_;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "examples/voip/reliable_channel.h"
+
+#include <algorithm>
+
+#include "rtc_base/helpers.h"
+
+namespace {
+
+const int64_t kInitialRto = 1000;
+const int64_t kMinRto = 200;
+const int64_t kMaxRto = 5*1000;
+//包括第一次发送
+const int kMaxAttempts = 7;
+//未确认的消息数量上限, 小于接收端的去重窗口
+const size_t kMaxInFlight = 32;
+const int kReplayWindow = 64;
+
+}  // namespace
+
+ReliableChannel::ReliableChannel() {
+}
+
+int ReliableChannel::OnSend(int64_t peer_id, const std::string& content,
+                            int version, int64_t now_ms) {
+  Peer& peer = peers_[peer_id];
+  if (peer.next_seq == 0) {
+    //随机的初始序号, 重启后的序号不会落入对端旧的去重窗口
+    peer.next_seq = (uint16_t)(rtc::CreateRandomId() | 1);
+  }
+  int rt_seq = peer.next_seq++;
+  if (peer.next_seq == 0) {
+    peer.next_seq = 1;
+  }
+  stats_.sent++;
+
+  if (peer.legacy) {
+    return rt_seq;
+  }
+  if (peer.unacked.size() >= kMaxInFlight) {
+    GiveUp(peer_id, &peer.unacked.front());
+    peer.unacked.pop_front();
+  }
+
+  Pending p;
+  p.rt_seq = rt_seq;
+  p.version = version;
+  p.content = content;
+  p.first_send_ms = now_ms;
+  p.deadline_ms = now_ms + RtoOf(peer);
+  p.attempts = 1;
+  peer.unacked.push_back(std::move(p));
+  return rt_seq;
+}
+
+bool ReliableChannel::OnAck(int64_t peer_id, int rt_seq, int64_t now_ms) {
+  auto it = peers_.find(peer_id);
+  if (it == peers_.end()) {
+    return false;
+  }
+  Peer& peer = it->second;
+  peer.acked = true;
+  peer.legacy = false;
+
+  std::deque<Pending>& unacked = peer.unacked;
+  for (size_t i = 0; i < unacked.size(); i++) {
+    if (unacked[i].rt_seq != rt_seq) {
+      continue;
+    }
+    //重传过的消息无法确定确认的是哪一次发送
+    if (unacked[i].attempts == 1) {
+      AddSample(&peer, now_ms - unacked[i].first_send_ms);
+    }
+    unacked.erase(unacked.begin() + i);
+    stats_.acked++;
+    return true;
+  }
+  return false;
+}
+
+bool ReliableChannel::OnReceive(int64_t peer_id, int rt_seq) {
+  if (rt_seq == 0) {
+    return true;
+  }
+  Peer& peer = peers_[peer_id];
+  uint16_t seq = (uint16_t)rt_seq;
+  if (!peer.has_recv) {
+    peer.has_recv = true;
+    peer.recv_max = seq;
+    peer.recv_mask = 1;
+    return true;
+  }
+
+  int diff = (int16_t)(uint16_t)(seq - peer.recv_max);
+  if (diff > 0) {
+    peer.recv_mask = diff < kReplayWindow ? (peer.recv_mask << diff) | 1 : 1;
+    peer.recv_max = seq;
+    return true;
+  }
+  if (-diff >= kReplayWindow) {
+    //发送端不会重传窗口之外的消息, 只能是对端重启了
+    peer.recv_max = seq;
+    peer.recv_mask = 1;
+    return true;
+  }
+
+  uint64_t bit = (uint64_t)1 << -diff;
+  if (peer.recv_mask & bit) {
+    stats_.duplicates++;
+    return false;
+  }
+  peer.recv_mask |= bit;
+  return true;
+}
+
+void ReliableChannel::Poll(int64_t now_ms, std::vector<Retransmit>* out,
+                           std::vector<Retransmit>* gave_up) {
+  for (auto& it : peers_) {
+    Peer& peer = it.second;
+    std::deque<Pending>& unacked = peer.unacked;
+    size_t i = 0;
+    //对端确认过之前只重传最早的一条
+    while (i < unacked.size() && (peer.acked || i == 0)) {
+      Pending& p = unacked[i];
+      if (p.deadline_ms > now_ms) {
+        i++;
+        continue;
+      }
+      if (p.attempts >= kMaxAttempts) {
+        GiveUp(it.first, &p);
+        unacked.erase(unacked.begin() + i);
+        if (!peer.acked) {
+          //对端从未确认, 不支持MSG_ACK
+          for (Pending& rest : unacked) {
+            GiveUp(it.first, &rest);
+          }
+          unacked.clear();
+          peer.legacy = true;
+        }
+        continue;
+      }
+
+      int64_t rto = std::min<int64_t>(kMaxRto,
+                                      (int64_t)RtoOf(peer) << p.attempts);
+      p.attempts++;
+      p.deadline_ms = now_ms + rto;
+      stats_.retransmits++;
+
+      Retransmit r;
+      r.peer_id = it.first;
+      r.rt_seq = p.rt_seq;
+      r.version = p.version;
+      r.content = p.content;
+      out->push_back(std::move(r));
+      i++;
+    }
+  }
+  if (gave_up) {
+    for (Retransmit& r : gave_up_) {
+      gave_up->push_back(std::move(r));
+    }
+  }
+  gave_up_.clear();
+}
+
+int64_t ReliableChannel::NextDeadline() const {
+  int64_t deadline = -1;
+  for (const auto& it : peers_) {
+    const Peer& peer = it.second;
+    for (size_t i = 0; i < peer.unacked.size(); i++) {
+      if (!peer.acked && i > 0) {
+        break;
+      }
+      int64_t d = peer.unacked[i].deadline_ms;
+      if (deadline < 0 || d < deadline) {
+        deadline = d;
+      }
+    }
+  }
+  return deadline;
+}
+
+int ReliableChannel::rto_ms(int64_t peer_id) const {
+  auto it = peers_.find(peer_id);
+  if (it == peers_.end()) {
+    return (int)kInitialRto;
+  }
+  return RtoOf(it->second);
+}
+
+size_t ReliableChannel::unacked() const {
+  size_t n = 0;
+  for (const auto& it : peers_) {
+    n += it.second.unacked.size();
+  }
+  return n;
+}
+
+void ReliableChannel::Reset() {
+  peers_.clear();
+  gave_up_.clear();
+}
+
+int ReliableChannel::RtoOf(const Peer& peer) const {
+  if (!peer.has_rtt) {
+    return (int)kInitialRto;
+  }
+  int64_t rto = peer.srtt_ms + 4 * peer.rttvar_ms;
+  return (int)std::max(kMinRto, std::min(kMaxRto, rto));
+}
+
+void ReliableChannel::AddSample(Peer* peer, int64_t rtt_ms) {
+  rtt_ms = std::max<int64_t>(0, rtt_ms);
+  if (!peer->has_rtt) {
+    peer->has_rtt = true;
+    peer->srtt_ms = rtt_ms;
+    peer->rttvar_ms = rtt_ms / 2;
+    return;
+  }
+  int64_t delta = peer->srtt_ms - rtt_ms;
+  if (delta < 0) {
+    delta = -delta;
+  }
+  peer->rttvar_ms = (3 * peer->rttvar_ms + delta) / 4;
+  peer->srtt_ms = (7 * peer->srtt_ms + rtt_ms) / 8;
+}
+
+void ReliableChannel::GiveUp(int64_t peer_id, Pending* p) {
+  stats_.gave_up++;
+  Retransmit r;
+  r.peer_id = peer_id;
+  r.rt_seq = p->rt_seq;
+  r.version = p->version;
+  r.content = std::move(p->content);
+  gave_up_.push_back(std::move(r));
+}
@@ -0,0 +1,117 @@
+#ifndef RELIABLE_CHANNEL_H
+#define RELIABLE_CHANNEL_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// End-to-end reliability for MSG_RT. The relay may drop a frame (receiver
+// offline, queue overflow, relay restart), so every MSG_RT carries a per-peer
+// 16-bit rt_seq in the header and the receiving client answers it with a
+// MSG_ACK carrying the same rt_seq.
+//
+// Sender: frames stay queued until acked and are retransmitted after an RTO
+// estimated per peer like TCP (RFC 6298): srtt + 4 * rttvar clamped to
+// [200 ms, 5 s], 1 s before the first sample, doubled on every retransmission
+// and sampled only from frames sent once (Karn). A frame is given up after
+// kMaxAttempts sends, and when more than kMaxInFlight frames are unacked the
+// oldest is given up, so retransmissions always stay within the receiver's
+// replay window.
+//
+// Peers that do not implement MSG_ACK would see every retransmission as a
+// new message. Until a peer has acked once, only its oldest frame is
+// retransmitted, like the old DIAL resend loop; if that probe is never acked
+// the peer is treated as legacy and further frames are sent once.
+//
+// Frames that are given up are reported by Poll(), so the caller can decide
+// whether the message is still worth sending, e.g. re-dial while dialing.
+//
+// Receiver: a 64 entry sliding window per sender drops duplicates. rt_seq 0
+// means the sender does not want an ack and is never deduplicated.
+//
+// Not thread safe; times are milliseconds.
+class ReliableChannel {
+ public:
+  struct Stats {
+    int64_t sent = 0;
+    int64_t retransmits = 0;
+    int64_t acked = 0;
+    int64_t duplicates = 0;
+    int64_t gave_up = 0;
+  };
+
+  struct Retransmit {
+    int64_t peer_id;
+    int rt_seq;
+    int version;
+    std::string content;
+  };
+
+  ReliableChannel();
+
+  // Assigns the next rt_seq to a frame for |peer_id| and keeps a copy of it
+  // until it is acked.
+  int OnSend(int64_t peer_id, const std::string& content, int version,
+             int64_t now_ms);
+  // Returns false for an ack that matches no unacked frame.
+  bool OnAck(int64_t peer_id, int rt_seq, int64_t now_ms);
+  // Returns false if the frame was already delivered.
+  bool OnReceive(int64_t peer_id, int rt_seq);
+
+  // Appends the frames whose RTO expired at |now_ms| to |out|, and the
+  // frames given up since the last call to |gave_up| if it is not NULL.
+  void Poll(int64_t now_ms, std::vector<Retransmit>* out,
+            std::vector<Retransmit>* gave_up = NULL);
+  // Earliest retransmission deadline, -1 if nothing is waiting for an ack.
+  int64_t NextDeadline() const;
+
+  // RTO currently used for |peer_id|.
+  int rto_ms(int64_t peer_id) const;
+  size_t unacked() const;
+  const Stats& stats() const { return stats_; }
+
+  // Drops all state, e.g. on sign out.
+  void Reset();
+
+ private:
+  struct Pending {
+    int rt_seq;
+    int version;
+    std::string content;
+    int64_t first_send_ms;
+    int64_t deadline_ms;
+    int attempts;
+  };
+
+  struct Peer {
+    //发送
+    uint16_t next_seq = 0;
+    std::deque<Pending> unacked;
+    int64_t srtt_ms = 0;
+    int64_t rttvar_ms = 0;
+    bool has_rtt = false;
+    //对端是否确认过消息
+    bool acked = false;
+    //对端不支持MSG_ACK
+    bool legacy = false;
+
+    //接收: recv_max为收到的最大序号, recv_mask的第i位对应recv_max - i
+    bool has_recv = false;
+    uint16_t recv_max = 0;
+    uint64_t recv_mask = 0;
+  };
+
+  int RtoOf(const Peer& peer) const;
+  void AddSample(Peer* peer, int64_t rtt_ms);
+  void GiveUp(int64_t peer_id, Pending* p);
+
+  std::map<int64_t, Peer> peers_;
+  //放弃的消息, 由下一次Poll()报告
+  std::vector<Retransmit> gave_up_;
+  Stats stats_;
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "examples/voip/sdp_codec.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Identifies kDictionary. Bump it whenever an entry is added, removed or
+// reordered, since entries are referenced by index.
+const char kDictionaryId = 1;
+
+// Output bytes below 0x80 are literal ASCII, 0x80-0xFE reference
+// kDictionary[b - 0x80] and 0xFF escapes the following byte.
+const uint8_t kFirstReference = 0x80;
+const uint8_t kEscape = 0xFF;
+
+// Built from the offers and answers of the unified-plan, audio + video
+// configuration set up in Conductor::CreatePeerConnection.
+const char* const kDictionary[] = {
+    "v=0\r\no=- ",
+    " 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n",
+    "a=group:BUNDLE 0 1\r\n",
+    "a=msid-semantic: WMS stream_label\r\n",
+    "a=msid-semantic: WMS\r\n",
+    "m=audio 9 UDP/TLS/RTP/SAVPF ",
+    "m=video 9 UDP/TLS/RTP/SAVPF ",
+    "111 103 104 9 102 0 8 106 105 13 110 112 113 126\r\n",
+    "c=IN IP4 0.0.0.0\r\na=rtcp:9 IN IP4 0.0.0.0\r\n",
+    "c=IN IP4 ",
+    "a=rtcp:",
+    " IN IP4 ",
+    "a=ice-ufrag:",
+    "a=ice-pwd:",
+    "a=ice-options:trickle\r\n",
+    "a=fingerprint:sha-256 ",
+    "a=setup:actpass\r\n",
+    "a=setup:active\r\n",
+    "a=setup:passive\r\n",
+    "a=mid:0\r\n",
+    "a=mid:1\r\n",
+    "a=extmap:",
+    " urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n",
+    " http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n",
+    " http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n",
+    " urn:ietf:params:rtp-hdrext:sdes:mid\r\n",
+    " urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id\r\n",
+    " urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id\r\n",
+    " urn:ietf:params:rtp-hdrext:toffset\r\n",
+    " urn:3gpp:video-orientation\r\n",
+    " http://www.webrtc.org/experiments/rtp-hdrext/playout-delay\r\n",
+    " http://www.webrtc.org/experiments/rtp-hdrext/video-content-type\r\n",
+    " http://www.webrtc.org/experiments/rtp-hdrext/video-timing\r\n",
+    " http://www.webrtc.org/experiments/rtp-hdrext/color-space\r\n",
+    "a=sendrecv\r\n",
+    "a=sendonly\r\n",
+    "a=recvonly\r\n",
+    "a=inactive\r\n",
+    "a=msid:stream_label audio_label\r\n",
+    "a=msid:stream_label video_label\r\n",
+    "a=msid:",
+    "a=rtcp-mux\r\n",
+    "a=rtcp-rsize\r\n",
+    "a=rtpmap:111 opus/48000/2\r\n",
+    "a=rtcp-fb:111 transport-cc\r\n",
+    "a=fmtp:111 minptime=10;useinbandfec=1\r\n",
+    "a=rtpmap:103 ISAC/16000\r\n",
+    "a=rtpmap:104 ISAC/32000\r\n",
+    "a=rtpmap:9 G722/8000\r\n",
+    "a=rtpmap:102 ILBC/8000\r\n",
+    "a=rtpmap:0 PCMU/8000\r\n",
+    "a=rtpmap:8 PCMA/8000\r\n",
+    "a=rtpmap:106 CN/32000\r\n",
+    "a=rtpmap:105 CN/16000\r\n",
+    "a=rtpmap:13 CN/8000\r\n",
+    "a=rtpmap:110 telephone-event/48000\r\n",
+    "a=rtpmap:112 telephone-event/32000\r\n",
+    "a=rtpmap:113 telephone-event/16000\r\n",
+    "a=rtpmap:126 telephone-event/8000\r\n",
+    "a=rtpmap:",
+    "a=rtcp-fb:",
+    "a=fmtp:",
+    " VP8/90000\r\n",
+    " VP9/90000\r\n",
+    " H264/90000\r\n",
+    " AV1X/90000\r\n",
+    " rtx/90000\r\n",
+    " red/90000\r\n",
+    " ulpfec/90000\r\n",
+    " goog-remb\r\n",
+    " transport-cc\r\n",
+    " ccm fir\r\n",
+    " nack\r\n",
+    " nack pli\r\n",
+    " apt=",
+    " profile-id=0\r\n",
+    " profile-id=2\r\n",
+    " level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42001f\r\n",
+    " level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42001f\r\n",
+    " level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n",
+    " level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42e01f\r\n",
+    " level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=4d001f\r\n",
+    " level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=4d001f\r\n",
+    "a=ssrc-group:FID ",
+    "a=ssrc:",
+    " cname:",
+    " msid:stream_label audio_label\r\n",
+    " msid:stream_label video_label\r\n",
+    " mslabel:stream_label\r\n",
+    " label:audio_label\r\n",
+    " label:video_label\r\n",
+    "a=candidate:",
+    " 1 udp ",
+    " 1 tcp ",
+    " typ host",
+    " typ srflx raddr ",
+    " typ relay raddr ",
+    " rport ",
+    " tcptype active",
+    " generation 0 ufrag ",
+    " network-id ",
+    " network-cost ",
+    "a=end-of-candidates\r\n",
+    "\r\n",
+    "\r\na=",
+};
+
+const size_t kDictionarySize = sizeof(kDictionary) / sizeof(kDictionary[0]);
+static_assert(sizeof(kDictionary) / sizeof(kDictionary[0]) <=
+                  kEscape - kFirstReference,
+              "dictionary does not fit in one-byte references");
+
+struct Entry {
+  const char* text;
+  size_t length;
+  uint8_t code;
+};
+
+// Dictionary entries bucketed by a hash of their first four bytes (shorter
+// entries by their first byte), longest first, so the encoder can take the
+// longest match at each position with a couple of memcmp()s.
+class DictionaryIndex {
+ public:
+  DictionaryIndex() {
+    for (size_t i = 0; i < kDictionarySize; i++) {
+      Entry e;
+      e.text = kDictionary[i];
+      e.length = strlen(kDictionary[i]);
+      e.code = (uint8_t)(kFirstReference + i);
+      if (e.length >= 4) {
+        long_[Hash(e.text)].push_back(e);
+      } else {
+        short_[(uint8_t)e.text[0]].push_back(e);
+      }
+    }
+    for (std::vector<Entry>& bucket : long_) {
+      SortByLength(&bucket);
+    }
+    for (std::vector<Entry>& bucket : short_) {
+      SortByLength(&bucket);
+    }
+  }
+
+  const Entry* Match(const char* p, size_t size) const {
+    if (size >= 4) {
+      for (const Entry& e : long_[Hash(p)]) {
+        if (e.length <= size && memcmp(p, e.text, e.length) == 0) {
+          return &e;
+        }
+      }
+    }
+    for (const Entry& e : short_[(uint8_t)*p]) {
+      if (e.length <= size && memcmp(p, e.text, e.length) == 0) {
+        return &e;
+      }
+    }
+    return nullptr;
+  }
+
+ private:
+  static const size_t kBuckets = 1024;
+
+  static size_t Hash(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> 22;
+  }
+
+  static void SortByLength(std::vector<Entry>* bucket) {
+    std::sort(bucket->begin(), bucket->end(),
+              [](const Entry& a, const Entry& b) {
+                return a.length > b.length;
+              });
+  }
+
+  std::vector<Entry> long_[kBuckets];
+  std::vector<Entry> short_[256];
+};
+
+const DictionaryIndex& GetDictionaryIndex() {
+  static const DictionaryIndex* index = new DictionaryIndex();
+  return *index;
+}
+
+}  // namespace
+
+std::string CompressSdp(absl::string_view sdp) {
+  const DictionaryIndex& index = GetDictionaryIndex();
+
+  std::string out;
+  out.reserve(sdp.size() / 2 + 16);
+  out.push_back(kDictionaryId);
+
+  const char* p = sdp.data();
+  const char* end = sdp.data() + sdp.size();
+  while (p < end) {
+    const Entry* e = index.Match(p, end - p);
+    if (e) {
+      out.push_back((char)e->code);
+      p += e->length;
+      continue;
+    }
+
+    uint8_t c = (uint8_t)*p++;
+    if (c >= kFirstReference) {
+      out.push_back((char)kEscape);
+    }
+    out.push_back((char)c);
+  }
+  return out;
+}
+
+bool DecompressSdp(absl::string_view data, std::string* sdp) {
+  if (data.empty() || data[0] != kDictionaryId) {
+    return false;
+  }
+
+  sdp->clear();
+  sdp->reserve(data.size() * 3);
+  for (size_t i = 1; i < data.size(); i++) {
+    uint8_t c = (uint8_t)data[i];
+    if (c < kFirstReference) {
+      sdp->push_back((char)c);
+    } else if (c == kEscape) {
+      if (++i == data.size()) {
+        return false;
+      }
+      sdp->push_back(data[i]);
+    } else {
+      size_t n = c - kFirstReference;
+      if (n >= kDictionarySize) {
+        return false;
+      }
+      sdp->append(kDictionary[n]);
+    }
+  }
+  return true;
+}
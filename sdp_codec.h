@@ -0,0 +1,17 @@
+#ifndef SDP_CODEC_H
+#define SDP_CODEC_H
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+// Static-dictionary compression for the offers and answers produced by
+// CreatePeerConnection's configuration. Lines and fragments that repeat on
+// every call (codec maps, rtcp-fb, header extensions, ...) are replaced by
+// one-byte references into a built-in dictionary; everything else is copied
+// through. The first byte of the output identifies the dictionary, so a peer
+// with a different dictionary rejects the data instead of misdecoding it.
+std::string CompressSdp(absl::string_view sdp);
+bool DecompressSdp(absl::string_view data, std::string* sdp);
+
+#endif
@@ -0,0 +1,340 @@
+#include "examples/voip/send_queue.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "examples/voip/message.h"
+
+#ifdef WIN32
+#include <Winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace {
+
+const size_t kDefaultHighWatermark = 256*1024;
+const size_t kDefaultLowWatermark = 64*1024;
+const size_t kDefaultMaxBytes = 4*1024*1024;
+//低优先级的lane每等待这么多字节, 可以插队发送一条消息
+const size_t kDefaultStarvationBytes = 32*1024;
+
+int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+size_t FrameSizeAt(const char* p) {
+    uint32_t length;
+    memcpy(&length, p, 4);
+    return HEADER_SIZE + ntohl(length);
+}
+
+}  // namespace
+
+ChunkPool::ChunkPool(size_t chunk_size, size_t max_free)
+    : chunk_size_(chunk_size), max_free_(max_free) {
+}
+
+ChunkPool::~ChunkPool() {
+    for (SendChunk* chunk : free_) {
+        delete chunk;
+    }
+}
+
+SendChunk* ChunkPool::Get(size_t min_size) {
+    SendChunk* chunk;
+    if (min_size <= chunk_size_ && !free_.empty()) {
+        chunk = free_.back();
+        free_.pop_back();
+    } else {
+        chunk = new SendChunk();
+        chunk->capacity = std::max(min_size, chunk_size_);
+        chunk->data.reset(new char[chunk->capacity]);
+    }
+    chunk->begin = 0;
+    chunk->end = 0;
+    chunk->frame_begin = 0;
+    return chunk;
+}
+
+void ChunkPool::Put(SendChunk* chunk) {
+    if (chunk->capacity == chunk_size_ && free_.size() < max_free_) {
+        free_.push_back(chunk);
+    } else {
+        delete chunk;
+    }
+}
+
+SendQueue::SendQueue(ChunkPool* pool)
+    : pool_(pool),
+      starvation_bytes_(kDefaultStarvationBytes),
+      bytes_(0),
+      frames_(0),
+      high_watermark_(kDefaultHighWatermark),
+      low_watermark_(kDefaultLowWatermark),
+      max_bytes_(kDefaultMaxBytes),
+      blocked_(false) {
+    if (pool_ == nullptr) {
+        own_pool_.reset(new ChunkPool());
+        pool_ = own_pool_.get();
+    }
+}
+
+SendQueue::~SendQueue() {
+    Clear();
+}
+
+SendQueue::Lane SendQueue::LaneOf(int cmd) {
+    switch (cmd) {
+        case MSG_AUTH_TOKEN:
+        case MSG_AUTH_STATUS:
+        case MSG_PING:
+        case MSG_PONG:
+        case MSG_ACK:
+            return LANE_CONTROL;
+        case MSG_RT:
+            return LANE_CALL;
+        default:
+            return LANE_BULK;
+    }
+}
+
+bool SendQueue::Push(Message& msg, Lane lane) {
+    return Append(&lanes_[lane], nullptr, GetMessageSize(msg), &msg);
+}
+
+bool SendQueue::PushFrame(const char* frame, size_t size, Lane lane) {
+    return Append(&lanes_[lane], frame, size, nullptr);
+}
+
+bool SendQueue::Append(LaneQueue* lane, const char* frame, size_t size,
+                       Message* msg) {
+    if (bytes_ + size > max_bytes_) {
+        return false;
+    }
+
+    std::deque<SendChunk*>& chunks = lane->chunks;
+    SendChunk* chunk = chunks.empty() ? nullptr : chunks.back();
+    if (chunk == nullptr || chunk->capacity - chunk->end < size) {
+        chunk = pool_->Get(size);
+        chunks.push_back(chunk);
+    }
+
+    char* p = chunk->data.get() + chunk->end;
+    if (msg) {
+        int n = WriteMessage(p, (int)(chunk->capacity - chunk->end), *msg);
+        if (n < 0) {
+            if (chunk->end == 0) {
+                chunks.pop_back();
+                pool_->Put(chunk);
+            }
+            return false;
+        }
+        size = n;
+    } else {
+        memcpy(p, frame, size);
+    }
+    chunk->end += size;
+    lane->bytes += size;
+    lane->enqueue_us.push_back(NowUs());
+    bytes_ += size;
+    frames_++;
+    UpdateWritable();
+    return true;
+}
+
+bool SendQueue::PushFront(Message& msg, Lane lane) {
+    size_t size = GetMessageSize(msg);
+    if (bytes_ + size > max_bytes_) {
+        return false;
+    }
+
+    SendChunk* chunk = pool_->Get(size);
+    int n = WriteMessage(chunk->data.get(), (int)chunk->capacity, msg);
+    if (n < 0) {
+        pool_->Put(chunk);
+        return false;
+    }
+    chunk->end = n;
+    LaneQueue& q = lanes_[lane];
+    q.chunks.push_front(chunk);
+    q.enqueue_us.push_front(NowUs());
+    q.bytes += n;
+    bytes_ += n;
+    frames_++;
+    UpdateWritable();
+    return true;
+}
+
+int SendQueue::HeadLane() const {
+    int first = -1;
+    int starved = -1;
+    for (int i = 0; i < LANE_COUNT; i++) {
+        const LaneQueue& q = lanes_[i];
+        if (q.chunks.empty()) {
+            continue;
+        }
+        const SendChunk* chunk = q.chunks.front();
+        if (chunk->begin != chunk->frame_begin) {
+            //发送了一部分的消息必须先发完
+            return i;
+        }
+        if (first < 0) {
+            first = i;
+        }
+        if (starvation_bytes_ > 0 && q.owed >= starvation_bytes_ &&
+            (starved < 0 || q.owed > lanes_[starved].owed)) {
+            starved = i;
+        }
+    }
+    return starved >= 0 ? starved : first;
+}
+
+int SendQueue::Gather(Segment* segs, int max) const {
+    int lane = HeadLane();
+    if (lane < 0) {
+        return 0;
+    }
+    int count = 0;
+    for (SendChunk* chunk : lanes_[lane].chunks) {
+        if (count == max) {
+            break;
+        }
+        segs[count].data = chunk->data.get() + chunk->begin;
+        segs[count].size = chunk->end - chunk->begin;
+        count++;
+    }
+    return count;
+}
+
+void SendQueue::Consume(size_t n) {
+    int lane = HeadLane();
+    if (lane < 0) {
+        return;
+    }
+    LaneQueue& q = lanes_[lane];
+    //Gather只返回了这个lane的数据
+    n = std::min(n, q.bytes);
+    bytes_ -= n;
+    q.bytes -= n;
+    while (n > 0) {
+        SendChunk* chunk = q.chunks.front();
+        size_t take = std::min(n, chunk->end - chunk->begin);
+        chunk->begin += take;
+        n -= take;
+
+        //统计已经完整发送的消息
+        while (chunk->frame_begin < chunk->end &&
+               chunk->frame_begin + FrameSizeAt(chunk->data.get() + chunk->frame_begin) <=
+               chunk->begin) {
+            size_t size = FrameSizeAt(chunk->data.get() + chunk->frame_begin);
+            chunk->frame_begin += size;
+            OnFrameSent(lane, size);
+        }
+
+        if (chunk->begin == chunk->end) {
+            q.chunks.pop_front();
+            pool_->Put(chunk);
+        }
+    }
+    UpdateWritable();
+}
+
+void SendQueue::OnFrameSent(int lane, size_t size) {
+    LaneQueue& q = lanes_[lane];
+    frames_--;
+    if (!q.enqueue_us.empty()) {
+        int64_t delay = NowUs() - q.enqueue_us.front();
+        q.enqueue_us.pop_front();
+        q.stats.frames++;
+        q.stats.queue_delay_us += delay;
+        q.stats.max_queue_delay_us = std::max(q.stats.max_queue_delay_us, delay);
+    }
+    q.owed = 0;
+    //更低优先级的lane在等待, 记下它被跳过的字节数
+    for (int i = lane + 1; i < LANE_COUNT; i++) {
+        if (lanes_[i].bytes > 0) {
+            lanes_[i].owed += size;
+        }
+    }
+}
+
+void SendQueue::Clear() {
+    for (LaneQueue& q : lanes_) {
+        for (SendChunk* chunk : q.chunks) {
+            pool_->Put(chunk);
+        }
+        q.chunks.clear();
+        q.enqueue_us.clear();
+        q.bytes = 0;
+        q.owed = 0;
+    }
+    bytes_ = 0;
+    frames_ = 0;
+    UpdateWritable();
+}
+
+void SendQueue::Rewind() {
+    for (LaneQueue& q : lanes_) {
+        q.owed = 0;
+        if (q.chunks.empty()) {
+            continue;
+        }
+        SendChunk* chunk = q.chunks.front();
+        size_t sent = chunk->begin - chunk->frame_begin;
+        q.bytes += sent;
+        bytes_ += sent;
+        chunk->begin = chunk->frame_begin;
+    }
+    UpdateWritable();
+}
+
+int SendQueue::front_cmd() const {
+    int lane = HeadLane();
+    if (lane < 0) {
+        return -1;
+    }
+    const SendChunk* chunk = lanes_[lane].chunks.front();
+    return (uint8_t)chunk->data[chunk->begin + 8];
+}
+
+void SendQueue::PopFront() {
+    int lane = HeadLane();
+    if (lane < 0) {
+        return;
+    }
+    LaneQueue& q = lanes_[lane];
+    SendChunk* chunk = q.chunks.front();
+    size_t size = FrameSizeAt(chunk->data.get() + chunk->begin);
+    chunk->begin += size;
+    chunk->frame_begin = chunk->begin;
+    q.bytes -= size;
+    if (!q.enqueue_us.empty()) {
+        q.enqueue_us.pop_front();
+    }
+    bytes_ -= size;
+    frames_--;
+    if (chunk->begin == chunk->end) {
+        q.chunks.pop_front();
+        pool_->Put(chunk);
+    }
+    UpdateWritable();
+}
+
+void SendQueue::set_watermarks(size_t high, size_t low) {
+    high_watermark_ = high;
+    low_watermark_ = std::min(low, high);
+    UpdateWritable();
+}
+
+void SendQueue::UpdateWritable() {
+    if (!blocked_ && bytes_ >= high_watermark_) {
+        blocked_ = true;
+    } else if (blocked_ && bytes_ <= low_watermark_) {
+        blocked_ = false;
+    }
+}
@@ -0,0 +1,162 @@
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+class Message;
+
+// A block of serialized frames. Frames are written back to back and never
+// span two chunks, so every chunk starts on a frame boundary.
+struct SendChunk {
+  std::unique_ptr<char[]> data;
+  size_t capacity;
+  size_t begin;        //第一个未发送的字节
+  size_t end;          //已写入数据的末尾
+  size_t frame_begin;  //|begin|所在消息的起始位置
+};
+
+// Free list of fixed-size chunks. Frames larger than chunk_size() get a
+// dedicated chunk that is released instead of pooled.
+class ChunkPool {
+ public:
+  explicit ChunkPool(size_t chunk_size = 16*1024, size_t max_free = 16);
+  ~ChunkPool();
+
+  size_t chunk_size() const { return chunk_size_; }
+  size_t free_chunks() const { return free_.size(); }
+
+  SendChunk* Get(size_t min_size);
+  void Put(SendChunk* chunk);
+
+ private:
+  size_t chunk_size_;
+  size_t max_free_;
+  std::vector<SendChunk*> free_;
+};
+
+// Outgoing frame queue for a signaling socket. Frames are serialized straight
+// into pooled chunks and handed to the socket as a gather list, so one
+// writev()/sendmsg() can flush many frames without an intermediate copy.
+//
+// The queue keeps a high and a low watermark: writable() turns false once
+// the queued bytes reach the high watermark and stays false until they drain
+// to the low watermark, which lets producers apply backpressure instead of
+// dropping frames. Push() only fails past the hard limit, max_bytes().
+//
+// Frames are queued in priority lanes, FIFO within a lane. The head frame is
+// taken from the highest non-empty lane, and a frame that has started going
+// out is always finished before switching lanes. To keep a flood of higher
+// priority frames from starving a lower lane, a waiting lane is owed one
+// frame for every starvation_bytes() written from the lanes above it.
+// Callers that only use the default lane get a plain FIFO.
+class SendQueue {
+ public:
+  enum Lane {
+    LANE_CONTROL,  // auth, ping/pong, acks
+    LANE_CALL,     // MSG_RT: call control, SDP and ICE, kept in order
+    LANE_BULK,     // MSG_IM and everything else
+    LANE_COUNT,
+  };
+
+  struct Segment {
+    const char* data;
+    size_t size;
+  };
+
+  // Time frames of a lane spent queued, from Push() until their last byte
+  // was consumed.
+  struct LaneStats {
+    int64_t frames = 0;
+    int64_t queue_delay_us = 0;
+    int64_t max_queue_delay_us = 0;
+
+    int64_t average_delay_us() const {
+      return frames > 0 ? queue_delay_us / frames : 0;
+    }
+  };
+
+  explicit SendQueue(ChunkPool* pool = nullptr);
+  ~SendQueue();
+
+  // Lane a frame with command |cmd| is queued in by the signaling client.
+  static Lane LaneOf(int cmd);
+
+  // Serializes |msg| at the tail of |lane|.
+  bool Push(Message& msg, Lane lane = LANE_BULK);
+  // Appends a frame that is already encoded, e.g. one forwarded verbatim.
+  bool PushFrame(const char* frame, size_t size, Lane lane = LANE_BULK);
+  // Serializes |msg| ahead of every frame queued in |lane|. Only valid while
+  // no bytes of a head frame have been sent, e.g. right after Rewind().
+  bool PushFront(Message& msg, Lane lane = LANE_BULK);
+
+  // Fills |segs| with up to |max| contiguous runs of unsent bytes, in order.
+  // All of them belong to the lane of the head frame.
+  int Gather(Segment* segs, int max) const;
+  // Drops |n| bytes from the head after they were written to the socket.
+  void Consume(size_t n);
+  void Clear();
+
+  // Un-sends the partially written head frame so that it goes out whole on
+  // a new connection, and forgets what lower lanes were owed, so that the
+  // highest lane goes first on the new connection.
+  void Rewind();
+  // Command byte of the head frame, or -1 if the queue is empty.
+  int front_cmd() const;
+  // Drops the head frame. The queue must be rewound.
+  void PopFront();
+
+  bool empty() const { return bytes_ == 0; }
+  // Queued bytes and frames, including a partially sent head frame.
+  size_t bytes() const { return bytes_; }
+  size_t frames() const { return frames_; }
+  size_t lane_bytes(Lane lane) const { return lanes_[lane].bytes; }
+  const LaneStats& lane_stats(Lane lane) const { return lanes_[lane].stats; }
+
+  void set_starvation_bytes(size_t bytes) { starvation_bytes_ = bytes; }
+  size_t starvation_bytes() const { return starvation_bytes_; }
+
+  void set_watermarks(size_t high, size_t low);
+  size_t high_watermark() const { return high_watermark_; }
+  size_t low_watermark() const { return low_watermark_; }
+  void set_max_bytes(size_t max_bytes) { max_bytes_ = max_bytes; }
+  size_t max_bytes() const { return max_bytes_; }
+
+  bool writable() const { return !blocked_; }
+
+ private:
+  struct LaneQueue {
+    std::deque<SendChunk*> chunks;
+    //每条未发送完的消息的入队时间
+    std::deque<int64_t> enqueue_us;
+    size_t bytes = 0;
+    //等待期间更高优先级的lane发送的字节数
+    size_t owed = 0;
+    LaneStats stats;
+  };
+
+  bool Append(LaneQueue* lane, const char* frame, size_t size,
+              Message* msg);
+  // Lane the next bytes are taken from, or -1 if the queue is empty.
+  int HeadLane() const;
+  void OnFrameSent(int lane, size_t size);
+  void UpdateWritable();
+
+  ChunkPool* pool_;
+  std::unique_ptr<ChunkPool> own_pool_;
+  LaneQueue lanes_[LANE_COUNT];
+  size_t starvation_bytes_;
+
+  size_t bytes_;
+  size_t frames_;
+  size_t high_watermark_;
+  size_t low_watermark_;
+  size_t max_bytes_;
+  bool blocked_;
+};
+
+#endif
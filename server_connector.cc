@@ -0,0 +1,373 @@
+#include "examples/voip/server_connector.h"
+
+#include <algorithm>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+#ifdef WIN32
+#include "rtc_base/win32socketserver.h"
+#else
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "rtc_base/physical_socket_server.h"
+#endif
+
+namespace {
+
+// Delay between starting connection attempts (RFC 8305 recommends 250 ms).
+const int kConnectStagger = 250;
+// Give up on the whole race after this long.
+const int kConnectTimeout = 10*1000;
+
+enum {
+  MSG_START_NEXT = 0,
+  MSG_TIMEOUT,
+  MSG_RELEASE_SOCKETS,
+  MSG_FAST_OPEN,
+};
+
+// Interleaves address families, keeping the family of the first (preferred)
+// address first.
+std::vector<rtc::IPAddress> SortAddresses(
+    const std::vector<rtc::IPAddress>& addresses) {
+  if (addresses.empty()) {
+    return addresses;
+  }
+  int first_family = addresses[0].family();
+  std::vector<rtc::IPAddress> first, second;
+  for (const rtc::IPAddress& ip : addresses) {
+    if (ip.family() == first_family) {
+      first.push_back(ip);
+    } else {
+      second.push_back(ip);
+    }
+  }
+
+  std::vector<rtc::IPAddress> sorted;
+  for (size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+    if (i < first.size()) {
+      sorted.push_back(first[i]);
+    }
+    if (i < second.size()) {
+      sorted.push_back(second[i]);
+    }
+  }
+  return sorted;
+}
+
+}  // namespace
+
+rtc::AsyncSocket* CreateClientSocket(int family) {
+#ifdef WIN32
+  rtc::Win32Socket* sock = new rtc::Win32Socket();
+  sock->CreateT(family, SOCK_STREAM);
+  return sock;
+#elif defined(WEBRTC_POSIX)
+  rtc::Thread* thread = rtc::Thread::Current();
+  RTC_DCHECK(thread != NULL);
+  return thread->socketserver()->CreateAsyncSocket(family, SOCK_STREAM);
+#else
+#error Platform not supported.
+#endif
+}
+
+DnsCache::DnsCache(int ttl_ms) : ttl_ms_(ttl_ms) {
+}
+
+bool DnsCache::Get(const std::string& host, int64_t now_ms,
+                   std::vector<rtc::IPAddress>* addresses) const {
+  auto it = entries_.find(host);
+  if (it == entries_.end() || now_ms >= it->second.expires) {
+    return false;
+  }
+  *addresses = it->second.addresses;
+  return true;
+}
+
+bool DnsCache::GetStale(const std::string& host,
+                        std::vector<rtc::IPAddress>* addresses) const {
+  auto it = entries_.find(host);
+  if (it == entries_.end()) {
+    return false;
+  }
+  *addresses = it->second.addresses;
+  return true;
+}
+
+void DnsCache::Put(const std::string& host,
+                   const std::vector<rtc::IPAddress>& addresses,
+                   int64_t now_ms) {
+  Entry& entry = entries_[host];
+  //保留上次连接成功的地址在最前面
+  rtc::IPAddress preferred;
+  if (!entry.addresses.empty()) {
+    preferred = entry.addresses[0];
+  }
+  entry.addresses = addresses;
+  entry.expires = now_ms + ttl_ms_;
+  if (!preferred.IsNil()) {
+    Prefer(host, preferred);
+  }
+}
+
+void DnsCache::Prefer(const std::string& host, const rtc::IPAddress& ip) {
+  auto it = entries_.find(host);
+  if (it == entries_.end()) {
+    return;
+  }
+  std::vector<rtc::IPAddress>& addresses = it->second.addresses;
+  auto pos = std::find(addresses.begin(), addresses.end(), ip);
+  if (pos != addresses.end()) {
+    std::rotate(addresses.begin(), pos, pos + 1);
+  }
+}
+
+ServerConnector::ServerConnector()
+    : stagger_ms_(kConnectStagger),
+      timeout_ms_(kConnectTimeout),
+      fast_open_(false),
+      resolver_(NULL),
+      connecting_(false) {
+}
+
+ServerConnector::~ServerConnector() {
+  Cancel();
+  rtc::Thread::Current()->Clear(this);
+  discarded_.clear();
+}
+
+void ServerConnector::Connect(const rtc::SocketAddress& server) {
+  Cancel();
+  server_ = server;
+  connecting_ = true;
+  results_.clear();
+
+  if (!server.IsUnresolvedIP()) {
+    Race(std::vector<rtc::IPAddress>(1, server.ipaddr()));
+    return;
+  }
+
+  std::vector<rtc::IPAddress> addresses;
+  if (dns_cache_.Get(server.hostname(), rtc::TimeMillis(), &addresses)) {
+    RTC_LOG(INFO) << "dns cache hit:" << server.hostname()
+                  << " addresses:" << addresses.size();
+    Race(addresses);
+    return;
+  }
+
+  RTC_LOG(INFO) << "resolve:" << server.hostname();
+  resolver_ = new rtc::AsyncResolver();
+  resolver_->SignalDone.connect(this, &ServerConnector::OnResolveResult);
+  resolver_->Start(server);
+}
+
+void ServerConnector::Cancel() {
+  rtc::Thread::Current()->Clear(this, MSG_START_NEXT);
+  rtc::Thread::Current()->Clear(this, MSG_TIMEOUT);
+  rtc::Thread::Current()->Clear(this, MSG_FAST_OPEN);
+  if (resolver_ != NULL) {
+    resolver_->Destroy(false);
+    resolver_ = NULL;
+  }
+  //可能在某个socket的回调中被调用, 延迟释放
+  for (Attempt& attempt : attempts_) {
+    if (attempt.socket) {
+      Discard(std::move(attempt.socket));
+    }
+  }
+  attempts_.clear();
+  pending_.clear();
+  connecting_ = false;
+}
+
+void ServerConnector::OnResolveResult(rtc::AsyncResolverInterface* resolver) {
+  RTC_DCHECK(resolver == resolver_);
+  std::vector<rtc::IPAddress> addresses;
+  if (resolver_->GetError() == 0) {
+    addresses = resolver_->addresses();
+  }
+  resolver_->Destroy(false);
+  resolver_ = NULL;
+
+  const std::string& host = server_.hostname();
+  if (!addresses.empty()) {
+    dns_cache_.Put(host, addresses, rtc::TimeMillis());
+    dns_cache_.Get(host, rtc::TimeMillis(), &addresses);
+  } else if (dns_cache_.GetStale(host, &addresses)) {
+    RTC_LOG(WARNING) << "resolve " << host << " failed, use stale addresses";
+  } else {
+    RTC_LOG(LS_ERROR) << "resolve " << host << " failed";
+    Fail();
+    return;
+  }
+  Race(addresses);
+}
+
+void ServerConnector::Race(const std::vector<rtc::IPAddress>& addresses) {
+  std::vector<rtc::IPAddress> sorted = SortAddresses(addresses);
+  //逆序存放, 从尾部取下一个地址
+  for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+    pending_.push_back(rtc::SocketAddress(*it, server_.port()));
+  }
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, timeout_ms_, this,
+                                      MSG_TIMEOUT);
+  StartNextAttempt();
+}
+
+void ServerConnector::StartNextAttempt() {
+  rtc::Thread::Current()->Clear(this, MSG_START_NEXT);
+  while (!pending_.empty()) {
+    rtc::SocketAddress address = pending_.back();
+    pending_.pop_back();
+
+    AttemptResult result;
+    result.address = address;
+    results_.push_back(result);
+
+    Attempt attempt;
+    attempt.socket.reset(CreateClientSocket(address.ipaddr().family()));
+    attempt.start_ms = rtc::TimeMillis();
+    attempt.result = results_.size() - 1;
+    //只有上次连接成功的地址使用TFO
+    bool fast_open = fast_open_ && attempt.result == 0 && attempt.socket &&
+                     EnableFastOpen(attempt.socket.get());
+    if (!attempt.socket ||
+        attempt.socket->Connect(address) == SOCKET_ERROR) {
+      RTC_LOG(WARNING) << "connect " << address.ToString() << " failed";
+      results_.back().latency_ms = 0;
+      if (attempt.socket) {
+        Discard(std::move(attempt.socket));
+      }
+      continue;
+    }
+
+    RTC_LOG(INFO) << "connecting " << address.ToString();
+    attempt.socket->SignalConnectEvent.connect(
+        this, &ServerConnector::OnSocketConnect);
+    attempt.socket->SignalCloseEvent.connect(
+        this, &ServerConnector::OnSocketClose);
+    attempts_.push_back(std::move(attempt));
+
+    if (fast_open &&
+        attempts_.back().socket->GetState() == rtc::Socket::CS_CONNECTED) {
+      //connect()已返回, 不会有SignalConnectEvent, 回到消息循环后再通知
+      rtc::Thread::Current()->Post(RTC_FROM_HERE, this, MSG_FAST_OPEN);
+      return;
+    }
+    if (!pending_.empty()) {
+      rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, stagger_ms_, this,
+                                          MSG_START_NEXT);
+    }
+    return;
+  }
+
+  if (attempts_.empty()) {
+    Fail();
+  }
+}
+
+bool ServerConnector::EnableFastOpen(rtc::AsyncSocket* socket) {
+#if defined(WEBRTC_POSIX) && defined(TCP_FASTOPEN_CONNECT)
+  int fd = static_cast<rtc::SocketDispatcher*>(socket)->GetDescriptor();
+  int one = 1;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one,
+                 sizeof(one)) == 0) {
+    return true;
+  }
+  RTC_LOG(WARNING) << "TCP_FASTOPEN_CONNECT failed, error:" << errno;
+#endif
+  return false;
+}
+
+ServerConnector::Attempt* ServerConnector::FindAttempt(
+    rtc::AsyncSocket* socket) {
+  for (Attempt& attempt : attempts_) {
+    if (attempt.socket.get() == socket) {
+      return &attempt;
+    }
+  }
+  return nullptr;
+}
+
+void ServerConnector::OnSocketConnect(rtc::AsyncSocket* socket) {
+  Attempt* winner = FindAttempt(socket);
+  if (winner == nullptr) {
+    return;
+  }
+
+  AttemptResult& result = results_[winner->result];
+  result.connected = true;
+  result.latency_ms = rtc::TimeMillis() - winner->start_ms;
+  RTC_LOG(INFO) << "connected " << result.address.ToString() << " in "
+                << result.latency_ms << "ms, attempts:" << results_.size();
+  if (server_.IsUnresolvedIP()) {
+    dns_cache_.Prefer(server_.hostname(), result.address.ipaddr());
+  }
+
+  std::unique_ptr<rtc::AsyncSocket> connected = std::move(winner->socket);
+  connected->SignalConnectEvent.disconnect(this);
+  connected->SignalCloseEvent.disconnect(this);
+  Cancel();
+
+  SignalConnected(this, connected.release());
+}
+
+void ServerConnector::OnSocketClose(rtc::AsyncSocket* socket, int err) {
+  auto it = std::find_if(attempts_.begin(), attempts_.end(),
+                         [socket](const Attempt& a) {
+                           return a.socket.get() == socket;
+                         });
+  if (it == attempts_.end()) {
+    return;
+  }
+
+  AttemptResult& result = results_[it->result];
+  result.latency_ms = rtc::TimeMillis() - it->start_ms;
+  RTC_LOG(WARNING) << "connect " << result.address.ToString()
+                   << " failed after " << result.latency_ms
+                   << "ms, error:" << err;
+  Discard(std::move(it->socket));
+  attempts_.erase(it);
+
+  //失败后立即尝试下一个地址
+  StartNextAttempt();
+}
+
+void ServerConnector::Fail() {
+  Cancel();
+  SignalFailed(this);
+}
+
+void ServerConnector::Discard(std::unique_ptr<rtc::AsyncSocket> socket) {
+  socket->SignalConnectEvent.disconnect(this);
+  socket->SignalCloseEvent.disconnect(this);
+  socket->Close();
+  discarded_.push_back(std::move(socket));
+  rtc::Thread::Current()->Post(RTC_FROM_HERE, this, MSG_RELEASE_SOCKETS);
+}
+
+void ServerConnector::OnMessage(rtc::Message* msg) {
+  switch (msg->message_id) {
+    case MSG_START_NEXT:
+      StartNextAttempt();
+      break;
+    case MSG_TIMEOUT:
+      RTC_LOG(LS_ERROR) << "connect " << server_.ToString() << " timeout";
+      Fail();
+      break;
+    case MSG_RELEASE_SOCKETS:
+      discarded_.clear();
+      break;
+    case MSG_FAST_OPEN:
+      //TFO的第一个地址是唯一的尝试
+      if (!attempts_.empty()) {
+        OnSocketConnect(attempts_.front().socket.get());
+      }
+      break;
+  }
+}
@@ -0,0 +1,134 @@
+#ifndef SERVER_CONNECTOR_H
+#define SERVER_CONNECTOR_H
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rtc_base/async_socket.h"
+#include "rtc_base/ip_address.h"
+#include "rtc_base/net_helpers.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/third_party/sigslot/sigslot.h"
+#include "rtc_base/thread.h"
+
+// Unconnected TCP socket of |family| from the current thread's socket server.
+rtc::AsyncSocket* CreateClientSocket(int family);
+
+// Resolved addresses of signaling server host names. getaddrinfo() does not
+// report record TTLs, so entries live for a configured ttl. An expired entry
+// is still returned by GetStale() so a failed refresh can fall back to it.
+class DnsCache {
+ public:
+  explicit DnsCache(int ttl_ms = 5*60*1000);
+
+  void set_ttl(int ttl_ms) { ttl_ms_ = ttl_ms; }
+
+  bool Get(const std::string& host, int64_t now_ms,
+           std::vector<rtc::IPAddress>* addresses) const;
+  bool GetStale(const std::string& host,
+                std::vector<rtc::IPAddress>* addresses) const;
+  void Put(const std::string& host, const std::vector<rtc::IPAddress>& addresses,
+           int64_t now_ms);
+  // Moves |ip| to the front so the next connect tries it first.
+  void Prefer(const std::string& host, const rtc::IPAddress& ip);
+
+ private:
+  struct Entry {
+    std::vector<rtc::IPAddress> addresses;
+    int64_t expires;
+  };
+
+  int ttl_ms_;
+  std::map<std::string, Entry> entries_;
+};
+
+// Connects to a signaling server that may have several addresses, following
+// Happy Eyeballs (RFC 8305): the addresses are ordered alternating between
+// IPv6 and IPv4, and a new attempt starts every stagger_ms() or as soon as
+// the previous one fails, while earlier attempts keep running. The first
+// socket to connect wins and the rest are closed. Host names are resolved
+// through a DnsCache and the winning address is tried first next time.
+//
+// With set_fast_open(), the first attempt, i.e. the address that won last
+// time, uses TCP Fast Open (TCP_FASTOPEN_CONNECT, Linux 4.11+): connect()
+// returns at once and the SYN is only sent with the first write, carrying
+// that data when the kernel holds a TFO cookie for the server. The attempt
+// is reported connected right away, so the race ends there; a dead address
+// shows up as the socket closing on the first write.
+class ServerConnector : public sigslot::has_slots<>,
+                        public rtc::MessageHandler {
+ public:
+  struct AttemptResult {
+    rtc::SocketAddress address;
+    bool connected = false;
+    // Time from the start of the attempt to connect or failure. -1 when the
+    // attempt was still pending when another one won.
+    int64_t latency_ms = -1;
+  };
+
+  ServerConnector();
+  ~ServerConnector();
+
+  void set_stagger(int ms) { stagger_ms_ = ms; }
+  int stagger_ms() const { return stagger_ms_; }
+  void set_timeout(int ms) { timeout_ms_ = ms; }
+  void set_fast_open(bool enabled) { fast_open_ = enabled; }
+  bool fast_open() const { return fast_open_; }
+  DnsCache* dns_cache() { return &dns_cache_; }
+
+  // Starts connecting to |server|. Any attempt in progress is cancelled.
+  void Connect(const rtc::SocketAddress& server);
+  void Cancel();
+  bool connecting() const { return connecting_; }
+
+  // Results of the last Connect(), in the order the attempts were started.
+  const std::vector<AttemptResult>& results() const { return results_; }
+
+  // The connected socket; the receiver takes ownership and must connect its
+  // own signals.
+  sigslot::signal2<ServerConnector*, rtc::AsyncSocket*> SignalConnected;
+  sigslot::signal1<ServerConnector*> SignalFailed;
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  struct Attempt {
+    std::unique_ptr<rtc::AsyncSocket> socket;
+    int64_t start_ms;
+    size_t result;  // index into results_
+  };
+
+  void OnResolveResult(rtc::AsyncResolverInterface* resolver);
+  void Race(const std::vector<rtc::IPAddress>& addresses);
+  void StartNextAttempt();
+  // Sets TCP_FASTOPEN_CONNECT on |socket|; false if the platform lacks it.
+  bool EnableFastOpen(rtc::AsyncSocket* socket);
+  void OnSocketConnect(rtc::AsyncSocket* socket);
+  void OnSocketClose(rtc::AsyncSocket* socket, int err);
+  void Fail();
+  Attempt* FindAttempt(rtc::AsyncSocket* socket);
+  // Closes and releases an attempt's socket once the stack unwinds out of
+  // its signal handler.
+  void Discard(std::unique_ptr<rtc::AsyncSocket> socket);
+
+  DnsCache dns_cache_;
+  int stagger_ms_;
+  int timeout_ms_;
+  bool fast_open_;
+
+  rtc::SocketAddress server_;
+  rtc::AsyncResolver* resolver_;
+  bool connecting_;
+
+  std::vector<rtc::SocketAddress> pending_;  // not started yet
+  std::vector<Attempt> attempts_;
+  std::vector<std::unique_ptr<rtc::AsyncSocket>> discarded_;
+  std::vector<AttemptResult> results_;
+};
+
+#endif
@@ -0,0 +1,516 @@
+#include "examples/voip/signaling_mux.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "examples/voip/message.h"
+#include "examples/voip/server_connector.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/helpers.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+// Timer wheel resolution and size: 512 slots of 100 ms cover 51.2 s, longer
+// than any heartbeat interval, so timers rarely go around more than once.
+const int kTick = 100;
+const size_t kWheelSlots = 512;
+
+// Shared by all sessions; one read drains up to this much from a socket.
+const size_t kReadBufferSize = 64*1024;
+// Initial size of a session's buffer for a frame split across reads.
+const size_t kMinPendingSize = 1024;
+const size_t kMaxRecvBufferSize = HEADER_SIZE + MAX_BODY_SIZE;
+
+//多数会话只收发少量信令, 用小块减少空闲内存
+const size_t kChunkSize = 4*1024;
+const size_t kMaxFreeChunks = 1024;
+const size_t kMaxSendBytes = 1024*1024;
+
+const int kAuthTimeout = 10*1000;
+const int kReconnectBaseDelay = 500;
+const int kReconnectMaxDelay = 30*1000;
+
+enum {
+  MSG_TICK = 0,
+  MSG_RELEASE,
+};
+
+}  // namespace
+
+// Charges the wall time of a socket event or timer to a session and its mux.
+class MuxCpuScope {
+ public:
+  MuxCpuScope(int64_t* session_us, int64_t* mux_us)
+      : session_us_(session_us), mux_us_(mux_us), start_(rtc::TimeMicros()) {}
+  ~MuxCpuScope() {
+    int64_t elapsed = rtc::TimeMicros() - start_;
+    *session_us_ += elapsed;
+    *mux_us_ += elapsed;
+  }
+
+ private:
+  int64_t* session_us_;
+  int64_t* mux_us_;
+  int64_t start_;
+};
+
+MuxSession::MuxSession(SignalingMux* mux, int64_t uid,
+                       const std::string& token)
+    : mux_(mux),
+      uid_(uid),
+      token_(token),
+      state_(NOT_CONNECTED),
+      send_queue_(mux->pool()),
+      seq_(0),
+      timer_kind_(TIMER_NONE),
+      reconnect_attempts_(0) {
+  timer_.session = this;
+  send_queue_.set_max_bytes(kMaxSendBytes);
+}
+
+MuxSession::~MuxSession() {
+  Close();
+}
+
+bool MuxSession::SendRTMessage(int64_t peer_id, const std::string& content,
+                               int version) {
+  Message m;
+  m.cmd = MSG_RT;
+  m.version = version;
+  m.sender = uid_;
+  m.receiver = peer_id;
+  m.content = content;
+  return SendMessage(m);
+}
+
+MuxSession::Stats MuxSession::stats() const {
+  Stats stats = stats_;
+  //不含socket对象本身
+  stats.memory_bytes = sizeof(MuxSession) + send_queue_.bytes();
+  if (pending_) {
+    stats.memory_bytes += pending_->capacity();
+  }
+  return stats;
+}
+
+void MuxSession::Connect() {
+  state_ = CONNECTING;
+  if (!mux_->resolved()) {
+    //解析完成后由mux统一发起连接
+    mux_->Resolve();
+    return;
+  }
+
+  const rtc::SocketAddress& server = mux_->server();
+  socket_.reset(CreateClientSocket(server.ipaddr().family()));
+  if (!socket_) {
+    OnConnectionLost();
+    return;
+  }
+  socket_->SignalConnectEvent.connect(this, &MuxSession::OnConnect);
+  socket_->SignalReadEvent.connect(this, &MuxSession::OnRead);
+  socket_->SignalWriteEvent.connect(this, &MuxSession::OnWrite);
+  socket_->SignalCloseEvent.connect(this, &MuxSession::OnClose);
+  if (socket_->Connect(server) == SOCKET_ERROR) {
+    RTC_LOG(WARNING) << "session " << uid_ << " connect failed";
+    OnConnectionLost();
+    return;
+  }
+  SetTimer(TIMER_RECONNECT, kAuthTimeout);
+}
+
+void MuxSession::Close() {
+  if (socket_) {
+    socket_->SignalConnectEvent.disconnect(this);
+    socket_->SignalReadEvent.disconnect(this);
+    socket_->SignalWriteEvent.disconnect(this);
+    socket_->SignalCloseEvent.disconnect(this);
+    socket_->Close();
+    //可能在socket的回调中, 延迟释放
+    mux_->Discard(std::move(socket_));
+  }
+  pending_.reset();
+  send_queue_.Clear();
+  heartbeat_.Reset();
+}
+
+void MuxSession::OnConnect(rtc::AsyncSocket* socket) {
+  MuxCpuScope scope(&stats_.cpu_us, &mux_->cpu_us_);
+  state_ = SIGNING_IN;
+  SendAuth();
+}
+
+void MuxSession::OnRead(rtc::AsyncSocket* socket) {
+  MuxCpuScope scope(&stats_.cpu_us, &mux_->cpu_us_);
+  while (socket_) {
+    if (pending_) {
+      size_t len = 0;
+      char* p = pending_->WritePtr(&len);
+      if (len == 0) {
+        RTC_LOG(LS_ERROR) << "session " << uid_ << " receive buffer overflow";
+        OnConnectionLost();
+        return;
+      }
+      int bytes = socket->Recv(p, len, nullptr);
+      if (bytes <= 0) {
+        break;
+      }
+      pending_->Commit(bytes);
+      if (!ProcessPending()) {
+        OnConnectionLost();
+        return;
+      }
+      continue;
+    }
+
+    //直接在共享缓冲区中解码, 只拷贝不完整的尾部
+    char* buffer = mux_->read_buffer();
+    int bytes = socket->Recv(buffer, kReadBufferSize, nullptr);
+    if (bytes <= 0) {
+      break;
+    }
+    int n = ProcessFrames(buffer, bytes);
+    if (n < 0) {
+      OnConnectionLost();
+      return;
+    }
+    if (n < bytes) {
+      size_t rest = bytes - n;
+      pending_.reset(new RecvBuffer(std::max(rest, kMinPendingSize),
+                                    kMaxRecvBufferSize));
+      size_t len = 0;
+      char* p = pending_->WritePtr(&len);
+      RTC_DCHECK(len >= rest);
+      memcpy(p, buffer + n, rest);
+      pending_->Commit(rest);
+    }
+  }
+}
+
+int MuxSession::ProcessFrames(const char* p, int size) {
+  int consumed = 0;
+  while (consumed < size) {
+    MessageView m;
+    int n = DecodeMessage(p + consumed, size - consumed, &m);
+    if (n < 0) {
+      RTC_LOG(LS_ERROR) << "session " << uid_ << " malformed frame";
+      return -1;
+    }
+    if (n == 0) {
+      break;
+    }
+    HandleMessage(m);
+    consumed += n;
+  }
+  return consumed;
+}
+
+bool MuxSession::ProcessPending() {
+  while (pending_->size() > 0) {
+    MessageView m;
+    int n = pending_->PeekMessage(&m);
+    if (n < 0) {
+      RTC_LOG(LS_ERROR) << "session " << uid_ << " malformed frame";
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    HandleMessage(m);
+    pending_->Consume(n);
+  }
+  //不完整的消息已处理完, 归还缓冲区
+  pending_.reset();
+  return true;
+}
+
+void MuxSession::HandleMessage(const MessageView& m) {
+  stats_.frames_in++;
+  SignalingMuxObserver* observer = mux_->observer();
+  if (m.cmd == MSG_AUTH_STATUS) {
+    RTC_LOG(INFO) << "session " << uid_ << " auth status:" << m.status;
+    state_ = CONNECTED;
+    reconnect_attempts_ = 0;
+    SetTimer(TIMER_PING, heartbeat_.interval_ms());
+    if (observer) {
+      observer->OnSignedIn(this);
+    }
+  } else if (m.cmd == MSG_PONG) {
+    heartbeat_.OnPong(m.seq, rtc::TimeMicros());
+    if (heartbeat_.outstanding() == 0) {
+      SetTimer(TIMER_PING, heartbeat_.interval_ms());
+    }
+  } else if (m.cmd == MSG_RT) {
+    if (observer) {
+      observer->HandleRTMessage(this, m.sender, m.receiver, m.version,
+                                m.content);
+    }
+  }
+}
+
+void MuxSession::OnWrite(rtc::AsyncSocket* socket) {
+  MuxCpuScope scope(&stats_.cpu_us, &mux_->cpu_us_);
+  Flush();
+}
+
+void MuxSession::OnClose(rtc::AsyncSocket* socket, int err) {
+  MuxCpuScope scope(&stats_.cpu_us, &mux_->cpu_us_);
+  RTC_LOG(WARNING) << "session " << uid_ << " closed, error:" << err;
+  OnConnectionLost();
+}
+
+void MuxSession::OnConnectionLost() {
+  bool was_connected = state_ == CONNECTED;
+  Close();
+  state_ = NOT_CONNECTED;
+
+  int attempt = reconnect_attempts_++;
+  int delay = 0;
+  if (attempt > 0) {
+    delay = attempt - 1 < 16
+                ? std::min(kReconnectMaxDelay,
+                           kReconnectBaseDelay << (attempt - 1))
+                : kReconnectMaxDelay;
+    //随机化, 避免大量会话同时重连
+    delay = delay / 2 + (int)(rtc::CreateRandomId() % (delay / 2 + 1));
+  }
+  stats_.reconnects++;
+  SetTimer(TIMER_RECONNECT, delay);
+
+  if (was_connected && mux_->observer()) {
+    mux_->observer()->OnDisconnected(this);
+  }
+}
+
+void MuxSession::OnTimer() {
+  MuxCpuScope scope(&stats_.cpu_us, &mux_->cpu_us_);
+  TimerKind kind = timer_kind_;
+  timer_kind_ = TIMER_NONE;
+
+  switch (kind) {
+    case TIMER_RECONNECT:
+      if (state_ == NOT_CONNECTED) {
+        Connect();
+      } else if (state_ != CONNECTED) {
+        //连接或auth超时
+        RTC_LOG(WARNING) << "session " << uid_ << " sign in timeout";
+        OnConnectionLost();
+      }
+      break;
+    case TIMER_PING:
+      if (state_ != CONNECTED) {
+        break;
+      }
+      if (heartbeat_.IsTimedOut(rtc::TimeMicros())) {
+        OnConnectionLost();
+        break;
+      }
+      SendPing();
+      break;
+    case TIMER_PONG_TIMEOUT:
+      if (state_ != CONNECTED) {
+        break;
+      }
+      if (heartbeat_.IsTimedOut(rtc::TimeMicros())) {
+        RTC_LOG(INFO) << "session " << uid_ << " ping timeout after "
+                      << heartbeat_.timeout_ms() << "ms";
+        OnConnectionLost();
+      } else {
+        SetTimer(TIMER_PING, heartbeat_.interval_ms());
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool MuxSession::SendMessage(Message& m) {
+  if (!socket_ || (state_ != CONNECTED && m.cmd != MSG_AUTH_TOKEN)) {
+    return false;
+  }
+  m.seq = ++seq_;
+  if (!send_queue_.Push(m, SendQueue::LaneOf(m.cmd))) {
+    RTC_LOG(LS_ERROR) << "session " << uid_ << " send queue overflow";
+    return false;
+  }
+  stats_.frames_out++;
+  Flush();
+  return true;
+}
+
+void MuxSession::SendAuth() {
+  Message m;
+  m.cmd = MSG_AUTH_TOKEN;
+  m.token = token_;
+  m.device_id = "0123456789";
+  m.platform_id = PLATFORM_LINUX;
+  SendMessage(m);
+}
+
+void MuxSession::SendPing() {
+  Message m;
+  m.cmd = MSG_PING;
+  if (!SendMessage(m)) {
+    return;
+  }
+  heartbeat_.OnPingSent(m.seq, rtc::TimeMicros());
+  SetTimer(TIMER_PONG_TIMEOUT, heartbeat_.timeout_ms() + 1);
+}
+
+void MuxSession::Flush() {
+  while (socket_ && !send_queue_.empty()) {
+    SendQueue::Segment seg;
+    send_queue_.Gather(&seg, 1);
+    int sent = socket_->Send(seg.data, seg.size);
+    if (sent <= 0) {
+      //阻塞时socket server会再发出可写事件
+      break;
+    }
+    send_queue_.Consume(sent);
+    if ((size_t)sent < seg.size) {
+      break;
+    }
+  }
+}
+
+void MuxSession::SetTimer(TimerKind kind, int delay_ms) {
+  timer_kind_ = kind;
+  mux_->wheel()->Schedule(&timer_, rtc::TimeMillis() + delay_ms);
+  mux_->EnsureTick();
+}
+
+SignalingMux::SignalingMux(const rtc::SocketAddress& server)
+    : server_(server),
+      resolver_(NULL),
+      observer_(NULL),
+      read_buffer_(new char[kReadBufferSize]),
+      pool_(kChunkSize, kMaxFreeChunks),
+      wheel_(kTick, kWheelSlots, rtc::TimeMillis()),
+      tick_pending_(false),
+      cpu_us_(0) {
+}
+
+SignalingMux::~SignalingMux() {
+  if (resolver_ != NULL) {
+    resolver_->Destroy(false);
+    resolver_ = NULL;
+  }
+  sessions_.clear();
+  removed_.clear();
+  rtc::Thread::Current()->Clear(this);
+  discarded_.clear();
+}
+
+MuxSession* SignalingMux::AddSession(int64_t uid, const std::string& token) {
+  sessions_.emplace_back(new MuxSession(this, uid, token));
+  MuxSession* session = sessions_.back().get();
+  session->Connect();
+  return session;
+}
+
+void SignalingMux::RemoveSession(MuxSession* session) {
+  auto it = std::find_if(sessions_.begin(), sessions_.end(),
+                         [session](const std::unique_ptr<MuxSession>& s) {
+                           return s.get() == session;
+                         });
+  if (it == sessions_.end()) {
+    return;
+  }
+  //可能在该会话的回调中, 延迟释放
+  TimerWheel::Cancel(&session->timer_);
+  session->timer_kind_ = MuxSession::TIMER_NONE;
+  removed_.push_back(std::move(*it));
+  sessions_.erase(it);
+  rtc::Thread::Current()->Post(RTC_FROM_HERE, this, MSG_RELEASE);
+}
+
+SignalingMux::Stats SignalingMux::stats() const {
+  Stats stats;
+  stats.sessions = sessions_.size();
+  for (const auto& session : sessions_) {
+    stats.session_bytes += session->stats().memory_bytes;
+    if (session->is_connected()) {
+      stats.signed_in++;
+    }
+    if (session->pending_) {
+      stats.pending_recv_buffers++;
+    }
+  }
+  stats.shared_bytes = sizeof(SignalingMux) + kReadBufferSize +
+                       kWheelSlots * sizeof(TimerWheel::Timer) +
+                       pool_.free_chunks() * pool_.chunk_size();
+  stats.timers = wheel_.size();
+  stats.cpu_us = cpu_us_;
+  return stats;
+}
+
+void SignalingMux::Resolve() {
+  if (resolver_ != NULL) {
+    return;
+  }
+  RTC_LOG(INFO) << "resolve:" << server_.hostname();
+  resolver_ = new rtc::AsyncResolver();
+  resolver_->SignalDone.connect(this, &SignalingMux::OnResolveResult);
+  resolver_->Start(server_);
+}
+
+void SignalingMux::OnResolveResult(rtc::AsyncResolverInterface* resolver) {
+  RTC_DCHECK(resolver == resolver_);
+  rtc::SocketAddress resolved;
+  bool ok = resolver_->GetError() == 0 &&
+            (resolver_->GetResolvedAddress(AF_INET, &resolved) ||
+             resolver_->GetResolvedAddress(AF_INET6, &resolved));
+  resolver_->Destroy(false);
+  resolver_ = NULL;
+
+  if (ok) {
+    server_ = resolved;
+  } else {
+    RTC_LOG(LS_ERROR) << "resolve " << server_.hostname() << " failed";
+  }
+  for (const auto& session : sessions_) {
+    if (session->state_ != MuxSession::CONNECTING || session->socket_) {
+      continue;
+    }
+    if (ok) {
+      session->Connect();
+    } else {
+      session->OnConnectionLost();
+    }
+  }
+}
+
+void SignalingMux::EnsureTick() {
+  if (tick_pending_ || wheel_.size() == 0) {
+    return;
+  }
+  tick_pending_ = true;
+  rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kTick, this, MSG_TICK);
+}
+
+void SignalingMux::Discard(std::unique_ptr<rtc::AsyncSocket> socket) {
+  discarded_.push_back(std::move(socket));
+  rtc::Thread::Current()->Post(RTC_FROM_HERE, this, MSG_RELEASE);
+}
+
+void SignalingMux::OnMessage(rtc::Message* msg) {
+  switch (msg->message_id) {
+    case MSG_TICK: {
+      tick_pending_ = false;
+      std::vector<TimerWheel::Timer*> expired;
+      wheel_.Advance(rtc::TimeMillis(), &expired);
+      for (TimerWheel::Timer* timer : expired) {
+        static_cast<MuxSession::SessionTimer*>(timer)->session->OnTimer();
+      }
+      EnsureTick();
+      break;
+    }
+    case MSG_RELEASE:
+      removed_.clear();
+      discarded_.clear();
+      break;
+  }
+}
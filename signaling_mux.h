@@ -0,0 +1,218 @@
+#ifndef SIGNALING_MUX_H
+#define SIGNALING_MUX_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "examples/voip/heartbeat.h"
+#include "examples/voip/recv_buffer.h"
+#include "examples/voip/send_queue.h"
+#include "examples/voip/timer_wheel.h"
+#include "rtc_base/async_socket.h"
+#include "rtc_base/net_helpers.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/third_party/sigslot/sigslot.h"
+#include "rtc_base/thread.h"
+
+class Message;
+struct MessageView;
+class MuxSession;
+class SignalingMux;
+
+struct SignalingMuxObserver {
+  virtual void OnSignedIn(MuxSession* session) = 0;
+  virtual void OnDisconnected(MuxSession* session) = 0;
+  virtual void HandleRTMessage(MuxSession* session,
+                               int64_t sender,
+                               int64_t receiver,
+                               int version,
+                               absl::string_view content) = 0;
+
+ protected:
+  virtual ~SignalingMuxObserver() {}
+};
+
+// One signed-in uid of a SignalingMux. Holds only what is specific to the
+// connection: its socket, the send queue (chunks come from the mux's pool),
+// a receive buffer that exists only while a partial frame is pending, the
+// heartbeat state and one timer on the mux's wheel.
+class MuxSession : public sigslot::has_slots<> {
+ public:
+  enum State {
+    NOT_CONNECTED,
+    CONNECTING,
+    SIGNING_IN,
+    CONNECTED,
+  };
+
+  struct Stats {
+    // Bytes owned by this session right now: the object itself, a pending
+    // receive buffer and queued send data.
+    size_t memory_bytes = 0;
+    // Time spent handling this session's socket events and timers.
+    int64_t cpu_us = 0;
+    int64_t frames_in = 0;
+    int64_t frames_out = 0;
+    int reconnects = 0;
+  };
+
+  MuxSession(SignalingMux* mux, int64_t uid, const std::string& token);
+  ~MuxSession();
+
+  int64_t uid() const { return uid_; }
+  State state() const { return state_; }
+  bool is_connected() const { return state_ == CONNECTED; }
+
+  // Returns false when not signed in or the send queue is past its limit.
+  bool SendRTMessage(int64_t peer_id, const std::string& content,
+                     int version = 0);
+
+  Stats stats() const;
+  const RttStats& rtt_stats() const { return heartbeat_.stats(); }
+
+ private:
+  friend class SignalingMux;
+
+  enum TimerKind {
+    TIMER_NONE,
+    TIMER_RECONNECT,
+    TIMER_PING,
+    TIMER_PONG_TIMEOUT,
+  };
+
+  struct SessionTimer : public TimerWheel::Timer {
+    MuxSession* session = nullptr;
+  };
+
+  void Connect();
+  void Close();
+  void OnConnect(rtc::AsyncSocket* socket);
+  void OnRead(rtc::AsyncSocket* socket);
+  void OnWrite(rtc::AsyncSocket* socket);
+  void OnClose(rtc::AsyncSocket* socket, int err);
+  void OnTimer();
+  void OnConnectionLost();
+
+  // Handles complete frames in [p, p + size); returns the bytes consumed,
+  // or -1 if the stream is corrupt.
+  int ProcessFrames(const char* p, int size);
+  bool ProcessPending();
+  void HandleMessage(const MessageView& m);
+
+  bool SendMessage(Message& m);
+  void SendAuth();
+  void SendPing();
+  void Flush();
+  void SetTimer(TimerKind kind, int delay_ms);
+
+  SignalingMux* mux_;
+  int64_t uid_;
+  std::string token_;
+  State state_;
+  std::unique_ptr<rtc::AsyncSocket> socket_;
+  //只有收到不完整的消息时才分配
+  std::unique_ptr<RecvBuffer> pending_;
+  SendQueue send_queue_;
+  Heartbeat heartbeat_;
+  int seq_;
+
+  //心跳, pong超时和重连共用一个定时器
+  SessionTimer timer_;
+  TimerKind timer_kind_;
+  int reconnect_attempts_;
+
+  Stats stats_;
+};
+
+// Runs many signaling sessions on one rtc::Thread. Sessions share:
+//  - one read buffer: frames are decoded straight out of it, and only the
+//    tail of a frame split across reads is copied into a per-session
+//    RecvBuffer, which is released again once drained;
+//  - one ChunkPool for all send queues;
+//  - one timer wheel, advanced by a single PostDelayed() tick, that carries
+//    every session's heartbeat, pong timeout and reconnect timer.
+// An idle signed-in session therefore costs its object, a socket and a
+// Heartbeat, instead of a PeerConnectionClient with its own buffers,
+// connector, relay pool and posted messages.
+//
+// Must be created and used on the thread that owns the socket server.
+// Sessions must not be destroyed from observer callbacks; use
+// RemoveSession(), which defers the deletion.
+class SignalingMux : public sigslot::has_slots<>,
+                     public rtc::MessageHandler {
+ public:
+  struct Stats {
+    size_t sessions = 0;
+    size_t signed_in = 0;
+    // Sum of MuxSession::Stats::memory_bytes.
+    size_t session_bytes = 0;
+    // Memory shared by all sessions: read buffer, timer wheel and free
+    // chunks held by the pool.
+    size_t shared_bytes = 0;
+    size_t pending_recv_buffers = 0;
+    size_t timers = 0;
+    int64_t cpu_us = 0;
+
+    size_t bytes_per_session() const {
+      return sessions > 0 ? (session_bytes + shared_bytes) / sessions : 0;
+    }
+    int64_t cpu_us_per_session() const {
+      return sessions > 0 ? cpu_us / (int64_t)sessions : 0;
+    }
+  };
+
+  explicit SignalingMux(const rtc::SocketAddress& server);
+  ~SignalingMux();
+
+  void RegisterObserver(SignalingMuxObserver* observer) {
+    observer_ = observer;
+  }
+
+  // Creates a session and starts connecting it.
+  MuxSession* AddSession(int64_t uid, const std::string& token);
+  void RemoveSession(MuxSession* session);
+  const std::vector<std::unique_ptr<MuxSession>>& sessions() const {
+    return sessions_;
+  }
+
+  Stats stats() const;
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  friend class MuxSession;
+
+  bool resolved() const { return !server_.IsUnresolvedIP(); }
+  const rtc::SocketAddress& server() const { return server_; }
+  void Resolve();
+  void OnResolveResult(rtc::AsyncResolverInterface* resolver);
+
+  char* read_buffer() { return read_buffer_.get(); }
+  ChunkPool* pool() { return &pool_; }
+  TimerWheel* wheel() { return &wheel_; }
+  SignalingMuxObserver* observer() { return observer_; }
+  void EnsureTick();
+  // Deletes |socket| once the current socket callback has returned.
+  void Discard(std::unique_ptr<rtc::AsyncSocket> socket);
+
+  rtc::SocketAddress server_;
+  rtc::AsyncResolver* resolver_;
+  SignalingMuxObserver* observer_;
+
+  std::unique_ptr<char[]> read_buffer_;
+  ChunkPool pool_;
+  TimerWheel wheel_;
+  bool tick_pending_;
+
+  std::vector<std::unique_ptr<MuxSession>> sessions_;
+  std::vector<std::unique_ptr<MuxSession>> removed_;
+  std::vector<std::unique_ptr<rtc::AsyncSocket>> discarded_;
+  int64_t cpu_us_;
+};
+
+#endif
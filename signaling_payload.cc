@@ -0,0 +1,335 @@
+#include "examples/voip/signaling_payload.h"
+
+#include "examples/voip/sdp_codec.h"
+#include "rtc_base/strings/json.h"
+
+namespace {
+
+// Names used for a IceCandidate JSON object.
+const char kCandidateSdpMidName[] = "id";//"sdpMid";
+const char kCandidateSdpMlineIndexName[] = "label";//"sdpMLineIndex";
+const char kCandidateSdpName[] = "candidate";
+const char kCandidatesName[] = "candidates";
+
+// Names used for a SessionDescription JSON object.
+const char kSessionDescriptionTypeName[] = "type";
+const char kSessionDescriptionSdpName[] = "sdp";
+
+// TLV layout: 1 byte payload kind, followed by fields encoded as
+// 1 byte tag + varint length + value. Integers are varints inside the value.
+// Unknown tags are skipped so fields can be added later.
+enum TLVKind {
+  TLV_KIND_VOIP = 1,
+  TLV_KIND_P2P = 2,
+};
+
+enum VOIPTag {
+  TAG_VOIP_COMMAND = 1,
+  TAG_VOIP_CHANNEL_ID = 2,
+  TAG_VOIP_CAPS = 3,
+};
+
+enum P2PTag {
+  TAG_P2P_TYPE = 1,
+  TAG_P2P_SDP = 2,
+  TAG_P2P_SDP_MID = 3,
+  TAG_P2P_SDP_MLINE_INDEX = 4,
+  TAG_P2P_CANDIDATE = 5,
+  //CompressSdp()压缩后的sdp
+  TAG_P2P_SDP_DICT = 6,
+  //一个candidate, 重复出现, 值为TAG_P2P_SDP_MID等字段的TLV
+  TAG_P2P_CANDIDATES = 7,
+};
+
+void WriteVarint(std::string* out, uint64_t v) {
+  while (v >= 0x80) {
+    out->push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back((char)v);
+}
+
+bool ReadVarint(absl::string_view* in, uint64_t* v) {
+  *v = 0;
+  for (int shift = 0; shift < 64 && !in->empty(); shift += 7) {
+    uint8_t b = (uint8_t)(*in)[0];
+    in->remove_prefix(1);
+    *v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WriteField(std::string* out, int tag, absl::string_view value) {
+  out->push_back((char)tag);
+  WriteVarint(out, value.size());
+  out->append(value.data(), value.size());
+}
+
+void WriteIntField(std::string* out, int tag, int64_t value) {
+  std::string v;
+  WriteVarint(&v, (uint64_t)value);
+  WriteField(out, tag, v);
+}
+
+bool ReadField(absl::string_view* in, int* tag, absl::string_view* value) {
+  if (in->empty()) {
+    return false;
+  }
+  *tag = (uint8_t)(*in)[0];
+  in->remove_prefix(1);
+  uint64_t len;
+  if (!ReadVarint(in, &len) || len > in->size()) {
+    return false;
+  }
+  *value = in->substr(0, len);
+  in->remove_prefix(len);
+  return true;
+}
+
+bool ReadIntValue(absl::string_view value, int* v) {
+  uint64_t t;
+  if (!ReadVarint(&value, &t)) {
+    return false;
+  }
+  *v = (int)t;
+  return true;
+}
+
+void WriteCandidate(std::string* out, const std::string& sdp_mid,
+                    int sdp_mline_index, const std::string& candidate) {
+  WriteField(out, TAG_P2P_SDP_MID, sdp_mid);
+  WriteIntField(out, TAG_P2P_SDP_MLINE_INDEX, sdp_mline_index);
+  WriteField(out, TAG_P2P_CANDIDATE, candidate);
+}
+
+bool ReadCandidate(absl::string_view content, P2PCandidate* c) {
+  while (!content.empty()) {
+    int tag;
+    absl::string_view value;
+    if (!ReadField(&content, &tag, &value)) {
+      return false;
+    }
+    if (tag == TAG_P2P_SDP_MID) {
+      c->sdp_mid.assign(value.data(), value.size());
+    } else if (tag == TAG_P2P_SDP_MLINE_INDEX) {
+      if (!ReadIntValue(value, &c->sdp_mline_index)) {
+        return false;
+      }
+    } else if (tag == TAG_P2P_CANDIDATE) {
+      c->candidate.assign(value.data(), value.size());
+    }
+  }
+  return true;
+}
+
+bool DecodeTLV(absl::string_view content, RTPayload* payload) {
+  if (content.empty()) {
+    return false;
+  }
+  int kind = (uint8_t)content[0];
+  content.remove_prefix(1);
+
+  if (kind == TLV_KIND_VOIP) {
+    payload->kind = RTPayload::VOIP;
+  } else if (kind == TLV_KIND_P2P) {
+    payload->kind = RTPayload::P2P;
+  } else {
+    return false;
+  }
+
+  VOIPCommand& voip = payload->voip;
+  P2PSignal& p2p = payload->p2p;
+  while (!content.empty()) {
+    int tag;
+    absl::string_view value;
+    if (!ReadField(&content, &tag, &value)) {
+      return false;
+    }
+
+    bool r = true;
+    if (kind == TLV_KIND_VOIP) {
+      if (tag == TAG_VOIP_COMMAND) {
+        r = ReadIntValue(value, &voip.command);
+      } else if (tag == TAG_VOIP_CHANNEL_ID) {
+        voip.channel_id.assign(value.data(), value.size());
+      } else if (tag == TAG_VOIP_CAPS) {
+        r = ReadIntValue(value, &voip.caps);
+      }
+    } else {
+      if (tag == TAG_P2P_TYPE) {
+        p2p.type.assign(value.data(), value.size());
+      } else if (tag == TAG_P2P_SDP) {
+        p2p.sdp.assign(value.data(), value.size());
+      } else if (tag == TAG_P2P_SDP_MID) {
+        p2p.sdp_mid.assign(value.data(), value.size());
+      } else if (tag == TAG_P2P_SDP_MLINE_INDEX) {
+        r = ReadIntValue(value, &p2p.sdp_mline_index);
+      } else if (tag == TAG_P2P_CANDIDATE) {
+        p2p.candidate.assign(value.data(), value.size());
+      } else if (tag == TAG_P2P_SDP_DICT) {
+        r = DecompressSdp(value, &p2p.sdp);
+      } else if (tag == TAG_P2P_CANDIDATES) {
+        p2p.candidates.emplace_back();
+        r = ReadCandidate(value, &p2p.candidates.back());
+      }
+    }
+    if (!r) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DecodeJSON(absl::string_view content, RTPayload* payload) {
+  Json::Reader reader;
+  Json::Value value;
+
+  //直接解析接收缓冲区中的消息体,不做拷贝
+  if (!reader.parse(content.data(), content.data() + content.size(),
+                    value, false)) {
+    return false;
+  }
+
+  Json::Value obj;
+  if (rtc::GetValueFromJsonObject(value, "voip", &obj)) {
+    payload->kind = RTPayload::VOIP;
+    payload->voip.command = obj["command"].asInt();
+    payload->voip.channel_id = obj["channel_id"].asString();
+    payload->voip.caps = obj["caps"].asInt();
+    return true;
+  }
+
+  if (rtc::GetValueFromJsonObject(value, "p2p", &obj)) {
+    payload->kind = RTPayload::P2P;
+    P2PSignal& p2p = payload->p2p;
+    rtc::GetStringFromJsonObject(obj, kSessionDescriptionTypeName, &p2p.type);
+    rtc::GetStringFromJsonObject(obj, kSessionDescriptionSdpName, &p2p.sdp);
+    rtc::GetStringFromJsonObject(obj, kCandidateSdpMidName, &p2p.sdp_mid);
+    rtc::GetIntFromJsonObject(obj, kCandidateSdpMlineIndexName,
+                              &p2p.sdp_mline_index);
+    rtc::GetStringFromJsonObject(obj, kCandidateSdpName, &p2p.candidate);
+
+    Json::Value candidates;
+    if (rtc::GetValueFromJsonObject(obj, kCandidatesName, &candidates) &&
+        candidates.isArray()) {
+      for (const Json::Value& item : candidates) {
+        P2PCandidate c;
+        rtc::GetStringFromJsonObject(item, kCandidateSdpMidName, &c.sdp_mid);
+        rtc::GetIntFromJsonObject(item, kCandidateSdpMlineIndexName,
+                                  &c.sdp_mline_index);
+        rtc::GetStringFromJsonObject(item, kCandidateSdpName, &c.candidate);
+        p2p.candidates.push_back(c);
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+int PayloadVersionForCaps(int caps) {
+  if (caps & PAYLOAD_CAP_TLV) {
+    return PAYLOAD_VERSION_TLV;
+  }
+  return PAYLOAD_VERSION_JSON;
+}
+
+std::string EncodeVOIPCommand(const VOIPCommand& command, int version) {
+  if (version == PAYLOAD_VERSION_TLV) {
+    std::string out;
+    out.push_back((char)TLV_KIND_VOIP);
+    WriteIntField(&out, TAG_VOIP_COMMAND, command.command);
+    WriteField(&out, TAG_VOIP_CHANNEL_ID, command.channel_id);
+    if (command.caps != 0) {
+      WriteIntField(&out, TAG_VOIP_CAPS, command.caps);
+    }
+    return out;
+  }
+
+  Json::Value value;
+  value["command"] = command.command;
+  value["channel_id"] = command.channel_id;
+  if (command.caps != 0) {
+    value["caps"] = command.caps;
+  }
+
+  Json::Value json;
+  json["voip"] = value;
+  return rtc::JsonValueToString(json);
+}
+
+std::string EncodeP2PSignal(const P2PSignal& signal, int version,
+                            int peer_caps) {
+  bool is_candidate = signal.type == "candidate";
+  bool is_candidates = signal.type == kCandidatesName;
+  if (version == PAYLOAD_VERSION_TLV) {
+    std::string out;
+    out.reserve(signal.sdp.size() + signal.candidate.size() + 32);
+    out.push_back((char)TLV_KIND_P2P);
+    WriteField(&out, TAG_P2P_TYPE, signal.type);
+    if (is_candidate) {
+      WriteCandidate(&out, signal.sdp_mid, signal.sdp_mline_index,
+                     signal.candidate);
+    } else if (is_candidates) {
+      std::string item;
+      for (const P2PCandidate& c : signal.candidates) {
+        item.clear();
+        WriteCandidate(&item, c.sdp_mid, c.sdp_mline_index, c.candidate);
+        WriteField(&out, TAG_P2P_CANDIDATES, item);
+      }
+    } else if (peer_caps & PAYLOAD_CAP_SDP_DICT) {
+      WriteField(&out, TAG_P2P_SDP_DICT, CompressSdp(signal.sdp));
+    } else {
+      WriteField(&out, TAG_P2P_SDP, signal.sdp);
+    }
+    return out;
+  }
+
+  Json::Value value;
+  value[kSessionDescriptionTypeName] = signal.type;
+  if (is_candidate) {
+    value[kCandidateSdpMidName] = signal.sdp_mid;
+    value[kCandidateSdpMlineIndexName] = signal.sdp_mline_index;
+    value[kCandidateSdpName] = signal.candidate;
+  } else if (is_candidates) {
+    Json::Value candidates(Json::arrayValue);
+    for (const P2PCandidate& c : signal.candidates) {
+      Json::Value item;
+      item[kCandidateSdpMidName] = c.sdp_mid;
+      item[kCandidateSdpMlineIndexName] = c.sdp_mline_index;
+      item[kCandidateSdpName] = c.candidate;
+      candidates.append(item);
+    }
+    value[kCandidatesName] = candidates;
+  } else {
+    value[kSessionDescriptionSdpName] = signal.sdp;
+  }
+
+  Json::Value json;
+  json["p2p"] = value;
+  return rtc::JsonValueToString(json);
+}
+
+std::string EncodeRTPayload(const RTPayload& payload, int version,
+                            int peer_caps) {
+  if (payload.kind == RTPayload::VOIP) {
+    return EncodeVOIPCommand(payload.voip, version);
+  } else if (payload.kind == RTPayload::P2P) {
+    return EncodeP2PSignal(payload.p2p, version, peer_caps);
+  }
+  return std::string();
+}
+
+bool DecodeRTPayload(int version, absl::string_view content,
+                     RTPayload* payload) {
+  if (version == PAYLOAD_VERSION_TLV) {
+    return DecodeTLV(content, payload);
+  } else if (version == PAYLOAD_VERSION_JSON) {
+    return DecodeJSON(content, payload);
+  }
+  return false;
+}
@@ -0,0 +1,106 @@
+#ifndef SIGNALING_PAYLOAD_H
+#define SIGNALING_PAYLOAD_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+// Encoding of a MSG_RT body, carried in the Message::version header byte.
+#define PAYLOAD_VERSION_JSON 0
+#define PAYLOAD_VERSION_TLV 1
+
+// Capabilities a client advertises in the "caps" field of its VOIP commands.
+// Peers that never advertise PAYLOAD_CAP_TLV are only sent JSON.
+#define PAYLOAD_CAP_TLV 0x01
+// Offer/answer SDP may be compressed with the built-in dictionary, see
+// sdp_codec.h. Only used together with PAYLOAD_VERSION_TLV.
+#define PAYLOAD_CAP_SDP_DICT 0x02
+// Understands "candidates" messages carrying several ICE candidates.
+#define PAYLOAD_CAP_CANDIDATE_BATCH 0x04
+
+#define PAYLOAD_CAPS (PAYLOAD_CAP_TLV | PAYLOAD_CAP_SDP_DICT | \
+                      PAYLOAD_CAP_CANDIDATE_BATCH)
+
+enum EVOIPCommand {
+    //语音通话
+    VOIP_COMMAND_DIAL = 1,
+    VOIP_COMMAND_ACCEPT = 2,
+    VOIP_COMMAND_CONNECTED = 3,
+    VOIP_COMMAND_REFUSE = 4,
+    VOIP_COMMAND_REFUSED = 5,
+    VOIP_COMMAND_HANG_UP = 6,
+    VOIP_COMMAND_RESET = 7,
+
+    //通话中
+    VOIP_COMMAND_TALKING = 8,
+    
+    //视频通话
+    VOIP_COMMAND_DIAL_VIDEO = 9,
+    
+    VOIP_COMMAND_PING = 10,
+};
+
+//voip控制命令
+struct VOIPCommand {
+  int command = 0;
+  std::string channel_id;
+  int caps = 0;
+};
+
+struct P2PCandidate {
+  std::string sdp_mid;
+  int sdp_mline_index = 0;
+  std::string candidate;
+};
+
+//offer/answer/candidate/candidates
+struct P2PSignal {
+  std::string type;
+
+  //offer, answer
+  std::string sdp;
+
+  //candidate
+  std::string sdp_mid;
+  int sdp_mline_index = 0;
+  std::string candidate;
+
+  //candidates
+  std::vector<P2PCandidate> candidates;
+};
+
+struct RTPayload {
+  enum Kind {
+    NONE,
+    VOIP,
+    P2P,
+  };
+
+  Kind kind = NONE;
+  VOIPCommand voip;
+  P2PSignal p2p;
+};
+
+// Best encoding for a peer that advertised |caps|.
+int PayloadVersionForCaps(int caps);
+
+// Encodes a payload as JSON ({"voip":{...}} / {"p2p":{...}}) or as TLV,
+// depending on |version|. |peer_caps| enables optional features of the TLV
+// encoding such as SDP compression.
+std::string EncodeVOIPCommand(const VOIPCommand& command, int version);
+std::string EncodeP2PSignal(const P2PSignal& signal, int version,
+                            int peer_caps = 0);
+// Encodes whichever of |payload|'s members its kind selects. NONE encodes
+// to an empty string.
+std::string EncodeRTPayload(const RTPayload& payload, int version,
+                            int peer_caps = 0);
+
+// Decodes a MSG_RT body of the given |version|. Returns false for an
+// unknown version or a malformed body.
+bool DecodeRTPayload(int version, absl::string_view content,
+                     RTPayload* payload);
+
+#endif
@@ -0,0 +1,340 @@
+#include "examples/voip/signaling_thread.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "examples/voip/message.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace {
+
+// Capacity of each handoff queue, in messages.
+const size_t kQueueSize = 1024;
+
+enum {
+  MSG_DRAIN_INBOUND = 1,  //主线程
+  MSG_DRAIN_OUTBOUND,     //I/O线程
+  MSG_FLUSH_BACKLOG,      //I/O线程
+};
+
+void AddSample(SignalingThread::LatencyStats* stats, int64_t us) {
+  stats->count++;
+  stats->total_us += us;
+  stats->max_us = std::max(stats->max_us, us);
+}
+
+}  // namespace
+
+SignalingThread::SignalingThread(rtc::Thread* main_thread)
+    : main_thread_(main_thread),
+      inbound_(kQueueSize),
+      outbound_(kQueueSize),
+      inbound_wakeup_(false),
+      outbound_wakeup_(false),
+      backlog_pending_(false),
+      outbound_blocked_(false),
+      client_writable_(true),
+      observer_(NULL),
+      id_(-1) {
+  io_thread_ = rtc::Thread::CreateWithSocketServer();
+  io_thread_->SetName("signaling_io", nullptr);
+  io_thread_->Start();
+
+  io_thread_->Invoke<void>(RTC_FROM_HERE, [this] {
+    client_.reset(new PeerConnectionClient());
+    client_->RegisterObserver(this);
+    client_->SignalReadyToSend.connect(this,
+        &SignalingThread::OnClientReadyToSend);
+  });
+}
+
+SignalingThread::~SignalingThread() {
+  io_thread_->Invoke<void>(RTC_FROM_HERE, [this] {
+    client_->SignOut();
+    client_.reset();
+  });
+  io_thread_->Stop();
+  main_thread_->Clear(this);
+}
+
+void SignalingThread::setID(int64_t id) {
+  id_ = id;
+  io_thread_->Invoke<void>(RTC_FROM_HERE, [this, id] { client_->setID(id); });
+}
+
+void SignalingThread::setToken(std::string& token) {
+  io_thread_->Invoke<void>(RTC_FROM_HERE,
+                           [this, &token] { client_->setToken(token); });
+}
+
+void SignalingThread::set_servers(
+    const std::vector<rtc::SocketAddress>& servers) {
+  io_thread_->Invoke<void>(RTC_FROM_HERE,
+                           [this, &servers] { client_->set_servers(servers); });
+}
+
+void SignalingThread::set_tls(bool enabled, bool ignore_bad_cert) {
+  io_thread_->Invoke<void>(RTC_FROM_HERE, [this, enabled, ignore_bad_cert] {
+    client_->set_tls(enabled, ignore_bad_cert);
+  });
+}
+
+void SignalingThread::set_fast_open(bool enabled) {
+  io_thread_->Invoke<void>(RTC_FROM_HERE,
+                           [this, enabled] { client_->set_fast_open(enabled); });
+}
+
+void SignalingThread::RegisterObserver(PeerConnectionClientObserver* ob) {
+  RTC_DCHECK(main_thread_->IsCurrent());
+  observer_ = ob;
+}
+
+void SignalingThread::Connect() {
+  io_thread_->Invoke<void>(RTC_FROM_HERE, [this] { client_->Connect(); });
+}
+
+bool SignalingThread::SignOut() {
+  return io_thread_->Invoke<bool>(RTC_FROM_HERE,
+                                  [this] { return client_->SignOut(); });
+}
+
+bool SignalingThread::OpenIMOutbox(const std::string& path) {
+  return io_thread_->Invoke<bool>(
+      RTC_FROM_HERE, [this, &path] { return client_->OpenIMOutbox(path); });
+}
+
+bool SignalingThread::StartTrace(const std::string& path) {
+  return io_thread_->Invoke<bool>(
+      RTC_FROM_HERE, [this, &path] { return client_->StartTrace(path); });
+}
+
+void SignalingThread::StopTrace() {
+  io_thread_->Invoke<void>(RTC_FROM_HERE, [this] { client_->StopTrace(); });
+}
+
+bool SignalingThread::SendRTMessage(int64_t peer_id, std::string content,
+                                    int version) {
+  Outgoing out;
+  out.cmd = MSG_RT;
+  out.peer_id = peer_id;
+  out.version = version;
+  out.content = std::move(content);
+  return PushOutgoing(std::move(out));
+}
+
+bool SignalingThread::SendRTPayload(int64_t peer_id, const RTPayload& payload,
+                                    int peer_caps) {
+  int version = PayloadVersionForCaps(peer_caps);
+  return SendRTMessage(peer_id, EncodeRTPayload(payload, version, peer_caps),
+                       version);
+}
+
+bool SignalingThread::SendIMMessage(int64_t peer_id, std::string content) {
+  Outgoing out;
+  out.cmd = MSG_IM;
+  out.peer_id = peer_id;
+  out.content = std::move(content);
+  return PushOutgoing(std::move(out));
+}
+
+bool SignalingThread::PushOutgoing(Outgoing out) {
+  RTC_DCHECK(main_thread_->IsCurrent());
+  out.enqueue_us = rtc::TimeMicros();
+  if (!outbound_.Push(std::move(out))) {
+    //Push失败时不会移走out. 先置标志再重试, 与DrainOutbound()并发时
+    //不会漏掉READY_TO_SEND
+    outbound_blocked_ = true;
+    if (!outbound_.Push(std::move(out))) {
+      RTC_LOG(WARNING) << "signaling outbound queue full";
+      return false;
+    }
+  }
+  if (!outbound_wakeup_.exchange(true)) {
+    io_thread_->Post(RTC_FROM_HERE, this, MSG_DRAIN_OUTBOUND);
+  }
+  return true;
+}
+
+bool SignalingThread::writable() const {
+  if (client_writable_ && outbound_.size() < outbound_.capacity() / 2) {
+    return true;
+  }
+  //调用者会等待SignalReadyToSend: 先置标志再检查一次, 检查之后完成的
+  //DrainOutbound()一定能看到标志
+  outbound_blocked_ = true;
+  return client_writable_ && outbound_.size() < outbound_.capacity() / 2;
+}
+
+SignalingThread::LatencyStats SignalingThread::outbound_latency() const {
+  return io_thread_->Invoke<LatencyStats>(
+      RTC_FROM_HERE, [this] { return outbound_latency_; });
+}
+
+void SignalingThread::OnSignedIn() {
+  PushEvent(Event::SIGNED_IN);
+}
+
+void SignalingThread::OnDisconnected() {
+  PushEvent(Event::DISCONNECTED);
+}
+
+void SignalingThread::OnServerConnectionFailure() {
+  PushEvent(Event::SERVER_CONNECTION_FAILURE);
+}
+
+void SignalingThread::HandleRTMessage(int64_t sender, int64_t receiver,
+                                      int version, absl::string_view content) {
+  Event event;
+  event.type = Event::RT_MESSAGE;
+  event.sender = sender;
+  event.receiver = receiver;
+  event.version = version;
+  //content指向client_的接收缓冲区, 跨线程前必须拷贝
+  event.content.assign(content.data(), content.size());
+  PushEvent(std::move(event));
+}
+
+void SignalingThread::HandleIMMessage(int64_t sender, int64_t receiver,
+                                      int msgid, absl::string_view content) {
+  Event event;
+  event.type = Event::IM_MESSAGE;
+  event.sender = sender;
+  event.receiver = receiver;
+  event.version = msgid;
+  event.content.assign(content.data(), content.size());
+  PushEvent(std::move(event));
+}
+
+void SignalingThread::OnRTMessageGaveUp(int64_t peer_id, int version,
+                                        absl::string_view content) {
+  Event event;
+  event.type = Event::RT_GAVE_UP;
+  event.receiver = peer_id;
+  event.version = version;
+  event.content.assign(content.data(), content.size());
+  PushEvent(std::move(event));
+}
+
+void SignalingThread::OnClientReadyToSend(PeerConnectionClient* client) {
+  client_writable_ = true;
+  PushEvent(Event::READY_TO_SEND);
+}
+
+void SignalingThread::PushEvent(Event::Type type) {
+  Event event;
+  event.type = type;
+  PushEvent(std::move(event));
+}
+
+void SignalingThread::PushEvent(Event event) {
+  RTC_DCHECK(io_thread_->IsCurrent());
+  event.enqueue_us = rtc::TimeMicros();
+  //保持顺序: 有积压时新事件排在积压之后
+  if (!backlog_.empty() || !inbound_.Push(std::move(event))) {
+    backlog_.push_back(std::move(event));
+    backlog_pending_ = true;
+  }
+  if (!inbound_wakeup_.exchange(true)) {
+    main_thread_->Post(RTC_FROM_HERE, this, MSG_DRAIN_INBOUND);
+  }
+}
+
+void SignalingThread::FlushBacklog() {
+  while (!backlog_.empty()) {
+    if (!inbound_.Push(std::move(backlog_.front()))) {
+      break;
+    }
+    backlog_.pop_front();
+  }
+  if (backlog_.empty()) {
+    backlog_pending_ = false;
+  }
+  if (!inbound_wakeup_.exchange(true)) {
+    main_thread_->Post(RTC_FROM_HERE, this, MSG_DRAIN_INBOUND);
+  }
+}
+
+void SignalingThread::DrainOutbound() {
+  outbound_wakeup_ = false;
+
+  Outgoing out;
+  while (outbound_.Pop(&out)) {
+    AddSample(&outbound_latency_, rtc::TimeMicros() - out.enqueue_us);
+    if (out.cmd == MSG_IM) {
+      client_->SendIMMessage(out.peer_id, std::move(out.content));
+    } else {
+      client_->SendRTMessage(out.peer_id, std::move(out.content),
+                             out.version);
+    }
+  }
+  client_writable_ = client_->writable();
+
+  if (outbound_blocked_.exchange(false)) {
+    PushEvent(Event::READY_TO_SEND);
+  }
+}
+
+void SignalingThread::DrainInbound() {
+  inbound_wakeup_ = false;
+
+  Event event;
+  bool ready = false;
+  while (inbound_.Pop(&event)) {
+    AddSample(&inbound_latency_, rtc::TimeMicros() - event.enqueue_us);
+    if (event.type == Event::READY_TO_SEND) {
+      ready = true;
+      continue;
+    }
+    if (observer_ == NULL) {
+      continue;
+    }
+    switch (event.type) {
+      case Event::SIGNED_IN:
+        observer_->OnSignedIn();
+        break;
+      case Event::DISCONNECTED:
+        observer_->OnDisconnected();
+        break;
+      case Event::SERVER_CONNECTION_FAILURE:
+        observer_->OnServerConnectionFailure();
+        break;
+      case Event::RT_MESSAGE:
+        observer_->HandleRTMessage(event.sender, event.receiver,
+                                   event.version, event.content);
+        break;
+      case Event::IM_MESSAGE:
+        observer_->HandleIMMessage(event.sender, event.receiver,
+                                   event.version, event.content);
+        break;
+      case Event::RT_GAVE_UP:
+        observer_->OnRTMessageGaveUp(event.receiver, event.version,
+                                     event.content);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (backlog_pending_) {
+    io_thread_->Post(RTC_FROM_HERE, this, MSG_FLUSH_BACKLOG);
+  }
+  if (ready && writable()) {
+    SignalReadyToSend(this);
+  }
+}
+
+void SignalingThread::OnMessage(rtc::Message* msg) {
+  switch (msg->message_id) {
+    case MSG_DRAIN_INBOUND:
+      DrainInbound();
+      break;
+    case MSG_DRAIN_OUTBOUND:
+      DrainOutbound();
+      break;
+    case MSG_FLUSH_BACKLOG:
+      FlushBacklog();
+      break;
+  }
+}
@@ -0,0 +1,169 @@
+#ifndef SIGNALING_THREAD_H
+#define SIGNALING_THREAD_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "examples/voip/peer_connection_client.h"
+#include "examples/voip/signaling_transport.h"
+#include "examples/voip/spsc_queue.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/third_party/sigslot/sigslot.h"
+#include "rtc_base/thread.h"
+
+// Runs a PeerConnectionClient, i.e. the signaling socket and the frame
+// codec, on a dedicated I/O thread so that UI work on the main thread and
+// signaling I/O do not delay each other.
+//
+// Everything crosses between the threads through two SpscQueues: decoded
+// events flow from the I/O thread to the main thread, outgoing MSG_RT and
+// MSG_IM payloads flow back. A thread is only woken (one Post()) when its
+// queue goes from drained to non-empty, so a burst of messages costs a
+// single wakeup. All public methods must be called on |main_thread|, where
+// the observer and SignalReadyToSend are also invoked.
+class SignalingThread : public SignalingTransport,
+                        public PeerConnectionClientObserver,
+                        public sigslot::has_slots<>,
+                        public rtc::MessageHandler {
+ public:
+  // Time from being queued on one thread to being handled on the other.
+  struct LatencyStats {
+    int64_t count = 0;
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+
+    int64_t average_us() const { return count > 0 ? total_us / count : 0; }
+  };
+
+  explicit SignalingThread(rtc::Thread* main_thread);
+  ~SignalingThread();
+
+  // Configuration, applied synchronously on the I/O thread.
+  void setID(int64_t id);
+  void setToken(std::string& token);
+  void set_servers(const std::vector<rtc::SocketAddress>& servers);
+  // See PeerConnectionClient::set_tls() and set_fast_open().
+  void set_tls(bool enabled, bool ignore_bad_cert = false);
+  void set_fast_open(bool enabled);
+
+  int64_t id() const { return id_; }
+  bool is_connected() const { return id_ != -1; }
+  void RegisterObserver(PeerConnectionClientObserver* ob) override;
+
+  void Connect();
+  bool SignOut();
+
+  // Queues a MSG_RT for the I/O thread. Returns false when the handoff
+  // queue is full; SignalReadyToSend fires once there is room again.
+  bool SendRTMessage(int64_t peer_id, std::string content, int version = 0);
+  // Encodes |payload| for |peer_caps| and queues it with SendRTMessage().
+  bool SendRTPayload(int64_t peer_id, const RTPayload& payload,
+                     int peer_caps) override;
+  // Queues an instant message, see PeerConnectionClient::SendIMMessage().
+  bool SendIMMessage(int64_t peer_id, std::string content);
+  bool OpenIMOutbox(const std::string& path);
+  // See PeerConnectionClient::StartTrace().
+  bool StartTrace(const std::string& path);
+  void StopTrace();
+  // False while either the handoff queue or the client's send queue is past
+  // its high watermark. Once it returned false, SignalReadyToSend fires
+  // when sending can resume.
+  bool writable() const override;
+
+  // I/O thread -> main thread events.
+  const LatencyStats& inbound_latency() const { return inbound_latency_; }
+  // Main thread -> I/O thread payloads.
+  LatencyStats outbound_latency() const;
+
+  rtc::Thread* io_thread() { return io_thread_.get(); }
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  struct Event {
+    enum Type {
+      NONE,
+      SIGNED_IN,
+      DISCONNECTED,
+      SERVER_CONNECTION_FAILURE,
+      RT_MESSAGE,
+      IM_MESSAGE,
+      RT_GAVE_UP,
+      READY_TO_SEND,
+    };
+
+    Type type = NONE;
+    //RT_GAVE_UP: receiver为对端
+    int64_t sender = 0;
+    int64_t receiver = 0;
+    //RT_MESSAGE, RT_GAVE_UP: version, IM_MESSAGE: msgid
+    int version = 0;
+    std::string content;
+    int64_t enqueue_us = 0;
+  };
+
+  struct Outgoing {
+    //MSG_RT或MSG_IM
+    int cmd = 0;
+    int64_t peer_id = 0;
+    int version = 0;
+    std::string content;
+    int64_t enqueue_us = 0;
+  };
+
+  // PeerConnectionClientObserver, called on the I/O thread.
+  void OnSignedIn() override;
+  void OnDisconnected() override;
+  void OnServerConnectionFailure() override;
+  void HandleRTMessage(int64_t sender, int64_t receiver, int version,
+                       absl::string_view content) override;
+  void HandleIMMessage(int64_t sender, int64_t receiver, int msgid,
+                       absl::string_view content) override;
+  void OnRTMessageGaveUp(int64_t peer_id, int version,
+                         absl::string_view content) override;
+  void OnClientReadyToSend(PeerConnectionClient* client);
+
+  // I/O thread.
+  void PushEvent(Event::Type type);
+  void PushEvent(Event event);
+  void FlushBacklog();
+  void DrainOutbound();
+
+  // Main thread.
+  bool PushOutgoing(Outgoing out);
+  void DrainInbound();
+
+  rtc::Thread* main_thread_;
+  std::unique_ptr<rtc::Thread> io_thread_;
+  // Created, used and destroyed on |io_thread_|.
+  std::unique_ptr<PeerConnectionClient> client_;
+
+  SpscQueue<Event> inbound_;
+  SpscQueue<Outgoing> outbound_;
+  std::atomic<bool> inbound_wakeup_;
+  std::atomic<bool> outbound_wakeup_;
+
+  //I/O线程: inbound_已满时暂存的事件
+  std::deque<Event> backlog_;
+  std::atomic<bool> backlog_pending_;
+
+  //主线程看到过不可写(发送失败或writable()返回false), I/O线程排空
+  //outbound_后据此发出READY_TO_SEND
+  mutable std::atomic<bool> outbound_blocked_;
+  //client_的发送队列是否低于高水位
+  std::atomic<bool> client_writable_;
+
+  PeerConnectionClientObserver* observer_;
+  int64_t id_;
+  LatencyStats inbound_latency_;
+  LatencyStats outbound_latency_;  // I/O thread
+};
+
+#endif
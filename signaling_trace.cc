@@ -0,0 +1,154 @@
+#include "examples/voip/signaling_trace.h"
+
+#include <string.h>
+
+#include "examples/voip/message.h"
+
+namespace {
+
+const char kMagic[4] = {'V', 'T', 'R', '1'};
+//与协议的消息长度上限一致, 防止损坏的文件申请过大的内存
+const uint64_t kMaxFrameSize = HEADER_SIZE + MAX_BODY_SIZE;
+
+void PutVarint(std::string* s, uint64_t v) {
+  while (v >= 0x80) {
+    s->push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  s->push_back((char)v);
+}
+
+bool GetVarint(FILE* file, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(file);
+    if (c == EOF) {
+      return false;
+    }
+    result |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+SignalingTraceWriter::SignalingTraceWriter()
+    : file_(NULL), last_us_(-1), records_(0) {
+}
+
+SignalingTraceWriter::~SignalingTraceWriter() {
+  Close();
+}
+
+bool SignalingTraceWriter::Open(const std::string& path,
+                                int64_t wall_time_us) {
+  Close();
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    return false;
+  }
+  char header[12];
+  memcpy(header, kMagic, 4);
+  for (int i = 0; i < 8; i++) {
+    header[4 + i] = (char)((uint64_t)wall_time_us >> (56 - 8 * i));
+  }
+  fwrite(header, 1, sizeof(header), file_);
+  last_us_ = -1;
+  records_ = 0;
+  return true;
+}
+
+void SignalingTraceWriter::Close() {
+  if (file_) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+void SignalingTraceWriter::Record(TraceDirection direction, int64_t time_us,
+                                  const char* frame, size_t size) {
+  if (!file_) {
+    return;
+  }
+  int64_t delta = last_us_ < 0 ? 0 : time_us - last_us_;
+  if (delta < 0) {
+    delta = 0;
+  }
+  last_us_ = time_us;
+
+  //写入stdio的缓冲区, 由Flush()或缓冲区满时落盘
+  record_.clear();
+  record_.push_back((char)direction);
+  PutVarint(&record_, (uint64_t)delta);
+  PutVarint(&record_, size);
+  fwrite(record_.data(), 1, record_.size(), file_);
+  fwrite(frame, 1, size, file_);
+  records_++;
+}
+
+void SignalingTraceWriter::Flush() {
+  if (file_) {
+    fflush(file_);
+  }
+}
+
+SignalingTraceReader::SignalingTraceReader()
+    : file_(NULL), wall_time_us_(0), time_us_(0) {
+}
+
+SignalingTraceReader::~SignalingTraceReader() {
+  Close();
+}
+
+bool SignalingTraceReader::Open(const std::string& path) {
+  Close();
+  file_ = fopen(path.c_str(), "rb");
+  if (!file_) {
+    return false;
+  }
+  unsigned char header[12];
+  if (fread(header, 1, sizeof(header), file_) != sizeof(header) ||
+      memcmp(header, kMagic, 4) != 0) {
+    Close();
+    return false;
+  }
+  uint64_t wall = 0;
+  for (int i = 0; i < 8; i++) {
+    wall = (wall << 8) | header[4 + i];
+  }
+  wall_time_us_ = (int64_t)wall;
+  time_us_ = 0;
+  return true;
+}
+
+void SignalingTraceReader::Close() {
+  if (file_) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+bool SignalingTraceReader::Next(Record* record) {
+  if (!file_) {
+    return false;
+  }
+  int direction = fgetc(file_);
+  uint64_t delta, size;
+  if (direction == EOF || !GetVarint(file_, &delta) ||
+      !GetVarint(file_, &size) || size > kMaxFrameSize) {
+    return false;
+  }
+  record->frame.resize(size);
+  if (size > 0 && fread(&record->frame[0], 1, size, file_) != size) {
+    return false;
+  }
+  time_us_ += (int64_t)delta;
+  record->direction =
+      direction == TRACE_RECEIVED ? TRACE_RECEIVED : TRACE_SENT;
+  record->time_us = time_us_;
+  return true;
+}
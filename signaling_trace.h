@@ -0,0 +1,78 @@
+#ifndef SIGNALING_TRACE_H
+#define SIGNALING_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+enum TraceDirection {
+  TRACE_SENT = 0,
+  TRACE_RECEIVED = 1,
+};
+
+// Binary trace of the signaling frames a client sent and received, for
+// reproducing a session offline. The file starts with the magic "VTR1" and
+// the wall clock time in microseconds (8 bytes, big endian) when recording
+// started, followed by one record per frame:
+//
+//   direction (1 byte) | delta_us (varint) | size (varint) | frame
+//
+// delta_us is the monotonic time since the previous record, so timestamps
+// cost one or two bytes and do not jump with the wall clock. frame is the
+// whole frame, header included, exactly as on the wire.
+class SignalingTraceWriter {
+ public:
+  SignalingTraceWriter();
+  ~SignalingTraceWriter();
+
+  // Truncates |path| and starts a trace. |wall_time_us| goes into the file
+  // header to match the trace with logs.
+  bool Open(const std::string& path, int64_t wall_time_us);
+  void Close();
+  bool is_open() const { return file_ != NULL; }
+
+  // |time_us| is a monotonic timestamp, e.g. rtc::TimeMicros().
+  void Record(TraceDirection direction, int64_t time_us, const char* frame,
+              size_t size);
+  // Writes buffered records to the file.
+  void Flush();
+
+  int64_t records() const { return records_; }
+
+ private:
+  FILE* file_;
+  //上一条记录的时间, -1表示还没有记录
+  int64_t last_us_;
+  int64_t records_;
+  std::string record_;
+};
+
+class SignalingTraceReader {
+ public:
+  struct Record {
+    TraceDirection direction = TRACE_SENT;
+    // Monotonic time since the first record.
+    int64_t time_us = 0;
+    std::string frame;
+  };
+
+  SignalingTraceReader();
+  ~SignalingTraceReader();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  // Reads the next record. Returns false at the end of the trace; a
+  // truncated last record, e.g. from a crash, also ends it.
+  bool Next(Record* record);
+
+  int64_t wall_time_us() const { return wall_time_us_; }
+
+ private:
+  FILE* file_;
+  int64_t wall_time_us_;
+  int64_t time_us_;
+};
+
+#endif
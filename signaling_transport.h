@@ -0,0 +1,35 @@
+#ifndef SIGNALING_TRANSPORT_H
+#define SIGNALING_TRANSPORT_H
+
+#include <stdint.h>
+
+#include "examples/voip/peer_connection_client.h"
+#include "examples/voip/signaling_payload.h"
+#include "rtc_base/third_party/sigslot/sigslot.h"
+
+// What Conductor and VOIPWnd need from signaling: MSG_RT payloads out to a
+// peer, and the peer's payloads back through a PeerConnectionClientObserver.
+//
+// SignalingThread is the implementation over the TCP relay; it encodes
+// payloads and its observer gets HandleRTMessage(). InProcessTransport
+// hands the payloads to another endpoint in the same process unencoded,
+// through HandleRTPayload(). Observers must handle both.
+class SignalingTransport {
+ public:
+  virtual ~SignalingTransport() {}
+
+  virtual void RegisterObserver(PeerConnectionClientObserver* observer) = 0;
+
+  // Sends |payload| to |peer_id|. |peer_caps| are the capabilities the peer
+  // advertised, PAYLOAD_CAP_*; transports that encode pick the encoding
+  // from them. Returns false if the payload was dropped.
+  virtual bool SendRTPayload(int64_t peer_id, const RTPayload& payload,
+                             int peer_caps) = 0;
+
+  // False while sends should be held back; SignalReadyToSend fires once
+  // they can resume.
+  virtual bool writable() const = 0;
+  sigslot::signal1<SignalingTransport*> SignalReadyToSend;
+};
+
+#endif
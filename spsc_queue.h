@@ -0,0 +1,81 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The producer only writes |tail_| and the consumer only writes
+// |head_|; each side keeps a cached copy of the other index so that the
+// shared cache line is only read when the queue looks full or empty.
+template <typename T>
+class SpscQueue {
+ public:
+  // |capacity| is rounded up to a power of two.
+  explicit SpscQueue(size_t capacity) : head_(0), tail_(0) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    mask_ = n - 1;
+    slots_.reset(new T[n]);
+    cached_head_ = 0;
+    cached_tail_ = 0;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Producer side. Returns false, leaving |value| untouched, when full.
+  bool Push(T&& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when empty.
+  bool Pop(T* value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    *value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called concurrently with Push()/Pop().
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static const size_t kCacheLine = 64;
+
+  std::unique_ptr<T[]> slots_;
+  size_t mask_;
+
+  alignas(kCacheLine) std::atomic<size_t> head_;
+  size_t cached_tail_;  // consumer's copy of |tail_|
+
+  alignas(kCacheLine) std::atomic<size_t> tail_;
+  size_t cached_head_;  // producer's copy of |head_|
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "examples/voip/timer_wheel.h"
+
+#include <algorithm>
+
+TimerWheel::Timer::~Timer() {
+  TimerWheel::Cancel(this);
+}
+
+TimerWheel::TimerWheel(int tick_ms, size_t slots, int64_t now_ms)
+    : tick_ms_(std::max(1, tick_ms)),
+      slots_(std::max<size_t>(1, slots)),
+      current_tick_(now_ms / tick_ms_),
+      size_(0) {
+  for (Timer& slot : slots_) {
+    slot.prev = &slot;
+    slot.next = &slot;
+  }
+}
+
+TimerWheel::~TimerWheel() {
+  //剩余的定时器从轮上摘下, 以免析构时访问已释放的槽
+  for (Timer& slot : slots_) {
+    while (slot.next != &slot) {
+      Unlink(slot.next);
+    }
+    slot.prev = nullptr;
+    slot.next = nullptr;
+  }
+}
+
+void TimerWheel::Schedule(Timer* timer, int64_t deadline_ms) {
+  if (timer->scheduled()) {
+    Cancel(timer);
+  }
+  timer->deadline_ms = deadline_ms;
+  timer->wheel = this;
+
+  int64_t tick = std::max(deadline_ms / tick_ms_, current_tick_ + 1);
+  Timer* slot = &slots_[tick % slots_.size()];
+  timer->prev = slot->prev;
+  timer->next = slot;
+  slot->prev->next = timer;
+  slot->prev = timer;
+  size_++;
+}
+
+void TimerWheel::Cancel(Timer* timer) {
+  if (!timer->scheduled()) {
+    return;
+  }
+  timer->wheel->size_--;
+  Unlink(timer);
+}
+
+void TimerWheel::Advance(int64_t now_ms, std::vector<Timer*>* expired) {
+  int64_t now_tick = now_ms / tick_ms_;
+  if (now_tick <= current_tick_) {
+    return;
+  }
+  //跨越超过一圈时每个槽只需检查一次
+  int64_t first = std::max(current_tick_ + 1,
+                           now_tick - (int64_t)slots_.size() + 1);
+  for (int64_t tick = first; tick <= now_tick; tick++) {
+    Timer* slot = &slots_[tick % slots_.size()];
+    Timer* node = slot->next;
+    while (node != slot) {
+      Timer* next = node->next;
+      if (node->deadline_ms / tick_ms_ <= now_tick) {
+        Unlink(node);
+        size_--;
+        expired->push_back(node);
+      }
+      node = next;
+    }
+  }
+  current_tick_ = now_tick;
+}
+
+void TimerWheel::Unlink(Timer* timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = nullptr;
+  timer->next = nullptr;
+  timer->wheel = nullptr;
+}
@@ -0,0 +1,53 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Hashed timing wheel. Timers are intrusive list nodes hashed into
+// |slots| buckets by deadline / tick_ms, so scheduling, cancelling and
+// expiring are O(1) regardless of how many timers are pending; deadlines
+// beyond one revolution simply stay in their bucket for more rounds.
+// Expiry has tick_ms resolution.
+class TimerWheel {
+ public:
+  struct Timer {
+    Timer() : prev(nullptr), next(nullptr), deadline_ms(0), wheel(nullptr) {}
+    ~Timer();
+
+    bool scheduled() const { return wheel != nullptr; }
+
+    Timer* prev;
+    Timer* next;
+    int64_t deadline_ms;
+    TimerWheel* wheel;
+  };
+
+  TimerWheel(int tick_ms, size_t slots, int64_t now_ms);
+  ~TimerWheel();
+
+  int tick_ms() const { return tick_ms_; }
+  size_t size() const { return size_; }
+
+  // (Re)schedules |timer| to expire at |deadline_ms|. A deadline in the past
+  // expires on the next Advance().
+  void Schedule(Timer* timer, int64_t deadline_ms);
+  static void Cancel(Timer* timer);
+
+  // Unlinks every timer due at |now_ms| and appends it to |expired|, which
+  // the caller handles after the wheel is consistent again. Timers in
+  // |expired| must stay alive until the caller is done with them.
+  void Advance(int64_t now_ms, std::vector<Timer*>* expired);
+
+ private:
+  static void Unlink(Timer* timer);
+
+  int tick_ms_;
+  std::vector<Timer> slots_;  //每个槽是一个循环链表的哨兵
+  int64_t current_tick_;
+  size_t size_;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "examples/voip/trace_replayer.h"
+
+#include <algorithm>
+
+#include "examples/voip/message.h"
+#include "examples/voip/signaling_payload.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+TraceReplayer::TraceReplayer(PeerConnectionClientObserver* observer)
+    : observer_(observer),
+      dial_peer_id_(0),
+      next_(0),
+      speed_(1),
+      start_us_(0),
+      base_us_(0),
+      running_(false) {
+}
+
+TraceReplayer::~TraceReplayer() {
+  Stop();
+}
+
+bool TraceReplayer::Open(const std::string& path) {
+  SignalingTraceReader reader;
+  if (!reader.Open(path)) {
+    return false;
+  }
+  records_.clear();
+  dial_peer_id_ = 0;
+  dial_channel_id_.clear();
+  SignalingTraceReader::Record record;
+  while (reader.Next(&record)) {
+    //只回放收到的消息, 发送的消息中只需要第一个dial
+    if (record.direction == TRACE_RECEIVED) {
+      records_.push_back(std::move(record));
+    } else if (dial_peer_id_ == 0) {
+      FindDial(record);
+    }
+  }
+  next_ = 0;
+  RTC_LOG(INFO) << "trace " << path << " frames:" << records_.size()
+                << " dial peer:" << dial_peer_id_
+                << " channel:" << dial_channel_id_;
+  return true;
+}
+
+void TraceReplayer::FindDial(const SignalingTraceReader::Record& record) {
+  MessageView m;
+  int n = DecodeMessage(record.frame.data(), (int)record.frame.size(), &m);
+  if (n <= 0 || m.cmd != MSG_RT) {
+    return;
+  }
+  RTPayload payload;
+  if (!DecodeRTPayload(m.version, m.content, &payload) ||
+      payload.kind != RTPayload::VOIP) {
+    return;
+  }
+  if (payload.voip.command == VOIP_COMMAND_DIAL ||
+      payload.voip.command == VOIP_COMMAND_DIAL_VIDEO) {
+    dial_peer_id_ = m.receiver;
+    dial_channel_id_ = payload.voip.channel_id;
+  }
+}
+
+void TraceReplayer::Start(double speed) {
+  speed_ = std::max(0.0, speed);
+  next_ = 0;
+  stats_ = Stats();
+  start_us_ = rtc::TimeMicros();
+  base_us_ = records_.empty() ? 0 : records_[0].time_us;
+  reliable_.Reset();
+  running_ = true;
+  DeliverDue();
+}
+
+void TraceReplayer::Stop() {
+  running_ = false;
+  rtc::Thread::Current()->Clear(this);
+}
+
+void TraceReplayer::OnMessage(rtc::Message* msg) {
+  if (running_) {
+    DeliverDue();
+  }
+}
+
+void TraceReplayer::DeliverDue() {
+  if (running_ && !done()) {
+    const SignalingTraceReader::Record& record = records_[next_];
+    int64_t offset = record.time_us - base_us_;
+    int64_t due = start_us_ + (speed_ > 0 ? (int64_t)(offset / speed_) : 0);
+    int64_t now = rtc::TimeMicros();
+    if (due > now) {
+      //PostDelayed只有毫秒精度, 向上取整
+      int delay = (int)((due - now + 999) / 1000);
+      rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this);
+      return;
+    }
+
+    stats_.max_lag_us = std::max(stats_.max_lag_us, now - due);
+    stats_.trace_us = offset;
+    next_++;
+    Deliver(record);
+    //每次只投递一条, observer为这条消息投递的任务先执行
+    if (running_ && !done()) {
+      rtc::Thread::Current()->Post(RTC_FROM_HERE, this);
+      return;
+    }
+  }
+
+  if (running_ && done()) {
+    running_ = false;
+    stats_.elapsed_us = rtc::TimeMicros() - start_us_;
+    RTC_LOG(INFO) << "replay done, frames:" << stats_.delivered
+                  << " skipped:" << stats_.skipped
+                  << " duplicates:" << stats_.duplicates
+                  << " trace:" << stats_.trace_us / 1000 << "ms"
+                  << " elapsed:" << stats_.elapsed_us / 1000 << "ms"
+                  << " handler:" << stats_.handler_us / 1000 << "ms"
+                  << " max handler:" << stats_.max_handler_us << "us"
+                  << " max lag:" << stats_.max_lag_us << "us";
+    SignalDone(this);
+  }
+}
+
+void TraceReplayer::Deliver(const SignalingTraceReader::Record& record) {
+  MessageView m;
+  int n = DecodeMessage(record.frame.data(), (int)record.frame.size(), &m);
+  if (n <= 0) {
+    stats_.skipped++;
+    return;
+  }
+
+  int64_t start = rtc::TimeMicros();
+  if (m.cmd == MSG_AUTH_STATUS) {
+    observer_->OnSignedIn();
+  } else if (m.cmd == MSG_RT) {
+    //与PeerConnectionClient::HandleRT()一样丢弃重传的消息
+    if (!reliable_.OnReceive(m.sender, m.rt_seq)) {
+      stats_.duplicates++;
+      return;
+    }
+    observer_->HandleRTMessage(m.sender, m.receiver, m.version, m.content);
+  } else if (m.cmd == MSG_IM) {
+    observer_->HandleIMMessage(m.sender, m.receiver, m.msgid, m.content);
+  } else {
+    stats_.skipped++;
+    return;
+  }
+  int64_t elapsed = rtc::TimeMicros() - start;
+  stats_.delivered++;
+  stats_.handler_us += elapsed;
+  stats_.max_handler_us = std::max(stats_.max_handler_us, elapsed);
+}
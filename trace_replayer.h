@@ -0,0 +1,91 @@
+#ifndef TRACE_REPLAYER_H
+#define TRACE_REPLAYER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "examples/voip/peer_connection_client.h"
+#include "examples/voip/reliable_channel.h"
+#include "examples/voip/signaling_trace.h"
+#include "rtc_base/third_party/sigslot/sigslot.h"
+#include "rtc_base/thread.h"
+
+// Feeds the frames a client received, from a trace recorded with
+// PeerConnectionClient::StartTrace(), to an observer such as VOIPWnd on the
+// current thread: MSG_AUTH_STATUS to OnSignedIn(), MSG_RT to
+// HandleRTMessage() (and from there Conductor::OnMessageFromPeer()) and
+// MSG_IM to HandleIMMessage(). The recorded gaps between frames are divided
+// by the speed, and speed 0 delivers them back to back. Each frame is
+// delivered in its own message loop iteration, so that work the observer
+// posts for a frame, e.g. creating the Conductor on ACCEPT, runs before the
+// next frame as it would live. The trace is loaded up front, so the replay
+// does no file I/O and is the same every run.
+//
+// Retransmitted MSG_RT frames that share an rt_seq are dropped like
+// PeerConnectionClient drops them live, through ReliableChannel's replay
+// window, so the observer sees each offer or candidate once.
+//
+// Sent frames are not replayed, the code under test sends its own. The
+// first sent DIAL tells whom the recorded client called on which channel;
+// the observer has to be put into that call with dial_peer_id() and
+// dial_channel_id() before Start(), or it drops the peer's replies.
+class TraceReplayer : public rtc::MessageHandler {
+ public:
+  struct Stats {
+    int64_t delivered = 0;
+    // Received frames the observer has no callback for, e.g. pongs.
+    int64_t skipped = 0;
+    // Retransmitted MSG_RT frames the live client would have dropped.
+    int64_t duplicates = 0;
+    // Time spent in the observer, total and worst frame.
+    int64_t handler_us = 0;
+    int64_t max_handler_us = 0;
+    // Worst delay of a frame behind its scheduled time.
+    int64_t max_lag_us = 0;
+    // Recorded span of the delivered frames and the wall time the replay
+    // took.
+    int64_t trace_us = 0;
+    int64_t elapsed_us = 0;
+  };
+
+  explicit TraceReplayer(PeerConnectionClientObserver* observer);
+  ~TraceReplayer();
+
+  bool Open(const std::string& path);
+  void Start(double speed);
+  void Stop();
+  bool done() const { return next_ >= records_.size(); }
+  // Callee and channel of the first DIAL the recorded client sent; 0 if it
+  // sent none.
+  int64_t dial_peer_id() const { return dial_peer_id_; }
+  const std::string& dial_channel_id() const { return dial_channel_id_; }
+  const Stats& stats() const { return stats_; }
+
+  sigslot::signal1<TraceReplayer*> SignalDone;
+
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
+ private:
+  void DeliverDue();
+  void Deliver(const SignalingTraceReader::Record& record);
+  void FindDial(const SignalingTraceReader::Record& record);
+
+  PeerConnectionClientObserver* observer_;
+  std::vector<SignalingTraceReader::Record> records_;
+  int64_t dial_peer_id_;
+  std::string dial_channel_id_;
+  size_t next_;
+  double speed_;
+  int64_t start_us_;
+  //第一条被回放的记录的时间
+  int64_t base_us_;
+  bool running_;
+  //只用于接收端去重
+  ReliableChannel reliable_;
+  Stats stats_;
+};
+
+#endif
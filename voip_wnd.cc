@@ -23,16 +23,22 @@
 
 
 namespace {
-    const int kDialDelay = 1000;
+    //对方一直没有接听, 挂断
+    const int kDialTimeout = 60*1000;
     const int kPingDelay = 1000;
+    //合并50ms内收集到的本地candidate
+    const int kCandidateBatchWindow = 50;
 }
 
 //voipwnd
-VOIPWnd::VOIPWnd(PeerConnectionClient *client, rtc::Thread* main_thread,
-                 int64_t uid, std::string& token)
-    :state_(0), client_(client),
+VOIPWnd::VOIPWnd(SignalingTransport* client, MediaEngine* engine,
+                 rtc::Thread* main_thread, int64_t uid, std::string& token)
+    :state_(0), peer_caps_(0), conductor_(NULL), client_(client),
+     engine_(engine),
      uid_(uid), token_(token),
-     main_thread_(main_thread) {
+     main_thread_(main_thread),
+     pool_(engine, main_thread) {
+    pool_.set_configuration(CreateRTCConfiguration(uid, token));
     RTC_LOG(INFO) << "register observer...";
     client_->RegisterObserver(this);
 }
@@ -44,10 +50,9 @@ VOIPWnd::~VOIPWnd() {
 void VOIPWnd::OnMessage(rtc::Message* msg) {
     if (msg->message_id == 1) {
         if (state_ == VOIP_DIALING) {
-            RTC_LOG(INFO) << "dial...";            
-            SendVOIPCommand(peer_id_, VOIP_COMMAND_DIAL_VIDEO, channel_id_);
-            rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kDialDelay,
-                                                this, 1);
+            RTC_LOG(INFO) << "peer:" << peer_id_ << " no answer, hang up";
+            SendVOIPCommand(peer_id_, VOIP_COMMAND_HANG_UP, channel_id_);
+            state_ = VOIP_HANGED_UP;
         }
     } else if (msg->message_id == 2) {
         if (state_ == VOIP_CONNECTED) {
@@ -73,17 +78,24 @@ void VOIPWnd::OnMessage(rtc::Message* msg) {
 void VOIPWnd::OnPeerConnected() {
     //on peer connected
     timestamp_ = rtc::Time32();
-    conductor_ = new rtc::RefCountedObject<Conductor>(client_,
+    conductor_ = new rtc::RefCountedObject<Conductor>(client_, engine_,
                                                       main_thread_, uid_, token_);
     conductor_->AddRef();
 
     conductor_->SetLocalRenderer(localRender());
     conductor_->SetRemoteRenderer(remoteRender());
+    conductor_->set_peer_caps(peer_caps_);
+    conductor_->set_candidate_batch_window(kCandidateBatchWindow);
+    conductor_->set_peer_connection_pool(&pool_);
     
     conductor_->ConnectToPeer(peer_id_);
 }
 
 void VOIPWnd::OnPeerDisconnected() {
+    const Conductor::CandidateStats& stats = conductor_->candidate_stats();
+    RTC_LOG(INFO) << "candidates sent:" << stats.candidates
+                  << " messages:" << stats.messages
+                  << " setup:" << conductor_->setup_us() << "us";
     conductor_->OnPeerDisconnected(peer_id_);
     conductor_->Release();
     conductor_  = NULL;
@@ -91,15 +103,23 @@ void VOIPWnd::OnPeerDisconnected() {
     RTC_LOG(INFO) << "peer:" << peer_id_ << " disconnected";    
 }
 
-void VOIPWnd::HandleVOIPMessage(int64_t sender, int64_t receiver, Json::Value& obj) {
-    int64_t cmd = obj["command"].asInt();
-    std::string channel_id = obj["channel_id"].asString();
-    RTC_LOG(INFO) << "voip:" << cmd << " channel:" << channel_id;
+void VOIPWnd::HandleVOIPMessage(int64_t sender, int64_t receiver,
+                                const VOIPCommand& command) {
+    int cmd = command.command;
+    const std::string& channel_id = command.channel_id;
+    RTC_LOG(INFO) << "voip:" << cmd << " channel:" << channel_id
+                  << " caps:" << command.caps;
 
 
     if (sender != peer_id_) {
         return;
     }
+    if (command.caps != peer_caps_) {
+        peer_caps_ = command.caps;
+        if (conductor_) {
+            conductor_->set_peer_caps(peer_caps_);
+        }
+    }
     if (cmd == VOIP_COMMAND_ACCEPT) {
         SendVOIPCommand(peer_id_, VOIP_COMMAND_CONNECTED, channel_id_);
         if (state_ == VOIP_CONNECTED) {
@@ -125,35 +145,56 @@ void VOIPWnd::HandleVOIPMessage(int64_t sender, int64_t receiver, Json::Value& o
     return;        
 }
 
-void VOIPWnd::HandleP2PMessage(int64_t sender, int64_t receiver, Json::Value& obj) {
+void VOIPWnd::HandleP2PMessage(int64_t sender, int64_t receiver,
+                               const P2PSignal& signal) {
     if (state_ == VOIP_CONNECTED) {
-        conductor_->OnMessageFromPeer(sender, rtc::JsonValueToString(obj));
+        conductor_->OnMessageFromPeer(sender, signal);
     }
 }    
 
-void VOIPWnd::HandleRTMessage(int64_t sender, int64_t receiver, std::string& content) {
-    Json::Reader reader;
-    Json::Value value;
-
-    if (reader.parse(content, value)) {
-        Json::Value obj;
-        bool r;
-        r = rtc::GetValueFromJsonObject(value, "voip", &obj);
-        if (r) {
-            HandleVOIPMessage(sender, receiver, obj);
-        }
+void VOIPWnd::HandleRTMessage(int64_t sender, int64_t receiver, int version,
+                              absl::string_view content) {
+    RTPayload payload;
+    if (!DecodeRTPayload(version, content, &payload)) {
+        RTC_LOG(WARNING) << "invalid rt message, version:" << version
+                         << " size:" << content.size();
+        return;
+    }
+    HandleRTPayload(sender, receiver, payload);
+}
 
-        r = rtc::GetValueFromJsonObject(value, "p2p", &obj);
-        if (r) {
-            RTC_LOG(INFO) << "p2p message:" << content;
-            HandleP2PMessage(sender, receiver, obj);
-        }
+void VOIPWnd::HandleRTPayload(int64_t sender, int64_t receiver,
+                              const RTPayload& payload) {
+    if (payload.kind == RTPayload::VOIP) {
+        HandleVOIPMessage(sender, receiver, payload.voip);
+    } else if (payload.kind == RTPayload::P2P) {
+        RTC_LOG(INFO) << "p2p message:" << payload.p2p.type;
+        HandleP2PMessage(sender, receiver, payload.p2p);
     }
 }
 
 
+void VOIPWnd::OnRTMessageGaveUp(int64_t peer_id, int version,
+                                absl::string_view content) {
+    if (state_ != VOIP_DIALING || peer_id != peer_id_) {
+        return;
+    }
+    RTPayload payload;
+    if (!DecodeRTPayload(version, content, &payload) ||
+        payload.kind != RTPayload::VOIP ||
+        payload.voip.command != VOIP_COMMAND_DIAL_VIDEO ||
+        payload.voip.channel_id != channel_id_) {
+        return;
+    }
+    //dial的重传全部丢失, 对方可能还没有上线, 重新拨号
+    RTC_LOG(INFO) << "dial gave up, dial again...";
+    SendVOIPCommand(peer_id_, VOIP_COMMAND_DIAL_VIDEO, channel_id_);
+}
+
 void VOIPWnd::OnSignedIn() {
     RTC_LOG(INFO) << "signed in";
+    //TURN使用登录的token, 登录后开始预热
+    pool_.Start();
 }
 
 void VOIPWnd::OnServerConnectionFailure() {
@@ -168,15 +209,13 @@ void VOIPWnd::OnDisconnected() {
 
 void VOIPWnd::SendVOIPCommand(int64_t peer_id, int voip_cmd,
                               const std::string& channel_id) {
-    Json::Value value;
-    value["command"] = voip_cmd;
-    value["channel_id"] = channel_id;
- 
-    Json::Value json;
-    json["voip"] = value;
-    std::string s = rtc::JsonValueToString(json);
-    //todo fix json bug
-    client_->SendRTMessage(peer_id, s);
+    RTPayload payload;
+    payload.kind = RTPayload::VOIP;
+    payload.voip.command = voip_cmd;
+    payload.voip.channel_id = channel_id;
+    payload.voip.caps = PAYLOAD_CAPS;
+    //根据对方声明的能力选择消息体的编码
+    client_->SendRTPayload(peer_id, payload, peer_caps_);
 }
 
 
@@ -200,12 +239,25 @@ void VOIPWnd::Dial() {
     std::string channel_id(std::to_string(now));
     //todo input by user
     int64_t peer_id = 1;
+    peer_caps_ = 0;
+    //丢失的dial由PeerConnectionClient按rtt重传, 直到对端确认;
+    //重传放弃时OnRTMessageGaveUp()重新拨号, 超时仍未接听则挂断
     SendVOIPCommand(peer_id, VOIP_COMMAND_DIAL_VIDEO, channel_id);
-
-    rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kDialDelay,
+    rtc::Thread::Current()->Clear(this, 1);
+    rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kDialTimeout,
                                         this, 1);
 
     channel_id_ = channel_id;
     peer_id_ = peer_id;
     state_ = VOIP_DIALING;    
 }
+
+void VOIPWnd::ReplayDial(int64_t peer_id, const std::string& channel_id) {
+    RTC_LOG(INFO) << "replay dial peer:" << peer_id
+                  << " channel:" << channel_id;
+    //trace中对方的回复会到达, 不需要重发dial
+    peer_caps_ = 0;
+    channel_id_ = channel_id;
+    peer_id_ = peer_id;
+    state_ = VOIP_DIALING;
+}
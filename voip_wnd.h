@@ -18,31 +18,42 @@
 
 #include "api/media_stream_interface.h"
 #include "api/video/video_frame.h"
-#include "rtc_base/strings/json.h"
 #include "media/base/media_channel.h"
 #include "media/base/video_common.h"
-#include "examples/voip/peer_connection_client.h"
 #include "examples/voip/conductor.h"
+#include "examples/voip/peer_connection_pool.h"
+#include "examples/voip/signaling_payload.h"
+#include "examples/voip/signaling_transport.h"
 
 
 class VOIPWnd : public rtc::MessageHandler,
     public PeerConnectionClientObserver {
  public:
 
-    VOIPWnd(PeerConnectionClient* client,
+    VOIPWnd(SignalingTransport* client,
+            MediaEngine* engine,
             rtc::Thread* main_thread,
             int64_t uid, std::string& token);
 
     virtual ~VOIPWnd();
 
     void Dial();
+    //回放trace时进入录制的客户端拨出的通话, 不发送dial
+    void ReplayDial(int64_t peer_id, const std::string& channel_id);
     //PeerConnectionObserver implement
     virtual void OnSignedIn();  
     virtual void OnDisconnected();
     virtual void OnServerConnectionFailure();
     virtual void HandleRTMessage(int64_t sender,
                                  int64_t receiver,
-                                 std::string& content);
+                                 int version,
+                                 absl::string_view content);
+    virtual void HandleRTPayload(int64_t sender,
+                                 int64_t receiver,
+                                 const RTPayload& payload);
+    virtual void OnRTMessageGaveUp(int64_t peer_id,
+                                   int version,
+                                   absl::string_view content);
  protected:
 
     virtual rtc::VideoSinkInterface<webrtc::VideoFrame> *localRender() = 0;
@@ -57,8 +68,10 @@ class VOIPWnd : public rtc::MessageHandler,
                          const std::string& channel_id);
     void OnMessage(rtc::Message* msg);
 
-    void HandleVOIPMessage(int64_t sender, int64_t receiver, Json::Value& obj);
-    void HandleP2PMessage(int64_t sender, int64_t receiver, Json::Value& obj);
+    void HandleVOIPMessage(int64_t sender, int64_t receiver,
+                           const VOIPCommand& command);
+    void HandleP2PMessage(int64_t sender, int64_t receiver,
+                          const P2PSignal& signal);
 
 
 
@@ -88,13 +101,18 @@ class VOIPWnd : public rtc::MessageHandler,
 
     std::string channel_id_;
     int64_t peer_id_;
+    //对方在voip命令中声明的能力, PAYLOAD_CAP_*
+    int peer_caps_;
 
     rtc::RefCountedObject<Conductor> *conductor_;
-    PeerConnectionClient *client_;
+    SignalingTransport* client_;
+    MediaEngine* engine_;
     int64_t uid_;
     std::string token_;
     rtc::Thread *main_thread_;
     uint32_t timestamp_; //last received ping timestamp, unit:ms
+    //登录后预先创建PeerConnection, 拨号和接听时直接使用
+    PeerConnectionPool pool_;
 };
 
 #endif